@@ -25,6 +25,7 @@ limitations under the License. */
 #include "config.h"
 #include "error.h"
 #include "gradient_machine.h"
+#include "inference_server.h"
 #include "main.h"
 #include "matrix.h"
 #include "vector.h"
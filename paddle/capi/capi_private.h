@@ -22,7 +22,14 @@ limitations under the License. */
 namespace paddle {
 namespace capi {
 
-enum CType { kIVECTOR = 0, kMATRIX, kARGUMENTS, kGRADIENT_MACHINE };
+enum CType {
+  kIVECTOR = 0,
+  kMATRIX,
+  kARGUMENTS,
+  kGRADIENT_MACHINE,
+  kINFERENCE_SERVER,
+  kINFERENCE_SESSION
+};
 
 #define STRUCT_HEADER CType type;
 
@@ -15,6 +15,8 @@ limitations under the License. */
 #include "gradient_machine.h"
 #include "capi_private.h"
 #include "paddle/gserver/gradientmachines/NeuralNetwork.h"
+#include "paddle/parameter/PackedModel.h"
+#include "paddle/utils/Flags.h"
 
 #define cast(v) paddle::capi::cast<paddle::capi::CGradientMachine>(v)
 
@@ -54,6 +56,64 @@ paddle_error paddle_gradient_machine_create_for_inference(
   return kPD_NO_ERROR;
 }
 
+paddle_error paddle_gradient_machine_create_from_packed_model(
+    paddle_gradient_machine* machine, const char* path) {
+  if (machine == nullptr || path == nullptr) return kPD_NULLPTR;
+  auto model = paddle::PackedModel::open(path);
+  if (model == nullptr) return kPD_IO_ERROR;
+  paddle::ModelConfig config;
+  if (!config.ParseFromArray(model->getConfig(),
+                             (int)model->getConfigSize()) ||
+      !config.IsInitialized() ||
+      (size_t)config.parameters_size() != model->getNumParameters()) {
+    return kPD_PROTOBUF_ERROR;
+  }
+  for (auto& para : config.parameters()) {
+    if (para.is_sparse()) return kPD_NOT_SUPPORTED;
+  }
+
+  std::unique_ptr<paddle::capi::CGradientMachine> ptr(
+      new paddle::capi::CGradientMachine());
+  auto nn = paddle::NeuralNetwork::create(config);
+  nn->init(config,
+           [&model](int paramId, paddle::Parameter* param) {
+             auto value = model->getValue(paramId);
+             CHECK_EQ(value->getSize(), param->getSize())
+                 << "Size mismatch of parameter " << param->getName();
+             if (param->useGpu()) {
+               param->enableType(paddle::PARAMETER_VALUE);
+               param->getBuf(paddle::PARAMETER_VALUE)->copyFrom(*value);
+             } else {
+               param->enableSharedType(paddle::PARAMETER_VALUE, value);
+             }
+           },
+           {paddle::PARAMETER_VALUE},
+           FLAGS_use_gpu);
+  ptr->machine.reset(nn);
+  *machine = ptr.release();
+  return kPD_NO_ERROR;
+}
+
+paddle_error paddle_gradient_machine_save_packed_model(
+    paddle_gradient_machine machine,
+    void* modelConfigProtobuf,
+    int size,
+    const char* path) {
+  auto m = cast(machine);
+  if (m == nullptr || modelConfigProtobuf == nullptr || path == nullptr ||
+      m->machine == nullptr)
+    return kPD_NULLPTR;
+  auto& parameters = m->machine->getParameters();
+  for (auto& para : parameters) {
+    if (para->isSparse()) return kPD_NOT_SUPPORTED;
+  }
+  std::string config(reinterpret_cast<char*>(modelConfigProtobuf), size);
+  if (!paddle::PackedModel::save(path, config, parameters)) {
+    return kPD_IO_ERROR;
+  }
+  return kPD_NO_ERROR;
+}
+
 paddle_error paddle_gradient_machine_destroy(paddle_gradient_machine machine) {
   delete cast(machine);
   return kPD_NO_ERROR;
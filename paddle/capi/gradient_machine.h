@@ -36,6 +36,38 @@ typedef void* paddle_gradient_machine;
 PD_API paddle_error paddle_gradient_machine_create_for_inference(
     paddle_gradient_machine* machine, void* modelConfigProtobuf, int size);
 
+/**
+ * @brief Create a gradient machine used for model inference from a packed
+ *        model file, which holds the model config and all the parameters.
+ *
+ * The file is memory mapped copy-on-write, and the parameters of the machine
+ * point into the mapping when running on CPU. So the processes on one host
+ * share one copy of the parameters, and the parameters are read from disk
+ * only when they are used. Modifying the parameters, such as by
+ * paddle_gradient_machine_randomize_param, copies the modified pages, and
+ * does not change the file.
+ * @param [out] machine that used for model inference.
+ * @param [in] path of the packed model file.
+ * @return paddle_error
+ */
+PD_API paddle_error paddle_gradient_machine_create_from_packed_model(
+    paddle_gradient_machine* machine, const char* path);
+
+/**
+ * @brief Save the model config and the parameters of a gradient machine into
+ *        a packed model file.
+ * @param machine Gradient Machine.
+ * @param [in] modelConfigProtobuf model config protobuf of the machine.
+ * @param [in] size of model config buffer.
+ * @param [in] path of the packed model file.
+ * @return paddle_error
+ */
+PD_API paddle_error
+paddle_gradient_machine_save_packed_model(paddle_gradient_machine machine,
+                                          void* modelConfigProtobuf,
+                                          int size,
+                                          const char* path);
+
 /**
  * @brief Load parameter from disk.
  * @param machine Gradient Machine.
@@ -0,0 +1,496 @@
+/* Copyright (c) 2016 PaddlePaddle Authors. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "inference_server.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include "capi_private.h"
+#include "paddle/utils/Locks.h"
+#include "paddle/utils/Stat.h"
+
+namespace paddle {
+namespace capi {
+
+/**
+ * @brief Dynamic batching of the inference requests.
+ *
+ * forward() puts a request into the queue and waits. Each worker thread owns
+ * a gradient machine, it takes the requests from the front of the queue while
+ * they fit into maxBatchSize samples, concatenates every input slot of them
+ * into one Argument (the sequence start positions are merged by
+ * Argument::concat), runs the machine once, and copies the rows of each
+ * request out of the batch output.
+ *
+ * A stateful server carries the states of the recurrent layers of each
+ * session from one forward to the next. Every sequence of a batch has one
+ * row in the states of the recurrent layers: the row of its session, or zero
+ * for the requests without session. The rows are set into the machine before
+ * the forward, and copied back to the sessions after it.
+ */
+class InferenceServer {
+public:
+  InferenceServer(std::vector<GradientMachinePtr>&& machines,
+                  size_t maxBatchSize,
+                  uint64_t maxLatencyUs,
+                  bool stateful)
+      : machines_(std::move(machines)),
+        maxBatchSize_(std::max(maxBatchSize, (size_t)1)),
+        maxLatencyUs_(maxLatencyUs),
+        stateful_(stateful),
+        queuedSamples_(0),
+        stopping_(false) {
+    if (stateful_) {
+      MachineState state;
+      for (auto& machine : machines_) {
+        machine->resetState();
+        machine->getState(state);
+      }
+      // the width of each state matrix of each layer
+      stateWidths_.resize(state.size());
+      for (size_t i = 0; i < state.size(); ++i) {
+        if (state[i] == nullptr) continue;
+        for (auto& value : state[i]->value) {
+          stateWidths_[i].push_back(value->getWidth());
+        }
+      }
+    }
+    for (auto& machine : machines_) {
+      GradientMachine* m = machine.get();
+      threads_.emplace_back([this, m]() { run(m); });
+    }
+  }
+
+  ~InferenceServer() {
+    {
+      std::lock_guard<std::mutex> guard(lock_);
+      stopping_ = true;
+    }
+    cond_.notify_all();
+    for (auto& thread : threads_) {
+      thread.join();
+    }
+  }
+
+  bool isStateful() const { return stateful_; }
+
+  /**
+   * Forward a request. If state is not nullptr, the request is one sequence
+   * of a session, which starts from *state and updates it. The same state
+   * must not be forwarded by two threads at the same time.
+   */
+  void forward(const std::vector<Argument>& inArgs,
+               std::vector<Argument>* outArgs,
+               MachineState* state = nullptr) {
+    CHECK(state == nullptr || stateful_);
+    Request request;
+    request.inArgs = &inArgs;
+    request.outArgs = outArgs;
+    request.state = state;
+    request.numSamples = inArgs[0].getNumSequences();
+    request.deadline = nowInMicroSec() + maxLatencyUs_;
+    {
+      std::lock_guard<std::mutex> guard(lock_);
+      queue_.push_back(&request);
+      queuedSamples_ += request.numSamples;
+    }
+    cond_.notify_all();
+    request.done.wait();
+  }
+
+private:
+  struct Request {
+    const std::vector<Argument>* inArgs;
+    std::vector<Argument>* outArgs;
+    MachineState* state;
+    size_t numSamples;
+    uint64_t deadline;
+    Semaphore done;
+  };
+
+  // The requests of one batch must have the same kind of inputs.
+  static bool canBatch(const std::vector<Argument>& a,
+                       const std::vector<Argument>& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+      if (!a[i].value != !b[i].value || !a[i].ids != !b[i].ids ||
+          !a[i].strs != !b[i].strs || a[i].hasSeq() != b[i].hasSeq() ||
+          a[i].hasSubseq() != b[i].hasSubseq() ||
+          a[i].dataId != b[i].dataId) {
+        return false;
+      }
+      if (a[i].value && a[i].value->getWidth() != b[i].value->getWidth()) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * Wait until the queue has maxBatchSize samples or the front request
+   * reaches its deadline, then take the requests of the next batch.
+   * Return false if the server is stopped and the queue is empty.
+   */
+  bool takeBatch(std::vector<Request*>* batch) {
+    std::unique_lock<std::mutex> lock(lock_);
+    while (true) {
+      if (queue_.empty()) {
+        if (stopping_) return false;
+        cond_.wait(lock);
+        continue;
+      }
+      if (stopping_ || queuedSamples_ >= maxBatchSize_) break;
+      uint64_t now = nowInMicroSec();
+      uint64_t deadline = queue_.front()->deadline;
+      if (now >= deadline) break;
+      cond_.wait_for(lock, std::chrono::microseconds(deadline - now));
+    }
+
+    size_t numSamples = 0;
+    batch->clear();
+    while (!queue_.empty()) {
+      Request* request = queue_.front();
+      // The front request is always taken, even if it is larger than
+      // maxBatchSize by itself.
+      if (!batch->empty() &&
+          (numSamples + request->numSamples > maxBatchSize_ ||
+           !canBatch(*(*batch)[0]->inArgs, *request->inArgs))) {
+        break;
+      }
+      numSamples += request->numSamples;
+      queuedSamples_ -= request->numSamples;
+      batch->push_back(request);
+      queue_.pop_front();
+    }
+    if (!queue_.empty()) {
+      // Wake up another worker for the remaining requests.
+      lock.unlock();
+      cond_.notify_all();
+    }
+    return true;
+  }
+
+  void run(GradientMachine* machine) {
+    std::vector<Request*> batch;
+    std::vector<Argument> inArgs;
+    std::vector<Argument> outArgs;
+    std::vector<Argument> parts;
+    MachineState state;
+    while (takeBatch(&batch)) {
+      const std::vector<Argument>* in = batch[0]->inArgs;
+      if (batch.size() > 1) {
+        inArgs.resize(in->size());
+        for (size_t i = 0; i < in->size(); ++i) {
+          parts.clear();
+          for (auto request : batch) {
+            parts.push_back((*request->inArgs)[i]);
+          }
+          inArgs[i].concat(parts);
+        }
+        in = &inArgs;
+      }
+      if (stateful_) {
+        setState(machine, batch, &state);
+      }
+      machine->forward(*in, &outArgs, PASS_TEST);
+      if (stateful_) {
+        getState(machine, batch, &state);
+      }
+      scatter(batch, outArgs);
+      for (auto request : batch) {
+        request->done.post();
+      }
+    }
+  }
+
+  void setState(GradientMachine* machine,
+                const std::vector<Request*>& batch,
+                MachineState* state) {
+    size_t numSequences = 0;
+    for (auto request : batch) {
+      numSequences += request->numSamples;
+    }
+    state->resize(stateWidths_.size());
+    for (size_t i = 0; i < stateWidths_.size(); ++i) {
+      if (stateWidths_[i].empty()) {
+        (*state)[i] = nullptr;
+        continue;
+      }
+      LayerStatePtr layerState = std::make_shared<LayerState>();
+      for (size_t j = 0; j < stateWidths_[i].size(); ++j) {
+        MatrixPtr value = Matrix::create(numSequences, stateWidths_[i][j]);
+        value->zeroMem();
+        size_t row = 0;
+        for (auto request : batch) {
+          if (request->state && !request->state->empty()) {
+            value->subMatrix(row, 1)->copyFrom(
+                *(*request->state)[i]->value[j]);
+          }
+          row += request->numSamples;
+        }
+        layerState->value.push_back(value);
+      }
+      (*state)[i] = layerState;
+    }
+    machine->setState(*state);
+  }
+
+  void getState(GradientMachine* machine,
+                const std::vector<Request*>& batch,
+                MachineState* state) {
+    machine->getState(*state);
+    size_t row = 0;
+    for (auto request : batch) {
+      if (request->state) {
+        MachineState& sessionState = *request->state;
+        sessionState.resize(stateWidths_.size());
+        for (size_t i = 0; i < stateWidths_.size(); ++i) {
+          if (stateWidths_[i].empty()) continue;
+          LayerStatePtr layerState = std::make_shared<LayerState>();
+          for (auto& batchValue : (*state)[i]->value) {
+            MatrixPtr value = Matrix::create(1, batchValue->getWidth());
+            value->copyFrom(*batchValue->subMatrix(row, 1));
+            layerState->value.push_back(value);
+          }
+          sessionState[i] = layerState;
+        }
+      }
+      row += request->numSamples;
+    }
+  }
+
+  /**
+   * Copy the outputs of each request out of the batch output. An output
+   * with sequences, or with one row per sample, is split by samples.
+   * Otherwise it has one row per input row, and is split by rows.
+   */
+  static void scatter(const std::vector<Request*>& batch,
+                      const std::vector<Argument>& outArgs) {
+    int64_t numSamples = 0;
+    int64_t numRows = 0;
+    for (auto request : batch) {
+      numSamples += request->numSamples;
+      numRows += (*request->inArgs)[0].getBatchSize();
+    }
+    for (auto request : batch) {
+      request->outArgs->resize(outArgs.size());
+    }
+    for (size_t i = 0; i < outArgs.size(); ++i) {
+      const Argument& out = outArgs[i];
+      bool bySample = out.hasSeq() || out.getBatchSize() == numSamples;
+      CHECK(bySample || out.getBatchSize() == numRows)
+          << "Cannot split output " << i << " of batch size "
+          << out.getBatchSize() << " into requests";
+      int32_t start = 0;
+      for (auto request : batch) {
+        int32_t size = bySample ? request->numSamples
+                                : (*request->inArgs)[0].getBatchSize();
+        (*request->outArgs)[i].resizeAndCopyFrom(
+            out, start, size, /* useGpu */ false);
+        start += size;
+      }
+    }
+  }
+
+  std::vector<GradientMachinePtr> machines_;
+  std::vector<std::thread> threads_;
+  size_t maxBatchSize_;
+  uint64_t maxLatencyUs_;
+  bool stateful_;
+  std::vector<std::vector<size_t>> stateWidths_;
+
+  std::mutex lock_;
+  std::condition_variable cond_;
+  std::deque<Request*> queue_;
+  size_t queuedSamples_;
+  bool stopping_;
+};
+
+struct CInferenceServer {
+  STRUCT_HEADER
+  std::unique_ptr<InferenceServer> server;
+
+  CInferenceServer() : type(kINFERENCE_SERVER) {}
+};
+
+struct CInferenceSession {
+  STRUCT_HEADER
+  InferenceServer* server;
+  MachineState state;
+
+  CInferenceSession() : type(kINFERENCE_SESSION), server(nullptr) {}
+};
+
+/**
+ * The states of the recurrent layers can be carried across the forwards of
+ * lstmemory, gated_recurrent and recurrent layers running forward in time.
+ * The other layers with state, and the recurrent layer groups, do not keep
+ * one row of state for each sequence.
+ */
+static bool isStateSupported(const ModelConfig& config) {
+  for (auto& subModel : config.sub_models()) {
+    if (subModel.is_recurrent_layer_group()) return false;
+  }
+  for (auto& layer : config.layers()) {
+    if (layer.type() == "lstmemory" || layer.type() == "gated_recurrent" ||
+        layer.type() == "recurrent") {
+      if (layer.reversed()) return false;
+    }
+    for (auto& input : layer.inputs()) {
+      if (input.has_proj_conf() && input.proj_conf().type() == "context") {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static paddle_error createServer(paddle_inference_server* server,
+                                 paddle_gradient_machine origin,
+                                 void* modelConfigProtobuf,
+                                 int size,
+                                 int numThreads,
+                                 uint64_t maxBatchSize,
+                                 uint64_t maxLatencyUs,
+                                 bool stateful) {
+  if (server == nullptr || origin == nullptr) return kPD_NULLPTR;
+  if (numThreads <= 0) return kPD_OUT_OF_RANGE;
+  if (stateful) {
+    if (modelConfigProtobuf == nullptr) return kPD_NULLPTR;
+    ModelConfig config;
+    if (!config.ParseFromArray(modelConfigProtobuf, size)) {
+      return kPD_PROTOBUF_ERROR;
+    }
+    if (!isStateSupported(config)) return kPD_NOT_SUPPORTED;
+  }
+
+  std::vector<GradientMachinePtr> machines;
+  for (int i = 0; i < numThreads; ++i) {
+    paddle_gradient_machine slave;
+    paddle_error err = paddle_gradient_machine_create_shared_param(
+        origin, modelConfigProtobuf, size, &slave);
+    if (err != kPD_NO_ERROR) return err;
+    machines.push_back(cast<CGradientMachine>(slave)->machine);
+    paddle_gradient_machine_destroy(slave);
+  }
+
+  auto ptr = new CInferenceServer();
+  ptr->server.reset(new InferenceServer(
+      std::move(machines), maxBatchSize, maxLatencyUs, stateful));
+  *server = ptr;
+  return kPD_NO_ERROR;
+}
+
+}  // namespace capi
+}  // namespace paddle
+
+#define cast(v) paddle::capi::cast<paddle::capi::CInferenceServer>(v)
+
+extern "C" {
+paddle_error paddle_inference_server_create(paddle_inference_server* server,
+                                            paddle_gradient_machine origin,
+                                            void* modelConfigProtobuf,
+                                            int size,
+                                            int numThreads,
+                                            uint64_t maxBatchSize,
+                                            uint64_t maxLatencyUs) {
+  return paddle::capi::createServer(server,
+                                    origin,
+                                    modelConfigProtobuf,
+                                    size,
+                                    numThreads,
+                                    maxBatchSize,
+                                    maxLatencyUs,
+                                    /* stateful */ false);
+}
+
+paddle_error paddle_inference_server_create_stateful(
+    paddle_inference_server* server,
+    paddle_gradient_machine origin,
+    void* modelConfigProtobuf,
+    int size,
+    int numThreads,
+    uint64_t maxBatchSize,
+    uint64_t maxLatencyUs) {
+  return paddle::capi::createServer(server,
+                                    origin,
+                                    modelConfigProtobuf,
+                                    size,
+                                    numThreads,
+                                    maxBatchSize,
+                                    maxLatencyUs,
+                                    /* stateful */ true);
+}
+
+paddle_error paddle_inference_server_forward(paddle_inference_server server,
+                                             paddle_arguments inArgs,
+                                             paddle_arguments outArgs) {
+  auto s = cast(server);
+  auto in = paddle::capi::cast<paddle::capi::CArguments>(inArgs);
+  auto out = paddle::capi::cast<paddle::capi::CArguments>(outArgs);
+  if (s == nullptr || in == nullptr || out == nullptr || s->server == nullptr)
+    return kPD_NULLPTR;
+  if (in->args.empty()) return kPD_OUT_OF_RANGE;
+  s->server->forward(in->args, &out->args);
+  return kPD_NO_ERROR;
+}
+
+paddle_error paddle_inference_server_destroy(paddle_inference_server server) {
+  delete cast(server);
+  return kPD_NO_ERROR;
+}
+
+paddle_error paddle_inference_session_create(
+    paddle_inference_server server, paddle_inference_session* session) {
+  auto s = cast(server);
+  if (s == nullptr || session == nullptr || s->server == nullptr)
+    return kPD_NULLPTR;
+  if (!s->server->isStateful()) return kPD_NOT_SUPPORTED;
+  auto ptr = new paddle::capi::CInferenceSession();
+  ptr->server = s->server.get();
+  *session = ptr;
+  return kPD_NO_ERROR;
+}
+
+paddle_error paddle_inference_session_forward(paddle_inference_session session,
+                                              paddle_arguments inArgs,
+                                              paddle_arguments outArgs) {
+  auto s = paddle::capi::cast<paddle::capi::CInferenceSession>(session);
+  auto in = paddle::capi::cast<paddle::capi::CArguments>(inArgs);
+  auto out = paddle::capi::cast<paddle::capi::CArguments>(outArgs);
+  if (s == nullptr || in == nullptr || out == nullptr || s->server == nullptr)
+    return kPD_NULLPTR;
+  // The state has one row for the only sequence of the session.
+  if (in->args.empty() || !in->args[0].hasSeq() ||
+      in->args[0].getNumSequences() != 1)
+    return kPD_OUT_OF_RANGE;
+  s->server->forward(in->args, &out->args, &s->state);
+  return kPD_NO_ERROR;
+}
+
+paddle_error paddle_inference_session_reset(paddle_inference_session session) {
+  auto s = paddle::capi::cast<paddle::capi::CInferenceSession>(session);
+  if (s == nullptr) return kPD_NULLPTR;
+  s->state.clear();
+  return kPD_NO_ERROR;
+}
+
+paddle_error paddle_inference_session_destroy(
+    paddle_inference_session session) {
+  delete paddle::capi::cast<paddle::capi::CInferenceSession>(session);
+  return kPD_NO_ERROR;
+}
+}
@@ -0,0 +1,160 @@
+/* Copyright (c) 2016 PaddlePaddle Authors. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#ifndef __PADDLE_CAPI_INFERENCE_SERVER_H__
+#define __PADDLE_CAPI_INFERENCE_SERVER_H__
+#include "arguments.h"
+#include "config.h"
+#include "error.h"
+#include "gradient_machine.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief InferenceServer runs the inference requests of many threads with
+ *        dynamic batching.
+ *
+ * The concurrent requests are queued, and coalesced into one batch until the
+ * batch has maxBatchSize samples or the oldest request has waited
+ * maxLatencyUs microseconds. Each batch is run by one of the worker threads,
+ * and the outputs are split back to the requests.
+ */
+typedef void* paddle_inference_server;
+
+/**
+ * @brief Create an inference server.
+ * @param [out] server the inference server.
+ * @param [in] origin gradient machine that owns the parameters. Every worker
+ *             thread has a gradient machine sharing the parameters of origin,
+ *             so origin must not be destroyed before the server.
+ * @param [in] modelConfigProtobuf model config protobuf
+ * @param [in] size of model config buffer.
+ * @param [in] numThreads number of worker threads.
+ * @param [in] maxBatchSize max number of samples in one batch. The number of
+ *             samples of a request is the number of sequences of its first
+ *             input, or the batch size if the first input is not a sequence.
+ * @param [in] maxLatencyUs max microseconds a request waits for the batch to
+ *             be filled.
+ * @return paddle_error
+ */
+PD_API paddle_error
+paddle_inference_server_create(paddle_inference_server* server,
+                               paddle_gradient_machine origin,
+                               void* modelConfigProtobuf,
+                               int size,
+                               int numThreads,
+                               uint64_t maxBatchSize,
+                               uint64_t maxLatencyUs);
+
+/**
+ * @brief Create an inference server for streaming sessions. It has the same
+ *        parameters as paddle_inference_server_create.
+ *
+ * The server carries the states of the lstmemory, gated_recurrent and
+ * recurrent layers of each session across its forwards, so a stream can be
+ * fed chunk by chunk. The forwards of concurrent sessions are batched
+ * together. The requests without session start from zero states.
+ *
+ * @return kPD_NOT_SUPPORTED if the model has reversed recurrent layers,
+ *         context projections or recurrent layer groups, whose states are
+ *         not kept for each sequence.
+ */
+PD_API paddle_error
+paddle_inference_server_create_stateful(paddle_inference_server* server,
+                                        paddle_gradient_machine origin,
+                                        void* modelConfigProtobuf,
+                                        int size,
+                                        int numThreads,
+                                        uint64_t maxBatchSize,
+                                        uint64_t maxLatencyUs);
+
+/**
+ * @brief Forward a request through the inference server. It blocks until the
+ *        outputs are ready, and can be called from many threads at the same
+ *        time.
+ * @param server inference server
+ * @param inArgs input arguments
+ * @param outArgs output arguments, they are copied from the batch output
+ *        so they stay valid after other requests finish.
+ * @return paddle_error
+ */
+PD_API paddle_error
+paddle_inference_server_forward(paddle_inference_server server,
+                                paddle_arguments inArgs,
+                                paddle_arguments outArgs);
+
+/**
+ * @brief Destroy an inference server. The queued requests are finished before
+ *        the worker threads exit.
+ * @param server that need to destroy
+ * @return paddle_error
+ */
+PD_API paddle_error
+paddle_inference_server_destroy(paddle_inference_server server);
+
+/**
+ * @brief InferenceSession is one stream of a stateful inference server. It
+ *        keeps the states of the recurrent layers after its last forward.
+ */
+typedef void* paddle_inference_session;
+
+/**
+ * @brief Create a session with zero states.
+ * @param server stateful inference server, it must not be destroyed before
+ *        the session.
+ * @param [out] session the inference session.
+ * @return kPD_NOT_SUPPORTED if the server is not stateful.
+ */
+PD_API paddle_error
+paddle_inference_session_create(paddle_inference_server server,
+                                paddle_inference_session* session);
+
+/**
+ * @brief Forward the next chunk of a session, which continues from the
+ *        states of the previous chunk. It blocks until the outputs are ready.
+ *        Different sessions can be forwarded from many threads at the same
+ *        time, but one session must not.
+ * @param session inference session
+ * @param inArgs input arguments, the first one must have exactly one
+ *        sequence.
+ * @param outArgs output arguments
+ * @return paddle_error
+ */
+PD_API paddle_error
+paddle_inference_session_forward(paddle_inference_session session,
+                                 paddle_arguments inArgs,
+                                 paddle_arguments outArgs);
+
+/**
+ * @brief Reset the states of a session to zero, to start a new stream.
+ * @param session inference session
+ * @return paddle_error
+ */
+PD_API paddle_error
+paddle_inference_session_reset(paddle_inference_session session);
+
+/**
+ * @brief Destroy an inference session.
+ * @param session that need to destroy
+ * @return paddle_error
+ */
+PD_API paddle_error
+paddle_inference_session_destroy(paddle_inference_session session);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
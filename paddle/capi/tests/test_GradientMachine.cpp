@@ -17,8 +17,11 @@ limitations under the License. */
 #include <paddle/trainer/TrainerConfigHelper.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <thread>
 #include <type_traits>
 #include "capi.h"
+#include "capi_private.h"
 #include "paddle/utils/ThreadLocal.h"
 
 static std::vector<paddle_real> randomBuffer(size_t bufSize) {
@@ -105,6 +108,263 @@ TEST(GradientMachine, testPredict) {
   ASSERT_EQ(kPD_NO_ERROR, paddle_gradient_machine_destroy(machine));
 }
 
+TEST(GradientMachine, testPackedModel) {
+  paddle::TrainerConfigHelper config("./test_predict_network.py");
+  std::string buffer;
+  ASSERT_TRUE(config.getModelConfig().SerializeToString(&buffer));
+  paddle_gradient_machine machine;
+  ASSERT_EQ(kPD_NO_ERROR,
+            paddle_gradient_machine_create_for_inference(
+                &machine, &buffer[0], (int)buffer.size()));
+  ASSERT_EQ(kPD_NO_ERROR, paddle_gradient_machine_randomize_param(machine));
+  // The packed model is written to a temporary file, not the source tree.
+  const char* dir = getenv("TMPDIR");
+  std::string path = std::string(dir ? dir : "/tmp") + "/model.packed.XXXXXX";
+  int fd = mkstemp(&path[0]);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  ASSERT_EQ(kPD_NO_ERROR,
+            paddle_gradient_machine_save_packed_model(
+                machine, &buffer[0], (int)buffer.size(), path.c_str()));
+
+  paddle_gradient_machine packed;
+  ASSERT_EQ(kPD_IO_ERROR,
+            paddle_gradient_machine_create_from_packed_model(
+                &packed, "./not_exist.packed"));
+  ASSERT_EQ(kPD_NO_ERROR,
+            paddle_gradient_machine_create_from_packed_model(
+                &packed, path.c_str()));
+
+  paddle_arguments inArgs = paddle_arguments_create_none();
+  ASSERT_EQ(kPD_NO_ERROR, paddle_arguments_resize(inArgs, 1));
+  paddle_matrix mat = paddle_matrix_create(2, 100, false);
+  auto data = randomBuffer(200);
+  paddle_real* rowPtr;
+  ASSERT_EQ(kPD_NO_ERROR, paddle_matrix_get_row(mat, 0, &rowPtr));
+  memcpy(rowPtr, data.data(), data.size() * sizeof(paddle_real));
+  ASSERT_EQ(kPD_NO_ERROR, paddle_arguments_set_value(inArgs, 0, mat));
+
+  paddle_arguments outArgs = paddle_arguments_create_none();
+  paddle_arguments packedOutArgs = paddle_arguments_create_none();
+  ASSERT_EQ(kPD_NO_ERROR,
+            paddle_gradient_machine_forward(machine, inArgs, outArgs, false));
+  ASSERT_EQ(kPD_NO_ERROR,
+            paddle_gradient_machine_forward(
+                packed, inArgs, packedOutArgs, false));
+
+  auto out = paddle::capi::cast<paddle::capi::CArguments>(outArgs);
+  auto packedOut = paddle::capi::cast<paddle::capi::CArguments>(packedOutArgs);
+  auto expected = out->args[0].value;
+  auto actual = packedOut->args[0].value;
+  ASSERT_EQ(expected->getElementCnt(), actual->getElementCnt());
+  for (size_t i = 0; i < expected->getElementCnt(); ++i) {
+    ASSERT_EQ(expected->getData()[i], actual->getData()[i]);
+  }
+
+  // The parameters of a packed machine can be written, which changes
+  // neither the file nor the other machines loaded from it.
+  paddle_gradient_machine packed2;
+  ASSERT_EQ(kPD_NO_ERROR,
+            paddle_gradient_machine_create_from_packed_model(&packed2,
+                                                             path.c_str()));
+  ASSERT_EQ(kPD_NO_ERROR, paddle_gradient_machine_randomize_param(packed));
+  ASSERT_EQ(kPD_NO_ERROR,
+            paddle_gradient_machine_forward(
+                packed, inArgs, packedOutArgs, false));
+  ASSERT_EQ(kPD_NO_ERROR, paddle_gradient_machine_destroy(packed));
+  ASSERT_EQ(kPD_NO_ERROR,
+            paddle_gradient_machine_create_from_packed_model(&packed,
+                                                             path.c_str()));
+  for (auto loaded : {packed, packed2}) {
+    ASSERT_EQ(kPD_NO_ERROR,
+              paddle_gradient_machine_forward(
+                  loaded, inArgs, packedOutArgs, false));
+    actual = packedOut->args[0].value;
+    for (size_t i = 0; i < expected->getElementCnt(); ++i) {
+      ASSERT_EQ(expected->getData()[i], actual->getData()[i]);
+    }
+  }
+
+  ASSERT_EQ(kPD_NO_ERROR, paddle_matrix_destroy(mat));
+  ASSERT_EQ(kPD_NO_ERROR, paddle_arguments_destroy(inArgs));
+  ASSERT_EQ(kPD_NO_ERROR, paddle_arguments_destroy(outArgs));
+  ASSERT_EQ(kPD_NO_ERROR, paddle_arguments_destroy(packedOutArgs));
+  ASSERT_EQ(kPD_NO_ERROR, paddle_gradient_machine_destroy(packed2));
+  ASSERT_EQ(kPD_NO_ERROR, paddle_gradient_machine_destroy(packed));
+  ASSERT_EQ(kPD_NO_ERROR, paddle_gradient_machine_destroy(machine));
+  unlink(path.c_str());
+}
+
+TEST(InferenceServer, testBatchedPredict) {
+  paddle::TrainerConfigHelper config("./test_predict_network.py");
+  std::string buffer;
+  ASSERT_TRUE(config.getModelConfig().SerializeToString(&buffer));
+  paddle_gradient_machine machine;
+  ASSERT_EQ(kPD_NO_ERROR,
+            paddle_gradient_machine_create_for_inference(
+                &machine, &buffer[0], (int)buffer.size()));
+  ASSERT_EQ(kPD_NO_ERROR, paddle_gradient_machine_randomize_param(machine));
+
+  paddle_inference_server server;
+  ASSERT_EQ(kPD_NO_ERROR,
+            paddle_inference_server_create(&server,
+                                           machine,
+                                           &buffer[0],
+                                           (int)buffer.size(),
+                                           /* numThreads */ 2,
+                                           /* maxBatchSize */ 8,
+                                           /* maxLatencyUs */ 1000));
+
+  // Each thread sends requests of a different batch size, and checks the
+  // outputs against the forward of the machine without batching.
+  const size_t numThreads = 8;
+  const size_t numIters = 10;
+  std::vector<std::thread> threads;
+  std::vector<std::vector<paddle_real>> inputs(numThreads);
+  std::vector<std::vector<paddle_real>> outputs(numThreads);
+  for (size_t t = 0; t < numThreads; ++t) {
+    threads.emplace_back([&, t]() {
+      uint64_t batchSize = t % 3 + 1;
+      paddle_arguments inArgs = paddle_arguments_create_none();
+      paddle_arguments outArgs = paddle_arguments_create_none();
+      paddle_matrix mat = paddle_matrix_create(batchSize, 100, false);
+      paddle_matrix prob = paddle_matrix_create_none();
+      paddle_arguments_resize(inArgs, 1);
+      for (size_t iter = 0; iter < numIters; ++iter) {
+        inputs[t] = randomBuffer(batchSize * 100);
+        paddle_real* rowPtr;
+        paddle_matrix_get_row(mat, 0, &rowPtr);
+        memcpy(rowPtr,
+               inputs[t].data(),
+               inputs[t].size() * sizeof(paddle_real));
+        paddle_arguments_set_value(inArgs, 0, mat);
+        paddle_inference_server_forward(server, inArgs, outArgs);
+        paddle_arguments_get_value(outArgs, 0, prob);
+        paddle_matrix_get_row(prob, 0, &rowPtr);
+        outputs[t].assign(rowPtr, rowPtr + batchSize * 100);
+      }
+      paddle_matrix_destroy(prob);
+      paddle_matrix_destroy(mat);
+      paddle_arguments_destroy(outArgs);
+      paddle_arguments_destroy(inArgs);
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  ASSERT_EQ(kPD_NO_ERROR, paddle_inference_server_destroy(server));
+
+  auto gm = paddle::capi::cast<paddle::capi::CGradientMachine>(machine);
+  for (size_t t = 0; t < numThreads; ++t) {
+    size_t batchSize = inputs[t].size() / 100;
+    std::vector<paddle::Argument> paddleInArgs(1);
+    std::vector<paddle::Argument> paddleOutArgs;
+    paddleInArgs[0].value = paddle::Matrix::create(
+        inputs[t].data(), batchSize, 100, false, false);
+    gm->machine->forward(paddleInArgs, &paddleOutArgs, paddle::PASS_TEST);
+    auto matPaddle = paddleOutArgs[0].value;
+    ASSERT_EQ(batchSize, matPaddle->getHeight());
+    ASSERT_EQ(outputs[t].size(), matPaddle->getElementCnt());
+    for (size_t i = 0; i < outputs[t].size(); ++i) {
+      ASSERT_NEAR(matPaddle->getData()[i], outputs[t][i], 1e-5);
+    }
+  }
+  ASSERT_EQ(kPD_NO_ERROR, paddle_gradient_machine_destroy(machine));
+}
+
+TEST(InferenceServer, testStreamingSession) {
+  paddle::TrainerConfigHelper config("./test_predict_rnn_network.py");
+  std::string buffer;
+  ASSERT_TRUE(config.getModelConfig().SerializeToString(&buffer));
+  paddle_gradient_machine machine;
+  ASSERT_EQ(kPD_NO_ERROR,
+            paddle_gradient_machine_create_for_inference(
+                &machine, &buffer[0], (int)buffer.size()));
+  ASSERT_EQ(kPD_NO_ERROR, paddle_gradient_machine_randomize_param(machine));
+
+  paddle_inference_server server;
+  ASSERT_EQ(kPD_NO_ERROR,
+            paddle_inference_server_create_stateful(&server,
+                                                    machine,
+                                                    &buffer[0],
+                                                    (int)buffer.size(),
+                                                    /* numThreads */ 2,
+                                                    /* maxBatchSize */ 4,
+                                                    /* maxLatencyUs */ 1000));
+
+  // Each thread feeds one sequence chunk by chunk through its session, the
+  // outputs are checked against the forward of the whole sequence.
+  const size_t numThreads = 6;
+  const size_t width = 16;
+  const size_t outWidth = 24;
+  std::vector<std::vector<paddle_real>> inputs(numThreads);
+  std::vector<std::vector<paddle_real>> outputs(numThreads);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < numThreads; ++t) {
+    threads.emplace_back([&, t]() {
+      size_t length = 2 * t + 3;
+      inputs[t] = randomBuffer(length * width);
+      paddle_inference_session session;
+      ASSERT_EQ(kPD_NO_ERROR,
+                paddle_inference_session_create(server, &session));
+      paddle_arguments inArgs = paddle_arguments_create_none();
+      paddle_arguments outArgs = paddle_arguments_create_none();
+      paddle_matrix out = paddle_matrix_create_none();
+      paddle_arguments_resize(inArgs, 1);
+      size_t start = 0;
+      while (start < length) {
+        size_t chunk = std::min(length - start, t % 3 + 1);
+        paddle_matrix mat = paddle_matrix_create(chunk, width, false);
+        paddle_real* rowPtr;
+        paddle_matrix_get_row(mat, 0, &rowPtr);
+        memcpy(rowPtr,
+               inputs[t].data() + start * width,
+               chunk * width * sizeof(paddle_real));
+        int seqPos[] = {0, (int)chunk};
+        paddle_ivector pos = paddle_ivector_create(seqPos, 2, true, false);
+        paddle_arguments_set_value(inArgs, 0, mat);
+        paddle_arguments_set_sequence_start_pos(inArgs, 0, 0, pos);
+        ASSERT_EQ(kPD_NO_ERROR,
+                  paddle_inference_session_forward(session, inArgs, outArgs));
+        paddle_arguments_get_value(outArgs, 0, out);
+        paddle_matrix_get_row(out, 0, &rowPtr);
+        outputs[t].insert(outputs[t].end(), rowPtr, rowPtr + chunk * outWidth);
+        paddle_ivector_destroy(pos);
+        paddle_matrix_destroy(mat);
+        start += chunk;
+      }
+      paddle_matrix_destroy(out);
+      paddle_arguments_destroy(outArgs);
+      paddle_arguments_destroy(inArgs);
+      ASSERT_EQ(kPD_NO_ERROR, paddle_inference_session_destroy(session));
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  ASSERT_EQ(kPD_NO_ERROR, paddle_inference_server_destroy(server));
+
+  auto gm = paddle::capi::cast<paddle::capi::CGradientMachine>(machine);
+  for (size_t t = 0; t < numThreads; ++t) {
+    size_t length = inputs[t].size() / width;
+    std::vector<paddle::Argument> paddleInArgs(1);
+    std::vector<paddle::Argument> paddleOutArgs;
+    paddleInArgs[0].value = paddle::Matrix::create(
+        inputs[t].data(), length, width, false, false);
+    paddleInArgs[0].sequenceStartPositions =
+        paddle::ICpuGpuVector::create(2, false);
+    paddleInArgs[0].sequenceStartPositions->getMutableData(false)[0] = 0;
+    paddleInArgs[0].sequenceStartPositions->getMutableData(false)[1] = length;
+    gm->machine->forward(paddleInArgs, &paddleOutArgs, paddle::PASS_TEST);
+    auto matPaddle = paddleOutArgs[0].value;
+    ASSERT_EQ(outputs[t].size(), matPaddle->getElementCnt());
+    for (size_t i = 0; i < outputs[t].size(); ++i) {
+      ASSERT_NEAR(matPaddle->getData()[i], outputs[t][i], 1e-5);
+    }
+  }
+  ASSERT_EQ(kPD_NO_ERROR, paddle_gradient_machine_destroy(machine));
+}
+
 int main(int argc, char** argv) {
   testing::InitGoogleTest(&argc, argv);
   std::vector<char*> argvs;
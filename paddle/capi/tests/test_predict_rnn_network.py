@@ -0,0 +1,15 @@
+from paddle.trainer_config_helpers import *
+
+settings(batch_size=100)
+
+x = data_layer(name='x', size=16)
+
+lstm = simple_lstm(input=x, size=8)
+
+gru_input = fc_layer(input=x, size=8 * 3, act=LinearActivation())
+gru = grumemory(input=gru_input)
+
+rnn_input = fc_layer(input=x, size=8, act=LinearActivation())
+rnn = recurrent_layer(input=rnn_input)
+
+outputs(concat_layer(input=[lstm, gru, rnn]))
@@ -0,0 +1,291 @@
+/* Copyright (c) 2016 PaddlePaddle Authors. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+#include "ConvOp.h"
+#include "paddle/math/MemoryHandle.h"
+#include "paddle/utils/Stat.h"
+
+DEFINE_string(conv_tuning_file,
+              "",
+              "The file to load and save the convolution algorithms chosen "
+              "by AutoTuneConv. If empty, the results are kept in memory.");
+DEFINE_int32(conv_tuning_repeat,
+             3,
+             "The number of timed runs of each convolution algorithm "
+             "when AutoTuneConv benchmarks a new shape.");
+
+namespace paddle {
+
+/*
+ * \brief The fastest convolution algorithm of each shape, shared by all the
+ *        AutoTuneConvFunction objects of the process.
+ *
+ * The cache is loaded from FLAGS_conv_tuning_file on first use, and reloaded
+ * if the flag changes. Every new result is appended to the file. Each line
+ * of the file is "<shape key> <algorithm>", the later line wins for
+ * duplicated keys.
+ */
+class ConvTuningCache {
+public:
+  static ConvTuningCache& instance() {
+    static ConvTuningCache cache;
+    return cache;
+  }
+
+  bool get(const std::string& key, std::string* algorithm) {
+    std::lock_guard<std::mutex> guard(lock_);
+    load();
+    auto it = results_.find(key);
+    if (it == results_.end()) return false;
+    *algorithm = it->second;
+    return true;
+  }
+
+  void put(const std::string& key, const std::string& algorithm) {
+    std::lock_guard<std::mutex> guard(lock_);
+    load();
+    results_[key] = algorithm;
+    if (!FLAGS_conv_tuning_file.empty()) {
+      std::ofstream file(FLAGS_conv_tuning_file, std::ios::app);
+      if (file) {
+        file << key << " " << algorithm << std::endl;
+      } else {
+        LOG(WARNING) << "Cannot write conv tuning file "
+                     << FLAGS_conv_tuning_file;
+      }
+    }
+  }
+
+private:
+  ConvTuningCache() : loaded_(false) {}
+
+  void load() {
+    if (loaded_ && fileName_ == FLAGS_conv_tuning_file) return;
+    loaded_ = true;
+    fileName_ = FLAGS_conv_tuning_file;
+    results_.clear();
+    if (fileName_.empty()) return;
+    std::ifstream file(fileName_);
+    std::string key;
+    std::string algorithm;
+    while (file >> key >> algorithm) {
+      results_[key] = algorithm;
+    }
+    VLOG(1) << "Load " << results_.size() << " conv tuning results from "
+            << fileName_;
+  }
+
+  std::mutex lock_;
+  bool loaded_;
+  /// the file the results are loaded from
+  std::string fileName_;
+  std::unordered_map<std::string, std::string> results_;
+};
+
+/*
+ * \brief Forward calculation of convolution with the fastest registered
+ *        implementation for the shape of the arguments.
+ *
+ * On the first calc of a new (input, filter, output, stride, padding, groups)
+ * combination, with the batch size rounded up to a power of 2, every eligible
+ * candidate is run FLAGS_conv_tuning_repeat times on the real inputs into a
+ * temporary output, and the fastest one is kept in ConvTuningCache. The
+ * candidates are GemmConv, DirectConv, WinogradConv with tile 2 and 4,
+ * DepthwiseConv if groups equals the input channels, and NNPACKConv if it is
+ * compiled in. A cached algorithm that is not an eligible candidate of this
+ * build is tuned again.
+ */
+template <DeviceType Device>
+class AutoTuneConvFunction : public ConvFunctionBase {
+public:
+  void init(const FuncConfig& config) override {
+    ConvFunctionBase::init(config);
+    Error err;
+    algo_ = config.get<std::string>("algo", &err);
+    if (!err.isOK()) algo_ = "auto";
+  }
+
+  void check(const BufferArgs& inputs, const BufferArgs& outputs) override {
+    const TensorShape& input = inputs[0].shape();
+    const TensorShape& filter = inputs[1].shape();
+    const TensorShape& output = outputs[0].shape();
+    checkShape(input, filter, output);
+  }
+
+  void calc(const BufferArgs& inputs, const BufferArgs& outputs) override {
+    CHECK_EQ(numInputs_, inputs.size());
+    CHECK_EQ(numOutputs_, outputs.size());
+    check(inputs, outputs);
+
+    bool addTo = outputs[0].getArgType() == ADD_TO;
+    std::string key = getKey(
+        inputs[0].shape(), inputs[1].shape(), outputs[0].shape(), addTo);
+    std::string algorithm;
+    if (!ConvTuningCache::instance().get(key, &algorithm) ||
+        !isCandidate(
+            algorithm, inputs[0].shape(), inputs[1].shape(), addTo)) {
+      // The tuning file may come from another build or be edited by hand.
+      if (!algorithm.empty()) {
+        LOG(WARNING) << "Conv " << key << " retunes, since the cached "
+                     << algorithm << " is not a candidate";
+      }
+      algorithm = tune(inputs, outputs, addTo);
+      ConvTuningCache::instance().put(key, algorithm);
+      VLOG(1) << "Conv " << key << " choose " << algorithm;
+    }
+    getFunction(algorithm)->calc(inputs, outputs);
+  }
+
+protected:
+  std::string getKey(const TensorShape& input,
+                     const TensorShape& filter,
+                     const TensorShape& output,
+                     bool addTo) const {
+    // The batch size is bucketed, so that the last partial batch and the
+    // inference batch sizes reuse the results of the training batch size.
+    // Batch 1 has a bucket of its own, since NNPACKConv is eligible for it.
+    size_t batchBucket = 1;
+    while (batchBucket < input[0]) batchBucket <<= 1;
+
+    std::ostringstream os;
+    auto dims = [&os](const TensorShape& shape, size_t begin) {
+      for (size_t i = begin; i < shape.ndims(); i++) {
+        os << (i == begin ? "" : "x") << shape[i];
+      }
+      os << "_";
+    };
+    os << "b" << batchBucket << "_";
+    dims(input, 1);
+    dims(filter, 0);
+    dims(output, 1);
+    os << "s" << strideH() << "x" << strideW() << "_p" << paddingH() << "x"
+       << paddingW() << "_g" << groups_ << (addTo ? "_add" : "");
+    return os.str();
+  }
+
+  bool isEligible(const std::string& algorithm,
+                  const TensorShape& input,
+                  const TensorShape& filter,
+                  bool addTo) const {
+    bool stride1 = strideH() == 1 && strideW() == 1;
+    bool filter3x3 =
+        getFilterHeight(filter) == 3 && getFilterWidth(filter) == 3;
+    if (algorithm == "WinogradConv2" || algorithm == "WinogradConv4") {
+      return filter3x3 && stride1;
+    } else if (algorithm == "NNPACKConv") {
+      return !addTo && groups_ == 1 && (stride1 || input[0] == 1);
+    } else if (algorithm == "DepthwiseConv") {
+      // DepthwiseConv always assigns to the output.
+      return !addTo && groups_ == input[1];
+    }
+    return true;
+  }
+
+  bool isCandidate(const std::string& algorithm,
+                   const TensorShape& input,
+                   const TensorShape& filter,
+                   bool addTo) const {
+    const std::vector<std::string>& candidates = getCandidates();
+    return std::find(candidates.begin(), candidates.end(), algorithm) !=
+               candidates.end() &&
+           isEligible(algorithm, input, filter, addTo);
+  }
+
+  std::string tune(const BufferArgs& inputs,
+                   const BufferArgs& outputs,
+                   bool addTo) {
+    const TensorShape& input = inputs[0].shape();
+    const TensorShape& filter = inputs[1].shape();
+    const TensorShape& output = outputs[0].shape();
+
+    // The candidates write into a temporary output, so that
+    // the real output is untouched in ADD_TO mode.
+    resizeBuffer<Device>(output.getElements());
+    BufferArg tempOutput(
+        memory_->getBuf(), VALUE_TYPE_FLOAT, output, ASSIGN_TO);
+    BufferArgs tempOutputs;
+    tempOutputs.addArg(tempOutput);
+
+    std::string best;
+    uint64_t bestTime = -1;
+    for (auto& algorithm : getCandidates()) {
+      if (!isEligible(algorithm, input, filter, addTo)) continue;
+      FunctionBase* function = getFunction(algorithm);
+      // The first run is a warm up, it allocates the temporary memory.
+      function->calc(inputs, tempOutputs);
+      uint64_t minTime = -1;
+      for (int i = 0; i < FLAGS_conv_tuning_repeat; i++) {
+        uint64_t start = nowInMicroSec();
+        function->calc(inputs, tempOutputs);
+        minTime = std::min(minTime, nowInMicroSec() - start);
+      }
+      VLOG(2) << algorithm << " takes " << minTime << "us";
+      if (minTime < bestTime) {
+        bestTime = minTime;
+        best = algorithm;
+      }
+    }
+    CHECK(!best.empty());
+    return best;
+  }
+
+  static const std::vector<std::string>& getCandidates() {
+    static std::vector<std::string> candidates = []() {
+      std::vector<std::string> names = {"GemmConv",
+                                        "DirectConv",
+                                        "WinogradConv2",
+                                        "WinogradConv4",
+                                        "DepthwiseConv"};
+      FunctionBase::funcRegistrar_.forEachType([&](const std::string& type) {
+        if (type == "NNPACKConv-CPU") names.push_back("NNPACKConv");
+      });
+      return names;
+    }();
+    return candidates;
+  }
+
+  FunctionBase* getFunction(const std::string& algorithm) {
+    auto it = functions_.find(algorithm);
+    if (it != functions_.end()) return it->second.get();
+
+    FuncConfig config;
+    config.set("paddings", paddings_)
+        .set("strides", strides_)
+        .set("groups", groups_);
+    std::string type = algorithm;
+    if (algorithm == "WinogradConv2" || algorithm == "WinogradConv4") {
+      type = "WinogradConv";
+      config.set("tile", (size_t)(algorithm == "WinogradConv2" ? 2 : 4));
+    } else if (algorithm == "NNPACKConv") {
+      config.set("algo", algo_);
+    }
+    std::shared_ptr<FunctionBase> function(
+        FunctionBase::funcRegistrar_.createByType(type + "-CPU"));
+    function->init(config);
+    functions_[algorithm] = function;
+    return function.get();
+  }
+
+  std::string algo_;
+  std::unordered_map<std::string, std::shared_ptr<FunctionBase>> functions_;
+};
+
+REGISTER_TYPED_FUNC(AutoTuneConv, CPU, AutoTuneConvFunction);
+
+}  // namespace paddle
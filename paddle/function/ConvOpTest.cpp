@@ -13,10 +13,14 @@ See the License for the specific language governing permissions and
 limitations under the License. */
 
 #include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
 #include <memory>
 #include "Function.h"
 #include "FunctionTest.h"
 
+DECLARE_string(conv_tuning_file);
+
 namespace paddle {
 
 enum TestType {
@@ -228,6 +232,164 @@ TEST(Forward, GEMM) {
       "NaiveConv-CPU", "GemmConv-CPU", kForwardTest, false);
 }
 
+TEST(Forward, Direct) {
+  ConvolutionTest<DEVICE_TYPE_CPU, DEVICE_TYPE_CPU> test(
+      "NaiveConv-CPU", "DirectConv-CPU", kForwardTest, false);
+  ConvolutionTest2<DEVICE_TYPE_CPU, DEVICE_TYPE_CPU> test2(
+      "NaiveConv-CPU", "DirectConv-CPU", kForwardTest, false);
+}
+
+TEST(Forward, AutoTune) {
+  ConvolutionTest2<DEVICE_TYPE_CPU, DEVICE_TYPE_CPU> test2(
+      "NaiveConv-CPU", "AutoTuneConv-CPU", kForwardTest, false);
+}
+
+static size_t countLines(const std::string& fileName) {
+  std::ifstream file(fileName);
+  std::string line;
+  size_t lines = 0;
+  while (std::getline(file, line)) lines++;
+  return lines;
+}
+
+// Run a new AutoTuneConv of a 3x3 convolution on the batch size.
+static void autoTuneForward(size_t batchSize) {
+  std::vector<size_t> paddings = {1, 1};
+  std::vector<size_t> strides = {1, 1};
+  Compare2Function<DEVICE_TYPE_CPU, DEVICE_TYPE_CPU> test(
+      "NaiveConv-CPU",
+      "AutoTuneConv-CPU",
+      FuncConfig()
+          .set("paddings", paddings)
+          .set("strides", strides)
+          .set("groups", (size_t)1)
+          .set("algo", std::string("auto")));
+  test.addInputs(
+      BufferArg(VALUE_TYPE_FLOAT, TensorShape{batchSize, 8, 14, 14}));
+  test.addInputs(BufferArg(VALUE_TYPE_FLOAT, TensorShape{16, 8, 3, 3}));
+  test.addOutputs(
+      BufferArg(VALUE_TYPE_FLOAT, TensorShape{batchSize, 16, 14, 14}));
+  test.run();
+}
+
+// Each tuning appends a line to the tuning file.
+TEST(Forward, AutoTuneFile) {
+  const std::string file1 = "./test_ConvTuning1.txt";
+  const std::string file2 = "./test_ConvTuning2.txt";
+  std::remove(file1.c_str());
+  std::remove(file2.c_str());
+
+  FLAGS_conv_tuning_file = file1;
+  autoTuneForward(3);
+  EXPECT_EQ(1UL, countLines(file1));
+  // 3 and 4 are in the same batch bucket
+  autoTuneForward(4);
+  EXPECT_EQ(1UL, countLines(file1));
+  autoTuneForward(1);
+  EXPECT_EQ(2UL, countLines(file1));
+
+  // A new run reloads the results from the file instead of tuning again.
+  {
+    std::ifstream src(file1);
+    std::ofstream dst(file2);
+    dst << src.rdbuf();
+  }
+  FLAGS_conv_tuning_file = file2;
+  autoTuneForward(4);
+  autoTuneForward(1);
+  EXPECT_EQ(2UL, countLines(file2));
+
+  FLAGS_conv_tuning_file = "";
+  std::remove(file1.c_str());
+  std::remove(file2.c_str());
+}
+
+// A cached algorithm that is not an eligible candidate is tuned again.
+TEST(Forward, AutoTuneInvalidFile) {
+  const std::string file = "./test_ConvTuning3.txt";
+  {
+    std::ofstream os(file);
+    os << "b4_8x14x14_16x8x3x3_16x14x14_s1x1_p1x1_g1 NoSuchConv" << std::endl;
+    os << "b1_8x14x14_16x8x3x3_16x14x14_s1x1_p1x1_g1 DepthwiseConv"
+       << std::endl;
+  }
+  FLAGS_conv_tuning_file = file;
+  autoTuneForward(4);
+  autoTuneForward(1);
+  EXPECT_EQ(4UL, countLines(file));
+
+  FLAGS_conv_tuning_file = "";
+  std::remove(file.c_str());
+}
+
+TEST(Forward, AutoTuneDepthwise) {
+  for (size_t multiplier : {1, 2}) {
+    std::vector<size_t> paddings = {1, 1};
+    std::vector<size_t> strides = {2, 2};
+    Compare2Function<DEVICE_TYPE_CPU, DEVICE_TYPE_CPU> test(
+        "GemmConv-CPU",
+        "AutoTuneConv-CPU",
+        FuncConfig()
+            .set("paddings", paddings)
+            .set("strides", strides)
+            .set("groups", (size_t)8)
+            .set("algo", std::string("auto")));
+    test.addInputs(BufferArg(VALUE_TYPE_FLOAT, TensorShape{2, 8, 15, 15}));
+    test.addInputs(
+        BufferArg(VALUE_TYPE_FLOAT, TensorShape{8, multiplier, 1, 3, 3}));
+    test.addOutputs(
+        BufferArg(VALUE_TYPE_FLOAT, TensorShape{2, 8 * multiplier, 8, 8}));
+    test.run();
+  }
+}
+
+// The Winograd convolution only supports 3x3 filter and stride 1.
+TEST(Forward, Winograd) {
+  for (size_t tile : {2, 4}) {
+    for (size_t batchSize : {1, 8}) {
+      for (size_t inputHeight : {7, 14, 31}) {
+        for (size_t inputWidth : {10, 54}) {
+          for (size_t inputChannels : {3, 64}) {
+            for (size_t outputChannels : {3, 64}) {
+              for (size_t padding : {0, 1}) {
+                size_t outputHeight = inputHeight - 2 + 2 * padding;
+                size_t outputWidth = inputWidth - 2 + 2 * padding;
+                VLOG(3) << " tile=" << tile << " batchSize=" << batchSize
+                        << " inputChannels=" << inputChannels
+                        << " inputHeight=" << inputHeight
+                        << " inputWidth=" << inputWidth
+                        << " outputChannels=" << outputChannels
+                        << " padding=" << padding;
+
+                std::vector<size_t> paddings = {padding, padding};
+                std::vector<size_t> strides = {1, 1};
+                Compare2Function<DEVICE_TYPE_CPU, DEVICE_TYPE_CPU> test(
+                    "NaiveConv-CPU",
+                    "WinogradConv-CPU",
+                    FuncConfig()
+                        .set("paddings", paddings)
+                        .set("strides", strides)
+                        .set("groups", (size_t)1)
+                        .set("tile", tile));
+
+                TensorShape input{
+                    batchSize, inputChannels, inputHeight, inputWidth};
+                TensorShape filter{outputChannels, inputChannels, 3, 3};
+                TensorShape output{
+                    batchSize, outputChannels, outputHeight, outputWidth};
+                test.addInputs(BufferArg(VALUE_TYPE_FLOAT, input));
+                test.addInputs(BufferArg(VALUE_TYPE_FLOAT, filter));
+                test.addOutputs(BufferArg(VALUE_TYPE_FLOAT, output));
+                test.run();
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
 #ifndef PADDLE_ONLY_CPU
 TEST(Forward, GEMM2) {
   ConvolutionTest<DEVICE_TYPE_CPU, DEVICE_TYPE_GPU> test(
@@ -266,8 +428,154 @@ TEST(BackwardFilter, GEMM) {
 
 // ======Start DepthwiseConvolution TEST======
 
-// TODO(zhaolong) The depthwise convolution cpu test will be added when the cpu
-// version of depthwiseConv is implemented.
+TEST(DepthwiseConvForward, CPU) {
+  ConvolutionTest<DEVICE_TYPE_CPU, DEVICE_TYPE_CPU> test(
+      "GemmConv-CPU", "DepthwiseConv-CPU", kForwardTest);
+  ConvolutionTest2<DEVICE_TYPE_CPU, DEVICE_TYPE_CPU> test2(
+      "GemmConv-CPU", "DepthwiseConv-CPU", kForwardTest);
+}
+
+TEST(DepthwiseConvBackwardInput, CPU) {
+  ConvolutionTest<DEVICE_TYPE_CPU, DEVICE_TYPE_CPU> test(
+      "GemmConvGradInput-CPU",
+      "DepthwiseConvGradInput-CPU",
+      kBackwardInputTest);
+  ConvolutionTest2<DEVICE_TYPE_CPU, DEVICE_TYPE_CPU> test2(
+      "GemmConvGradInput-CPU",
+      "DepthwiseConvGradInput-CPU",
+      kBackwardInputTest);
+}
+
+TEST(DepthwiseConvBackwardFilter, CPU) {
+  ConvolutionTest<DEVICE_TYPE_CPU, DEVICE_TYPE_CPU> test(
+      "GemmConvGradFilter-CPU",
+      "DepthwiseConvGradFilter-CPU",
+      kBackwardFilterTest);
+  ConvolutionTest2<DEVICE_TYPE_CPU, DEVICE_TYPE_CPU> test2(
+      "GemmConvGradFilter-CPU",
+      "DepthwiseConvGradFilter-CPU",
+      kBackwardFilterTest);
+}
+
+// Compare the fused DepthwiseSeparableConv with DepthwiseConv followed by
+// a bias, relu and a 1x1 GemmConv.
+TEST(DepthwiseSeparableConv, CPU) {
+  for (size_t batchSize : {1, 4}) {
+    for (size_t inputSize : {7, 32, 112}) {
+      for (size_t channels : {3, 32}) {
+        for (size_t multiplier : {1, 2}) {
+          for (size_t stride : {1, 2}) {
+            size_t filterSize = 3;
+            size_t padding = 1;
+            size_t middleChannels = channels * multiplier;
+            size_t outputChannels = 16;
+            size_t outputSize =
+                (inputSize - filterSize + 2 * padding + stride) / stride;
+            VLOG(3) << " batchSize=" << batchSize << " inputSize=" << inputSize
+                    << " channels=" << channels
+                    << " multiplier=" << multiplier << " stride=" << stride;
+
+            std::vector<size_t> paddings = {padding, padding};
+            std::vector<size_t> strides = {stride, stride};
+            std::vector<size_t> noPaddings = {0, 0};
+            std::vector<size_t> noStrides = {1, 1};
+            FunctionBase* depthwise =
+                FunctionBase::funcRegistrar_.createByType("DepthwiseConv-CPU");
+            depthwise->init(FuncConfig()
+                                .set("paddings", paddings)
+                                .set("strides", strides)
+                                .set("groups", channels));
+            FunctionBase* pointwise =
+                FunctionBase::funcRegistrar_.createByType("GemmConv-CPU");
+            pointwise->init(FuncConfig()
+                                .set("paddings", noPaddings)
+                                .set("strides", noStrides)
+                                .set("groups", (size_t)1));
+            FunctionBase* fused = FunctionBase::funcRegistrar_.createByType(
+                "DepthwiseSeparableConv-CPU");
+            fused->init(FuncConfig()
+                            .set("paddings", paddings)
+                            .set("strides", strides)
+                            .set("groups", channels)
+                            .set("relu", true));
+
+            TensorShape inputShape{batchSize, channels, inputSize, inputSize};
+            TensorShape depthwiseShape{
+                channels, multiplier, 1, filterSize, filterSize};
+            TensorShape pointwiseShape{outputChannels, middleChannels, 1, 1};
+            TensorShape biasShape{middleChannels};
+            TensorShape middleShape{
+                batchSize, middleChannels, outputSize, outputSize};
+            TensorShape outputShape{
+                batchSize, outputChannels, outputSize, outputSize};
+
+            CpuVector input(inputShape.getElements());
+            CpuVector depthwiseFilter(depthwiseShape.getElements());
+            CpuVector pointwiseFilter(pointwiseShape.getElements());
+            CpuVector bias(biasShape.getElements());
+            CpuVector middle(middleShape.getElements());
+            CpuVector expect(outputShape.getElements());
+            CpuVector output(outputShape.getElements());
+            input.uniform(-1, 1);
+            depthwiseFilter.uniform(-1, 1);
+            pointwiseFilter.uniform(-1, 1);
+            bias.uniform(-1, 1);
+
+            BufferArg inputArg(input.getData(), VALUE_TYPE_FLOAT, inputShape);
+            BufferArg depthwiseArg(
+                depthwiseFilter.getData(), VALUE_TYPE_FLOAT, depthwiseShape);
+            BufferArg pointwiseArg(
+                pointwiseFilter.getData(), VALUE_TYPE_FLOAT, pointwiseShape);
+            BufferArg biasArg(bias.getData(), VALUE_TYPE_FLOAT, biasShape);
+            BufferArg middleArg(
+                middle.getData(), VALUE_TYPE_FLOAT, middleShape, ASSIGN_TO);
+            BufferArg expectArg(
+                expect.getData(), VALUE_TYPE_FLOAT, outputShape, ASSIGN_TO);
+            BufferArg outputArg(
+                output.getData(), VALUE_TYPE_FLOAT, outputShape, ASSIGN_TO);
+
+            BufferArgs dwInputs;
+            BufferArgs dwOutputs;
+            dwInputs.addArg(inputArg);
+            dwInputs.addArg(depthwiseArg);
+            dwOutputs.addArg(middleArg);
+            depthwise->calc(dwInputs, dwOutputs);
+
+            // bias and relu
+            real* data = middle.getData();
+            real* biasData = bias.getData();
+            size_t pixels = outputSize * outputSize;
+            for (size_t i = 0; i < middleShape.getElements(); i++) {
+              real value = data[i] + biasData[i / pixels % middleChannels];
+              data[i] = value > 0 ? value : 0;
+            }
+
+            BufferArgs pwInputs;
+            BufferArgs pwOutputs;
+            pwInputs.addArg(middleArg);
+            pwInputs.addArg(pointwiseArg);
+            pwOutputs.addArg(expectArg);
+            pointwise->calc(pwInputs, pwOutputs);
+
+            BufferArgs inputs;
+            BufferArgs outputs;
+            inputs.addArg(inputArg);
+            inputs.addArg(depthwiseArg);
+            inputs.addArg(pointwiseArg);
+            inputs.addArg(biasArg);
+            outputs.addArg(outputArg);
+            fused->calc(inputs, outputs);
+
+            autotest::TensorCheckErr(expect, output);
+            delete depthwise;
+            delete pointwise;
+            delete fused;
+          }
+        }
+      }
+    }
+  }
+}
 
 #ifndef PADDLE_ONLY_CPU
 
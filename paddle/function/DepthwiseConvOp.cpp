@@ -18,6 +18,73 @@ limitations under the License. */
 
 namespace paddle {
 
+/*
+ * The range [begin, end) of output positions whose filter tap k
+ * falls inside the input, that is 0 <= out * stride - padding + k < inSize.
+ */
+static inline void validOutputRange(int k,
+                                    int inSize,
+                                    int outSize,
+                                    int stride,
+                                    int padding,
+                                    int* begin,
+                                    int* end) {
+  int low = padding - k;
+  *begin = low > 0 ? (low + stride - 1) / stride : 0;
+  int high = inSize - 1 + padding - k;
+  *end = high >= 0 ? std::min(outSize, high / stride + 1) : 0;
+}
+
+/*
+ * Compute the rows [rowBegin, rowEnd) of one channel of depthwise convolution.
+ * The output is accumulated one filter tap at a time, so that the innermost
+ * loop is a contiguous axpy over an output row, which the compiler
+ * vectorizes when stride is 1.
+ */
+template <class T>
+static void depthwiseConvRows(const T* input,
+                              int inputHeight,
+                              int inputWidth,
+                              const T* filter,
+                              int filterHeight,
+                              int filterWidth,
+                              T* output,
+                              int outputWidth,
+                              int rowBegin,
+                              int rowEnd,
+                              int strideH,
+                              int strideW,
+                              int paddingH,
+                              int paddingW) {
+  memset(output, 0, sizeof(T) * (rowEnd - rowBegin) * outputWidth);
+  for (int kh = 0; kh < filterHeight; kh++) {
+    int hBegin, hEnd;
+    validOutputRange(
+        kh, inputHeight, rowEnd, strideH, paddingH, &hBegin, &hEnd);
+    hBegin = std::max(hBegin, rowBegin);
+    for (int kw = 0; kw < filterWidth; kw++) {
+      int wBegin, wEnd;
+      validOutputRange(
+          kw, inputWidth, outputWidth, strideW, paddingW, &wBegin, &wEnd);
+      const T weight = filter[kh * filterWidth + kw];
+      for (int h = hBegin; h < hEnd; h++) {
+        const T* in = input + (h * strideH - paddingH + kh) * inputWidth +
+                      kw - paddingW;
+        T* out = output + (h - rowBegin) * outputWidth;
+        if (strideW == 1) {
+          for (int w = wBegin; w < wEnd; w++) {
+            out[w] += weight * in[w];
+          }
+        } else {
+          for (int w = wBegin; w < wEnd; w++) {
+            out[w] += weight * in[w * strideW];
+          }
+        }
+      }
+    }
+  }
+}
+
 template <class T>
 class DepthwiseConvFunctor<DEVICE_TYPE_CPU, T> {
 public:
@@ -38,7 +105,26 @@ public:
                   int paddingH,
                   int paddingW,
                   T* outputData) {
-    // TODO(zhaolong) : cpu implementation of depthwise convolution
+    for (int i = 0; i < batchSize * outputChannels; i++) {
+      int batch = i / outputChannels;
+      int c = i % outputChannels;
+      depthwiseConvRows(inputData + (batch * inputChannels +
+                                     c / filterMultiplier) *
+                                        inputHeight * inputWidth,
+                        inputHeight,
+                        inputWidth,
+                        filterData + c * filterHeight * filterWidth,
+                        filterHeight,
+                        filterWidth,
+                        outputData + i * outputHeight * outputWidth,
+                        outputWidth,
+                        0,
+                        outputHeight,
+                        strideH,
+                        strideW,
+                        paddingH,
+                        paddingW);
+    }
   }
 };
 
@@ -61,8 +147,35 @@ public:
                   int strideW,
                   int paddingH,
                   int paddingW,
-                  T* inputGrad) {}
-  // TODO(zhaolong) : cpu implementation of depthwise convolution
+                  T* inputGrad) {
+    for (int i = 0; i < batchSize * outputChannels; i++) {
+      int batch = i / outputChannels;
+      int c = i % outputChannels;
+      const T* outGrad = outputGrad + i * outputHeight * outputWidth;
+      const T* filter = filterData + c * filterHeight * filterWidth;
+      T* inGrad = inputGrad + (batch * inputChannels + c / filterMultiplier) *
+                                  inputHeight * inputWidth;
+      for (int kh = 0; kh < filterHeight; kh++) {
+        int hBegin, hEnd;
+        validOutputRange(
+            kh, inputHeight, outputHeight, strideH, paddingH, &hBegin, &hEnd);
+        for (int kw = 0; kw < filterWidth; kw++) {
+          int wBegin, wEnd;
+          validOutputRange(
+              kw, inputWidth, outputWidth, strideW, paddingW, &wBegin, &wEnd);
+          const T weight = filter[kh * filterWidth + kw];
+          for (int h = hBegin; h < hEnd; h++) {
+            T* in = inGrad + (h * strideH - paddingH + kh) * inputWidth + kw -
+                    paddingW;
+            const T* out = outGrad + h * outputWidth;
+            for (int w = wBegin; w < wEnd; w++) {
+              in[w * strideW] += weight * out[w];
+            }
+          }
+        }
+      }
+    }
+  }
 };
 
 template <class T>
@@ -85,8 +198,39 @@ public:
                   int paddingH,
                   int paddingW,
                   T* colData,
-                  T* filterGrad) {}
-  // TODO(zhaolong) : cpu implementation of depthwise convolution
+                  T* filterGrad) {
+    // The colData is not needed on cpu, the filter gradient is
+    // accumulated directly as dot products of the rows.
+    for (int i = 0; i < batchSize * outputChannels; i++) {
+      int batch = i / outputChannels;
+      int c = i % outputChannels;
+      const T* outGrad = outputGrad + i * outputHeight * outputWidth;
+      const T* input = inputData + (batch * inputChannels +
+                                    c / filterMultiplier) *
+                                       inputHeight * inputWidth;
+      T* filter = filterGrad + c * filterHeight * filterWidth;
+      for (int kh = 0; kh < filterHeight; kh++) {
+        int hBegin, hEnd;
+        validOutputRange(
+            kh, inputHeight, outputHeight, strideH, paddingH, &hBegin, &hEnd);
+        for (int kw = 0; kw < filterWidth; kw++) {
+          int wBegin, wEnd;
+          validOutputRange(
+              kw, inputWidth, outputWidth, strideW, paddingW, &wBegin, &wEnd);
+          T sum = 0;
+          for (int h = hBegin; h < hEnd; h++) {
+            const T* in = input + (h * strideH - paddingH + kh) * inputWidth +
+                          kw - paddingW;
+            const T* out = outGrad + h * outputWidth;
+            for (int w = wBegin; w < wEnd; w++) {
+              sum += out[w] * in[w * strideW];
+            }
+          }
+          filter[kh * filterWidth + kw] += sum;
+        }
+      }
+    }
+  }
 };
 
 /*
@@ -286,6 +430,146 @@ public:
   }
 };
 
+/*
+ * \brief Fused forward calculation of a depthwise convolution followed by
+ *        a pointwise (1x1) convolution, the depthwise separable convolution
+ *        block of MobileNet.
+ *
+ * Arguments:
+ *   inputs = {INPUT, DEPTHWISE_FILTER, POINTWISE_FILTER, [DEPTHWISE_BIAS]}
+ *   outputs = {OUTPUT}
+ *   DEPTHWISE_FILTER is [C, M, 1, FH, FW], the config groups must be C.
+ *   POINTWISE_FILTER is [K, C * M, 1, 1].
+ *   DEPTHWISE_BIAS is optional, a [C * M] bias added to the depthwise output,
+ *   such as a folded batch normalization.
+ *   The config "relu" (optional, default false) applies ReLU to the
+ *   depthwise output.
+ *
+ * The output rows of each image are computed in tiles. The depthwise output
+ * of a tile for all channels is small enough to stay in the L2 cache, and is
+ * multiplied by the pointwise filter directly into the output, so the full
+ * intermediate tensor is never written to memory.
+ */
+template <DeviceType Device>
+class DepthwiseSeparableConvFunction : public ConvFunctionBase {
+public:
+  void init(const FuncConfig& config) override {
+    ConvFunctionBase::init(config);
+    Error err;
+    relu_ = config.get<bool>("relu", &err);
+    if (!err.isOK()) relu_ = false;
+    numInputs_ = 4;
+  }
+
+  void check(const BufferArgs& inputs, const BufferArgs& outputs) override {
+    const TensorShape& input = inputs[0].shape();
+    const TensorShape& depthwise = inputs[1].shape();
+    const TensorShape& pointwise = inputs[2].shape();
+    const TensorShape& output = outputs[0].shape();
+    CHECK_EQ(input.ndims(), 4UL);
+    CHECK_EQ(output.ndims(), 4UL);
+    CHECK_EQ(input[0], output[0]);
+    CHECK_EQ(depthwise.ndims(), 5UL);
+    CHECK_EQ(depthwise[0], groups_);
+    CHECK_EQ(depthwise[2], 1UL);
+    CHECK_EQ(input[1], groups_);
+    CHECK_EQ(pointwise.ndims(), 4UL);
+    CHECK_EQ(pointwise[0], output[1]);
+    CHECK_EQ(pointwise[1], depthwise[0] * depthwise[1]);
+    CHECK_EQ(pointwise[2] * pointwise[3], 1UL);
+    if (inputs.size() == 4) {
+      CHECK_EQ(inputs[3].shape().getElements(), pointwise[1]);
+    }
+  }
+
+  void calc(const BufferArgs& inputs, const BufferArgs& outputs) override {
+    CHECK(inputs.size() == 3 || inputs.size() == 4);
+    CHECK_EQ(numOutputs_, outputs.size());
+    check(inputs, outputs);
+    const TensorShape& input = inputs[0].shape();
+    const TensorShape& depthwise = inputs[1].shape();
+    const TensorShape& output = outputs[0].shape();
+
+    int batchSize = input[0];
+    int inputChannels = input[1];
+    int inputHeight = input[2];
+    int inputWidth = input[3];
+    int filterMultiplier = depthwise[1];
+    int filterHeight = getFilterHeight(depthwise);
+    int filterWidth = getFilterWidth(depthwise);
+    int middleChannels = inputChannels * filterMultiplier;
+    int outputChannels = output[1];
+    int outputHeight = output[2];
+    int outputWidth = output[3];
+
+    real* inputData = inputs[0].data<real>();
+    real* depthwiseData = inputs[1].data<real>();
+    real* pointwiseData = inputs[2].data<real>();
+    real* biasData = inputs.size() == 4 ? inputs[3].data<real>() : nullptr;
+    real* outputData = outputs[0].data<real>();
+    real beta = outputs[0].getArgType() == ADD_TO ? 1.0 : 0.0;
+
+    int tileRows = std::max(
+        1, (int)(kTileBytes / (sizeof(real) * middleChannels * outputWidth)));
+    tileRows = std::min(tileRows, outputHeight);
+    resizeBuffer<Device>(middleChannels * tileRows * outputWidth);
+    real* middle = reinterpret_cast<real*>(memory_->getBuf());
+
+    GemmFunctor<Device, real> gemm;
+    for (int i = 0; i < batchSize; i++) {
+      for (int row = 0; row < outputHeight; row += tileRows) {
+        int rowEnd = std::min(row + tileRows, outputHeight);
+        int tileSize = (rowEnd - row) * outputWidth;
+        for (int c = 0; c < middleChannels; c++) {
+          real* tile = middle + c * tileSize;
+          depthwiseConvRows(
+              inputData + (i * inputChannels + c / filterMultiplier) *
+                              inputHeight * inputWidth,
+              inputHeight,
+              inputWidth,
+              depthwiseData + c * filterHeight * filterWidth,
+              filterHeight,
+              filterWidth,
+              tile,
+              outputWidth,
+              row,
+              rowEnd,
+              strideH(),
+              strideW(),
+              paddingH(),
+              paddingW());
+          if (biasData || relu_) {
+            real bias = biasData ? biasData[c] : 0;
+            for (int j = 0; j < tileSize; j++) {
+              real value = tile[j] + bias;
+              tile[j] = relu_ && value < 0 ? 0 : value;
+            }
+          }
+        }
+        gemm(CblasNoTrans,
+             CblasNoTrans,
+             outputChannels,
+             tileSize,
+             middleChannels,
+             1.0f,
+             pointwiseData,
+             middleChannels,
+             middle,
+             tileSize,
+             beta,
+             outputData + row * outputWidth,
+             outputHeight * outputWidth);
+      }
+      outputData += outputChannels * outputHeight * outputWidth;
+    }
+  }
+
+private:
+  // The size of the depthwise output buffer of a tile.
+  static const size_t kTileBytes = 256 * 1024;
+  bool relu_;
+};
+
 REGISTER_TYPED_FUNC(DepthwiseConv, CPU, DepthwiseConvFunction);
 REGISTER_TYPED_FUNC(DepthwiseConvGradInput,
                     CPU,
@@ -293,6 +577,9 @@ REGISTER_TYPED_FUNC(DepthwiseConvGradInput,
 REGISTER_TYPED_FUNC(DepthwiseConvGradFilter,
                     CPU,
                     DepthwiseConvGradFilterFunction);
+REGISTER_TYPED_FUNC(DepthwiseSeparableConv,
+                    CPU,
+                    DepthwiseSeparableConvFunction);
 #ifndef PADDLE_ONLY_CPU
 REGISTER_TYPED_FUNC(DepthwiseConv, GPU, DepthwiseConvFunction);
 REGISTER_TYPED_FUNC(DepthwiseConvGradInput,
@@ -0,0 +1,288 @@
+/* Copyright (c) 2016 PaddlePaddle Authors. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "ConvOp.h"
+#include "paddle/math/MemoryHandle.h"
+
+namespace paddle {
+
+/*
+ * The channel block size of the NCHWc layout. The innermost loop of the
+ * kernel runs over kChannelBlock output channels, which is the width of
+ * an AVX register for float.
+ */
+static const int kChannelBlock = 8;
+/* The number of output pixels computed at once by the kernel. */
+static const int kPixelBlock = 4;
+
+/*
+ * \brief Direct convolution on blocked NCHWc layout.
+ *
+ * The data are stored in memory in row major order.
+ * inputData  = [inputBlocks, paddedHeight, paddedWidth, kChannelBlock]
+ * filterData = [outputBlocks, inputBlocks, filterHeight, filterWidth,
+ *               kChannelBlock(input), kChannelBlock(output)]
+ * outputData = [outputBlocks, outputHeight, outputWidth, kChannelBlock]
+ *
+ * The padding is already applied to the inputData, so that the kernel has no
+ * boundary checks, and the innermost loop is over kChannelBlock contiguous
+ * output channels.
+ */
+template <class T>
+class DirectConvBlockedFunctor {
+public:
+  void operator()(const T* inputData,
+                  int inputBlocks,
+                  int paddedHeight,
+                  int paddedWidth,
+                  const T* filterData,
+                  int filterHeight,
+                  int filterWidth,
+                  T* outputData,
+                  int outputBlocks,
+                  int outputHeight,
+                  int outputWidth,
+                  int strideH,
+                  int strideW) {
+    for (int ob = 0; ob < outputBlocks; ob++) {
+      for (int oh = 0; oh < outputHeight; oh++) {
+        T* out = outputData + (ob * outputHeight + oh) * outputWidth *
+                                  kChannelBlock;
+        int ow = 0;
+        for (; ow + kPixelBlock <= outputWidth; ow += kPixelBlock) {
+          kernel<kPixelBlock>(inputData,
+                              inputBlocks,
+                              paddedHeight,
+                              paddedWidth,
+                              filterData + ob * inputBlocks * filterHeight *
+                                               filterWidth * kChannelBlock *
+                                               kChannelBlock,
+                              filterHeight,
+                              filterWidth,
+                              out + ow * kChannelBlock,
+                              oh * strideH,
+                              ow * strideW,
+                              strideW);
+        }
+        for (; ow < outputWidth; ow++) {
+          kernel<1>(inputData,
+                    inputBlocks,
+                    paddedHeight,
+                    paddedWidth,
+                    filterData + ob * inputBlocks * filterHeight * filterWidth *
+                                     kChannelBlock * kChannelBlock,
+                    filterHeight,
+                    filterWidth,
+                    out + ow * kChannelBlock,
+                    oh * strideH,
+                    ow * strideW,
+                    strideW);
+        }
+      }
+    }
+  }
+
+private:
+  // Compute Pixels x kChannelBlock output values, accumulated in registers.
+  template <int Pixels>
+  inline void kernel(const T* inputData,
+                     int inputBlocks,
+                     int paddedHeight,
+                     int paddedWidth,
+                     const T* filterData,
+                     int filterHeight,
+                     int filterWidth,
+                     T* outputData,
+                     int inStartH,
+                     int inStartW,
+                     int strideW) {
+    T sum[Pixels][kChannelBlock] = {{0}};
+    for (int ib = 0; ib < inputBlocks; ib++) {
+      for (int fh = 0; fh < filterHeight; fh++) {
+        const T* in = inputData +
+                      ((ib * paddedHeight + inStartH + fh) * paddedWidth +
+                       inStartW) *
+                          kChannelBlock;
+        for (int fw = 0; fw < filterWidth; fw++) {
+          const T* f = filterData + ((ib * filterHeight + fh) * filterWidth +
+                                     fw) *
+                                        kChannelBlock * kChannelBlock;
+          for (int ic = 0; ic < kChannelBlock; ic++) {
+            for (int p = 0; p < Pixels; p++) {
+              const T value = in[(p * strideW + fw) * kChannelBlock + ic];
+              for (int oc = 0; oc < kChannelBlock; oc++) {
+                sum[p][oc] += value * f[ic * kChannelBlock + oc];
+              }
+            }
+          }
+        }
+      }
+    }
+    for (int p = 0; p < Pixels; p++) {
+      for (int oc = 0; oc < kChannelBlock; oc++) {
+        outputData[p * kChannelBlock + oc] = sum[p][oc];
+      }
+    }
+  }
+};
+
+/*
+ * \brief Forward calculation of convolution without im2col.
+ *
+ * The input image and the filter are reordered into the blocked NCHWc
+ * layout (zero filled to a multiple of kChannelBlock channels), then the
+ * convolution is computed directly by DirectConvBlockedFunctor and the
+ * result is reordered back into NCHW.
+ *
+ * The temporary memory is about the size of one input image and one
+ * output image, instead of filterHeight * filterWidth times of the output
+ * image of GemmConvFunction. It is suitable for small filters and
+ * a small number of channels, where the GEMM is too small to be efficient.
+ */
+template <DeviceType Device>
+class DirectConvFunction : public ConvFunctionBase {
+public:
+  void init(const FuncConfig& config) override {
+    ConvFunctionBase::init(config);
+  }
+
+  void check(const BufferArgs& inputs, const BufferArgs& outputs) override {
+    const TensorShape& input = inputs[0].shape();
+    const TensorShape& filter = inputs[1].shape();
+    const TensorShape& output = outputs[0].shape();
+    checkShape(input, filter, output);
+  }
+
+  void calc(const BufferArgs& inputs, const BufferArgs& outputs) override {
+    CHECK_EQ(numInputs_, inputs.size());
+    CHECK_EQ(numOutputs_, outputs.size());
+    check(inputs, outputs);
+    const TensorShape& input = inputs[0].shape();
+    const TensorShape& filter = inputs[1].shape();
+    const TensorShape& output = outputs[0].shape();
+
+    bool addTo = outputs[0].getArgType() == ADD_TO;
+
+    int batchSize = input[0];
+    int inputChannels = input[1] / groups_;
+    int inputHeight = input[2];
+    int inputWidth = input[3];
+    int filterHeight = getFilterHeight(filter);
+    int filterWidth = getFilterWidth(filter);
+    int outputChannels = output[1] / groups_;
+    int outputHeight = output[2];
+    int outputWidth = output[3];
+
+    int inputBlocks = (inputChannels + kChannelBlock - 1) / kChannelBlock;
+    int outputBlocks = (outputChannels + kChannelBlock - 1) / kChannelBlock;
+    // The right and bottom borders are padded enough for the last
+    // filter window, including the windows dropped by the output size.
+    int paddedHeight = std::max(inputHeight + 2 * paddingH(),
+                                (outputHeight - 1) * strideH() + filterHeight);
+    int paddedWidth = std::max(inputWidth + 2 * paddingW(),
+                               (outputWidth - 1) * strideW() + filterWidth);
+
+    size_t blockedFilterSize = (size_t)groups_ * outputBlocks * inputBlocks *
+                               filterHeight * filterWidth * kChannelBlock *
+                               kChannelBlock;
+    size_t blockedInputSize =
+        (size_t)inputBlocks * paddedHeight * paddedWidth * kChannelBlock;
+    size_t blockedOutputSize =
+        (size_t)outputBlocks * outputHeight * outputWidth * kChannelBlock;
+    resizeBuffer<Device>(blockedFilterSize + blockedInputSize +
+                         blockedOutputSize);
+    real* blockedFilter = reinterpret_cast<real*>(memory_->getBuf());
+    real* blockedInput = blockedFilter + blockedFilterSize;
+    real* blockedOutput = blockedInput + blockedInputSize;
+
+    // reorder filter, [G, M, C, H, W] -> [G, Mb, Cb, H, W, c, m]
+    real* filterData = inputs[1].data<real>();
+    memset(blockedFilter, 0, blockedFilterSize * sizeof(real));
+    for (size_t g = 0; g < groups_; g++) {
+      real* dst = blockedFilter + g * blockedFilterSize / groups_;
+      for (int m = 0; m < outputChannels; m++) {
+        for (int c = 0; c < inputChannels; c++) {
+          for (int h = 0; h < filterHeight; h++) {
+            for (int w = 0; w < filterWidth; w++) {
+              size_t offset =
+                  ((((m / kChannelBlock) * inputBlocks + c / kChannelBlock) *
+                        filterHeight +
+                    h) *
+                       filterWidth +
+                   w) *
+                      kChannelBlock * kChannelBlock +
+                  (c % kChannelBlock) * kChannelBlock + m % kChannelBlock;
+              dst[offset] = *filterData++;
+            }
+          }
+        }
+      }
+    }
+
+    // The zero padding of blockedInput is never overwritten.
+    memset(blockedInput, 0, blockedInputSize * sizeof(real));
+    real* inputData = inputs[0].data<real>();
+    real* outputData = outputs[0].data<real>();
+    DirectConvBlockedFunctor<real> conv;
+    for (int i = 0; i < batchSize; i++) {
+      for (size_t g = 0; g < groups_; g++) {
+        // reorder input, [C, H, W] -> [Cb, H + 2 * pH, W + 2 * pW, c]
+        for (int c = 0; c < inputChannels; c++) {
+          real* dst = blockedInput +
+                      (c / kChannelBlock) * paddedHeight * paddedWidth *
+                          kChannelBlock +
+                      c % kChannelBlock;
+          for (int h = 0; h < inputHeight; h++) {
+            real* row = dst + ((h + paddingH()) * paddedWidth + paddingW()) *
+                                  kChannelBlock;
+            for (int w = 0; w < inputWidth; w++) {
+              row[w * kChannelBlock] = *inputData++;
+            }
+          }
+        }
+
+        conv(blockedInput,
+             inputBlocks,
+             paddedHeight,
+             paddedWidth,
+             blockedFilter + g * blockedFilterSize / groups_,
+             filterHeight,
+             filterWidth,
+             blockedOutput,
+             outputBlocks,
+             outputHeight,
+             outputWidth,
+             strideH(),
+             strideW());
+
+        // reorder output, [Mb, H, W, m] -> [M, H, W]
+        for (int m = 0; m < outputChannels; m++) {
+          const real* src = blockedOutput +
+                            (m / kChannelBlock) * outputHeight * outputWidth *
+                                kChannelBlock +
+                            m % kChannelBlock;
+          for (int j = 0; j < outputHeight * outputWidth; j++) {
+            real value = src[j * kChannelBlock];
+            *outputData = addTo ? *outputData + value : value;
+            outputData++;
+          }
+        }
+      }
+    }
+  }
+};
+
+REGISTER_TYPED_FUNC(DirectConv, CPU, DirectConvFunction);
+
+}  // namespace paddle
@@ -0,0 +1,289 @@
+/* Copyright (c) 2016 PaddlePaddle Authors. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "ConvOp.h"
+#include "GemmFunctor.h"
+#include "paddle/math/MemoryHandle.h"
+
+namespace paddle {
+
+/*
+ * \brief Transform matrices of the Winograd minimal filtering algorithm
+ *        F(m x m, 3 x 3), see "Fast Algorithms for Convolutional Neural
+ *        Networks" (Andrew Lavin, Scott Gray).
+ *
+ * An output tile of m x m is computed from an input tile of
+ * alpha x alpha (alpha = m + 2) as:
+ *     Y = AT * [(G * g * GT) .* (BT * d * B)] * A
+ * Only m = 2 and m = 4 are supported.
+ */
+template <class T>
+class WinogradTransform {
+public:
+  explicit WinogradTransform(size_t tileSize)
+      : tileSize_(tileSize), alpha_(tileSize + 2) {
+    if (tileSize == 2) {
+      static const T bt[] = {1, 0, -1, 0, 0, 1, 1, 0,  //
+                             0, -1, 1, 0, 0, 1, 0, -1};
+      static const T g[] = {1, 0, 0, 0.5, 0.5, 0.5, 0.5, -0.5, 0.5, 0, 0, 1};
+      static const T at[] = {1, 1, 1, 0, 0, 1, -1, -1};
+      bt_ = bt;
+      g_ = g;
+      at_ = at;
+    } else {
+      CHECK_EQ(tileSize, 4UL) << "Only F(2x2,3x3) and F(4x4,3x3) supported";
+      static const T bt[] = {4, 0,  -5, 0,  1, 0,  //
+                             0, -4, -4, 1,  1, 0,  //
+                             0, 4,  -4, -1, 1, 0,  //
+                             0, -2, -1, 2,  1, 0,  //
+                             0, 2,  -1, -2, 1, 0,  //
+                             0, 4,  0,  -5, 0, 1};
+      static const T g[] = {1.0 / 4,   0,         0,         //
+                            -1.0 / 6,  -1.0 / 6,  -1.0 / 6,  //
+                            -1.0 / 6,  1.0 / 6,   -1.0 / 6,  //
+                            1.0 / 24,  1.0 / 12,  1.0 / 6,   //
+                            1.0 / 24,  -1.0 / 12, 1.0 / 6,   //
+                            0,         0,         1};
+      static const T at[] = {1, 1, 1,  1, 1,  0,  //
+                             0, 1, -1, 2, -2, 0,  //
+                             0, 1, 1,  4, 4,  0,  //
+                             0, 1, -1, 8, -8, 1};
+      bt_ = bt;
+      g_ = g;
+      at_ = at;
+    }
+  }
+
+  size_t tileSize() const { return tileSize_; }
+  size_t alpha() const { return alpha_; }
+
+  // filter: [3, 3] -> [alpha, alpha], element i is stored at out[i * stride]
+  void filter(const T* in, T* out, size_t stride) const {
+    sandwich(g_, alpha_, 3, in, out, stride);
+  }
+
+  // input: [alpha, alpha] -> [alpha, alpha]
+  void input(const T* in, T* out, size_t stride) const {
+    sandwich(bt_, alpha_, alpha_, in, out, stride);
+  }
+
+  // output: [alpha, alpha] -> [m, m]
+  void output(const T* in, T* out) const {
+    sandwich(at_, tileSize_, alpha_, in, out, 1);
+  }
+
+private:
+  // out(r x r) = L(r x n) * in(n x n) * L(r x n)^T
+  static void sandwich(
+      const T* l, size_t r, size_t n, const T* in, T* out, size_t stride) {
+    T tmp[kMaxAlpha * kMaxAlpha];
+    for (size_t i = 0; i < r; i++) {
+      for (size_t j = 0; j < n; j++) {
+        T sum = 0;
+        for (size_t k = 0; k < n; k++) {
+          sum += l[i * n + k] * in[k * n + j];
+        }
+        tmp[i * n + j] = sum;
+      }
+    }
+    for (size_t i = 0; i < r; i++) {
+      for (size_t j = 0; j < r; j++) {
+        T sum = 0;
+        for (size_t k = 0; k < n; k++) {
+          sum += tmp[i * n + k] * l[j * n + k];
+        }
+        out[(i * r + j) * stride] = sum;
+      }
+    }
+  }
+
+  static const size_t kMaxAlpha = 6;
+  size_t tileSize_;
+  size_t alpha_;
+  const T* bt_;
+  const T* g_;
+  const T* at_;
+};
+
+/*
+ * \brief Forward calculation of 3x3 convolution with the Winograd algorithm.
+ *
+ * The filter and every alpha x alpha input tile are transformed into the
+ * Winograd domain, where the convolution becomes alpha * alpha independent
+ * matrix multiplications [outputChannels, inputChannels] x
+ * [inputChannels, tiles]. Compared with GemmConvFunction, this needs
+ * (alpha / m)^2 times of the input size of temporary memory instead of
+ * 9 times, and fewer multiplications.
+ *
+ * Only filter size 3x3 and stride 1 are supported. The config "tile" selects
+ * the output tile size, 2 for F(2x2,3x3) and 4 for F(4x4,3x3).
+ */
+template <DeviceType Device>
+class WinogradConvFunction : public ConvFunctionBase {
+public:
+  void init(const FuncConfig& config) override {
+    ConvFunctionBase::init(config);
+    tileSize_ = config.get<size_t>("tile");
+  }
+
+  void check(const BufferArgs& inputs, const BufferArgs& outputs) override {
+    const TensorShape& input = inputs[0].shape();
+    const TensorShape& filter = inputs[1].shape();
+    const TensorShape& output = outputs[0].shape();
+    checkShape(input, filter, output);
+    CHECK_EQ(getFilterHeight(filter), 3UL);
+    CHECK_EQ(getFilterWidth(filter), 3UL);
+    CHECK_EQ(strideH(), 1);
+    CHECK_EQ(strideW(), 1);
+  }
+
+  void calc(const BufferArgs& inputs, const BufferArgs& outputs) override {
+    CHECK_EQ(numInputs_, inputs.size());
+    CHECK_EQ(numOutputs_, outputs.size());
+    check(inputs, outputs);
+    const TensorShape& input = inputs[0].shape();
+    const TensorShape& output = outputs[0].shape();
+
+    bool addTo = outputs[0].getArgType() == ADD_TO;
+
+    size_t batchSize = input[0];
+    size_t inputChannels = input[1] / groups_;
+    size_t inputHeight = input[2];
+    size_t inputWidth = input[3];
+    size_t outputChannels = output[1] / groups_;
+    size_t outputHeight = output[2];
+    size_t outputWidth = output[3];
+
+    real* inputData = inputs[0].data<real>();
+    real* filterData = inputs[1].data<real>();
+    real* outputData = outputs[0].data<real>();
+
+    WinogradTransform<real> transform(tileSize_);
+    size_t m = transform.tileSize();
+    size_t alpha = transform.alpha();
+    size_t tilesH = (outputHeight + m - 1) / m;
+    size_t tilesW = (outputWidth + m - 1) / m;
+    size_t numTiles = tilesH * tilesW;
+
+    // U: [alpha * alpha, outputChannels, inputChannels]
+    // V: [alpha * alpha, inputChannels, numTiles]
+    // M: [alpha * alpha, outputChannels, numTiles]
+    size_t filterStride = outputChannels * inputChannels;
+    size_t inputStride = inputChannels * numTiles;
+    size_t outputStride = outputChannels * numTiles;
+    resizeBuffer<Device>(alpha * alpha *
+                         (groups_ * filterStride + inputStride + outputStride));
+    real* transFilter = reinterpret_cast<real*>(memory_->getBuf());
+    real* transInput = transFilter + alpha * alpha * groups_ * filterStride;
+    real* transOutput = transInput + alpha * alpha * inputStride;
+
+    // The filter is transformed once for all images in the batch.
+    for (size_t g = 0; g < groups_; g++) {
+      real* u = transFilter + g * alpha * alpha * filterStride;
+      for (size_t k = 0; k < outputChannels; k++) {
+        for (size_t c = 0; c < inputChannels; c++) {
+          transform.filter(
+              filterData + ((g * outputChannels + k) * inputChannels + c) * 9,
+              u + k * inputChannels + c,
+              filterStride);
+        }
+      }
+    }
+
+    GemmFunctor<Device, real> gemm;
+    size_t inputOffset = inputChannels * inputHeight * inputWidth;
+    size_t outputOffset = outputChannels * outputHeight * outputWidth;
+    real tile[36];
+    real result[16];
+    for (size_t i = 0; i < batchSize; i++) {
+      for (size_t g = 0; g < groups_; g++) {
+        const real* in = inputData + (i * groups_ + g) * inputOffset;
+        real* out = outputData + (i * groups_ + g) * outputOffset;
+
+        // input transform
+        for (size_t c = 0; c < inputChannels; c++) {
+          const real* im = in + c * inputHeight * inputWidth;
+          for (size_t th = 0; th < tilesH; th++) {
+            for (size_t tw = 0; tw < tilesW; tw++) {
+              int startH = th * m - paddingH();
+              int startW = tw * m - paddingW();
+              for (size_t y = 0; y < alpha; y++) {
+                int h = startH + y;
+                for (size_t x = 0; x < alpha; x++) {
+                  int w = startW + x;
+                  tile[y * alpha + x] =
+                      (h >= 0 && h < (int)inputHeight && w >= 0 &&
+                       w < (int)inputWidth)
+                          ? im[h * inputWidth + w]
+                          : 0;
+                }
+              }
+              transform.input(tile,
+                              transInput + c * numTiles + th * tilesW + tw,
+                              inputStride);
+            }
+          }
+        }
+
+        // alpha * alpha independent matrix multiplications
+        const real* u = transFilter + g * alpha * alpha * filterStride;
+        for (size_t xi = 0; xi < alpha * alpha; xi++) {
+          gemm(CblasNoTrans,
+               CblasNoTrans,
+               outputChannels,
+               numTiles,
+               inputChannels,
+               1.0f,
+               u + xi * filterStride,
+               inputChannels,
+               transInput + xi * inputStride,
+               numTiles,
+               0.0f,
+               transOutput + xi * outputStride,
+               numTiles);
+        }
+
+        // output transform
+        for (size_t k = 0; k < outputChannels; k++) {
+          real* im = out + k * outputHeight * outputWidth;
+          for (size_t th = 0; th < tilesH; th++) {
+            for (size_t tw = 0; tw < tilesW; tw++) {
+              const real* mData = transOutput + k * numTiles + th * tilesW + tw;
+              for (size_t xi = 0; xi < alpha * alpha; xi++) {
+                tile[xi] = mData[xi * outputStride];
+              }
+              transform.output(tile, result);
+              size_t hEnd = std::min(m, outputHeight - th * m);
+              size_t wEnd = std::min(m, outputWidth - tw * m);
+              for (size_t y = 0; y < hEnd; y++) {
+                real* dst = im + (th * m + y) * outputWidth + tw * m;
+                const real* src = result + y * m;
+                for (size_t x = 0; x < wEnd; x++) {
+                  dst[x] = addTo ? dst[x] + src[x] : src[x];
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
+private:
+  size_t tileSize_;
+};
+
+REGISTER_TYPED_FUNC(WinogradConv, CPU, WinogradConvFunction);
+
+}  // namespace paddle
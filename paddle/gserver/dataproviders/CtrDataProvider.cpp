@@ -0,0 +1,287 @@
+/* Copyright (c) 2016 PaddlePaddle Authors. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "CtrDataProvider.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include "paddle/math/SparseMatrix.h"
+#include "paddle/utils/Stat.h"
+#include "paddle/utils/Util.h"
+
+namespace paddle {
+
+REGISTER_DATA_PROVIDER(ctr, CtrDataProvider);
+
+static const uint64_t kHashSeed = 0x5bd1e995;
+
+static inline bool isSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+uint64_t CtrDataProvider::hash(const char* key, size_t len) {
+  const uint64_t m = 0xc6a4a7935bd1e995ULL;
+  const int r = 47;
+  uint64_t h = kHashSeed ^ (len * m);
+
+  const char* end = key + (len & ~(size_t)7);
+  for (const char* p = key; p != end; p += 8) {
+    uint64_t k;
+    memcpy(&k, p, sizeof(k));
+    k *= m;
+    k ^= k >> r;
+    k *= m;
+    h ^= k;
+    h *= m;
+  }
+  size_t tail = len & 7;
+  if (tail) {
+    uint64_t k = 0;
+    for (size_t i = 0; i < tail; ++i) {
+      k |= (uint64_t)(unsigned char)end[i] << (8 * i);
+    }
+    h ^= k;
+    h *= m;
+  }
+
+  h ^= h >> r;
+  h *= m;
+  h ^= h >> r;
+  return h;
+}
+
+CtrDataProvider::CtrDataProvider(const DataConfig& config, bool useGpu)
+    : DataProvider(config, useGpu), nextFile_(0), numLines_(0) {
+  CHECK_EQ(usageRatio_, 1.0f) << "usage_ratio is not supported by "
+                              << "CtrDataProvider";
+  CHECK(config_.ctr_slots_size()) << "No slot is defined by ctr_slots";
+  for (auto& slot : config_.ctr_slots()) {
+    CHECK_GT(slot.dim(), 0U) << "Invalid dim of slot " << slot.name();
+    CHECK_LE(slot.dim(), (uint32_t)INT32_MAX);
+    CHECK(slotIds_.emplace(slot.name(), slots_.size()).second)
+        << "Duplicated slot " << slot.name();
+    slots_.push_back(slot);
+  }
+  loadFileList(config_.files(), fileList_);
+  CHECK(!fileList_.empty()) << "no data file in " << config_.files();
+
+  int numThreads = config_.file_group_conf().load_thread_num();
+  CHECK_GE(numThreads, 1);
+  if (numThreads > 1) {
+    parsers_.reset(new SyncThreadPool(numThreads, /* checkOwner */ false));
+  }
+  parsed_.resize(numThreads);
+  offsets_.resize(numThreads);
+  for (auto& parsed : parsed_) {
+    parsed.numFeatures.resize(slots_.size());
+    parsed.cols.resize(slots_.size());
+    parsed.values.resize(slots_.size());
+  }
+}
+
+void CtrDataProvider::reset() {
+  stopAsyncLoad();
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    if (!skipShuffle_) {
+      std::shuffle(
+          fileList_.begin(), fileList_.end(), ThreadLocalRandomEngine::get());
+    }
+    nextFile_ = 0;
+    file_.close();
+    file_.clear();
+  }
+  DataProvider::reset();
+}
+
+bool CtrDataProvider::readLines(int64_t size) {
+  numLines_ = 0;
+  if (lines_.size() < (size_t)size) {
+    lines_.resize(size);
+  }
+  while (numLines_ < (size_t)size) {
+    if (!file_.is_open()) {
+      if (nextFile_ == fileList_.size()) break;
+      const std::string& fileName = fileList_[nextFile_++];
+      file_.clear();
+      file_.open(fileName);
+      CHECK(file_) << "Fail to open " << fileName;
+    }
+    std::string& line = lines_[numLines_];
+    if (!std::getline(file_, line)) {
+      CHECK(file_.eof()) << "Fail to read file";
+      file_.close();
+      file_.clear();
+      continue;
+    }
+    if (std::all_of(line.begin(), line.end(), isSpace)) continue;
+    ++numLines_;
+  }
+  return numLines_ > 0;
+}
+
+void CtrDataProvider::parseLines(size_t begin,
+                                 size_t end,
+                                 ParsedLines* parsed) {
+  parsed->labels.clear();
+  for (size_t s = 0; s < slots_.size(); ++s) {
+    parsed->numFeatures[s].clear();
+    parsed->cols[s].clear();
+    parsed->values[s].clear();
+  }
+
+  std::string slotName;
+  for (size_t i = begin; i < end; ++i) {
+    const char* p = lines_[i].c_str();
+    char* next;
+    long label = strtol(p, &next, 10);  // NOLINT
+    CHECK(next != p) << "Invalid label in line: " << lines_[i];
+    parsed->labels.push_back(label);
+    for (auto& numFeatures : parsed->numFeatures) {
+      numFeatures.push_back(0);
+    }
+
+    p = next;
+    while (true) {
+      while (isSpace(*p)) ++p;
+      if (*p == '\0') break;
+      const char* token = p;
+      while (*p != '\0' && !isSpace(*p)) ++p;
+      const char* colon = (const char*)memchr(token, ':', p - token);
+      CHECK(colon) << "Invalid feature " << std::string(token, p)
+                   << " in line: " << lines_[i];
+      slotName.assign(token, colon);
+      auto it = slotIds_.find(slotName);
+      if (it == slotIds_.end()) continue;
+      int s = it->second;
+
+      const char* feasign = colon + 1;
+      const char* feasignEnd = p;
+      if (slots_[s].with_value()) {
+        while (feasignEnd > feasign && feasignEnd[-1] != ':') --feasignEnd;
+        CHECK_GT(feasignEnd, feasign) << "No value of feature "
+                                      << std::string(token, p)
+                                      << " in line: " << lines_[i];
+        parsed->values[s].push_back(strtof(feasignEnd, nullptr));
+        --feasignEnd;
+      }
+      parsed->cols[s].push_back(hash(feasign, feasignEnd - feasign) %
+                                slots_[s].dim());
+      ++parsed->numFeatures[s].back();
+    }
+  }
+}
+
+void CtrDataProvider::fillBatch(const ParsedLines& parsed,
+                                size_t begin,
+                                int tid,
+                                BatchStorage* storage) {
+  size_t numLines = parsed.labels.size();
+  memcpy(storage->labels->getData() + begin,
+         parsed.labels.data(),
+         numLines * sizeof(int));
+  for (size_t s = 0; s < slots_.size(); ++s) {
+    auto matrix = dynamic_cast<CpuSparseMatrix*>(storage->slots[s].get());
+    size_t offset = offsets_[tid][s];
+    int* rows = matrix->getRows();
+    int row = offset;
+    for (size_t i = 0; i < numLines; ++i) {
+      row += parsed.numFeatures[s][i];
+      rows[begin + i + 1] = row;
+    }
+    memcpy(matrix->getCols() + offset,
+           parsed.cols[s].data(),
+           parsed.cols[s].size() * sizeof(int));
+    if (slots_[s].with_value()) {
+      memcpy(matrix->getValue() + offset,
+             parsed.values[s].data(),
+             parsed.values[s].size() * sizeof(real));
+    }
+  }
+}
+
+int64_t CtrDataProvider::getNextBatchInternal(int64_t size,
+                                              DataBatch* batch) {
+  std::lock_guard<std::mutex> guard(lock_);
+  if (!readLines(size)) {
+    return 0;
+  }
+
+  size_t numParsers = parsed_.size();
+  auto lineBegin = [&](size_t tid) { return numLines_ * tid / numParsers; };
+  {
+    REGISTER_TIMER("parseCtrLines");
+    SyncThreadPool::execHelper(parsers_.get(), [&](int tid, size_t) {
+      parseLines(lineBegin(tid), lineBegin(tid + 1), &parsed_[tid]);
+    });
+  }
+
+  // The nonzeros of the lines parsed by a thread start after the ones of the
+  // threads before.
+  std::vector<size_t> nnz(slots_.size(), 0);
+  for (size_t tid = 0; tid < numParsers; ++tid) {
+    offsets_[tid].resize(slots_.size());
+    for (size_t s = 0; s < slots_.size(); ++s) {
+      offsets_[tid][s] = nnz[s];
+      nnz[s] += parsed_[tid].cols[s].size();
+    }
+  }
+  BatchStorage& storage = *storage_;
+  storage.slots.resize(slots_.size());
+  for (size_t s = 0; s < slots_.size(); ++s) {
+    CHECK_LE(nnz[s], (size_t)INT32_MAX);
+    Matrix::resizeOrCreateSparseMatrix(
+        storage.slots[s],
+        numLines_,
+        slots_[s].dim(),
+        nnz[s],
+        slots_[s].with_value() ? FLOAT_VALUE : NO_VALUE,
+        SPARSE_CSR,
+        /* trans */ false,
+        /* useGpu */ false);
+    storage.slots[s]->getRows()[0] = 0;
+  }
+  IVector::resizeOrCreate(storage.labels, numLines_, /* useGpu */ false);
+  SyncThreadPool::execHelper(parsers_.get(), [&](int tid, size_t) {
+    fillBatch(parsed_[tid], lineBegin(tid), tid, &storage);
+  });
+
+  DataBatch& cpuBatch = storage.cpuBatch;
+  cpuBatch.clear();
+  for (auto& matrix : storage.slots) {
+    cpuBatch.appendData(matrix);
+  }
+  cpuBatch.appendLabel(storage.labels);
+  cpuBatch.setSize(numLines_);
+
+  if (useGpu_) {
+    std::vector<Argument>& cpuArguments = cpuBatch.getStreams();
+    DataBatch& gpuBatch = storage.gpuBatch;
+    std::vector<Argument>& gpuArguments = gpuBatch.getStreams();
+    gpuArguments.resize(cpuArguments.size());
+    gpuBatch.setSize(numLines_);
+    for (size_t i = 0; i < cpuArguments.size(); ++i) {
+      gpuArguments[i].resizeAndCopyFrom(
+          cpuArguments[i], useGpu_, HPPL_STREAM_1);
+    }
+    hl_stream_synchronize(HPPL_STREAM_1);
+    *batch = gpuBatch;
+  } else {
+    *batch = cpuBatch;
+  }
+  return numLines_;
+}
+
+}  // namespace paddle
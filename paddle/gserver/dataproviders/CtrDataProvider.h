@@ -0,0 +1,106 @@
+/* Copyright (c) 2016 PaddlePaddle Authors. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#pragma once
+
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "DataProvider.h"
+#include "paddle/utils/Thread.h"
+
+namespace paddle {
+
+/**
+ * @brief Provide the sparse slots of CTR data from text files of lines
+ *
+ *    label slot:feasign slot:feasign:value ...
+ *
+ * separated by spaces or tabs, where label is an integer, and the slots are
+ * defined by ctr_slots of DataConfig. A feasign is any string, which is
+ * hashed into the dimension of its slot. The features of the slots with
+ * value have a float value after the feasign, and the others have none. The
+ * features of the slots not defined are ignored.
+ *
+ * The batch has a sparse slot for each of ctr_slots, followed by the label
+ * slot. The lines are read sequentially, and parsed by load_thread_num
+ * threads of file_group_conf, each of which builds the CSR of its lines in
+ * its part of the reused matrices of the batch. The files are read in a
+ * random order at each pass, and the size is unknown.
+ */
+class CtrDataProvider : public DataProvider {
+public:
+  CtrDataProvider(const DataConfig& config, bool useGpu);
+
+  virtual void reset();
+  virtual void shuffle() {}
+  virtual int64_t getSize() { return -1; }
+  virtual int64_t getNextBatchInternal(int64_t size, DataBatch* batch);
+
+  /**
+   * @brief The hash of a feasign, which is MurmurHash64A.
+   */
+  static uint64_t hash(const char* key, size_t len);
+
+protected:
+  /// the features of the lines parsed by a thread
+  struct ParsedLines {
+    std::vector<int> labels;
+    /// the number of features of each line of each slot
+    std::vector<std::vector<int>> numFeatures;
+    std::vector<std::vector<int>> cols;
+    std::vector<std::vector<real>> values;
+  };
+
+  /// read up to size lines into lines_, return false if no line is read
+  bool readLines(int64_t size);
+
+  void parseLines(size_t begin, size_t end, ParsedLines* parsed);
+
+  /// the reused matrices of the batches of a thread
+  struct BatchStorage {
+    std::vector<MatrixPtr> slots;
+    IVectorPtr labels;
+    DataBatch cpuBatch;
+    DataBatch gpuBatch;
+  };
+
+  /// fill the lines parsed by a thread into the batch at line begin
+  void fillBatch(const ParsedLines& parsed,
+                 size_t begin,
+                 int tid,
+                 BatchStorage* storage);
+
+  std::vector<CtrSlotConfig> slots_;
+  std::unordered_map<std::string, int> slotIds_;
+  std::vector<std::string> fileList_;
+  size_t nextFile_;
+  std::ifstream file_;
+
+  std::unique_ptr<SyncThreadPool> parsers_;
+  std::vector<ParsedLines> parsed_;
+  /// the first nonzero of each slot of the lines of each parser
+  std::vector<std::vector<size_t>> offsets_;
+  std::vector<std::string> lines_;
+  size_t numLines_;
+
+  ThreadLocalD<BatchStorage> storage_;
+  /// the lines are read and parsed by one thread at a time
+  std::mutex lock_;
+};
+
+}  // namespace paddle
@@ -16,6 +16,8 @@ limitations under the License. */
 
 #include <unistd.h>
 #include <algorithm>
+#include <numeric>
+#include "ImageAugmenter.h"
 #include "ProtoDataProvider.h"
 #include "paddle/utils/Logging.h"
 #include "paddle/utils/StringUtil.h"
@@ -58,17 +60,31 @@ void BufferBatch::clone(DataBatch* srcBatch, bool useGpu) {
 
 DoubleBuffer::DoubleBuffer(DataProvider* dataPool,
                            bool useGpu,
-                           int64_t batchSize) {
+                           int64_t batchSize,
+                           int depth,
+                           int numThreads) {
+  CHECK_GE(depth, 1);
+  CHECK_GE(numThreads, 1);
   batchSize_ = batchSize;
   dataPool_ = dataPool;
   useGpu_ = useGpu;
+  depth_ = depth;
+  numThreads_ = numThreads;
   dataQueue_ = new BufferBatchQueue();
   bufferQueue_ = new BufferBatchQueue();
 
-  // insert a empty buffer
-  bufferQueue_->enqueue(new BufferBatch());
+  // insert the empty buffers
+  for (int i = 0; i < depth_; ++i) {
+    bufferQueue_->enqueue(new BufferBatch());
+  }
+  pass_ = 0;
+  passActive_ = false;
+  numActiveLoaders_ = 0;
+  numBusyLoaders_ = 0;
   stopping_ = false;
   pending_ = true;
+  readySum_ = 0;
+  numRemoved_ = 0;
 }
 
 DoubleBuffer::~DoubleBuffer() {
@@ -91,7 +107,13 @@ DoubleBuffer::~DoubleBuffer() {
 
 void DoubleBuffer::removeOneBatch(DataBatch* dataBatch) {
   // get data
-  BufferBatch* batch = dataQueue_->dequeue();
+  readySum_ += dataQueue_->size();
+  ++numRemoved_;
+  BufferBatch* batch;
+  {
+    REGISTER_TIMER("waitForBatch");
+    batch = dataQueue_->dequeue();
+  }
   batch->syncEvent();  // when use GPU, need synchronized with the cuEvent
   *dataBatch = *(batch->getDataBatch());
 
@@ -106,51 +128,115 @@ void DoubleBuffer::removeOneBatch(DataBatch* dataBatch) {
 
   if (0 == dataBatch->getSize()) {
     setPending(true);
+    VLOG(1) << "Prefetch: " << (double)readySum_ / numRemoved_ << " of "
+            << depth_ << " batches were ready on average";
+    readySum_ = 0;
+    numRemoved_ = 0;
   }
 }
 
 void DoubleBuffer::insertOneBatch(DataBatch* batch) {
-  while (!bufferQueue_->waitNotEmptyFor(2 /* seconds */)) {  // time out
-    if (stopping_) return;
+  {
+    REGISTER_TIMER("waitForBuffer");
+    while (!bufferQueue_->waitNotEmptyFor(2 /* seconds */)) {  // time out
+      if (stopping_ || !passActive_) return;
+    }
   }
   BufferBatch* bufBatch = bufferQueue_->dequeue();
   // clone and copy the data from an Threadlocal Variable
+  int64_t numAllocs = MemoryHandle::getNumAllocs();
   bufBatch->clone(batch, useGpu_);
+  bufBatch->getDataBatch()->setNumAllocs(
+      batch->getNumAllocs() + MemoryHandle::getNumAllocs() - numAllocs);
   dataQueue_->enqueue(bufBatch);
 }
 
 void DoubleBuffer::asyncLoadBatch() {
   int64_t actualSize = 0;
+  int64_t pass = 0;
   if (useGpu_) {
     hl_set_device(FLAGS_gpu_id);
   }
   setPending(false);
 
   while (true) {
-    taskReadySem_.wait();
-    if (stopping_) break;
+    {
+      std::unique_lock<std::mutex> lock(passLock_);
+      passCond_.wait(lock, [&]() {
+        return (pass_ > pass && passActive_) || stopping_;
+      });
+      if (stopping_) break;
+      pass = pass_;
+      ++numBusyLoaders_;
+    }
 
-    while (batchSize_ == 0 && !stopping_) {
+    while (batchSize_ == 0 && !stopping_ && passActive_) {
       usleep(5);
     }
-    if (stopping_) break;
 
-    do {
+    while (!stopping_ && passActive_) {
       DataBatch newBatch;
       {
         REGISTER_TIMER("getNextBatchInternal");
-        actualSize = dataPool_->getNextBatchInternal(batchSize_, &newBatch);
+        actualSize = dataPool_->loadBatch(batchSize_, &newBatch);
+      }
+      if (actualSize == 0) {
+        // Only the last loader finishing the pass inserts the empty batch,
+        // after all the batches of the pass.
+        std::lock_guard<std::mutex> guard(passLock_);
+        if (--numActiveLoaders_ > 0) break;
       }
       insertOneBatch(&newBatch);
-    } while (actualSize > 0 && !stopping_);
+      if (actualSize == 0) break;
+    }
+
+    {
+      std::lock_guard<std::mutex> guard(passLock_);
+      --numBusyLoaders_;
+    }
+    passCond_.notify_all();
   }
 }
 
+void DoubleBuffer::dropLoadedBatches() {
+  while (dataQueue_->size() > 0) {
+    bufferQueue_->enqueue(dataQueue_->dequeue());
+  }
+}
+
+void DoubleBuffer::stopPass() {
+  std::unique_lock<std::mutex> lock(passLock_);
+  passActive_ = false;
+  // The loaders may be waiting for free buffers, so the loaded batches are
+  // dropped until all the loaders leave the pass.
+  while (numBusyLoaders_ > 0) {
+    lock.unlock();
+    dropLoadedBatches();
+    lock.lock();
+    passCond_.wait_for(lock, std::chrono::milliseconds(1), [this]() {
+      return numBusyLoaders_ == 0;
+    });
+  }
+  lock.unlock();
+  dropLoadedBatches();
+}
+
 void DoubleBuffer::startAsyncLoad() {
-  if (asyncLoader_ == nullptr) {
-    asyncLoader_.reset(new std::thread([this]() { this->asyncLoadBatch(); }));
+  if (asyncLoaders_.empty()) {
+    for (int i = 0; i < numThreads_; ++i) {
+      asyncLoaders_.emplace_back(
+          new std::thread([this]() { this->asyncLoadBatch(); }));
+    }
   }
-  taskReadySem_.post();
+  // The batches left by a pass which was not read to its end are dropped.
+  stopPass();
+  {
+    std::lock_guard<std::mutex> guard(passLock_);
+    ++pass_;
+    passActive_ = true;
+    numActiveLoaders_ = numThreads_;
+  }
+  passCond_.notify_all();
 }
 
 ClassRegistrar<DataProvider, DataConfig, ModelConfig, bool>
@@ -167,14 +253,31 @@ REGISTER_DATA_PROVIDER(dummy, DummyDataProvider);
 REGISTER_DATA_PROVIDER(proto, ProtoDataProvider);
 REGISTER_DATA_PROVIDER(proto_sequence, ProtoSequenceDataProvider);
 
+DataProvider::DataProvider(const DataConfig& config, bool useGpu)
+    : config_(config),
+      skipShuffle_(false),
+      usageRatio_(config.usage_ratio()),
+      useGpu_(useGpu) {
+  if (config_.has_image_augment_config()) {
+    imageAugmenter_.reset(
+        new ImageAugmenter(config_.image_augment_config(), config_.for_test()));
+  }
+  if (config_.async_load_data()) {
+    initAsyncLoader();
+  }
+}
+
+DataProvider::~DataProvider() {}
+
 int64_t DataProvider::getNextBatch(int64_t size, DataBatch* batch) {
   int64_t batchSize = doubleBuffer_ ? getNextBatchFromBuffer(size, batch)
-                                    : getNextBatchInternal(size, batch);
+                                    : loadBatch(size, batch);
 
   if (!batchSize) return 0;
 
   if (!config_.constant_slots_size()) return batchSize;
 
+  int64_t numAllocs = MemoryHandle::getNumAllocs();
   auto& constantSlots = *constantSlots_;
   constantSlots.resize(config_.constant_slots_size());
 
@@ -193,10 +296,32 @@ int64_t DataProvider::getNextBatch(int64_t size, DataBatch* batch) {
     batch->appendData(constantSlots[i],
                       batch->getStream(0).sequenceStartPositions);
   }
+  batch->setNumAllocs(batch->getNumAllocs() + MemoryHandle::getNumAllocs() -
+                      numAllocs);
 
   return batchSize;
 }
 
+int64_t DataProvider::loadBatch(int64_t size, DataBatch* batch) {
+  int64_t numAllocs = MemoryHandle::getNumAllocs();
+  int64_t batchSize = getNextBatchInternal(size, batch);
+  if (batchSize && imageAugmenter_) {
+    imageAugmenter_->apply(batch, useGpu_);
+  }
+  batch->setNumAllocs(MemoryHandle::getNumAllocs() - numAllocs);
+  return batchSize;
+}
+
+bool DataProvider::isBatchReady(int64_t size) {
+  if (!doubleBuffer_) {
+    return true;
+  }
+  if (doubleBuffer_->getBatchSize() != size) {
+    doubleBuffer_->setBatchSize(size);
+  }
+  return doubleBuffer_->hasReadyBatch();
+}
+
 int64_t DataProvider::getNextBatchFromBuffer(int64_t size, DataBatch* batch) {
   CHECK(doubleBuffer_ != nullptr);
 
@@ -210,7 +335,11 @@ int64_t DataProvider::getNextBatchFromBuffer(int64_t size, DataBatch* batch) {
 
 void DataProvider::initAsyncLoader() {
   if (doubleBuffer_ == nullptr) {
-    doubleBuffer_.reset(new DoubleBuffer(this, useGpu_));
+    doubleBuffer_.reset(new DoubleBuffer(this,
+                                         useGpu_,
+                                         /* batchSize */ 0,
+                                         config_.prefetch_depth(),
+                                         config_.prefetch_thread_num()));
   }
   useGpu_ = false;  // Avoid D2D copy, it will delay the computing performance
 }
@@ -233,26 +362,22 @@ SimpleDataProviderBase::SimpleDataProviderBase(const DataConfig& config,
 }
 
 void SimpleDataProviderBase::shuffle() {
-  int i, t;
-  int len = sampleNumInBuf_;
-  std::vector<real> temp(sampleDim_);
-  real* data = hInputDataBuf_->getData();
-  int* label = hInputLabelBuf_->getData();
-  int* info = hInputInfoBuf_->getData();
-  int sampleSz = sizeof(real) * sampleDim_;
-  for (i = 0; i < len; i++) {
-    int randNum = rand();  // NOLINT TODO(yuyang18): Use rand_r instead?
-    t = randNum % (len - i) + i;
-    // swap
-    if (i != t) {
-      // swap data
-      memcpy(&temp[0], &data[i * sampleDim_], sampleSz);
-      memcpy(&data[i * sampleDim_], &data[t * sampleDim_], sampleSz);
-      memcpy(&data[t * sampleDim_], &temp[0], sampleSz);
-      std::swap(label[i], label[t]);
-      if (withInfo_) {
-        std::swap(info[i], info[t]);
-      }
+  std::shuffle(
+      sampleIds_.begin(), sampleIds_.end(), ThreadLocalRandomEngine::get());
+}
+
+void SimpleDataProviderBase::gatherSamples(
+    const int* ids, int64_t num, real* data, int* label, int* info) {
+  const real* dataBuf = hInputDataBuf_->getData();
+  const int* labelBuf = hInputLabelBuf_->getData();
+  const int* infoBuf = hInputInfoBuf_->getData();
+  for (int64_t i = 0; i < num; ++i) {
+    memcpy(data + i * sampleDim_,
+           dataBuf + ids[i] * sampleDim_,
+           sizeof(real) * sampleDim_);
+    label[i] = labelBuf[ids[i]];
+    if (info) {
+      info[i] = infoBuf[ids[i]];
     }
   }
 }
@@ -276,9 +401,7 @@ int64_t SimpleDataProviderBase::getNextBatchInternal(int64_t size,
   nextItemIndex_ += cpySize;
 
   if (cpySize > 0) {
-    real* data = hInputDataBuf_->getData() + startIndex * sampleDim_;
-    int* label = hInputLabelBuf_->getData() + startIndex;
-    int* info = hInputInfoBuf_->getData() + startIndex;
+    const int* ids = &sampleIds_[startIndex];
 
     MatrixPtr& dataBatch = *dataBatch_;     // get the thread local object
     IVectorPtr& labelBatch = *labelBatch_;  // get the thread local object
@@ -296,12 +419,26 @@ int64_t SimpleDataProviderBase::getNextBatchInternal(int64_t size,
         infoBatch->resize(cpySize);
       }
     }
-    dataBatch->copyFrom(data, cpySize * sampleDim_);
-    labelBatch->copyFrom(label, cpySize);
+    int* info = withInfo_ ? infoBatch->getData() : nullptr;
+    if (useGpu_) {
+      MatrixPtr& cpuDataBatch = *cpuDataBatch_;
+      IVectorPtr& cpuLabelBatch = *cpuLabelBatch_;
+      Matrix::resizeOrCreate(cpuDataBatch, cpySize, sampleDim_, false, false);
+      IVector::resizeOrCreate(cpuLabelBatch, cpySize, false);
+      gatherSamples(ids,
+                    cpySize,
+                    cpuDataBatch->getData(),
+                    cpuLabelBatch->getData(),
+                    info);
+      dataBatch->copyFrom(*cpuDataBatch);
+      labelBatch->copyFrom(*cpuLabelBatch);
+    } else {
+      gatherSamples(
+          ids, cpySize, dataBatch->getData(), labelBatch->getData(), info);
+    }
     batch->appendData(dataBatch);
     batch->appendLabel(labelBatch);
     if (withInfo_) {
-      infoBatch->copyFrom(info, cpySize);
       batch->appendLabel(infoBatch);
     }
   }
@@ -311,6 +448,7 @@ int64_t SimpleDataProviderBase::getNextBatchInternal(int64_t size,
 }
 
 void SimpleDataProviderBase::reset() {
+  stopAsyncLoad();
   sampleNumInBuf_ = 0;
   nextItemIndex_ = 0;
   DataProvider::reset();
@@ -326,12 +464,19 @@ int64_t SimpleDataProviderBase::fillBuffer() {
 
   /* flash the remaining data to the beginning of the buffer */
   if (n > 0) {
-    hInputDataBuf_->copyFrom(
-        hInputDataBuf_->getData() + nextItemIndex_ * sampleDim_,
-        n * sampleDim_);
-    hInputLabelBuf_->copyFrom(hInputLabelBuf_->getData() + nextItemIndex_, n);
+    // They are fewer than a batch, but may be anywhere in the buffer.
+    std::vector<real> data(n * sampleDim_);
+    std::vector<int> label(n);
+    std::vector<int> info(n);
+    gatherSamples(&sampleIds_[nextItemIndex_],
+                  n,
+                  data.data(),
+                  label.data(),
+                  withInfo_ ? info.data() : nullptr);
+    hInputDataBuf_->copyFrom(data.data(), n * sampleDim_);
+    hInputLabelBuf_->copyFrom(label.data(), n);
     if (withInfo_) {
-      hInputInfoBuf_->copyFrom(hInputInfoBuf_->getData() + nextItemIndex_, n);
+      hInputInfoBuf_->copyFrom(info.data(), n);
     }
   }
 
@@ -340,6 +485,8 @@ int64_t SimpleDataProviderBase::fillBuffer() {
                         hInputLabelBuf_->getData() + n,
                         hInputInfoBuf_->getData() + n,
                         bufferCapacity_ - n);
+  sampleIds_.resize(sampleNumInBuf_);
+  std::iota(sampleIds_.begin(), sampleIds_.end(), 0);
 
   /* for stachastic gradient training */
   if (!skipShuffle_) {
@@ -375,6 +522,7 @@ int64_t SimpleDataProvider::fillBufferImp(real* data,
 }
 
 void SimpleDataProvider::reset() {
+  stopAsyncLoad();
   currentSampleIndex_ = 0;
   SimpleDataProviderBase::reset();
 }
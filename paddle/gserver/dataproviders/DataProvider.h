@@ -18,6 +18,8 @@ limitations under the License. */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <atomic>
+#include <condition_variable>
 #include <fstream>
 #include <iostream>
 #include <memory>
@@ -72,7 +74,7 @@ typedef std::shared_ptr<BufferBatch> BufferBatchPtr;
  */
 class DataBatch {
 public:
-  DataBatch() : size_(0) { data_.clear(); }
+  DataBatch() : size_(0), numAllocs_(0) { data_.clear(); }
   /**
    * @brief Get batch size
    * @return batch size
@@ -93,6 +95,13 @@ public:
    * @param[in] size size
    */
   void setSize(int64_t size) { size_ = size; }
+  /**
+   * @brief Get the number of the memory buffers allocated to produce the
+   * batch, which is 0 when all the storage of the batch is reused
+   * @see MemoryHandle::getNumAllocs()
+   */
+  int64_t getNumAllocs() const { return numAllocs_; }
+  void setNumAllocs(int64_t numAllocs) { numAllocs_ = numAllocs; }
   /**
    * @brief Get size of argument vector
    * @return size of argument vector
@@ -123,6 +132,7 @@ public:
   void clear() {
     data_.clear();
     size_ = 0;
+    numAllocs_ = 0;
   }
 
   /**
@@ -186,6 +196,7 @@ protected:
    * @brief batch size
    */
   int64_t size_;
+  int64_t numAllocs_;
   /**
    * @brief A batch data consist of a Argument vector,
    * An argument corresponds to a type of input data.
@@ -243,12 +254,33 @@ protected:
 
 class DataProvider;
 typedef std::shared_ptr<DataProvider> DataProviderPtr;
+class ImageAugmenter;
 
 typedef Queue<BufferBatch*> BufferBatchQueue;
 
+/**
+ * @brief Load the batches of a data provider ahead of the trainer.
+ *
+ * numThreads loader threads call DataProvider::getNextBatchInternal(), and
+ * copy the batches into a pool of depth buffers, which are recycled after
+ * the trainer uses them. So up to depth batches are ready before they are
+ * needed, and the matrices of the buffers are reused instead of allocated
+ * for every batch. getNextBatchInternal() must be thread-safe if numThreads
+ * is larger than 1, and the batches may be out of order then. The providers
+ * build a whole batch under one lock, so more threads only overlap the
+ * augmentation of the batches and their copy into the buffers.
+ *
+ * The time the trainer waits for a batch, and the time the loaders wait for
+ * a free buffer, are the timers waitForBatch and waitForBuffer. The average
+ * number of the ready batches is logged by VLOG(1) at the end of each pass.
+ */
 class DoubleBuffer {
 public:
-  DoubleBuffer(DataProvider* dataPool, bool useGpu, int64_t batchSize = 0);
+  DoubleBuffer(DataProvider* dataPool,
+               bool useGpu,
+               int64_t batchSize = 0,
+               int depth = 1,
+               int numThreads = 1);
   virtual ~DoubleBuffer();
   void removeOneBatch(DataBatch* dataBatch);
 
@@ -256,13 +288,23 @@ public:
 
   int64_t getBatchSize() { return batchSize_; }
 
+  /// Whether a loaded batch, or the end of the pass, is waiting to be removed
+  bool hasReadyBatch() { return dataQueue_->size() > 0; }
+
   void startAsyncLoad();
+  /// Stops the loaders in the middle of the current pass, and drops the
+  /// batches they loaded.
+  void stopPass();
   void finishAsyncLoad() {
-    stopping_ = true;
-    taskReadySem_.post();
-    if (asyncLoader_) {
-      asyncLoader_->join();
+    {
+      std::lock_guard<std::mutex> guard(passLock_);
+      stopping_ = true;
+    }
+    passCond_.notify_all();
+    for (auto& loader : asyncLoaders_) {
+      loader->join();
     }
+    asyncLoaders_.clear();
   }
 
   void setPending(bool pending) { pending_ = pending; }
@@ -270,17 +312,33 @@ public:
 protected:
   virtual void asyncLoadBatch();
   void insertOneBatch(DataBatch* batch);
+  void dropLoadedBatches();
 
   DataProvider* dataPool_;
   bool useGpu_;
   int32_t batchSize_;
+  int depth_;
+  int numThreads_;
   ThreadLocal<BufferBatchPtr> usingBatch_;
   BufferBatchQueue* dataQueue_;
   BufferBatchQueue* bufferQueue_;
-  std::unique_ptr<std::thread> asyncLoader_;
-  Semaphore taskReadySem_;
+  std::vector<std::unique_ptr<std::thread>> asyncLoaders_;
+  /// protects pass_, passActive_, numActiveLoaders_ and numBusyLoaders_
+  std::mutex passLock_;
+  std::condition_variable passCond_;
+  /// the number of the passes started by startAsyncLoad()
+  int64_t pass_;
+  /// false once the current pass is stopped by stopPass()
+  std::atomic<bool> passActive_;
+  /// the number of the loaders which have not finished the current pass
+  int numActiveLoaders_;
+  /// the number of the loaders which are loading the current pass
+  int numBusyLoaders_;
   bool stopping_;
   bool pending_;
+  /// the sum of the ready batches seen by removeOneBatch() in this pass
+  int64_t readySum_;
+  int64_t numRemoved_;
 };
 
 /**
@@ -304,16 +362,8 @@ public:
     return create(config, ModelConfig(), useGpu);
   }
 
-  DataProvider(const DataConfig& config, bool useGpu)
-      : config_(config),
-        skipShuffle_(false),
-        usageRatio_(config.usage_ratio()),
-        useGpu_(useGpu) {
-    if (config_.async_load_data()) {
-      initAsyncLoader();
-    }
-  }
-  virtual ~DataProvider() {}
+  DataProvider(const DataConfig& config, bool useGpu);
+  virtual ~DataProvider();
 
   const DataConfig& getConfig() const { return config_; }
 
@@ -327,6 +377,13 @@ public:
    */
   int64_t getNextBatch(int64_t size, DataBatch* batch);
 
+  /**
+   * @brief Whether getNextBatch() returns without waiting for the loading,
+   * which is always true without async_load_data. Otherwise the async loader
+   * is also told to load batches of size.
+   */
+  bool isBatchReady(int64_t size);
+
   /**
    * @brief Shuffle the data set
    */
@@ -335,8 +392,8 @@ public:
   /**
    * @brief reset all the value of index
    * @note reset() must be called before any calls to getNextBatch()
-   * IMPORTANT: subclass reset() should always call the base class reset()
-   * at the end of the function
+   * IMPORTANT: subclass reset() should always call stopAsyncLoad() at the
+   * beginning of the function, and the base class reset() at the end
    */
   virtual void reset() {
     if (doubleBuffer_ != nullptr) {
@@ -359,6 +416,13 @@ public:
    */
   virtual int64_t getNextBatchInternal(int64_t size, DataBatch* batch) = 0;
 
+  /**
+   * @brief getNextBatchInternal() followed by the augmentation of the batch.
+   * They are both done by the async loader if async_load_data. The number of
+   * the allocations done by them is set to the batch.
+   */
+  int64_t loadBatch(int64_t size, DataBatch* batch);
+
 protected:
   DataConfig config_;
   bool skipShuffle_;
@@ -366,6 +430,7 @@ protected:
   bool useGpu_;
   std::unique_ptr<DoubleBuffer> doubleBuffer_;
   ThreadLocal<std::vector<MatrixPtr>> constantSlots_;
+  std::unique_ptr<ImageAugmenter> imageAugmenter_;
   /**
    * @@brief Get next batch training samples from buffer
    * @param[in]    size      size of training samples to get
@@ -375,6 +440,16 @@ protected:
   int64_t getNextBatchFromBuffer(int64_t size, DataBatch* batch);
 
   void initAsyncLoader();
+
+  /**
+   * @brief Stop the async loader in the middle of a pass, so that reset()
+   * can rewind the data without the loader reading it at the same time.
+   */
+  void stopAsyncLoad() {
+    if (doubleBuffer_ != nullptr) {
+      doubleBuffer_->stopPass();
+    }
+  }
 };
 
 /**
@@ -397,6 +472,9 @@ public:
 
 /**
  * Data provider for one input and one integer label.
+ *
+ * The samples stay where they are filled in the buffer. shuffle() permutes
+ * their ids, and a batch is gathered by the ids directly into its matrices.
  */
 class SimpleDataProviderBase : public DataProvider {
 protected:
@@ -419,9 +497,15 @@ protected:
   /// info buffer:bufferCapacity_ * 1
   CpuIVectorPtr hInputInfoBuf_;
 
+  /// the ids of the samples in the buffer in the order to be read
+  std::vector<int> sampleIds_;
+
   ThreadLocal<MatrixPtr> dataBatch_;
   ThreadLocal<IVectorPtr> labelBatch_;
   ThreadLocal<IVectorPtr> infoBatch_;
+  /// the batch gathered on CPU before it is copied to GPU
+  ThreadLocal<MatrixPtr> cpuDataBatch_;
+  ThreadLocal<IVectorPtr> cpuLabelBatch_;
 
   RWLock lock_;
 
@@ -455,6 +539,11 @@ protected:
                                 int* label,
                                 int* info,
                                 int64_t size) = 0;
+
+  /// Copy the samples of num ids in the buffer to data, label and info,
+  /// where info can be null.
+  void gatherSamples(
+      const int* ids, int64_t num, real* data, int* label, int* info);
 };
 
 class SimpleDataProvider : public SimpleDataProviderBase {
@@ -59,6 +59,7 @@ DataProviderGroup<T>::DataProviderGroup(const DataConfig& config, bool useGpu)
 
 template <class T>
 void DataProviderGroup<T>::reset() {
+  stopAsyncLoad();
   forceStopLoader();
   CHECK(!loader_);
   provider_ = nullptr;
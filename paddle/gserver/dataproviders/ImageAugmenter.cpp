@@ -0,0 +1,152 @@
+/* Copyright (c) 2016 PaddlePaddle Authors. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "ImageAugmenter.h"
+
+#include <random>
+#include "paddle/utils/Stat.h"
+
+namespace paddle {
+
+ImageAugmenter::ImageAugmenter(const ImageAugmentConfig& config, bool isTest)
+    : config_(config), isTest_(isTest) {
+  size_t channels = config_.channels();
+  CHECK_GT(channels, 0U);
+  CHECK_GT(config_.height(), 0U);
+  CHECK_GT(config_.width(), 0U);
+  cropHeight_ = config_.height();
+  cropWidth_ = config_.width();
+  if (config_.crop_size()) {
+    CHECK_LE(config_.crop_size(), config_.height());
+    CHECK_LE(config_.crop_size(), config_.width());
+    cropHeight_ = config_.crop_size();
+    cropWidth_ = config_.crop_size();
+  }
+
+  auto getChannelValue = [&](
+      const google::protobuf::RepeatedField<float>& values,
+      size_t c,
+      real defaultValue) -> real {
+    if (values.size() == 0) return defaultValue;
+    CHECK(values.size() == 1 || values.size() == (int)channels)
+        << "mean and std need one value or one value for each channel";
+    return values.size() == 1 ? values.Get(0) : values.Get(c);
+  };
+  for (size_t c = 0; c < channels; ++c) {
+    real mean = getChannelValue(config_.mean(), c, 0);
+    real std = getChannelValue(config_.std(), c, 1);
+    CHECK_GT(std, 0);
+    scale_.push_back(config_.scale() / std);
+    offset_.push_back(-mean / std);
+  }
+
+  CHECK_GE(config_.thread_num(), 1);
+  if (config_.thread_num() > 1) {
+    threads_.reset(new SyncThreadPool(config_.thread_num(),
+                                      /* checkOwner */ false));
+  }
+}
+
+template <typename T>
+void ImageAugmenter::augment(
+    const T* image, size_t y0, size_t x0, bool mirror, real* out) {
+  size_t channels = config_.channels();
+  size_t width = config_.width();
+  for (size_t c = 0; c < channels; ++c) {
+    real scale = scale_[c];
+    real offset = offset_[c];
+    for (size_t y = 0; y < cropHeight_; ++y) {
+      const T* in = image + ((y0 + y) * width + x0) * channels + c;
+      real* o = out + (c * cropHeight_ + y) * cropWidth_;
+      if (mirror) {
+        for (size_t x = 0; x < cropWidth_; ++x) {
+          o[cropWidth_ - 1 - x] =
+              static_cast<real>(in[x * channels]) * scale + offset;
+        }
+      } else {
+        for (size_t x = 0; x < cropWidth_; ++x) {
+          o[x] = static_cast<real>(in[x * channels]) * scale + offset;
+        }
+      }
+    }
+  }
+}
+
+void ImageAugmenter::apply(DataBatch* batch, bool useGpu) {
+  REGISTER_TIMER("ImageAugment");
+  CHECK_LT(config_.slot(), batch->getNumStreams())
+      << "No slot " << config_.slot() << " to augment";
+  Argument& arg = batch->getStreams()[config_.slot()];
+  size_t imageSize = config_.channels() * config_.height() * config_.width();
+  size_t numImages;
+  CHECK(!useGpu && !(arg.value && arg.value->useGpu()))
+      << "The images should be on CPU, set async_load_data when using GPU";
+  if (arg.strs) {
+    numImages = arg.strs->size();
+  } else {
+    CHECK(arg.value) << "The images should be a string or dense slot";
+    CHECK_EQ(arg.value->getWidth(), imageSize);
+    numImages = arg.value->getHeight();
+  }
+
+  MatrixPtr& output = *output_;
+  Matrix::resizeOrCreate(output,
+                         numImages,
+                         getOutputSize(),
+                         /* trans */ false,
+                         /* useGpu */ false);
+  auto job = [&](int tid, size_t numThreads) {
+    auto& engine = ThreadLocalRandomEngine::get();
+    std::uniform_int_distribution<size_t> yDist(
+        0, config_.height() - cropHeight_);
+    std::uniform_int_distribution<size_t> xDist(
+        0, config_.width() - cropWidth_);
+    std::bernoulli_distribution mirrorDist(0.5);
+    for (size_t i = tid; i < numImages; i += numThreads) {
+      size_t y0 = (config_.height() - cropHeight_) / 2;
+      size_t x0 = (config_.width() - cropWidth_) / 2;
+      bool mirror = false;
+      if (!isTest_) {
+        y0 = yDist(engine);
+        x0 = xDist(engine);
+        mirror = config_.mirror() && mirrorDist(engine);
+      }
+      real* out = output->getData() + i * getOutputSize();
+      if (arg.strs) {
+        const std::string& image = (*arg.strs)[i];
+        CHECK_EQ(image.size(), imageSize) << "Invalid image size";
+        augment(reinterpret_cast<const uint8_t*>(image.data()),
+                y0,
+                x0,
+                mirror,
+                out);
+      } else {
+        augment(arg.value->getData() + i * imageSize, y0, x0, mirror, out);
+      }
+    }
+  };
+  if (threads_) {
+    std::lock_guard<std::mutex> guard(lock_);
+    threads_->exec(job);
+  } else {
+    job(0, 1);
+  }
+
+  arg.value = output;
+  arg.strs = nullptr;
+  arg.frameHeight = cropHeight_;
+  arg.frameWidth = cropWidth_;
+}
+
+}  // namespace paddle
@@ -0,0 +1,78 @@
+/* Copyright (c) 2016 PaddlePaddle Authors. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "DataProvider.h"
+#include "paddle/utils/Thread.h"
+
+namespace paddle {
+
+/**
+ * @brief Crop, mirror and normalize the images of a slot of the batches as
+ *        configured by ImageAugmentConfig, instead of the python code of the
+ *        data provider.
+ *
+ * The images of a batch are divided among thread_num threads. Each image is
+ * written to its row of the output matrix channel by channel, so the inner
+ * loop goes through the pixels of a row of a channel, and the scale and the
+ * offset of the channel are loop invariants.
+ */
+class ImageAugmenter {
+public:
+  ImageAugmenter(const ImageAugmentConfig& config, bool isTest);
+
+  /**
+   * @brief Replace the images of the slot of the batch by the augmented
+   *        values. It can be called by many threads, such as the async
+   *        loaders of the data provider. The augmentation runs on CPU, so
+   *        useGpu, whether the batch is for GPU, has to be false.
+   */
+  void apply(DataBatch* batch, bool useGpu = false);
+
+  /// the number of the values of an augmented image
+  size_t getOutputSize() const {
+    return config_.channels() * cropHeight_ * cropWidth_;
+  }
+
+protected:
+  /**
+   * @brief Augment an image of HWC pixels into CHW values.
+   * @param[in]  image    the pixels of the image
+   * @param[in]  y0, x0   the top left corner of the crop
+   * @param[in]  mirror   whether to flip the image horizontally
+   * @param[out] out      the values of the image
+   */
+  template <typename T>
+  void augment(const T* image, size_t y0, size_t x0, bool mirror, real* out);
+
+  ImageAugmentConfig config_;
+  bool isTest_;
+  size_t cropHeight_;
+  size_t cropWidth_;
+  /// value = pixel * scale_[c] + offset_[c]
+  std::vector<real> scale_;
+  std::vector<real> offset_;
+  /// nullptr if thread_num is 1
+  std::unique_ptr<SyncThreadPool> threads_;
+  /// the thread pool runs one batch at a time
+  std::mutex lock_;
+  ThreadLocal<MatrixPtr> output_;
+};
+
+}  // namespace paddle
@@ -14,7 +14,9 @@ limitations under the License. */
 
 #include "MultiDataProvider.h"
 #include <algorithm>
+#include <random>
 #include "paddle/utils/Logging.h"
+#include "paddle/utils/Stat.h"
 #include "paddle/utils/Util.h"
 
 namespace paddle {
@@ -31,10 +33,15 @@ MultiDataProvider::MultiDataProvider(const DataConfig& config,
             << config.sub_data_configs_size();
   LOG(INFO) << "MultiDataProvider: for_test: " << config.for_test();
   isTestMode_ = config.for_test();
+  interleave_ = config.interleave_sub_data();
   for (int i = 0; i < config.sub_data_configs_size(); i++) {
     LOG(INFO) << "dataRatio of sub(" << i
               << ") is: " << config.sub_data_configs(i).data_ratio();
     totalDataRatio_ += config.sub_data_configs(i).data_ratio();
+    if (interleave_) {
+      CHECK_GT(config.sub_data_configs(i).data_ratio(), 0)
+          << "data_ratio is the weight of sub(" << i << ") to be sampled";
+    }
     if (config.sub_data_configs(i).is_main_data()) {
       LOG(INFO) << "main data is [" << i << "]";
       atLeastOneMainDataFlag = true;
@@ -53,7 +60,10 @@ MultiDataProvider::MultiDataProvider(const DataConfig& config,
   subDataProviders_.resize(subDataProviderCount);
   for (int i = 0; i < subDataProviderCount; i++) {
     subConfig = config.sub_data_configs(i);
-    if (subConfig.async_load_data()) {
+    if (interleave_) {
+      // each sub data is loaded by its own loader to be read concurrently
+      subConfig.set_async_load_data(true);
+    } else if (subConfig.async_load_data()) {
       LOG(INFO) << "can not use async_load_data in sub dataprovider of "
                    "MultiDataProvider";
       subConfig.set_async_load_data(false);
@@ -61,11 +71,26 @@ MultiDataProvider::MultiDataProvider(const DataConfig& config,
     subDataProviders_[i] = std::unique_ptr<DataProvider>(
         DataProvider::create(subConfig, modelConfig, useGpu_));
   }
+  subDataFinished_.resize(subDataProviderCount, true);
+  subDataStats_.resize(subDataProviderCount);
+  passStartTime_ = nowInMicroSec();
 }
 
 void MultiDataProvider::reset() {
-  for (auto& elem : subDataProviders_) {
-    elem->reset();
+  stopAsyncLoad();
+  if (interleave_) {
+    std::lock_guard<std::mutex> guard(lock_);
+    logSubDataStats();
+    for (size_t i = 0; i < subDataProviders_.size(); ++i) {
+      if (subDataFinished_[i]) {
+        subDataProviders_[i]->reset();
+        subDataFinished_[i] = false;
+      }
+    }
+  } else {
+    for (auto& elem : subDataProviders_) {
+      elem->reset();
+    }
   }
   DataProvider::reset();
 }
@@ -78,6 +103,12 @@ void MultiDataProvider::shuffle() {
 
 int64_t MultiDataProvider::getNextBatchInternal(int64_t size,
                                                 DataBatch* batch) {
+  if (interleave_) {
+    return getNextInterleavedBatch(size, batch);
+  }
+  // The sub data may be reset here, so the loaders of prefetch_thread_num
+  // read them one at a time.
+  std::lock_guard<std::mutex> guard(lock_);
   batch->clear();
   for (size_t i = 0; i < subDataProviders_.size(); ++i) {
     // calc size according to data ratio
@@ -117,6 +148,98 @@ int64_t MultiDataProvider::getNextBatchInternal(int64_t size,
   return batch->getSize();
 }
 
+int64_t MultiDataProvider::getNextInterleavedBatch(int64_t size,
+                                                   DataBatch* batch) {
+  std::lock_guard<std::mutex> guard(lock_);
+  batch->clear();
+  size_t numSubData = subDataProviders_.size();
+  std::vector<double> weights(numSubData);
+  std::vector<bool> ready(numSubData);
+  std::vector<bool> restarted(numSubData, false);
+  while (true) {
+    bool anyActive = false;
+    bool anyReady = false;
+    for (size_t i = 0; i < numSubData; ++i) {
+      bool active = !subDataFinished_[i];
+      ready[i] = active && subDataProviders_[i]->isBatchReady(size);
+      weights[i] = ready[i] ? config_.sub_data_configs(i).data_ratio() : 0;
+      anyActive = anyActive || active;
+      anyReady = anyReady || ready[i];
+    }
+    if (!anyActive) {
+      return 0;
+    }
+    if (!anyReady) {
+      // wait for one of the sub data sampled by the weights
+      for (size_t i = 0; i < numSubData; ++i) {
+        if (!subDataFinished_[i]) {
+          weights[i] = config_.sub_data_configs(i).data_ratio();
+        }
+      }
+    }
+    std::discrete_distribution<size_t> dist(weights.begin(), weights.end());
+    size_t id = dist(ThreadLocalRandomEngine::get());
+    SubDataStats& stats = subDataStats_[id];
+
+    DataBatch subBatch;
+    uint64_t startTime = nowInMicroSec();
+    int64_t realSize = subDataProviders_[id]->getNextBatch(size, &subBatch);
+    if (!anyReady) {
+      ++stats.numWaits;
+      stats.waitTime += nowInMicroSec() - startTime;
+    }
+    if (realSize == 0) {
+      if (isTestMode() || config_.sub_data_configs(id).is_main_data()) {
+        subDataFinished_[id] = true;
+        if (!isTestMode()) {
+          // a main data ends the pass in training
+          return 0;
+        }
+      } else {
+        // not main data, restart its pass
+        CHECK(!restarted[id]) << "sub(" << id << ") has no data";
+        subDataProviders_[id]->reset();
+        restarted[id] = true;
+      }
+      continue;
+    }
+
+    for (size_t i = 0; i < numSubData; ++i) {
+      if (i == id) {
+        batch->appendArguments(subBatch.getStreams(), realSize, id);
+      } else {
+        // an empty argument to skip the sub network
+        batch->appendArguments({Argument()}, 0, -1);
+      }
+    }
+    ++stats.numBatches;
+    stats.numSamples += realSize;
+    if (anyReady) {
+      for (size_t i = 0; i < numSubData; ++i) {
+        if (!subDataFinished_[i] && !ready[i]) {
+          ++subDataStats_[i].numStarved;
+        }
+      }
+    }
+    return realSize;
+  }
+}
+
+void MultiDataProvider::logSubDataStats() {
+  double passTime = (nowInMicroSec() - passStartTime_) / 1e6;
+  for (size_t i = 0; i < subDataStats_.size(); ++i) {
+    SubDataStats& stats = subDataStats_[i];
+    if (stats.numBatches) {
+      LOG(INFO) << "sub(" << i << "): " << stats.numBatches << " batches, "
+                << stats.numSamples / passTime << " samples/s, starved at "
+                << stats.numStarved << " batches, waited " << stats.numWaits
+                << " times for " << stats.waitTime / 1000 << "ms";
+    }
+    stats = SubDataStats();
+  }
+  passStartTime_ = nowInMicroSec();
+}
+
 REGISTER_DATA_PROVIDER_EX(multi, MultiDataProvider);
 
 }  // namespace paddle
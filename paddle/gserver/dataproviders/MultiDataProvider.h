@@ -14,10 +14,26 @@ limitations under the License. */
 
 #pragma once
 
+#include <mutex>
 #include "DataProvider.h"
 
 namespace paddle {
 
+/**
+ * @brief Provide the batches of several sub data providers for MultiNetwork.
+ *
+ * By default, each batch has the samples of all the sub data, whose sizes are
+ * proportional to their data_ratio, and the sub data are read one by one.
+ *
+ * With interleave_sub_data, each batch is from one sub data, and the other
+ * sub data have an empty argument, so that their sub networks are skipped.
+ * The sub data are loaded concurrently by their own async loaders, and the
+ * sub data of a batch is sampled with the weights of data_ratio among the
+ * ones with a batch ready, so a slow sub data does not delay the others. It
+ * is waited for only when no sub data is ready. A pass ends when a main sub
+ * data ends in training, or when all the sub data end in testing. The
+ * throughput and the starvation of each sub data are logged at each pass.
+ */
 class MultiDataProvider : public DataProvider {
 protected:
   std::vector<std::unique_ptr<DataProvider>> subDataProviders_;
@@ -33,9 +49,34 @@ public:
   virtual int64_t getNextBatchInternal(int64_t size, DataBatch* batch);
   bool isTestMode() const { return isTestMode_; }
 
+  /// The statistics of a sub data in the current pass of interleave_sub_data
+  struct SubDataStats {
+    int64_t numBatches = 0;
+    int64_t numSamples = 0;
+    /// the number of the batches picked while the sub data was not ready
+    int64_t numStarved = 0;
+    /// the number of the times that no sub data was ready and it was waited
+    int64_t numWaits = 0;
+    uint64_t waitTime = 0;  // in microseconds
+  };
+  const std::vector<SubDataStats>& getSubDataStats() const {
+    return subDataStats_;
+  }
+
 private:
+  int64_t getNextInterleavedBatch(int64_t size, DataBatch* batch);
+  void logSubDataStats();
+
   int totalDataRatio_;
   bool isTestMode_;
+
+  bool interleave_;
+  /// The sub data which ended its pass, and is reset at the next pass. The
+  /// others continue their pass, since their async loaders are running.
+  std::vector<bool> subDataFinished_;
+  std::vector<SubDataStats> subDataStats_;
+  uint64_t passStartTime_;
+  std::mutex lock_;
 };
 
 }  // namespace paddle
@@ -16,10 +16,12 @@ limitations under the License. */
 #include <algorithm>
 #include <fstream>
 #include <istream>
+#include <sstream>
 #include "paddle/utils/StringUtil.h"
 #include "paddle/utils/Util.h"
 
 #include "DataProviderGroup.h"
+#include "RecordIO.h"
 #include "paddle/utils/Logging.h"
 
 DEFINE_double(memory_threshold_on_load_data,
@@ -31,6 +33,8 @@ namespace paddle {
 REGISTER_DATA_PROVIDER(proto_group, DataProviderGroup<ProtoDataProvider>);
 REGISTER_DATA_PROVIDER(proto_sequence_group,
                        DataProviderGroup<ProtoSequenceDataProvider>);
+REGISTER_DATA_PROVIDER(proto_stream, ProtoStreamDataProvider);
+REGISTER_DATA_PROVIDER(recordio, RecordIODataProvider);
 
 ProtoDataProvider::ProtoDataProvider(const DataConfig& config,
                                      bool useGpu,
@@ -55,7 +59,10 @@ void ProtoDataProvider::loadData(const std::vector<std::string>& fileList) {
     LOG(INFO) << "load data file " << file;
     loadDataFile(file);
   }
+  finishLoadData();
+}
 
+void ProtoDataProvider::finishLoadData() {
   if (sequenceStartPositions_.size() == sampleNums_) {
     // This means that each sample is one sequence
     shuffledSequenceIds_.swap(sequenceStartPositions_);
@@ -236,6 +243,28 @@ void ProtoDataProvider::loadDataFile(const std::string& fileName) {
   is.close();
 }
 
+void ProtoDataProvider::clearSlots() {
+  for (auto& slot : slots_) {
+    slot.indexData.clear();
+    slot.denseData.clear();
+    slot.sparseNonValueData.clear();
+    slot.sparseFloatValueData.clear();
+    slot.indices.clear();
+    slot.subIndices.clear();
+    slot.varDenseData.clear();
+    slot.varIndices.clear();
+    slot.strData.clear();
+    if (SlotDef::VECTOR_SPARSE_NON_VALUE == slot.type ||
+        SlotDef::VECTOR_SPARSE_VALUE == slot.type) {
+      slot.indices.push_back(0);
+    }
+  }
+  sampleNums_ = 0;
+  sequenceStartPositions_.clear();
+  shuffledSequenceIds_.clear();
+  currentSequenceIndex_ = 0;
+}
+
 // checkSample has done before, no check here
 void ProtoDataProvider::fillSlots(const DataSample& sample) {
   for (size_t i = 0; i < slots_.size(); ++i) {
@@ -368,6 +397,7 @@ void ProtoDataProvider::showDataStats() {
 }
 
 void ProtoDataProvider::reset() {
+  stopAsyncLoad();
   currentSequenceIndex_ = 0;
   if (!skipShuffle_) {
     shuffle();
@@ -483,7 +513,8 @@ int64_t ProtoDataProvider::getNextBatchInternal(int64_t size,
   int64_t numScannedSeqs = 0;
   std::lock_guard<RWLock> guard(lock_);
   if (iidData()) {
-    size = std::min<int64_t>(getSize() - currentSequenceIndex_, size);
+    size = std::min<int64_t>(
+        ProtoDataProvider::getSize() - currentSequenceIndex_, size);
     numScannedSeqs = numSequences = size;
   } else {
     int64_t sz = 0;
@@ -929,4 +960,276 @@ int64_t ProtoSequenceDataProvider::getNextBatchInternal(int64_t size,
   return batch->getSize();
 }
 
+const size_t ProtoStreamDataProvider::kDefaultBufferCapacity;
+const size_t ProtoStreamDataProvider::kQueueCapacity;
+
+ProtoStreamDataProvider::ProtoStreamDataProvider(const DataConfig& config,
+                                                 bool useGpu)
+    : ProtoDataProvider(config, useGpu, false),
+      nextFile_(0),
+      stopping_(false),
+      finishedReaders_(0),
+      bufferSamples_(0),
+      checkIidData_(true),
+      iidData_(false) {
+  CHECK_EQ(usageRatio_, 1.0f) << "usage_ratio is not supported by "
+                              << "ProtoStreamDataProvider";
+  bufferCapacity_ = config_.buffer_capacity() ? config_.buffer_capacity()
+                                              : kDefaultBufferCapacity;
+  loadFileList(config_.files(), fileList_);
+  CHECK(!fileList_.empty()) << "no data file in " << config_.files();
+
+  // The slots are defined by the header of the first file.
+  std::ifstream is(fileList_[0]);
+  CHECK(is) << "Fail to open " << fileList_[0];
+  ProtoReader reader(&is, str::endsWith(fileList_[0], ".gz"));
+  DataHeader header;
+  CHECK(reader.read(&header)) << "Fail to read header of " << fileList_[0];
+  checkDataHeader(header);
+}
+
+ProtoStreamDataProvider::~ProtoStreamDataProvider() { stopReaders(); }
+
+void ProtoStreamDataProvider::reset() {
+  stopAsyncLoad();
+  stopReaders();
+  buffer_.clear();
+  bufferSamples_ = 0;
+  if (!skipShuffle_) {
+    std::shuffle(
+        fileList_.begin(), fileList_.end(), ThreadLocalRandomEngine::get());
+  }
+  startReaders();
+  DataProvider::reset();
+}
+
+void ProtoStreamDataProvider::startReaders() {
+  CHECK(readers_.empty());
+  queue_.reset(new BlockingQueue<SequencePtr>(kQueueCapacity));
+  nextFile_ = 0;
+  stopping_ = false;
+  finishedReaders_ = 0;
+  int numReaders = std::max(1, config_.file_group_conf().load_thread_num());
+  for (int i = 0; i < numReaders; ++i) {
+    readers_.emplace_back([this]() { readFiles(); });
+  }
+}
+
+void ProtoStreamDataProvider::stopReaders() {
+  if (readers_.empty()) return;
+  stopping_ = true;
+  // the readers may be waiting for the queue to be not full.
+  while (finishedReaders_ < readers_.size()) {
+    if (!queue_->dequeue()) {
+      ++finishedReaders_;
+    }
+  }
+  for (auto& reader : readers_) {
+    reader.join();
+  }
+  readers_.clear();
+}
+
+void ProtoStreamDataProvider::readFiles() {
+  for (size_t i = nextFile_++; i < fileList_.size() && !stopping_;
+       i = nextFile_++) {
+    LOG(INFO) << "read data file " << fileList_[i];
+    readFile(fileList_[i]);
+  }
+  queue_->enqueue(nullptr);
+}
+
+void ProtoStreamDataProvider::readFile(const std::string& fileName) {
+  std::ifstream is(fileName);
+  CHECK(is) << "Fail to open " << fileName;
+  ProtoReader reader(&is, str::endsWith(fileName, ".gz"));
+
+  DataHeader header;
+  CHECK(reader.read(&header)) << "Fail to read header of " << fileName;
+  checkDataHeader(header);
+
+  SequencePtr sequence;
+  DataSample sample;
+  while (!stopping_ && reader.read(&sample)) {
+    checkSample(sample);
+    if (sequence && sample.is_beginning()) {
+      queue_->enqueue(sequence);
+      sequence = nullptr;
+    }
+    if (!sequence) {
+      sequence = std::make_shared<std::vector<DataSample>>();
+    }
+    sequence->emplace_back();
+    sequence->back().Swap(&sample);
+  }
+  if (sequence) {
+    queue_->enqueue(sequence);
+  }
+  CHECK(stopping_ || is.eof()) << "Fail to read file " << fileName;
+}
+
+void ProtoStreamDataProvider::fillBuffer() {
+  while (bufferSamples_ < bufferCapacity_ &&
+         finishedReaders_ < readers_.size()) {
+    SequencePtr sequence = queue_->dequeue();
+    if (!sequence) {
+      ++finishedReaders_;
+      continue;
+    }
+    bufferSamples_ += sequence->size();
+    buffer_.push_back(sequence);
+  }
+  if (checkIidData_ && !buffer_.empty()) {
+    iidData_ = true;
+    for (auto& sequence : buffer_) {
+      if (sequence->size() > 1UL) {
+        iidData_ = false;
+        break;
+      }
+    }
+    checkIidData_ = false;
+  }
+}
+
+int64_t ProtoStreamDataProvider::getNextBatchInternal(int64_t size,
+                                                      DataBatch* batch) {
+  std::lock_guard<std::mutex> guard(streamLock_);
+  if (readers_.empty()) return 0;
+  fillBuffer();
+  if (buffer_.empty()) {
+    stopReaders();
+    return 0;
+  }
+
+  // take random sequences out of the buffer, the same as sequenceLoop.
+  clearSlots();
+  int64_t sz = 0;
+  while (true) {
+    if (buffer_.empty()) {
+      fillBuffer();
+      if (buffer_.empty()) break;
+    }
+    size_t i = 0;
+    if (!skipShuffle_) {
+      i = ThreadLocalRandomEngine::get()() % buffer_.size();
+    }
+    int64_t len = buffer_[i]->size();
+    if (sz + len > size && sz > 0) break;
+    sz += len;
+    sequenceStartPositions_.push_back(sampleNums_);
+    for (auto& sample : *buffer_[i]) {
+      fillSlots(sample);
+      ++sampleNums_;
+    }
+    bufferSamples_ -= len;
+    std::swap(buffer_[i], buffer_.front());
+    buffer_.pop_front();
+  }
+
+  if (iidData_) {
+    CHECK_EQ(sequenceStartPositions_.size(), sampleNums_)
+        << "a sequence has more than one sample, but the first buffer of "
+        << "sequences has only one sample in each sequence";
+    shuffledSequenceIds_.swap(sequenceStartPositions_);
+  } else {
+    sequenceStartPositions_.push_back(sampleNums_);
+    for (size_t i = 0; i < sequenceStartPositions_.size() - 1; ++i) {
+      shuffledSequenceIds_.push_back(i);
+    }
+  }
+  return ProtoDataProvider::getNextBatchInternal(sz, batch);
+}
+
+const size_t RecordIODataProvider::kChunksPerThread;
+
+RecordIODataProvider::RecordIODataProvider(const DataConfig& config,
+                                           bool useGpu)
+    : ProtoDataProvider(config, useGpu, false) {
+  std::vector<std::string> fileList;
+  loadFileList(config_.files(), fileList);
+  SyncThreadPool parsers(
+      std::max(1, config_.file_group_conf().load_thread_num()));
+  for (auto& line : fileList) {
+    LOG(INFO) << "load data file " << line;
+    loadRecordIOFile(line, &parsers);
+  }
+  finishLoadData();
+}
+
+void RecordIODataProvider::loadRecordIOFile(const std::string& line,
+                                            SyncThreadPool* parsers) {
+  std::string fileName;
+  std::istringstream fields(line);
+  fields >> fileName;
+  std::ifstream is(fileName, std::ios::binary);
+  CHECK(is) << "Fail to open " << fileName;
+  std::vector<RecordIOChunkIndex> index;
+  loadRecordIOIndex(is, &index);
+  CHECK(!index.empty()) << "No chunk in " << fileName;
+  size_t begin = 0;
+  size_t end = index.size();
+  if (fields >> begin) {
+    CHECK(fields >> end) << "Invalid chunk range: " << line;
+  }
+  CHECK_LE(begin, end) << line;
+  CHECK_LE(end, index.size()) << line;
+
+  // The first record of the file is the header.
+  RecordIOChunk chunk;
+  std::vector<std::string> records;
+  readRecordIOChunk(is, index[0].offset, &chunk);
+  parseRecordIOChunk(chunk, &records);
+  DataHeader header;
+  CHECK(!records.empty() && header.ParseFromString(records[0]))
+      << "Fail to read header of " << fileName;
+  checkDataHeader(header);
+
+  size_t numChunks = parsers->getNumThreads() * kChunksPerThread;
+  std::vector<RecordIOChunk> chunks;
+  std::vector<RecordIOChunk> nextChunks;
+  std::vector<std::vector<DataSample>> samples(numChunks);
+  auto readChunks = [&](size_t first, std::vector<RecordIOChunk>* out) {
+    out->resize(std::min(numChunks, end - std::min(first, end)));
+    for (size_t i = 0; i < out->size(); ++i) {
+      readRecordIOChunk(is, index[first + i].offset, &(*out)[i]);
+    }
+  };
+
+  // The chunks are read by this thread while the chunks read before are
+  // parsed by the parsers.
+  readChunks(begin, &chunks);
+  for (size_t first = begin; !chunks.empty(); first += numChunks) {
+    parsers->exec(
+        [&](int tid, size_t numThreads) {
+          std::vector<std::string> records;
+          for (size_t i = tid; i < chunks.size(); i += numThreads) {
+            parseRecordIOChunk(chunks[i], &records);
+            // skip the header in the first chunk
+            size_t start = first + i == 0 ? 1 : 0;
+            samples[i].resize(records.size() - start);
+            for (size_t j = start; j < records.size(); ++j) {
+              CHECK(samples[i][j - start].ParseFromString(records[j]))
+                  << "Fail to parse sample in chunk " << first + i << " of "
+                  << fileName;
+            }
+          }
+        },
+        [&](int tid, size_t numThreads) {
+          readChunks(first + numChunks, &nextChunks);
+        });
+
+    for (size_t i = 0; i < chunks.size(); ++i) {
+      for (auto& sample : samples[i]) {
+        checkSample(sample);
+        if (sample.is_beginning()) {
+          sequenceStartPositions_.push_back(sampleNums_);
+        }
+        fillSlots(sample);
+        ++sampleNums_;
+      }
+    }
+    chunks.swap(nextChunks);
+  }
+}
+
 }  // namespace paddle
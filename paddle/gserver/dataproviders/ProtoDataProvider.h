@@ -14,10 +14,15 @@ limitations under the License. */
 
 #pragma once
 
+#include <atomic>
+#include <deque>
+#include <thread>
 #include <vector>
 
 #include "DataFormat.pb.h"
+#include "paddle/utils/Queue.h"
 #include "paddle/utils/Stat.h"
+#include "paddle/utils/Thread.h"
 
 #include "DataProvider.h"
 #include "ProtoReader.h"
@@ -82,6 +87,17 @@ protected:
    * @param[in]  fileName   data file name
    */
   void loadDataFile(const std::string& fileName);
+
+  /**
+   * @brief set up the sequences after all the samples are loaded.
+   */
+  void finishLoadData();
+
+  /**
+   * @brief clear the samples in slot_, and keep the slot types.
+   */
+  void clearSlots();
+
   /** @brief check data header of each data sample
    *  @param[in] header     data header read from protobuf data
    */
@@ -176,4 +192,91 @@ public:
   virtual int64_t getNextBatchInternal(int64_t size, DataBatch* batch);
 };
 
+/**
+ * @brief Provide data from protobuf data files without loading all of them
+ * into memory.
+ *
+ * load_thread_num threads of file_group_conf read the files one after
+ * another, and queue the sequences read. So the next files are read while
+ * the batches are made. The sequences are kept in a shuffle buffer of at
+ * least buffer_capacity samples, and each batch takes random sequences out of
+ * the buffer, which is then refilled from the files. The order of the files
+ * is shuffled at each pass.
+ *
+ * The batches have the same slots and sequences as the ones of
+ * ProtoDataProvider. Whether each sample is one sequence is decided from the
+ * first buffer of sequences.
+ */
+class ProtoStreamDataProvider : public ProtoDataProvider {
+public:
+  ProtoStreamDataProvider(const DataConfig& config, bool useGpu);
+  ~ProtoStreamDataProvider();
+
+  virtual void reset();
+  virtual void shuffle() {}
+  virtual int64_t getSize() { return -1; }
+  virtual int64_t getNextBatchInternal(int64_t size, DataBatch* batch);
+
+protected:
+  typedef std::shared_ptr<std::vector<DataSample>> SequencePtr;
+
+  /// the default number of samples of the shuffle buffer
+  static const size_t kDefaultBufferCapacity = 100000;
+  /// the number of sequences read ahead of the shuffle buffer
+  static const size_t kQueueCapacity = 1024;
+
+  void startReaders();
+  void stopReaders();
+  /// the main function of the reader threads
+  void readFiles();
+  void readFile(const std::string& fileName);
+  /// move the sequences read into the buffer until it is full
+  void fillBuffer();
+
+  std::vector<std::string> fileList_;
+  size_t bufferCapacity_;
+
+  std::vector<std::thread> readers_;
+  /// the sequences read, a nullptr is queued when a reader finishes
+  std::unique_ptr<BlockingQueue<SequencePtr>> queue_;
+  std::atomic<size_t> nextFile_;
+  std::atomic<bool> stopping_;
+  size_t finishedReaders_;
+
+  std::deque<SequencePtr> buffer_;
+  size_t bufferSamples_;
+  bool checkIidData_;
+  bool iidData_;
+  std::mutex streamLock_;
+};
+
+/**
+ * @brief Provide data from RecordIO files (see RecordIO.h), whose records
+ * are the serialized messages of a protobuf data file: the DataHeader
+ * followed by the DataSamples.
+ *
+ * Each line of the file list is a file name, optionally followed by the
+ * range [begin, end) of the chunks to load, so that the chunks of a file can
+ * be split across trainers as the tasks of go/master. A range has to start
+ * at the beginning of a sequence, and the first chunk of a file is always
+ * read for the header. The chunks are read sequentially, while
+ * load_thread_num threads of file_group_conf check, decompress and parse the
+ * chunks read before.
+ */
+class RecordIODataProvider : public ProtoDataProvider {
+public:
+  RecordIODataProvider(const DataConfig& config, bool useGpu);
+
+protected:
+  /// the number of chunks parsed by each thread at a time
+  static const size_t kChunksPerThread = 2;
+
+  /**
+   * @brief load the chunks of a line of the file list
+   * @param[in]  line     file name, and the optional chunk range
+   * @param[in]  parsers  the threads parsing the chunks
+   */
+  void loadRecordIOFile(const std::string& line, SyncThreadPool* parsers);
+};
+
 }  // namespace paddle
@@ -259,6 +259,7 @@ void PyDataProvider::fillSlotsByStr(const std::string& samples) {
 }
 
 void PyDataProvider::reset() {
+  stopAsyncLoad();
   {  // Invoke PyDataProvider Reset
     PyGuard guard;
     PyObjectPtr obj(PyObject_CallMethod(
@@ -16,9 +16,16 @@ limitations under the License. */
 
 #include <Python.h>
 #include <numpy/numpyconfig.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
 #include <list>
+#include <numeric>
 #include <unordered_set>
 #define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
 #include <numpy/ndarrayobject.h>
@@ -71,6 +78,9 @@ enum CacheType {
   CACHE_PASS_IN_MEM = 1,  // First pass will load data from PyDataProvider2,
                           // then cache all data in memory. Load data from
                           // memory in rest passes.
+  CACHE_PASS_ON_DISK = 2,  // First pass will load data from PyDataProvider2,
+                           // then serialize all data into a file. Load data
+                           // from the mapped file in rest passes.
 };
 
 struct SlotHeader {  // Slot Header will parse from python object's slots field.
@@ -91,6 +101,10 @@ inline std::ostream& operator<<(std::ostream& os, const SlotHeader& header) {
  * It will read python object, and fill to argument's each slot.
  * There are two steps, prepare and fill. Scanner will alloc memory during
  * prepare step, fill data into argument during fill step.
+ *
+ * The scanners and the arguments are reused for the batches of a loading
+ * thread, so a scanner resets its state at startPrepare, and resizes the
+ * memory of the argument instead of creating it.
  */
 class IFieldScanner {
 public:
@@ -178,10 +192,398 @@ public:
    */
   virtual std::deque<PyObjectPtr>* load() = 0;
 
+  /**
+   * invoke instead of drop() when the used data are serialized records, which
+   * are read from the worker processes.
+   */
+  virtual void dropRecords(const std::vector<std::string>& records) {}
+
+  /**
+   * invoke when the data of a pass read from python are all used.
+   */
+  virtual void finishPass() {}
+
+  /**
+   * Return the number of the serialized records in cache. The cache returns
+   * the records by getRecord() instead of load() if it serializes the data.
+   */
+  virtual size_t getNumRecords() { return 0; }
+
+  /**
+   * Return the i-th record in cache, and its size.
+   */
+  virtual const char* getRecord(size_t i, size_t* size) { return nullptr; }
+
   /**
    * Factory method. Convert CacheType to IPyDataProviderCache*
+   * @param headers slot headers of the data.
+   * @param calcBatchSize the calc_batch_size of the provider, or nullptr.
+   */
+  static IPyDataProviderCache* create(CacheType ct,
+                                      const std::vector<SlotHeader>& headers,
+                                      PyObject* calcBatchSize);
+};
+
+/// The size of the shared memory of a worker process, which bounds the size
+/// of a serialized sample.
+static const size_t kWorkerBufferSize = 32UL << 20;
+
+/// The microseconds to sleep when the shared memory is full or empty.
+static const int kWorkerWaitUs = 100;
+
+/**
+ * A ring buffer of records in shared memory, which is written by a worker
+ * process and read by the trainer. There is one writer and one reader, and
+ * head and tail are the numbers of the bytes written and read. A record is its
+ * size followed by its bytes. The ring must be created before fork.
+ */
+class SharedMemoryRing {
+public:
+  explicit SharedMemoryRing(size_t capacity) : capacity_(capacity) {
+    mapSize_ = sizeof(Header) + capacity;
+    void* addr = mmap(nullptr,
+                      mapSize_,
+                      PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_ANONYMOUS,
+                      -1,
+                      0);
+    CHECK(addr != MAP_FAILED) << "Fail to map shared memory: "
+                              << strerror(errno);
+    header_ = new (addr) Header();
+    CHECK(header_->head.is_lock_free());
+    data_ = reinterpret_cast<char*>(addr) + sizeof(Header);
+  }
+
+  ~SharedMemoryRing() { munmap(header_, mapSize_); }
+
+  /**
+   * Append a record if there is enough space. Called by the writer.
    */
-  static IPyDataProviderCache* create(CacheType ct);
+  bool tryWrite(const std::string& record) {
+    uint32_t size = record.size();
+    size_t total = sizeof(size) + size;
+    CHECK_LE(total, capacity_) << "The sample is too large for the shared "
+                               << "memory of the worker process";
+    uint64_t head = header_->head.load(std::memory_order_relaxed);
+    uint64_t tail = header_->tail.load(std::memory_order_acquire);
+    if (capacity_ - (head - tail) < total) return false;
+    copyIn(head, reinterpret_cast<const char*>(&size), sizeof(size));
+    copyIn(head + sizeof(size), record.data(), size);
+    header_->head.store(head + total, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * Take the first record if there is any. Called by the reader.
+   */
+  bool tryRead(std::string* record) {
+    uint64_t tail = header_->tail.load(std::memory_order_relaxed);
+    uint64_t head = header_->head.load(std::memory_order_acquire);
+    if (head == tail) return false;
+    uint32_t size;
+    copyOut(tail, reinterpret_cast<char*>(&size), sizeof(size));
+    record->resize(size);
+    copyOut(tail + sizeof(size), &(*record)[0], size);
+    header_->tail.store(tail + sizeof(size) + size, std::memory_order_release);
+    return true;
+  }
+
+  /// Called by the writer after the last record.
+  void close() { header_->closed.store(true, std::memory_order_release); }
+
+  /// The records written before close() are readable if it returns true.
+  bool isClosed() const {
+    return header_->closed.load(std::memory_order_acquire);
+  }
+
+private:
+  struct Header {
+    std::atomic<uint64_t> head{0};
+    std::atomic<uint64_t> tail{0};
+    std::atomic<bool> closed{false};
+  };
+
+  void copyIn(uint64_t pos, const char* src, size_t size) {
+    size_t offset = pos % capacity_;
+    size_t first = std::min(size, capacity_ - offset);
+    memcpy(data_ + offset, src, first);
+    memcpy(data_, src + first, size - first);
+  }
+
+  void copyOut(uint64_t pos, char* dst, size_t size) const {
+    size_t offset = pos % capacity_;
+    size_t first = std::min(size, capacity_ - offset);
+    memcpy(dst, data_ + offset, first);
+    memcpy(dst + first, data_, size - first);
+  }
+
+  size_t capacity_;
+  size_t mapSize_;
+  Header* header_;
+  char* data_;
+};
+
+/**
+ * The samples of the worker processes are serialized into records. A record
+ * is the batch size of the sample, followed by the slots one after another.
+ * A dense timestep is dim reals, an index is an int, and a sparse vector is
+ * the number of its ids followed by the ids, or by the (id, value) pairs. A
+ * sequence is its length followed by its timesteps, or by its sub-sequences.
+ */
+template <typename T>
+inline void appendRecord(std::string* record, T value) {
+  record->append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+inline T readRecord(const char** pos) {
+  T value;
+  memcpy(&value, *pos, sizeof(T));
+  *pos += sizeof(T);
+  return value;
+}
+
+/**
+ * Serialize a slot of a python sample. If seqType is SQT_NONE, obj is a
+ * timestep, otherwise it is a sequence or a sequence of sub-sequences.
+ *
+ * @note It is called in the worker process, which does not use PyGuard.
+ */
+static void writeSlot(const SlotHeader& header,
+                      SeqType seqType,
+                      PyObject* obj,
+                      std::string* record) {
+  if (seqType != SQT_NONE) {
+    py::SequenceHelper s(obj);
+    appendRecord<uint32_t>(record, s.size());
+    SeqType innerType = seqType == SQT_SUBSEQ ? SQT_SEQ : SQT_NONE;
+    for (size_t i = 0; i < s.size(); ++i) {
+      writeSlot(header, innerType, s[i], record);
+    }
+    return;
+  }
+
+  bool ok;
+  switch (header.slotType) {
+    case ST_DENSE:
+      if (PyArray_Check(obj)) {
+        auto array = (PyArrayObject*)obj;
+        auto dtype = PyArray_DTYPE(array);
+        CHECK(dtype->type == 'f' && dtype->elsize == sizeof(real))
+            << "You should yield float" << sizeof(real) * 8 << " array";
+        CHECK_EQ((size_t)PyArray_SIZE(array), header.dim);
+        record->append((const char*)PyArray_DATA(array),
+                       header.dim * sizeof(real));
+      } else {
+        py::SequenceHelper s(obj);
+        for (size_t i = 0; i < header.dim; ++i) {
+          appendRecord<real>(record, (real)s.getDouble(i));
+        }
+      }
+      break;
+    case ST_INDEX:
+      appendRecord<int>(record, py::castInt<int>(obj, &ok));
+      CHECK(ok) << "Cannot cast int";
+      break;
+    case ST_NON_SPARSE_VALUE:
+    case ST_SPARSE_VALUE: {
+      py::SequenceHelper s(obj);
+      appendRecord<uint32_t>(record, s.size());
+      for (size_t i = 0; i < s.size(); ++i) {
+        if (header.slotType == ST_SPARSE_VALUE) {
+          py::SequenceHelper pair(s[i]);
+          appendRecord<int>(record, py::castInt<int>(pair[0], &ok));
+          CHECK(ok) << "Cannot cast int";
+          appendRecord<real>(record, (real)pair.getDouble(1));
+        } else {
+          appendRecord<int>(record, py::castInt<int>(s[i], &ok));
+          CHECK(ok) << "Cannot cast int";
+        }
+      }
+      break;
+    }
+    default:
+      LOG(FATAL) << "Not implemented " << header.slotType;
+  }
+}
+
+/**
+ * Serialize a python sample into a record. calcBatchSize is the
+ * calc_batch_size of the provider, or nullptr.
+ */
+static void writeSample(const std::vector<SlotHeader>& headers,
+                        PyObject* calcBatchSize,
+                        PyObject* sample,
+                        std::string* record) {
+  uint32_t batchSize = 1;
+  if (calcBatchSize) {
+    PyObjectPtr bs(
+        PyObject_CallFunctionObjArgs(calcBatchSize, sample, nullptr));
+    CHECK_PY(bs);
+    bool ok;
+    batchSize = py::castInt<uint32_t>(bs.get(), &ok);
+    CHECK(ok) << "CalcBatchSize must return int or long";
+  }
+  record->clear();
+  appendRecord<uint32_t>(record, batchSize);
+  py::SequenceHelper s(sample);
+  for (size_t i = 0; i < headers.size(); ++i) {
+    writeSlot(headers[i], headers[i].seqType, s[i], record);
+  }
+}
+
+/**
+ * Assemble the arguments of a batch from the records of the worker processes
+ * or of the cache on disk. It is the counterpart of the field scanners, and
+ * needs no python lock.
+ */
+class RecordAssembler {
+public:
+  explicit RecordAssembler(const std::vector<SlotHeader>& headers)
+      : headers_(headers), slots_(headers.size()) {
+    clear();
+  }
+
+  /// The batch size of the sample of a record.
+  static size_t getBatchSize(const char* record) {
+    return readRecord<uint32_t>(&record);
+  }
+
+  /// Add the sample of a record to the batch.
+  void add(const char* record, size_t size) {
+    const char* pos = record + sizeof(uint32_t);
+    for (size_t i = 0; i < headers_.size(); ++i) {
+      pos = readSlot(headers_[i], headers_[i].seqType, pos, &slots_[i]);
+    }
+    CHECK(pos == record + size) << "Broken record";
+  }
+
+  /// Fill the arguments with the added samples, and start a new batch.
+  void finish(std::vector<Argument>* args) {
+    args->resize(headers_.size());
+    for (size_t i = 0; i < headers_.size(); ++i) {
+      const SlotHeader& header = headers_[i];
+      SlotData& slot = slots_[i];
+      Argument& arg = (*args)[i];
+      switch (header.slotType) {
+        case ST_DENSE:
+          Matrix::resizeOrCreate(
+              arg.value, slot.numTimesteps, header.dim, false, false);
+          std::copy(
+              slot.values.begin(), slot.values.end(), arg.value->getData());
+          break;
+        case ST_INDEX:
+          IVector::resizeOrCreate(arg.ids, slot.numTimesteps, false);
+          std::copy(slot.ids.begin(), slot.ids.end(), arg.ids->getData());
+          break;
+        case ST_NON_SPARSE_VALUE:
+        case ST_SPARSE_VALUE: {
+          bool withValue = header.slotType == ST_SPARSE_VALUE;
+          Matrix::resizeOrCreateSparseMatrix(
+              arg.value,
+              slot.numTimesteps,
+              header.dim,
+              slot.ids.size(),
+              withValue ? FLOAT_VALUE : NO_VALUE);
+          auto smat = (CpuSparseMatrix*)(arg.value.get());
+          std::copy(slot.rows.begin(), slot.rows.end(), smat->getRows());
+          std::copy(slot.ids.begin(), slot.ids.end(), smat->getCols());
+          if (withValue) {
+            std::copy(slot.values.begin(), slot.values.end(), smat->getData());
+          }
+          break;
+        }
+        default:
+          LOG(FATAL) << "Not implemented " << header.slotType;
+      }
+      if (header.seqType != SQT_NONE) {
+        copyStarts(slot.seqStarts, &arg.sequenceStartPositions);
+      }
+      if (header.seqType == SQT_SUBSEQ) {
+        copyStarts(slot.subSeqStarts, &arg.subSequenceStartPositions);
+      }
+    }
+    clear();
+  }
+
+private:
+  struct SlotData {
+    size_t numTimesteps;
+    std::vector<real> values;
+    std::vector<int> ids;
+    std::vector<int> rows;
+    std::vector<int> seqStarts;
+    std::vector<int> subSeqStarts;
+  };
+
+  void clear() {
+    for (auto& slot : slots_) {
+      slot.numTimesteps = 0;
+      slot.values.clear();
+      slot.ids.clear();
+      slot.rows.assign(1, 0);
+      slot.seqStarts.assign(1, 0);
+      slot.subSeqStarts.assign(1, 0);
+    }
+  }
+
+  const char* readSlot(const SlotHeader& header,
+                       SeqType seqType,
+                       const char* pos,
+                       SlotData* slot) {
+    if (seqType != SQT_NONE) {
+      uint32_t length = readRecord<uint32_t>(&pos);
+      SeqType innerType = seqType == SQT_SUBSEQ ? SQT_SEQ : SQT_NONE;
+      for (uint32_t i = 0; i < length; ++i) {
+        pos = readSlot(header, innerType, pos, slot);
+      }
+      if (seqType == SQT_SEQ && header.seqType == SQT_SUBSEQ) {
+        slot->subSeqStarts.push_back(slot->numTimesteps);
+      } else {
+        slot->seqStarts.push_back(slot->numTimesteps);
+      }
+      return pos;
+    }
+
+    switch (header.slotType) {
+      case ST_DENSE: {
+        size_t size = slot->values.size();
+        slot->values.resize(size + header.dim);
+        memcpy(&slot->values[size], pos, header.dim * sizeof(real));
+        pos += header.dim * sizeof(real);
+        break;
+      }
+      case ST_INDEX:
+        slot->ids.push_back(readRecord<int>(&pos));
+        break;
+      case ST_NON_SPARSE_VALUE:
+      case ST_SPARSE_VALUE: {
+        uint32_t nnz = readRecord<uint32_t>(&pos);
+        for (uint32_t i = 0; i < nnz; ++i) {
+          slot->ids.push_back(readRecord<int>(&pos));
+          if (header.slotType == ST_SPARSE_VALUE) {
+            slot->values.push_back(readRecord<real>(&pos));
+          }
+        }
+        slot->rows.push_back(slot->ids.size());
+        break;
+      }
+      default:
+        LOG(FATAL) << "Not implemented " << header.slotType;
+    }
+    ++slot->numTimesteps;
+    return pos;
+  }
+
+  static void copyStarts(const std::vector<int>& starts,
+                         ICpuGpuVectorPtr* positions) {
+    ICpuGpuVector::resizeOrCreate(*positions, starts.size(), false);
+    std::copy(
+        starts.begin(), starts.end(), (*positions)->getMutableData(false));
+  }
+
+  const std::vector<SlotHeader>& headers_;
+  std::vector<SlotData> slots_;
 };
 
 /**
@@ -191,6 +593,13 @@ public:
  *
  * Here, we start a thread to read data. It is totally asynchronous for reading
  * data. And it support cache strategies.
+ *
+ * If num_workers of the provider is larger than 0, the generator runs in
+ * num_workers forked processes instead of the loading thread, each of which
+ * reads the files whose index modulo num_workers is its id. The samples are
+ * serialized into shared memory by the workers, and the loading thread moves
+ * them into the data pool. So the mini-batches are assembled without the
+ * python lock, which the data feeding would otherwise contend for.
  */
 class PyDataProvider2 : public DataProvider {
 public:
@@ -294,6 +703,24 @@ private:
       this->calcBatchSize_.reset();
     }
 
+    this->bucketWindow_ = self.getIntAttr<size_t>("bucket_window", &ok);
+    if (!ok) {
+      this->bucketWindow_ = 0;
+    }
+    if (this->bucketWindow_ > 1 && this->calcBatchSize_) {
+      LOG(WARNING) << "bucket_window is ignored with calc_batch_size";
+      this->bucketWindow_ = 0;
+    }
+
+    this->numWorkers_ = self.getIntAttr<size_t>("num_workers", &ok);
+    if (!ok) {
+      this->numWorkers_ = 0;
+    }
+    if (this->numWorkers_ > 0 && this->bucketWindow_ > 1) {
+      LOG(WARNING) << "bucket_window is ignored with num_workers";
+      this->bucketWindow_ = 0;
+    }
+
     generator_.reset(self.getAttr("generator"));
     CHECK(py::isCallable(generator_));
 
@@ -318,8 +745,21 @@ private:
     for (auto& header : headers_) {
       DBG << header;
     }
+    CacheType cacheType = (CacheType)self.getIntAttrWithError<int>("cache");
+    if (this->numWorkers_ > 0 && cacheType == CACHE_PASS_IN_MEM) {
+      LOG(WARNING) << "CACHE_PASS_IN_MEM is ignored with num_workers";
+      cacheType = NO_CACHE;
+    }
+    this->cacheOnDisk_ = cacheType == CACHE_PASS_ON_DISK;
+    if (this->cacheOnDisk_ && this->bucketWindow_ > 1) {
+      LOG(WARNING) << "bucket_window is ignored with CACHE_PASS_ON_DISK";
+      this->bucketWindow_ = 0;
+    }
+    if (this->numWorkers_ > 0 || this->cacheOnDisk_) {
+      assembler_.reset(new RecordAssembler(headers_));
+    }
     cache_.reset(IPyDataProviderCache::create(
-        (CacheType)self.getIntAttrWithError<int>("cache")));
+        cacheType, headers_, calcBatchSize_.get()));
   }
 
   PyObjectPtr loadPyFileLists(const std::string& fileListName) {
@@ -391,7 +831,7 @@ private:
       if (this->loadThread_) {  // wait poolActualSize < poolSize;
         std::unique_lock<std::mutex> l(mtx_);
         pushCV_.wait(l, [this, additionalBatchSize] {
-          return this->poolActualSize_ < poolSize_;
+          return this->poolActualSize_ < poolSize_ || this->exit_;
         });
       }
 
@@ -405,13 +845,164 @@ private:
     DBG << "load thread end";
   }
 
+  /**
+   * Fork the worker processes. The python lock is held while forking, so no
+   * thread of the trainer is running python code. The lock is never released
+   * in a worker, which has only the forking thread, so the worker calls the
+   * python api directly instead of through PyGuard.
+   */
+  void startWorkers() {
+    pid_t parent = getpid();
+    PyGuard g;
+    for (size_t i = 0; i < numWorkers_; ++i) {
+      workers_.emplace_back();
+      Worker& worker = workers_.back();
+      worker.ring.reset(new SharedMemoryRing(kWorkerBufferSize));
+      worker.finished = false;
+      worker.exited = false;
+      unsigned int seed = ThreadLocalRand::rand();
+      worker.pid = fork();
+      CHECK_NE(worker.pid, -1) << "Fail to fork: " << strerror(errno);
+      if (worker.pid == 0) {
+        workerMain(i, seed, parent, worker.ring.get());
+      }
+    }
+    numActiveWorkers_ = numWorkers_;
+  }
+
+  /**
+   * The worker process. It writes the samples of its files into the ring,
+   * and exits without returning.
+   */
+  void workerMain(size_t workerId,
+                  unsigned int seed,
+                  pid_t parent,
+                  SharedMemoryRing* ring) {
+    PyOS_AfterFork();
+    // The workers would draw the same random numbers as the trainer.
+    ThreadLocalRandomEngine::get().seed(seed);
+    PyObjectPtr random(PyImport_ImportModule("random"));
+    CHECK_PY(random) << "Import random error";
+    PyObjectPtr ret(
+        PyObject_CallMethod(random.get(), (char*)"seed", (char*)"I", seed));
+    CHECK_PY(ret) << "random.seed error";
+
+    std::deque<PyObjectPtr> contexts;
+    for (size_t i = workerId; i < fileLists_.size(); i += numWorkers_) {
+      PyObjectPtr filename(PyString_FromString(fileLists_[i].c_str()));
+      contexts.emplace_back(PyObject_CallFunctionObjArgs(
+          generator_.get(), instance_.get(), filename.get(), nullptr));
+      CHECK_PY(contexts.back()) << "Generator error.";
+      CHECK(PyIter_Check(contexts.back()));
+    }
+
+    PositionRandom p(skipShuffle_);
+    std::string record;
+    while (!contexts.empty()) {
+      size_t cid = p(contexts.size());
+      PyObjectPtr data(PyIter_Next(contexts[cid].get()));
+      if (data == nullptr) {
+        CHECK(!PyErr_Occurred()) << "Calling iterator next error"
+                                 << py::getPyCallStack();
+        std::swap(contexts[cid], contexts.front());
+        contexts.pop_front();
+        continue;
+      }
+
+      writeSample(headers_, calcBatchSize_.get(), data.get(), &record);
+
+      while (!ring->tryWrite(record)) {
+        if (getppid() != parent) {  // the trainer has exited.
+          _exit(1);
+        }
+        usleep(kWorkerWaitUs);
+      }
+    }
+    ring->close();
+    _exit(0);
+  }
+
+  void stopWorkers() {
+    for (auto& worker : workers_) {
+      if (!worker.exited) {
+        kill(worker.pid, SIGKILL);
+        waitpid(worker.pid, nullptr, 0);
+      }
+    }
+    workers_.clear();
+    recordPool_.clear();
+  }
+
+  /**
+   * The loading thread of the worker processes. It takes the records from
+   * the workers in turn, and moves them into the record pool.
+   */
+  void loadFromWorkers() {
+    std::string record;
+    size_t numActiveWorkers = workers_.size();
+    while (!exit_ && numActiveWorkers > 0) {
+      bool idle = true;
+      for (auto& worker : workers_) {
+        if (worker.finished) continue;
+        bool closed = worker.ring->isClosed();
+        if (!worker.ring->tryRead(&record)) {
+          if (closed) {
+            worker.finished = true;
+            --numActiveWorkers;
+            {
+              std::lock_guard<std::mutex> guard(mtx_);
+              numActiveWorkers_ = numActiveWorkers;
+            }
+            pullCV_.notify_all();
+          } else if (!worker.exited) {
+            int status;
+            if (waitpid(worker.pid, &status, WNOHANG) == worker.pid) {
+              // The worker may close the ring and exit after isClosed() is
+              // checked. Its remaining records are drained in the next turns.
+              worker.exited = true;
+              CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0)
+                  << "The data provider worker " << worker.pid
+                  << " exited unexpectedly with status " << status;
+              CHECK(worker.ring->isClosed())
+                  << "The data provider worker " << worker.pid
+                  << " exited without closing its ring";
+            }
+          }
+          continue;
+        }
+        idle = false;
+
+        size_t additionalBatchSize =
+            RecordAssembler::getBatchSize(record.data());
+        {
+          std::unique_lock<std::mutex> l(mtx_);
+          pushCV_.wait(l, [this] {
+            return this->poolActualSize_ < poolSize_ || this->exit_;
+          });
+          poolActualSize_ += additionalBatchSize;
+          recordPool_.emplace_back(std::move(record));
+        }
+        pullCV_.notify_all();
+      }
+      if (idle) {
+        usleep(kWorkerWaitUs);
+      }
+    }
+    DBG << "load thread of workers end";
+  }
+
   inline void resetImpl(bool startNewThread) {
     DBG << "Reseting " << startNewThread;
-    exit_.store(true);
+    {
+      std::lock_guard<std::mutex> guard(mtx_);
+      exit_.store(true);
+    }
+    pushCV_.notify_all();
     if (loadThread_) {  // is loading.
       loadThread_->join();
       loadThread_.reset();
     }
+    stopWorkers();
     {
       PyGuard g;
       callingContexts_.clear();
@@ -422,16 +1013,38 @@ private:
     {
       PyGuard g;
       dataPool_.clear();
+      buckets_.clear();
     }
     poolActualSize_ = 0;
+    numActiveWorkers_ = 0;
+    bucketStats_ = BucketStats();
 
+    recordOrder_.clear();
+    nextRecord_ = 0;
     if (startNewThread && cache_->reset()) {
-      DBG << "Start new thread.";
-      loadThread_.reset(new std::thread([this] {
-        exit_ = false;
-        loadThread();
-      }));
-      callingContextCreated_.wait();
+      if (numWorkers_ > 0) {
+        DBG << "Start workers.";
+        startWorkers();
+        loadThread_.reset(new std::thread([this] {
+          exit_ = false;
+          loadFromWorkers();
+        }));
+      } else {
+        DBG << "Start new thread.";
+        loadThread_.reset(new std::thread([this] {
+          exit_ = false;
+          loadThread();
+        }));
+        callingContextCreated_.wait();
+      }
+    } else if (startNewThread && cacheOnDisk_) {
+      recordOrder_.resize(cache_->getNumRecords());
+      std::iota(recordOrder_.begin(), recordOrder_.end(), 0);
+      if (!skipShuffle_) {
+        std::shuffle(recordOrder_.begin(),
+                     recordOrder_.end(),
+                     ThreadLocalRandomEngine::get());
+      }
     }
     DBG << "Reset done";
     exit_ = false;
@@ -458,10 +1071,47 @@ private:
   bool canOverBatchSize_;
   PyObjectPtr calcBatchSize_;
   PyObjectPtr generator_;
+
+  // The worker processes, see startWorkers().
+  struct Worker {
+    pid_t pid;
+    std::unique_ptr<SharedMemoryRing> ring;
+    bool finished;
+    bool exited;  // reaped by waitpid() in loadFromWorkers()
+  };
+  size_t numWorkers_;
+  std::vector<Worker> workers_;
+  size_t numActiveWorkers_;  // guarded by mtx_
+  std::deque<std::string> recordPool_;
+  std::unique_ptr<RecordAssembler> assembler_;
+
+  // The shuffled indices of the records of CACHE_PASS_ON_DISK.
+  bool cacheOnDisk_;
+  std::vector<size_t> recordOrder_;
+  size_t nextRecord_;
+
+  // The mini-batches of similar lengths, see fillBuckets().
+  size_t bucketWindow_;
+  std::deque<std::deque<PyObjectPtr>> buckets_;
+  struct BucketStats {
+    size_t numBatches = 0;
+    size_t numTokens = 0;
+    size_t paddedTokens = 0;          // batch size * max length of the batch
+    size_t unsortedPaddedTokens = 0;  // the same without bucketing
+  };
+  BucketStats bucketStats_;
   std::vector<std::string> fileLists_;
   std::vector<SlotHeader> headers_;
   static PyObjectPtr zeroTuple_;
 
+  // The CPU batch and the field scanners reused by a loading thread, so that
+  // the storage of the slots is only reallocated when a batch outgrows it.
+  struct BatchStorage {
+    DataBatch cpuBatch;
+    std::vector<std::unique_ptr<IFieldScanner>> scanners;
+  };
+  ThreadLocalD<BatchStorage> storage_;
+
   class PositionRandom {
   public:
     inline explicit PositionRandom(bool skipRand)
@@ -484,12 +1134,99 @@ private:
     bool skipRand_;
   };
 
+  /**
+   * The number of the time steps of a sample, which is the length of its
+   * longest sequence slot. It should be called with the python lock held.
+   */
+  size_t getSampleLength(const PyObjectPtr& sample) {
+    py::SequenceHelper s(sample);
+    size_t length = 1;
+    for (size_t i = 0; i < headers_.size(); ++i) {
+      size_t slotLength = 0;
+      if (headers_[i].seqType == SQT_SEQ) {
+        slotLength = PySequence_Size(s[i]);
+      } else if (headers_[i].seqType == SQT_SUBSEQ) {
+        py::SequenceHelper subSeqs(s[i]);
+        for (size_t j = 0; j < subSeqs.size(); ++j) {
+          slotLength += PySequence_Size(subSeqs[j]);
+        }
+      }
+      length = std::max(length, slotLength);
+    }
+    return length;
+  }
+
+  /**
+   * Sort the samples of a window by length, and split them into mini-batches
+   * of batchSize samples. So the sequences of a mini-batch have similar
+   * lengths, and the mini-batches computed step by step (SequenceToBatch)
+   * do not shrink to tiny batches in the tail. The mini-batches are returned
+   * in random order if shuffling.
+   */
+  void fillBuckets(size_t batchSize, std::deque<PyObjectPtr>* window) {
+    std::vector<std::pair<size_t, size_t>> lengths;  // (length, index)
+    lengths.reserve(window->size());
+    {
+      PyGuard g;
+      for (size_t i = 0; i < window->size(); ++i) {
+        lengths.emplace_back(getSampleLength((*window)[i]), i);
+      }
+    }
+
+    auto paddedTokens = [&lengths, batchSize]() {
+      size_t padded = 0;
+      for (size_t begin = 0; begin < lengths.size(); begin += batchSize) {
+        size_t end = std::min(begin + batchSize, lengths.size());
+        size_t maxLength = 0;
+        for (size_t i = begin; i < end; ++i) {
+          maxLength = std::max(maxLength, lengths[i].first);
+        }
+        padded += maxLength * (end - begin);
+      }
+      return padded;
+    };
+    bucketStats_.unsortedPaddedTokens += paddedTokens();
+    std::stable_sort(lengths.begin(), lengths.end());
+    bucketStats_.paddedTokens += paddedTokens();
+
+    std::deque<std::deque<PyObjectPtr>> buckets;
+    for (size_t begin = 0; begin < lengths.size(); begin += batchSize) {
+      size_t end = std::min(begin + batchSize, lengths.size());
+      buckets.emplace_back();
+      for (size_t i = begin; i < end; ++i) {
+        buckets.back().emplace_back(std::move((*window)[lengths[i].second]));
+        bucketStats_.numTokens += lengths[i].first;
+      }
+    }
+    window->clear();
+    bucketStats_.numBatches += buckets.size();
+    if (!skipShuffle_) {
+      std::shuffle(
+          buckets.begin(), buckets.end(), ThreadLocalRandomEngine::get());
+    }
+    for (auto& bucket : buckets) {
+      buckets_.emplace_back(std::move(bucket));
+    }
+  }
+
+  void logBucketStats() {
+    if (bucketStats_.numBatches == 0) return;
+    LOG(INFO) << "Length bucketing: " << bucketStats_.numBatches
+              << " batches, efficiency (tokens / padded tokens) "
+              << (double)bucketStats_.numTokens / bucketStats_.paddedTokens
+              << ", without bucketing "
+              << (double)bucketStats_.numTokens /
+                     bucketStats_.unsortedPaddedTokens;
+    bucketStats_ = BucketStats();
+  }
+
   // DataProvider interface
 public:
   /**
    * Resetting the PyDataProvider. May start reading thread here.
    */
   virtual void reset() {
+    stopAsyncLoad();
     resetImpl(true);
     DataProvider::reset();
   }
@@ -513,12 +1250,32 @@ public:
     REGISTER_TIMER("PyDP2.getNextBatchInternal")
     CHECK_GE(size_, 0);
     size_t size = (size_t)size_;
-    if (loadThread_) {  // loading from thread should wait for data pool ready.
-                        // but, loading from cache, cache object should ensure
-                        // data pool ready.
+    size_t batchSize = std::max(size, (size_t)1);
+    if (!loadThread_ && cacheOnDisk_) {
+      return getNextBatchFromRecords(size, batch);
+    }
+    if (numWorkers_ > 0) {
+      return getNextBatchFromWorkers(size, batch);
+    }
+    // With length bucketing, a window of bucketWindow_ mini-batches is taken
+    // from the pool when the buckets of the previous window are used up.
+    bool bucketing = bucketWindow_ > 1;
+    bool takeFromPool = !bucketing || buckets_.empty();
+    if (bucketing && takeFromPool) {
+      size *= bucketWindow_;
+    }
+    if (loadThread_ && takeFromPool) {
+      // loading from thread should wait for data pool ready.
+      // but, loading from cache, cache object should ensure
+      // data pool ready.
+      // The loading thread stops filling at poolSize_, so a window of
+      // bucketWindow_ mini-batches larger than the pool waits for a full
+      // pool only.
       std::unique_lock<std::mutex> l(mtx_);
-      pullCV_.wait(l, [this, &size] {
-        return this->poolActualSize_ >= std::max(size, this->minPoolSize_) ||
+      size_t waitSize = std::min(size, this->poolSize_);
+      pullCV_.wait(l, [this, &waitSize] {
+        return this->poolActualSize_ >=
+                   std::max(waitSize, this->minPoolSize_) ||
                callingContexts_.empty();
       });
 
@@ -543,7 +1300,7 @@ public:
 
     std::deque<PyObjectPtr>& pool = *poolPtr;
 
-    while (bsize < size && !pool.empty()) {
+    while (takeFromPool && bsize < size && !pool.empty()) {
       {
         // move data from pool to data
         std::lock_guard<std::mutex> guard(mtx_);
@@ -587,7 +1344,7 @@ public:
       }
     }
 
-    if (this->loadThread_) {
+    if (this->loadThread_ && takeFromPool) {
       {
         std::lock_guard<std::mutex> g(mtx_);
         poolActualSize_ -= bsize;
@@ -595,20 +1352,38 @@ public:
       this->pushCV_.notify_all();
     }
 
+    if (bucketing) {
+      if (takeFromPool) {
+        fillBuckets(batchSize, &data);
+      }
+      bsize = 0;
+      if (!buckets_.empty()) {
+        data = std::move(buckets_.front());
+        buckets_.pop_front();
+        bsize = data.size();
+      }
+    }
+
     if (bsize == 0) {  // end of pass. In data pool, cannot get any data.
+      logBucketStats();
+      if (this->loadThread_) {
+        cache_->finishPass();
+      }
       return 0;
     }
 
-    DataBatch cpuBatch;
+    BatchStorage& storage = *storage_;
+    DataBatch& cpuBatch = storage.cpuBatch;
     cpuBatch.setSize(bsize);
     auto& inArgs = cpuBatch.getStreams();
     inArgs.resize(headers_.size());
-    std::vector<std::unique_ptr<IFieldScanner>> scanners;
-    scanners.reserve(headers_.size());
-    for (auto& header : headers_) {
-      scanners.emplace_back(IFieldScanner::create(&header));
+    auto& scanners = storage.scanners;
+    if (scanners.empty()) {
+      for (auto& header : headers_) {
+        scanners.emplace_back(IFieldScanner::create(&header));
+      }
+      DBG << "Scanner created.";
     }
-    DBG << "Scanner created.";
     for (size_t i = 0; i < headers_.size(); ++i) {
       scanners[i]->startPrepare(inArgs[i]);
     }
@@ -642,12 +1417,105 @@ public:
 
     DBG << "Reading CPU Batch Done.";
 
+    outputBatch(cpuBatch, batch);
+    return bsize;
+  }
+
+private:
+  /**
+   * Loading a batch of data from the record pool of the worker processes.
+   */
+  int64_t getNextBatchFromWorkers(size_t size, DataBatch* batch) {
+    {
+      std::unique_lock<std::mutex> l(mtx_);
+      pullCV_.wait(l, [this, &size] {
+        return this->poolActualSize_ >= std::max(size, this->minPoolSize_) ||
+               this->numActiveWorkers_ == 0;
+      });
+
+      if (unittest::OnPoolFilled) {
+        (*unittest::OnPoolFilled)(this->poolActualSize_);
+      }
+    }
+    if (exit_) {
+      // PyDataProvider is destructing.
+      return 0;
+    }
+
+    std::vector<std::string> records;
+    size_t bsize = 0;
+    {
+      std::lock_guard<std::mutex> guard(mtx_);
+      while (bsize < size && !recordPool_.empty()) {
+        if (!skipShuffle_) {
+          size_t i = ThreadLocalRand::rand() % recordPool_.size();
+          std::swap(recordPool_[i], recordPool_.front());
+        }
+        size_t tmp = RecordAssembler::getBatchSize(recordPool_.front().data());
+        if (calcBatchSize_ && bsize + tmp > size && !canOverBatchSize_) {
+          break;
+        }
+        bsize += tmp;
+        records.emplace_back(std::move(recordPool_.front()));
+        recordPool_.pop_front();
+      }
+      poolActualSize_ -= bsize;
+    }
+    this->pushCV_.notify_all();
+
+    if (bsize == 0) {  // end of pass.
+      cache_->finishPass();
+      return 0;
+    }
+
+    DataBatch& cpuBatch = storage_.get()->cpuBatch;
+    cpuBatch.setSize(bsize);
+    for (auto& record : records) {
+      assembler_->add(record.data(), record.size());
+    }
+    assembler_->finish(&cpuBatch.getStreams());
+    cache_->dropRecords(records);
+    outputBatch(cpuBatch, batch);
+    return bsize;
+  }
+
+  /**
+   * Loading a batch of data from the records of CACHE_PASS_ON_DISK.
+   */
+  int64_t getNextBatchFromRecords(size_t size, DataBatch* batch) {
+    size_t bsize = 0;
+    for (; bsize < size && nextRecord_ < recordOrder_.size(); ++nextRecord_) {
+      size_t recordSize;
+      const char* record =
+          cache_->getRecord(recordOrder_[nextRecord_], &recordSize);
+      size_t tmp = RecordAssembler::getBatchSize(record);
+      if (calcBatchSize_ && bsize + tmp > size && !canOverBatchSize_) {
+        break;
+      }
+      bsize += tmp;
+      assembler_->add(record, recordSize);
+    }
+    if (bsize == 0) {  // end of pass.
+      return 0;
+    }
+
+    DataBatch& cpuBatch = storage_.get()->cpuBatch;
+    cpuBatch.setSize(bsize);
+    assembler_->finish(&cpuBatch.getStreams());
+    outputBatch(cpuBatch, batch);
+    return bsize;
+  }
+
+  /**
+   * Copy the batch read on CPU to batch, which is on GPU if useGpu_.
+   */
+  void outputBatch(DataBatch& cpuBatch, DataBatch* batch) {
     if (useGpu_) {
       std::vector<Argument>& cpuArguments = cpuBatch.getStreams();
       DataBatch& gpuBatch = *batch;
       std::vector<Argument>& gpuArguments = gpuBatch.getStreams();
       gpuArguments.resize(cpuArguments.size());
-      gpuBatch.setSize(bsize);
+      gpuBatch.setSize(cpuBatch.getSize());
       for (size_t i = 0; i < headers_.size(); ++i) {
         gpuArguments[i].resizeAndCopyFrom(
             cpuArguments[i], useGpu_, HPPL_STREAM_1);
@@ -656,7 +1524,6 @@ public:
     } else {
       *batch = cpuBatch;
     }
-    return bsize;
   }
 };
 
@@ -671,6 +1538,8 @@ class DenseScanner : public IFieldScanner {
 public:
   explicit DenseScanner(SlotHeader* ptr) : IFieldScanner(ptr), height_(0) {}
 
+  virtual void startPrepare(Argument& argument) { height_ = 0; }
+
   /**
    * Prepare.
    * @param argument target argument
@@ -721,6 +1590,8 @@ class IndexScanner : public IFieldScanner {
 public:
   explicit IndexScanner(SlotHeader* ptr) : IFieldScanner(ptr), cnt_(0) {}
 
+  virtual void startPrepare(Argument& argument) { cnt_ = 0; }
+
   /**
    * Prepare memory space.
    *
@@ -751,6 +1622,11 @@ public:
   explicit SparseNonValueScanner(SlotHeader* ptr)
       : IFieldScanner(ptr), nnz_(0), height_(0) {}
 
+  virtual void startPrepare(Argument& argument) {
+    nnz_ = 0;
+    height_ = 0;
+  }
+
   /**
    * Prepare memory space
    * @note obj is a timestep of one sample.
@@ -851,6 +1727,7 @@ public:
    * Start prepare. Invoke inner->startPrepare too.
    */
   virtual void startPrepare(Argument& argument) {
+    cnt_ = 0;
     inner_->startPrepare(argument);
   }
 
@@ -1018,12 +1895,142 @@ private:
   std::unique_ptr<std::deque<PyObjectPtr>> droppedPool_;
 };
 
-IPyDataProviderCache* IPyDataProviderCache::create(CacheType ct) {
+/**
+ * Cache One Pass On Disk strategy.
+ *
+ * In first pass, will load data from python and serialize them into an
+ * unlinked temporary file in $TMPDIR, in the record format of the worker
+ * processes. The rest passes, will load data from the mapped file without
+ * python.
+ */
+class CacheOnePassOnDisk : public IPyDataProviderCache {
+public:
+  CacheOnePassOnDisk(const std::vector<SlotHeader>& headers,
+                     PyObject* calcBatchSize)
+      : headers_(headers),
+        calcBatchSize_(calcBatchSize),
+        fd_(-1),
+        fileSize_(0),
+        mapped_(nullptr),
+        finished_(false) {
+    const char* dir = getenv("TMPDIR");
+    std::string path = std::string(dir ? dir : "/tmp") + "/pydp2_cache.XXXXXX";
+    fd_ = mkstemp(&path[0]);
+    CHECK_NE(fd_, -1) << "Fail to create " << path << ": " << strerror(errno);
+    // The file is removed when it is closed.
+    unlink(path.c_str());
+    LOG(INFO) << "Cache the data of PyDataProvider2 in " << path;
+  }
+
+  virtual ~CacheOnePassOnDisk() {
+    unmap();
+    close(fd_);
+  }
+
+  virtual bool reset() {
+    if (finished_) {
+      return false;
+    }
+    // The first pass, or it is reset before the end of the first pass.
+    unmap();
+    CHECK_EQ(ftruncate(fd_, 0), 0) << strerror(errno);
+    CHECK_EQ(lseek(fd_, 0, SEEK_SET), 0) << strerror(errno);
+    fileSize_ = 0;
+    buffer_.clear();
+    offsets_.assign(1, 0);
+    return true;
+  }
+
+  virtual void drop(std::deque<PyObjectPtr>* data) {
+    std::string record;
+    for (auto& sample : *data) {
+      writeSample(headers_, calcBatchSize_, sample.get(), &record);
+      append(record);
+    }
+    data->clear();
+  }
+
+  virtual void dropRecords(const std::vector<std::string>& records) {
+    for (auto& record : records) {
+      append(record);
+    }
+  }
+
+  virtual void finishPass() {
+    if (finished_) return;
+    flush();
+    if (fileSize_ > 0) {
+      void* addr = mmap(nullptr, fileSize_, PROT_READ, MAP_SHARED, fd_, 0);
+      CHECK(addr != MAP_FAILED) << "Fail to map the cache: " << strerror(errno);
+      mapped_ = reinterpret_cast<const char*>(addr);
+    }
+    finished_ = true;
+    LOG(INFO) << "Cached " << getNumRecords() << " samples of "
+              << fileSize_ / (1 << 20) << " MB";
+  }
+
+  virtual std::deque<PyObjectPtr>* load() { return nullptr; }
+
+  virtual size_t getNumRecords() { return offsets_.size() - 1; }
+
+  virtual const char* getRecord(size_t i, size_t* size) {
+    *size = offsets_[i + 1] - offsets_[i];
+    return mapped_ + offsets_[i];
+  }
+
+private:
+  /// The size of the buffer of the writes to the file.
+  static const size_t kBufferSize = 4UL << 20;
+
+  void append(const std::string& record) {
+    buffer_.append(record);
+    offsets_.push_back(offsets_.back() + record.size());
+    if (buffer_.size() >= kBufferSize) {
+      flush();
+    }
+  }
+
+  void flush() {
+    const char* data = buffer_.data();
+    size_t size = buffer_.size();
+    while (size > 0) {
+      ssize_t written = write(fd_, data, size);
+      CHECK_GT(written, 0) << "Fail to write the cache: " << strerror(errno);
+      data += written;
+      size -= written;
+    }
+    fileSize_ += buffer_.size();
+    buffer_.clear();
+  }
+
+  void unmap() {
+    if (mapped_) {
+      munmap(const_cast<char*>(mapped_), fileSize_);
+      mapped_ = nullptr;
+    }
+  }
+
+  const std::vector<SlotHeader>& headers_;
+  PyObject* calcBatchSize_;
+  int fd_;
+  size_t fileSize_;
+  const char* mapped_;
+  bool finished_;
+  std::string buffer_;
+  std::vector<uint64_t> offsets_;
+};
+
+IPyDataProviderCache* IPyDataProviderCache::create(
+    CacheType ct,
+    const std::vector<SlotHeader>& headers,
+    PyObject* calcBatchSize) {
   switch (ct) {
     case NO_CACHE:
       return new NoCacheStrategy();
     case CACHE_PASS_IN_MEM:
       return new CacheOnePassInMemory();
+    case CACHE_PASS_ON_DISK:
+      return new CacheOnePassOnDisk(headers, calcBatchSize);
     default:
       LOG(FATAL) << "Not implemented";
   }
@@ -0,0 +1,196 @@
+/* Copyright (c) 2016 PaddlePaddle Authors. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "RecordIO.h"
+
+#include <string.h>
+#include <zlib.h>
+#include <algorithm>
+#include "paddle/utils/Logging.h"
+
+namespace paddle {
+
+static const uint32_t kMagicNumber = 0x01020304;
+static const size_t kHeaderSize = 20;
+/// gzip format for deflateInit2 and inflateInit2
+static const int kGzipWindowBits = 15 + 16;
+
+static void appendUint32(uint32_t v, std::string* s) {
+  for (int i = 0; i < 4; ++i) {
+    s->push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+  }
+}
+
+static uint32_t decodeUint32(const char* p) {
+  const unsigned char* q = reinterpret_cast<const unsigned char*>(p);
+  return q[0] | (q[1] << 8) | (q[2] << 16) | ((uint32_t)q[3] << 24);
+}
+
+static void gzipCompress(const std::string& src, std::string* dest) {
+  z_stream zs;
+  memset(&zs, 0, sizeof(zs));
+  CHECK_EQ(Z_OK,
+           deflateInit2(&zs,
+                        Z_DEFAULT_COMPRESSION,
+                        Z_DEFLATED,
+                        kGzipWindowBits,
+                        8,
+                        Z_DEFAULT_STRATEGY));
+  dest->resize(deflateBound(&zs, src.size()));
+  zs.next_in = (Bytef*)src.data();
+  zs.avail_in = src.size();
+  zs.next_out = (Bytef*)&(*dest)[0];
+  zs.avail_out = dest->size();
+  CHECK_EQ(Z_STREAM_END, deflate(&zs, Z_FINISH));
+  dest->resize(zs.total_out);
+  deflateEnd(&zs);
+}
+
+static void gzipDecompress(const std::string& src, std::string* dest) {
+  CHECK_GE(src.size(), 4UL) << "Invalid gzip data";
+  z_stream zs;
+  memset(&zs, 0, sizeof(zs));
+  CHECK_EQ(Z_OK, inflateInit2(&zs, kGzipWindowBits));
+  // The last 4 bytes of gzip data are the uncompressed size modulo 2^32.
+  dest->resize(
+      std::max<size_t>(decodeUint32(src.data() + src.size() - 4), 1UL));
+  zs.next_in = (Bytef*)src.data();
+  zs.avail_in = src.size();
+  int ret;
+  do {
+    if (zs.total_out == dest->size()) {
+      dest->resize(dest->size() * 2);
+    }
+    zs.next_out = (Bytef*)&(*dest)[zs.total_out];
+    zs.avail_out = dest->size() - zs.total_out;
+    ret = inflate(&zs, Z_NO_FLUSH);
+    CHECK(ret == Z_OK || ret == Z_STREAM_END) << "Corrupted gzip data";
+  } while (ret != Z_STREAM_END);
+  dest->resize(zs.total_out);
+  inflateEnd(&zs);
+}
+
+RecordIOWriter::RecordIOWriter(std::ostream* s,
+                               RecordIOCompressor compressor,
+                               size_t maxChunkSize)
+    : s_(s),
+      compressor_(compressor),
+      maxChunkSize_(maxChunkSize),
+      numRecords_(0) {
+  CHECK(s) << "ostream pointer is nullptr";
+  CHECK(compressor == RECORDIO_NO_COMPRESSION || compressor == RECORDIO_GZIP)
+      << "Unsupported compressor " << compressor;
+}
+
+void RecordIOWriter::write(const std::string& record) {
+  appendUint32(record.size(), &chunk_);
+  chunk_.append(record);
+  ++numRecords_;
+  if (chunk_.size() >= maxChunkSize_) {
+    flush();
+  }
+}
+
+void RecordIOWriter::flush() {
+  if (numRecords_ == 0) return;
+  std::string compressed;
+  const std::string* data = &chunk_;
+  if (compressor_ == RECORDIO_GZIP) {
+    gzipCompress(chunk_, &compressed);
+    data = &compressed;
+  }
+  std::string header;
+  appendUint32(kMagicNumber, &header);
+  appendUint32(numRecords_, &header);
+  appendUint32(crc32(0, (const Bytef*)data->data(), data->size()), &header);
+  appendUint32(compressor_, &header);
+  appendUint32(data->size(), &header);
+  s_->write(header.data(), header.size());
+  s_->write(data->data(), data->size());
+  CHECK(*s_) << "Fail to write chunk";
+  chunk_.clear();
+  numRecords_ = 0;
+}
+
+/// read the header at offset, and return false at the end of the file
+static bool readHeader(std::istream& s,
+                       int64_t offset,
+                       RecordIOChunk* chunk,
+                       uint32_t* compressedSize) {
+  s.clear();
+  s.seekg(offset);
+  char buf[kHeaderSize];
+  s.read(buf, kHeaderSize);
+  if (s.gcount() == 0 && s.eof()) return false;
+  CHECK_EQ(static_cast<size_t>(s.gcount()), kHeaderSize)
+      << "Truncated chunk header at " << offset;
+  CHECK_EQ(kMagicNumber, decodeUint32(buf)) << "Invalid chunk at " << offset;
+  chunk->numRecords = decodeUint32(buf + 4);
+  chunk->checksum = decodeUint32(buf + 8);
+  chunk->compressor = decodeUint32(buf + 12);
+  *compressedSize = decodeUint32(buf + 16);
+  return true;
+}
+
+void loadRecordIOIndex(std::istream& s,
+                       std::vector<RecordIOChunkIndex>* index) {
+  index->clear();
+  int64_t offset = 0;
+  RecordIOChunk chunk;
+  uint32_t compressedSize;
+  while (readHeader(s, offset, &chunk, &compressedSize)) {
+    index->push_back({offset, chunk.numRecords});
+    offset += kHeaderSize + compressedSize;
+  }
+}
+
+void readRecordIOChunk(std::istream& s, int64_t offset, RecordIOChunk* chunk) {
+  uint32_t compressedSize;
+  CHECK(readHeader(s, offset, chunk, &compressedSize))
+      << "No chunk at " << offset;
+  chunk->data.resize(compressedSize);
+  s.read(&chunk->data[0], compressedSize);
+  CHECK_EQ(static_cast<uint32_t>(s.gcount()), compressedSize)
+      << "Truncated chunk at " << offset;
+}
+
+void parseRecordIOChunk(const RecordIOChunk& chunk,
+                        std::vector<std::string>* records) {
+  const std::string& compressed = chunk.data;
+  CHECK_EQ(chunk.checksum,
+           crc32(0, (const Bytef*)compressed.data(), compressed.size()))
+      << "Checksum mismatch";
+  std::string decompressed;
+  const std::string* data = &compressed;
+  if (chunk.compressor == RECORDIO_GZIP) {
+    gzipDecompress(compressed, &decompressed);
+    data = &decompressed;
+  } else {
+    CHECK_EQ(chunk.compressor, (uint32_t)RECORDIO_NO_COMPRESSION)
+        << "Unsupported compressor " << chunk.compressor;
+  }
+
+  records->resize(chunk.numRecords);
+  size_t pos = 0;
+  for (auto& record : *records) {
+    CHECK_LE(pos + 4, data->size()) << "Truncated records";
+    size_t size = decodeUint32(data->data() + pos);
+    pos += 4;
+    CHECK_LE(pos + size, data->size()) << "Truncated records";
+    record.assign(*data, pos, size);
+    pos += size;
+  }
+}
+
+}  // namespace paddle
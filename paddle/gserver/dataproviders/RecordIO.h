@@ -0,0 +1,104 @@
+/* Copyright (c) 2016 PaddlePaddle Authors. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#pragma once
+
+#include <stdint.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace paddle {
+
+/**
+ * A RecordIO file is a sequence of chunks of records. A chunk is
+ *
+ *    magic number, number of records, checksum, compressor, compressed size
+ *
+ *    compressed data
+ *
+ * where the header fields are little-endian uint32, and the data are the
+ * records each prefixed with its length as a little-endian uint32. The
+ * checksum is the CRC32 of the compressed data. It is the chunk format of the
+ * recordio package used by go/master, so the chunks of a file can be
+ * dispatched as tasks to many trainers, and be read independently.
+ */
+enum RecordIOCompressor {
+  RECORDIO_NO_COMPRESSION = 0,
+  RECORDIO_SNAPPY = 1,  // not supported
+  RECORDIO_GZIP = 2,
+};
+
+struct RecordIOChunkIndex {
+  /// the offset of the chunk header in the file
+  int64_t offset;
+  uint32_t numRecords;
+};
+
+/**
+ * @brief A chunk read from a file, whose data are not checked and
+ *        decompressed yet.
+ */
+struct RecordIOChunk {
+  uint32_t checksum;
+  uint32_t compressor;
+  uint32_t numRecords;
+  std::string data;
+};
+
+/**
+ * @brief Write records to a RecordIO file. A chunk is written when its
+ *        records reach maxChunkSize bytes, or when flush() is called.
+ */
+class RecordIOWriter {
+public:
+  explicit RecordIOWriter(std::ostream* s,
+                          RecordIOCompressor compressor = RECORDIO_GZIP,
+                          size_t maxChunkSize = 1 << 20);
+
+  ~RecordIOWriter() { flush(); }
+
+  void write(const std::string& record);
+
+  /// write the records not written yet as a chunk
+  void flush();
+
+protected:
+  std::ostream* s_;
+  RecordIOCompressor compressor_;
+  size_t maxChunkSize_;
+  /// the uncompressed data of the current chunk
+  std::string chunk_;
+  uint32_t numRecords_;
+};
+
+/**
+ * @brief Get the index of the chunks of a RecordIO file by going through the
+ *        chunk headers, without reading the data.
+ */
+void loadRecordIOIndex(std::istream& s, std::vector<RecordIOChunkIndex>* index);
+
+/**
+ * @brief Read the chunk starting at offset.
+ */
+void readRecordIOChunk(std::istream& s, int64_t offset, RecordIOChunk* chunk);
+
+/**
+ * @brief Check the checksum of a chunk, and decompress it into records.
+ *        It is thread-safe, so the chunks can be parsed in parallel.
+ */
+void parseRecordIOChunk(const RecordIOChunk& chunk,
+                        std::vector<std::string>* records);
+
+}  // namespace paddle
@@ -74,11 +74,13 @@ void MultiNetwork::forward(const std::vector<Argument>& inArgs,
   CHECK_EQ(argumentGroups.size(), subNetworks_.size());
   std::vector<Argument> tempOutArgs;
   outArgs->clear();
+  skipped_.assign(subNetworks_.size(), false);
 
   for (size_t i = 0; i < subNetworks_.size(); i++) {
     tempOutArgs.clear();
     if (argumentGroups[i].size() == 1 && argumentGroups[i][0].dataId == -1) {
       // check input args: if dataId is -1, then skip this sub network
+      skipped_[i] = true;
       continue;
     }
     subNetworks_[i]->forward(argumentGroups[i], &tempOutArgs, passType);
@@ -91,6 +93,7 @@ void MultiNetwork::forward(const std::vector<Argument>& inArgs,
 
 void MultiNetwork::backward(const UpdateCallback& callback) {
   for (size_t i = 0; i < subNetworks_.size(); i++) {
+    if (isSubNetworkSkipped(i)) continue;
     subNetworks_[i]->backward(callback);
   }
 }
@@ -145,6 +148,7 @@ public:
     int size = evaluators_.size();
     for (int i = 0; i < size; i++) {
       // one evaluator for one subNetwork
+      if (multiNetwork.isSubNetworkSkipped(i)) continue;
       evaluators_[i]->eval(*multiNetwork.getSubNetworks()[i]);
     }
   }
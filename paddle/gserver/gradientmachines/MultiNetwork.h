@@ -54,11 +54,18 @@ public:
     return subNetworks_;
   }
 
+  /// Whether the sub network had no input in the last forward
+  bool isSubNetworkSkipped(size_t i) const {
+    return i < skipped_.size() && skipped_[i];
+  }
+
   virtual void start();
 
   virtual void finish();
 
 protected:
   std::vector<std::unique_ptr<NeuralNetwork>> subNetworks_;
+  /// the sub networks skipped in the last forward, which are not backwarded
+  std::vector<bool> skipped_;
 };
 }  // namespace paddle
@@ -18,6 +18,7 @@ limitations under the License. */
 #include <cmath>
 #include <functional>
 #include <limits>
+#include <set>
 #include "NeuralNetwork.h"
 #include "paddle/gserver/layers/AgentLayer.h"
 #include "paddle/utils/Flags.h"
@@ -25,6 +26,16 @@ limitations under the License. */
 #include "paddle/utils/Util.h"
 
 DEFINE_string(diy_beam_search_prob_so, "", "the diy beam search cost so");
+DEFINE_int32(rnn_checkpoint_interval,
+             0,
+             "If positive, a recurrent layer group in training only keeps "
+             "the memories of every n-th frame, and recomputes the other "
+             "frames segment by segment in backward.");
+DEFINE_double(rnn_memory_budget_mb,
+              0,
+              "If positive and rnn_checkpoint_interval is not set, a "
+              "recurrent layer group chooses the checkpoint interval of "
+              "each batch to fit its frames into this many megabytes.");
 
 static const char* DIY_CALC_PROB_SYMBOL_NAME = "calc_prob";
 static const char* DIY_START_CALC_PROB_SYMBOL_NAME = "start_calc_prob";
@@ -129,6 +140,9 @@ RecurrentGradientMachine::RecurrentGradientMachine(
     const std::string& subModelName, NeuralNetwork* rootNetwork)
     : NeuralNetwork(subModelName),
       rootNetwork_(rootNetwork),
+      checkpointable_(false),
+      checkpointInterval_(0),
+      passType_(PASS_TRAIN),
       beamSearchCtrlCallbacks_(nullptr),
       beamSearchStatistics_(nullptr) {
   CHECK(!subModelName_.empty());
@@ -210,6 +224,24 @@ void RecurrentGradientMachine::init(
   reversed_ = subModelConfig->reversed();
   generating_ = subModelConfig->has_generator();
 
+  // A recomputed frame must give the same outputs as the first forward,
+  // which is not the case for the layers sampling in every forward: the
+  // dropout, sampling_id, and nce with its sampled negative labels. The
+  // batch norm updates its moving statistics in every forward. The
+  // evaluators of the group read the outputs of every frame.
+  checkpointable_ =
+      !generating_ && subModelConfig->evaluator_names_size() == 0;
+  std::set<std::string> layerNames(subModelConfig->layer_names().begin(),
+                                   subModelConfig->layer_names().end());
+  for (auto& layerConfig : config.layers()) {
+    if (!layerNames.count(layerConfig.name())) continue;
+    const std::string& type = layerConfig.type();
+    if (layerConfig.drop_rate() > 0 || type == "sampling_id" ||
+        type == "nce" || type.find("batch_norm") != std::string::npos) {
+      checkpointable_ = false;
+    }
+  }
+
   inFrameLines_.resize(subModelConfig->in_links_size());
   for (size_t i = 0; i < inFrameLines_.size(); ++i) {
     inFrameLines_[i].linkName = subModelConfig->in_links(i).link_name();
@@ -553,23 +585,169 @@ void RecurrentGradientMachine::forward(const std::vector<Argument>& inArgs,
   for (auto& memoryFrameLine : memoryFrameLines_) {
     memoryFrameLine.bootLayer->forward(passType);
   }
+  passType_ = passType;
+  checkpointInterval_ = 0;
+  // the frames of the last segment are kept for backward
+  int releaseEnd = 0;
   for (int i = 0; i < maxSequenceLength_; ++i) {
     const std::vector<Argument> inArgs;
     std::vector<Argument> outArgs;
     frames_[i]->forward(inArgs, &outArgs, passType);
+    if (i == 0) {
+      checkpointInterval_ = selectCheckpointInterval();
+      if (checkpointInterval_ > 0) {
+        releaseEnd = (maxSequenceLength_ - 1) / checkpointInterval_ *
+                     checkpointInterval_;
+      }
+    } else if (i - 1 < releaseEnd) {
+      // frame i - 1 is not used by the following frames any more
+      releaseFrame(i - 1, /* keepLinks */ true);
+    }
   }
 
   reorganizeOutput(passType);
 }
 
+int RecurrentGradientMachine::selectCheckpointInterval() {
+  if (!checkpointable_ || maxSequenceLength_ <= 1) {
+    return 0;
+  }
+  if (FLAGS_rnn_checkpoint_interval > 0) {
+    return std::min(FLAGS_rnn_checkpoint_interval, maxSequenceLength_);
+  }
+  if (FLAGS_rnn_memory_budget_mb <= 0) {
+    return 0;
+  }
+
+  // The first frame has the most sequences, so its size is an upper bound
+  // of the size of every frame.
+  double frameBytes = 0;
+  frames_[0]->forEachLayer([&frameBytes](const LayerPtr& layer) {
+    const Argument& output = layer->getOutput();
+    if (output.value) frameBytes += output.value->getElementCnt();
+    if (output.grad) frameBytes += output.grad->getElementCnt();
+    return false;
+  });
+  double stateBytes = 0;
+  for (auto& memoryFrameLine : memoryFrameLines_) {
+    const Argument& output = memoryFrameLine.frames[0]->getOutput();
+    if (output.value) stateBytes += output.value->getElementCnt();
+    if (output.grad) stateBytes += output.grad->getElementCnt();
+  }
+  frameBytes *= sizeof(real);
+  stateBytes *= sizeof(real);
+
+  double budget = FLAGS_rnn_memory_budget_mb * 1024 * 1024;
+  if (frameBytes * maxSequenceLength_ <= budget) {
+    return 0;
+  }
+  // With interval k, the checkpoints take (T / k) * stateBytes and the
+  // recomputed segment takes k * frameBytes, which is minimal at
+  // k = sqrt(T * stateBytes / frameBytes).
+  int interval = std::round(
+      std::sqrt(maxSequenceLength_ * stateBytes / std::max(frameBytes, 1.)));
+  interval = std::min(std::max(interval, 1), maxSequenceLength_);
+  double bytes = std::ceil((double)maxSequenceLength_ / interval) * stateBytes +
+                 interval * frameBytes;
+  LOG_IF(WARNING, bytes > budget)
+      << "Recurrent layer group " << subModelName_ << " needs " << bytes
+      << " bytes for " << maxSequenceLength_
+      << " frames, more than rnn_memory_budget_mb";
+  return interval;
+}
+
+void RecurrentGradientMachine::releaseFrame(int frameId, bool keepLinks) {
+  std::vector<Layer*> keptLayers;
+  if (keepLinks) {
+    // the outlinks are used by the gather agents in backward
+    for (auto& outFrameLine : outFrameLines_) {
+      keptLayers.push_back(outFrameLine.frames[frameId].get());
+    }
+    if (isCheckpoint(frameId)) {
+      for (auto& memoryFrameLine : memoryFrameLines_) {
+        keptLayers.push_back(memoryFrameLine.frames[frameId].get());
+      }
+    }
+  }
+  frames_[frameId]->forEachLayer([&keptLayers](const LayerPtr& layer) {
+    if (std::find(keptLayers.begin(), keptLayers.end(), layer.get()) ==
+        keptLayers.end()) {
+      // the agents only drop their references to the real layers
+      Argument& output = layer->getOutput();
+      output.value = nullptr;
+      output.grad = nullptr;
+      output.in = nullptr;
+    }
+    return false;
+  });
+}
+
+void RecurrentGradientMachine::recomputeFrames(int begin, int end) {
+  // Forwarding a layer clears its output gradient, which already has the
+  // gradients from the gather agents for the outlinks, and from the next
+  // frame for the memories of the last frame. They are added back after the
+  // forward.
+  savedGradLayers_.clear();
+  savedGrads_.clear();
+  auto save = [this](const LayerPtr& layer) {
+    if (std::find(savedGradLayers_.begin(), savedGradLayers_.end(), layer) !=
+        savedGradLayers_.end()) {
+      return;
+    }
+    savedGradLayers_.push_back(layer);
+    savedGrads_.push_back(layer->getOutput().grad);
+    layer->getOutput().grad = nullptr;
+  };
+  for (int i = begin; i < end; ++i) {
+    for (auto& outFrameLine : outFrameLines_) {
+      save(outFrameLine.frames[i]);
+    }
+  }
+  for (auto& memoryFrameLine : memoryFrameLines_) {
+    save(memoryFrameLine.frames[end - 1]);
+  }
+
+  for (int i = begin; i < end; ++i) {
+    const std::vector<Argument> inArgs;
+    std::vector<Argument> outArgs;
+    frames_[i]->forward(inArgs, &outArgs, passType_);
+  }
+
+  for (size_t i = 0; i < savedGradLayers_.size(); ++i) {
+    const MatrixPtr& grad = savedGradLayers_[i]->getOutputGrad();
+    if (savedGrads_[i] && grad) {
+      grad->add(*savedGrads_[i]);
+    }
+  }
+  savedGradLayers_.clear();
+  savedGrads_.clear();
+}
+
 void RecurrentGradientMachine::backward(const UpdateCallback& callback) {
   if (generating_) {
     return;
   }
   REGISTER_TIMER_INFO("RecurrentBwTime", "RecurrentBwTime");
   AsyncGpuBlock asyncGpuBlock;
-  for (int i = maxSequenceLength_ - 1; i >= 0; --i) {
-    frames_[i]->backward(nullptr);
+  if (checkpointInterval_ > 0) {
+    int lastBegin =
+        (maxSequenceLength_ - 1) / checkpointInterval_ * checkpointInterval_;
+    for (int begin = lastBegin; begin >= 0; begin -= checkpointInterval_) {
+      int end = std::min(begin + checkpointInterval_, maxSequenceLength_);
+      if (begin < lastBegin) {
+        recomputeFrames(begin, end);
+      }
+      for (int i = end - 1; i >= begin; --i) {
+        frames_[i]->backward(nullptr);
+      }
+      for (int i = begin; i < end; ++i) {
+        releaseFrame(i, /* keepLinks */ false);
+      }
+    }
+  } else {
+    for (int i = maxSequenceLength_ - 1; i >= 0; --i) {
+      frames_[i]->backward(nullptr);
+    }
   }
   for (auto& memoryFrameLine : memoryFrameLines_) {
     memoryFrameLine.bootLayer->backward(nullptr);
@@ -1046,6 +1224,7 @@ void RecurrentGradientMachine::oneWaySearch(size_t batchSize) {
   // entire batch, so its size exactly equals to batchSize.
   finalPaths_.clear();
   finalPaths_.resize(1);
+  pathTree_.clear();
   std::vector<Path>& finalPaths = finalPaths_[0];
   finalPaths.resize(batchSize);
 
@@ -1056,6 +1235,15 @@ void RecurrentGradientMachine::oneWaySearch(size_t batchSize) {
     seqIds_[i] = i;
   }
 
+  // stream out the only result of a finished sequence
+  auto streamResult = [&](size_t seqId) {
+    if (!finishedSequenceCallback_) return;
+    const Path& path = finalPaths[seqId];
+    std::vector<std::vector<int>> ids(1);
+    path.getIds(pathTree_, &ids[0]);
+    finishedSequenceCallback_(seqId, ids, {path.logProb});
+  };
+
   // forward
   for (int i = 0; i < maxSequenceLength_; ++i) {
     if (i && scatterIds.empty()) break;
@@ -1083,9 +1271,19 @@ void RecurrentGradientMachine::oneWaySearch(size_t batchSize) {
     frames_[machineCur]->forward(inArgs, &outArgs, PASS_TEST);
 
     const IVectorPtr& idVec = outFrameLine.frames[machineCur]->getOutput().ids;
+    // The probabilities are only needed by the streamed results.
+    MatrixPtr probs =
+        finishedSequenceCallback_
+            ? outFrameLine.frames[machineCur]->getOutput().in
+            : nullptr;
     for (size_t j = 0; j < seqIds_.size(); ++j) {
-      finalPaths[seqIds_[j]].ids.push_back(idVec->getElement(j));
-      finalPaths[seqIds_[j]].machineIdVec.push_back(j);
+      Path& path = finalPaths[seqIds_[j]];
+      path.node = pathTree_.add(path.node, idVec->getElement(j), 0, j);
+      path.length++;
+      if (probs) {
+        real prob = probs->getElement(j, 0);
+        path.logProb += generator_.config.log_prob() ? std::log(prob) : prob;
+      }
     }
 
     copyDataOutlinkFrame(machineCur);
@@ -1099,24 +1297,35 @@ void RecurrentGradientMachine::oneWaySearch(size_t batchSize) {
         // path.seqId = -1 indicates end of generation
         // of an input sequence
         finalPaths[seqIds_[j]].seqId = -1;
+        streamResult(seqIds_[j]);
       } else {
         scatterIds.push_back(j);
       }
     }
   }
+  // the sequences reaching maxSequenceLength_
+  for (size_t i = 0; i < batchSize; ++i) {
+    if (finalPaths[i].seqId != -1) streamResult(i);
+  }
 
   batchMachineIdVec_.clear();
   int* starts = generator_.outArg.sequenceStartPositions->getMutableData(false);
   starts[0] = 0;
   generator_.ids.clear();
   for (size_t i = 0; i < batchSize; ++i) {
-    generator_.ids.insert(generator_.ids.end(),
-                          finalPaths[i].ids.begin(),
-                          finalPaths[i].ids.end());
+    const Path& path = finalPaths[i];
+    size_t pos = generator_.ids.size();
+    generator_.ids.resize(pos + path.length);
+    pathTree_.gather(path.node,
+                     path.length,
+                     &PathTree::Node::id,
+                     generator_.ids.data() + pos);
     starts[i + 1] = generator_.ids.size();
-    batchMachineIdVec_.insert(batchMachineIdVec_.end(),
-                              finalPaths[i].machineIdVec.begin(),
-                              finalPaths[i].machineIdVec.end());
+    batchMachineIdVec_.resize(pos + path.length);
+    pathTree_.gather(path.node,
+                     path.length,
+                     &PathTree::Node::machineId,
+                     batchMachineIdVec_.data() + pos);
   }
 }
 
@@ -1180,8 +1389,15 @@ void RecurrentGradientMachine::singlePathExpand(Path& curPath,
                                                 size_t curPathId,
                                                 std::vector<Path>& newPaths,
                                                 size_t expandWidth) {
+  // The ids and the probability history of the path are only gathered
+  // for the user customized beam search.
+  bool needIds = gDiyProbStart || gDiyProbMethod || beamSearchCtrlCallbacks_;
+  if (needIds) {
+    curPath.getIds(pathTree_, &pathIds_);
+    curPath.getProbHistory(pathTree_, &probHistory_);
+  }
   int calc_id =
-      gDiyProbStart ? gDiyProbStart(curPath.ids.size(), curPath.ids.data()) : 0;
+      gDiyProbStart ? gDiyProbStart(pathIds_.size(), pathIds_.data()) : 0;
 
   const int* idVec = cpuId_->getData();
   const real* probMat = cpuProb_->getData();
@@ -1203,25 +1419,32 @@ void RecurrentGradientMachine::singlePathExpand(Path& curPath,
     if (id == -1) break;
 
     real newLogProb = generator_.config.log_prob() ? std::log(prob) : prob;
-    Path newPath(
-        curPath, id, newLogProb, curPathId /*machineId*/, k /*topIndex*/);
+    Path newPath(pathTree_,
+                 curPath,
+                 id,
+                 newLogProb,
+                 curPathId /*machineId*/,
+                 k /*topIndex*/);
+    if (needIds) {
+      pathIds_.resize(curPath.length);
+      pathIds_.push_back(id);
+      if (newPath.withHistory) {
+        probHistory_.resize(curPath.length + 1);
+        probHistory_.push_back(newLogProb);
+      }
+    }
     if (this->beamSearchCtrlCallbacks_) {
       if (beamSearchCtrlCallbacks_->stopDetermineCandidates(
-              newPath.seqId, newPath.ids, newPath.probHistory))
+              newPath.seqId, pathIds_, probHistory_))
         return;
     }
-    // outFrameLines_.size() > 1UL
-    if (dataArgsSize_) {
-      newPath.machineIdVec = curPath.machineIdVec;
-      newPath.machineIdVec.push_back(curPathId);
-    }
     bool atEos =
-        eosVec[index] == 1U || newPath.ids.size() >= (size_t)maxSequenceLength_;
+        eosVec[index] == 1U || newPath.length >= (size_t)maxSequenceLength_;
     // adjustNewPath
-    newPath.adjustProb(calc_id, atEos);
+    newPath.adjustProb(calc_id, pathIds_, atEos);
     if (this->beamSearchCtrlCallbacks_) {
       this->beamSearchCtrlCallbacks_->normOrDropNode(
-          newPath.seqId, newPath.ids, newPath.probHistory, &newPath.logProb);
+          newPath.seqId, pathIds_, probHistory_, &newPath.logProb);
     }
     if (!newPath.isDropable()) {
       atEos ? finalPaths_[curPath.seqId].push_back(newPath)
@@ -1281,18 +1504,57 @@ size_t RecurrentGradientMachine::beamShrink(std::vector<Path>& newPaths,
       std::max_element(newPaths.end() - minNewPathSize, newPaths.end())
           ->logProb;
 
-  // Remove the already formed paths that are relatively short
-  finalPaths_[seqId].erase(
-      std::remove_if(finalPaths_[seqId].begin(),
-                     finalPaths_[seqId].end(),
+  // Remove the already formed paths that are relatively short, except the
+  // best num_results_per_sample ones, which may still be the results.
+  // Otherwise dropping the unfinished paths below would raise
+  // minPathLogProb of the next step and remove a result.
+  size_t numResults = generator_.config.num_results_per_sample();
+  std::vector<Path>& finalPaths = finalPaths_[seqId];
+  size_t numKept = std::min(numResults, finalPaths.size());
+  if (numKept) {
+    std::nth_element(finalPaths.begin(),
+                     finalPaths.begin() + numKept - 1,
+                     finalPaths.end(),
+                     Path::greaterPath);
+  }
+  finalPaths.erase(
+      std::remove_if(finalPaths.begin() + numKept,
+                     finalPaths.end(),
                      [&](Path& p) { return p.logProb < minPathLogProb; }),
-      finalPaths_[seqId].end());
+      finalPaths.end());
   for (auto p : finalPaths_[seqId]) {
     if (minFinalPathLogProb_[seqId] > p.logProb) {
       minFinalPathLogProb_[seqId] = p.logProb;
     }
   }
 
+  // With log probabilities, a path never gains probability by expanding.
+  // So once num_results_per_sample paths are finished, the unfinished
+  // paths not better than the worst of them can not change the results,
+  // and they are dropped to keep the batch of the next step small.
+  if (generator_.config.log_prob() && !gDiyProbMethod &&
+      !beamSearchCtrlCallbacks_ && numResults > 0 &&
+      finalPaths.size() >= numResults) {
+    // The best numResults paths are in front since the erase above.
+    real worstResultLogProb =
+        std::min_element(finalPaths.begin(),
+                         finalPaths.begin() + numResults,
+                         [](const Path& a, const Path& b) {
+                           return a.logProb < b.logProb;
+                         })
+            ->logProb;
+    newPaths.erase(std::remove_if(newPaths.begin() + totalExpandCount,
+                                  newPaths.end(),
+                                  [&](const Path& p) {
+                                    return p.logProb < worstResultLogProb;
+                                  }),
+                   newPaths.end());
+    minNewPathSize = newPaths.size() - totalExpandCount;
+    if (!minNewPathSize) {
+      return 0;
+    }
+  }
+
   if (finalPaths_[seqId].size() >= getBeamSize() &&
       minFinalPathLogProb_[seqId] >= maxPathLogProb) {
     newPaths.resize(totalExpandCount);
@@ -1301,15 +1563,32 @@ size_t RecurrentGradientMachine::beamShrink(std::vector<Path>& newPaths,
   return minNewPathSize;
 }
 
+void RecurrentGradientMachine::finishSequence(size_t seqId) {
+  size_t numResults = generator_.config.num_results_per_sample();
+  std::vector<Path>& finalPaths = finalPaths_[seqId];
+  size_t minFinalPathsSize = std::min(numResults, finalPaths.size());
+  std::partial_sort(finalPaths.begin(),
+                    finalPaths.begin() + minFinalPathsSize,
+                    finalPaths.end(),
+                    Path::greaterPath);
+  finalPaths.resize(minFinalPathsSize);
+  seqFinished_[seqId] = true;
+
+  if (finishedSequenceCallback_) {
+    std::vector<std::vector<int>> ids(finalPaths.size());
+    std::vector<real> logProbs(finalPaths.size());
+    for (size_t i = 0; i < finalPaths.size(); ++i) {
+      finalPaths[i].getIds(pathTree_, &ids[i]);
+      logProbs[i] = finalPaths[i].logProb;
+    }
+    finishedSequenceCallback_(seqId, ids, logProbs);
+  }
+}
+
 void RecurrentGradientMachine::fillGenOutputs() {
   size_t numResults = generator_.config.num_results_per_sample();
   for (size_t i = 0; i < finalPaths_.size(); ++i) {
-    size_t minFinalPathsSize = std::min(numResults, finalPaths_[i].size());
-    std::partial_sort(finalPaths_[i].begin(),
-                      finalPaths_[i].begin() + minFinalPathsSize,
-                      finalPaths_[i].end(),
-                      Path::greaterPath);
-    finalPaths_[i].resize(minFinalPathsSize);
+    if (!seqFinished_[i]) finishSequence(i);
   }
 
   batchMachineIdVec_.clear();
@@ -1323,13 +1602,18 @@ void RecurrentGradientMachine::fillGenOutputs() {
     for (size_t i = 0; i < finalPaths_.size(); ++i) {
       for (size_t j = 0; j < finalPaths_[i].size(); ++j) {
         Path& path = finalPaths_[i][j];
-        size_t genLen = path.ids.size();
+        size_t genLen = path.length;
         generator_.ids.push_back(genLen);  // sequence size
-        generator_.ids.insert(
-            generator_.ids.end(), path.ids.begin(), path.ids.end());
+        size_t pos = generator_.ids.size();
+        generator_.ids.resize(pos + genLen);
+        pathTree_.gather(path.node,
+                         genLen,
+                         &PathTree::Node::id,
+                         generator_.ids.data() + pos);
         generator_.ids.push_back(-1);  // end of sequence
 
-        memcpy(idsProb + curPos, path.idsProb.data(), sizeof(real) * genLen);
+        pathTree_.gather(
+            path.node, genLen, &PathTree::Node::prob, idsProb + curPos);
         curPos += genLen;
         idsProb[curPos++] = -1.0;
         probs[i * numResults + j] = path.logProb;
@@ -1337,9 +1621,12 @@ void RecurrentGradientMachine::fillGenOutputs() {
         if (!j && dataArgsSize_) {
           // in beam search, here only reserved the top 1 generated result
           // for out_links that are not the generated word indices.
-          batchMachineIdVec_.insert(batchMachineIdVec_.end(),
-                                    path.machineIdVec.begin(),
-                                    path.machineIdVec.end());
+          size_t machinePos = batchMachineIdVec_.size();
+          batchMachineIdVec_.resize(machinePos + genLen);
+          pathTree_.gather(path.node,
+                           genLen,
+                           &PathTree::Node::machineId,
+                           batchMachineIdVec_.data() + machinePos);
         }
       }
       starts[i + 1] = generator_.ids.size();
@@ -1347,10 +1634,10 @@ void RecurrentGradientMachine::fillGenOutputs() {
   } else {
     for (size_t i = 0; i < finalPaths_.size(); ++i) {
       CHECK(!finalPaths_[i].empty());
-      generator_.ids.insert(generator_.ids.begin(),
-                            finalPaths_[i][0].ids.begin(),
-                            finalPaths_[i][0].ids.end());
-      starts[i + 1] = starts[i] + finalPaths_[i][0].ids.size();
+      finalPaths_[i][0].getIds(pathTree_, &pathIds_);
+      generator_.ids.insert(
+          generator_.ids.begin(), pathIds_.begin(), pathIds_.end());
+      starts[i + 1] = starts[i] + pathIds_.size();
     }
   }
 }
@@ -1370,8 +1657,8 @@ void RecurrentGradientMachine::createDataOutlink(
       getBeamSize() > 1UL ? finalPaths_.size() : finalPaths_[0].size();
   std::vector<int> starts(seqNum + 1, 0);
   for (size_t i = 0; i < seqNum; ++i) {
-    size_t seqLen = getBeamSize() > 1UL ? finalPaths_[i][0].ids.size()
-                                        : finalPaths_[0][i].ids.size();
+    size_t seqLen = getBeamSize() > 1UL ? finalPaths_[i][0].length
+                                        : finalPaths_[0][i].length;
     starts[i + 1] = starts[i] + seqLen;
   }
 
@@ -1396,6 +1683,9 @@ void RecurrentGradientMachine::beamSearch(size_t batchSize) {
   seqIds_.resize(batchSize);
   minFinalPathLogProb_.clear();
   minFinalPathLogProb_.resize(batchSize, 0);
+  seqFinished_.clear();
+  seqFinished_.resize(batchSize, false);
+  pathTree_.clear();
 
   std::vector<Path> paths;
   std::vector<Path> newPaths;
@@ -1426,18 +1716,33 @@ void RecurrentGradientMachine::beamSearch(size_t batchSize) {
     if (i) connectPrevFrame(i, paths);
 
     if (this->beamSearchCtrlCallbacks_) {
-      std::vector<std::vector<int>*> prefixes;
-      prefixes.resize(paths.size());
-      std::transform(
-          paths.begin(), paths.end(), prefixes.begin(), [](const Path& p) {
-            return const_cast<std::vector<int>*>(&p.ids);
-          });
+      std::vector<std::vector<int>> prefixIds(paths.size());
+      std::vector<std::vector<int>*> prefixes(paths.size());
+      for (size_t j = 0; j < paths.size(); ++j) {
+        paths[j].getIds(pathTree_, &prefixIds[j]);
+        prefixes[j] = &prefixIds[j];
+      }
       beamSearchCtrlCallbacks_->beamSearchCandidateAdjust(
           prefixes, frames_[machineCur].get(), i);
     }
 
     forwardFrame(machineCur);
     beamExpand(paths, newPaths);
+
+    // The sequences without unfinished paths are done. newPaths only has
+    // the paths of the unfinished sequences, so the frame of the next step
+    // is only forwarded for them.
+    for (size_t j = 0, k = 0; j < paths.size(); ++j) {
+      int seqId = paths[j].seqId;
+      if (seqFinished_[seqId] || (j + 1 < paths.size() &&
+                                  paths[j + 1].seqId == seqId)) {
+        continue;
+      }
+      while (k < newPaths.size() && newPaths[k].seqId < seqId) ++k;
+      if (k == newPaths.size() || newPaths[k].seqId != seqId) {
+        finishSequence(seqId);
+      }
+    }
     if (newPaths.empty()) break;
 
     paths = newPaths;
@@ -1446,7 +1751,9 @@ void RecurrentGradientMachine::beamSearch(size_t batchSize) {
   fillGenOutputs();
 }
 
-void RecurrentGradientMachine::Path::adjustProb(int calc_id, bool atEos) {
+void RecurrentGradientMachine::Path::adjustProb(int calc_id,
+                                                std::vector<int>& ids,
+                                                bool atEos) {
   if (gDiyProbMethod) {
     logProb = gDiyProbMethod(calc_id, ids.size(), ids.data(), logProb, atEos);
   }
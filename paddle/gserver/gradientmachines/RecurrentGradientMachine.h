@@ -113,7 +113,7 @@ public:
    *
    * The first parameter is sequence index in a batch
    *
-   * The second parameter is path.ids
+   * The second parameter is the ids of the path
    *
    * The third parameter is probabilites for each node in this path.
    *
@@ -176,6 +176,36 @@ public:
    */
   void removeBeamSearchStatisticsCallbacks();
 
+  /**
+   * @brief FinishedSequenceCallback
+   *
+   * Invoke in generation once all the paths of a sequence are finished,
+   * which is usually before the other sequences of the batch. With beam
+   * size 1, it is invoked once the only path of the sequence is finished.
+   *
+   * The first parameter is sequence index in a batch.
+   *
+   * The second parameter is the ids of the generated results, sorted by
+   * their probabilities. There are at most num_results_per_sample of them.
+   *
+   * The third parameter is the log probability of each result.
+   */
+  typedef std::function<void(int seqId,
+                             const std::vector<std::vector<int>>&,
+                             const std::vector<real>&)>
+      FinishedSequenceCallback;
+
+  /**
+   * @brief Register a callback to stream out each generated sequence of a
+   * batch as soon as it is finished, instead of waiting for the longest one.
+   */
+  void registerFinishedSequenceCallback(
+      const FinishedSequenceCallback& onSequenceFinished) {
+    finishedSequenceCallback_ = onSequenceFinished;
+  }
+
+  void removeFinishedSequenceCallback() { finishedSequenceCallback_ = nullptr; }
+
   /**
    * @brief Stop beam search for current source.
    *
@@ -183,16 +213,60 @@ public:
    */
   void stopBeamSearch();
 
+  /**
+   * @brief The nodes of all the paths formed in a generation, stored as a
+   * prefix tree.
+   *
+   * Each node is a generated word with a link to the node of the previous
+   * word, so expanding a path adds one node instead of copying the whole
+   * path, and the paths sharing a prefix share its nodes. The nodes are
+   * allocated in one array, and released together by clear() when a new
+   * generation starts. The words of a path are only gathered into a vector
+   * when they are needed.
+   */
+  class PathTree {
+  public:
+    struct Node {
+      int parent;     // index of the node of the previous word, -1 if none
+      int id;         // index of the generated word
+      int machineId;  // sample index of the frame generating the word
+      real prob;      // log probability of the generated word
+    };
+
+    int add(int parent, int id, real prob, int machineId) {
+      nodes_.push_back({parent, id, machineId, prob});
+      return nodes_.size() - 1;
+    }
+
+    void clear() { nodes_.clear(); }
+
+    /**
+     * @brief Gather a field of the length nodes ending at node into out,
+     * from the first word to the last one.
+     */
+    template <typename T>
+    void gather(int node, size_t length, T Node::*field, T* out) const {
+      for (size_t i = length; i > 0; --i) {
+        out[i - 1] = nodes_[node].*field;
+        node = nodes_[node].parent;
+      }
+    }
+
+  private:
+    std::vector<Node> nodes_;
+  };
+
   struct Path {
     /**
-     * @brief ids, path of beam search.
+     * @brief node, the last node of the path in the PathTree, -1 if the
+     * path is empty.
      */
-    std::vector<int> ids;
+    int node;
 
     /**
-     * @brief idsProb, log probability of each generated words.
+     * @brief length, number of generated words of the path.
      */
-    std::vector<real> idsProb;
+    size_t length;
 
     /**
      * @brief logProb, current probability of path.
@@ -202,50 +276,63 @@ public:
     int machineId;  // index of sample in frame
     int topIndex;   // index of MaxIdLayer output in one sample
     int seqId;      // index of sequence in batch generation
-    std::vector<int> machineIdVec;
 
     /**
-     * @brief A record of each node's probality in a formed path in beam search.
-     *
-     * @note  It could be empty when history is not recorded. If the history is
-     *        wanted to be recorded, recordHistory() MUST be invoked first.
+     * @brief Whether the probability history of the path is recorded.
+     * The history is the probability of the path when recordHistory() is
+     * invoked, followed by the probability of each word.
+     */
+    bool withHistory;
+
+    /**
+     * @brief historyStart, the probability of the path when recordHistory()
+     * is invoked, which is the first element of the history.
      */
-    std::vector<real> probHistory;
+    real historyStart;
 
     /**
      * @brief Path default ctor, first logProb is 0.
      */
-    Path() {
-      logProb = 0;
-      seqId = 0;
-    }
-    explicit Path(size_t seqId) : seqId(seqId) { logProb = 0; }
+    Path()
+        : node(-1),
+          length(0),
+          logProb(0),
+          seqId(0),
+          withHistory(false),
+          historyStart(0) {}
+    explicit Path(size_t seqId)
+        : node(-1),
+          length(0),
+          logProb(0),
+          seqId(seqId),
+          withHistory(false),
+          historyStart(0) {}
 
     /**
      * @brief Create a new path based on an old path and
      * a new node with probability.
      *
+     * @param tree      the PathTree storing the nodes of the paths
      * @param old       old path
      * @param newId     index of the new node
      * @param logProb   probability of the new node.
      * @param machineId sample index of a frame in RNN
      * @param topIndex  index of MaxIdLayer output in one sample
      */
-    Path(Path& old, int newId, real logProb, int machineId, int topIndex)
-        : ids(old.ids),
-          idsProb(old.idsProb),
+    Path(PathTree& tree,
+         const Path& old,
+         int newId,
+         real logProb,
+         int machineId,
+         int topIndex)
+        : node(tree.add(old.node, newId, logProb, machineId)),
+          length(old.length + 1),
           logProb(old.logProb + logProb),
           machineId(machineId),
           topIndex(topIndex),
-          seqId(old.seqId) {
-      ids.push_back(newId);
-      idsProb.push_back(logProb);
-      if (!old.probHistory.empty()) {
-        this->probHistory = old.probHistory;
-        // probHistory store current prob, not sum
-        this->probHistory.push_back(logProb);
-      }
-    }
+          seqId(old.seqId),
+          withHistory(old.withHistory),
+          historyStart(old.historyStart) {}
 
     /**
      * @brief operator <
@@ -259,18 +346,70 @@ public:
     static bool greaterPath(const Path& a, const Path& b) { return (b < a); }
 
     /**
-     * @brief Start recording history in this path.
+     * @brief Start recording history in this path. It must be invoked
+     * before the path is expanded.
+     */
+    void recordHistory() {
+      CHECK_EQ(length, 0UL);
+      withHistory = true;
+      historyStart = logProb;
+    }
+
+    /**
+     * @brief ids, path of beam search.
+     */
+    void getIds(const PathTree& tree, std::vector<int>* ids) const {
+      ids->resize(length);
+      tree.gather(node, length, &PathTree::Node::id, ids->data());
+    }
+
+    /**
+     * @brief idsProb, log probability of each generated words.
      */
-    void recordHistory() { this->probHistory.push_back(this->logProb); }
+    void getIdsProb(const PathTree& tree, std::vector<real>* idsProb) const {
+      idsProb->resize(length);
+      tree.gather(node, length, &PathTree::Node::prob, idsProb->data());
+    }
+
+    /**
+     * @brief machineIdVec, the sample index of the frame generating each
+     * word, which selects a row of output matrix in each frame.
+     */
+    void getMachineIdVec(const PathTree& tree,
+                         std::vector<int>* machineIdVec) const {
+      machineIdVec->resize(length);
+      tree.gather(
+          node, length, &PathTree::Node::machineId, machineIdVec->data());
+    }
+
+    /**
+     * @brief A record of each node's probality in a formed path in beam search.
+     *
+     * @note  It is empty when history is not recorded. If the history is
+     *        wanted to be recorded, recordHistory() MUST be invoked first.
+     */
+    void getProbHistory(const PathTree& tree,
+                        std::vector<real>* probHistory) const {
+      if (!withHistory) {
+        probHistory->clear();
+        return;
+      }
+      // the probability of each word follows historyStart, not their sum
+      probHistory->resize(length + 1);
+      (*probHistory)[0] = historyStart;
+      tree.gather(
+          node, length, &PathTree::Node::prob, probHistory->data() + 1);
+    }
 
     /**
      * @brief Adjust probability for DIY beam search interface.
      * In normal situation, it will do nothing.
      *
      * @param calc_id: the object id for DIY beam search interface.
+     * @param ids: the ids of this path.
      * @param atEos: at end of sequence or not.
      */
-    void adjustProb(int calc_id, bool atEos = false);
+    void adjustProb(int calc_id, std::vector<int>& ids, bool atEos = false);
 
     /**
      * @brief isDropable indacating whether the current node will be
@@ -290,6 +429,11 @@ public:
     return this->finalPaths_;
   }
 
+  /**
+   * @brief access the nodes of the beam search results.
+   */
+  const PathTree& getPathTree() const { return this->pathTree_; }
+
 protected:
   std::vector<Argument::SeqInfo> commonSeqInfo_;
   ICpuGpuVectorPtr sequenceStartPositions_;
@@ -304,6 +448,22 @@ protected:
   void resizeOrCreateFrames(int numFrames);
   void resizeBootFrame(int numSequences);
 
+  /**
+   * Checkpointing of the frames in training, to bound the memory of long
+   * sequences. The frames are split into segments of checkpointInterval_
+   * frames. In forward, the layer outputs of all the segments but the last
+   * one are released, except the outlinks and the memories of the last frame
+   * of each segment. In backward, each segment is forwarded again from the
+   * memories of the previous segment right before its own backward, and
+   * released afterwards.
+   */
+  int selectCheckpointInterval();
+  bool isCheckpoint(int frameId) const {
+    return (frameId + 1) % checkpointInterval_ == 0;
+  }
+  void releaseFrame(int frameId, bool keepLinks);
+  void recomputeFrames(int begin, int end);
+
   void generateSequence();
   void oneWaySearch(size_t batchSize);
   void beamSearch(size_t batchSize);
@@ -434,6 +594,13 @@ protected:
   bool useGpu_;
   bool stopBeamSearch_;
 
+  // false if recomputing a frame does not give the same outputs
+  bool checkpointable_;
+  int checkpointInterval_;  // 0 if checkpointing is off for this batch
+  PassType passType_;
+  std::vector<LayerPtr> savedGradLayers_;
+  std::vector<MatrixPtr> savedGrads_;
+
   std::vector<int>
       parameterIds_;  // parameters actually used by this Layer Group
 
@@ -533,6 +700,13 @@ private:
    */
   void beamExpand(std::vector<Path>& paths, std::vector<Path>& newPaths);
 
+  /*
+   * @brief keep the num_results_per_sample finished paths of the seqId-th
+   * sequence with the highest probabilities, and stream them out by
+   * finishedSequenceCallback_.
+   */
+  void finishSequence(size_t seqId);
+
   /*
    * @brief fill sequence start positions and some other information that are
    * uesed by the "text_printer" evaluator.
@@ -544,7 +718,14 @@ private:
   std::vector<int> seqIds_;
   std::vector<int> batchMachineIdVec_;
   std::vector<std::vector<Path>> finalPaths_;
+  PathTree pathTree_;
+  // the ids and the probability history of the path being expanded,
+  // only gathered for the user customized beam search.
+  std::vector<int> pathIds_;
+  std::vector<real> probHistory_;
   std::vector<real> minFinalPathLogProb_;
+  std::vector<bool> seqFinished_;
+  FinishedSequenceCallback finishedSequenceCallback_;
   BeamSearchControlCallbacks* beamSearchCtrlCallbacks_;
   BeamSearchStatisticsCallbacks* beamSearchStatistics_;
 };
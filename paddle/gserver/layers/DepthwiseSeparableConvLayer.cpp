@@ -0,0 +1,201 @@
+/* Copyright (c) 2016 PaddlePaddle Authors. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "DepthwiseSeparableConvLayer.h"
+#include "paddle/utils/Logging.h"
+#include "paddle/utils/Stat.h"
+
+namespace paddle {
+
+REGISTER_LAYER(depthwise_separable_conv, DepthwiseSeparableConvLayer);
+
+bool DepthwiseSeparableConvLayer::init(const LayerMap& layerMap,
+                                       const ParameterMap& parameterMap) {
+  /* Initialize the basic parent class */
+  Layer::init(layerMap, parameterMap);
+
+  CHECK_EQ(inputLayers_.size(), 2UL);
+  CHECK_EQ(parameters_.size(), 2UL);
+  const ConvConfig& depthwise = config_.inputs(0).conv_conf();
+  const ConvConfig& pointwise = config_.inputs(1).conv_conf();
+  size_t channels = depthwise.channels();
+  size_t middleChannels = pointwise.channels();
+  size_t numFilters = config_.num_filters();
+  CHECK_EQ(depthwise.groups(), depthwise.channels())
+      << "The first input must be a depthwise convolution";
+  CHECK_EQ(middleChannels % channels, 0UL);
+  CHECK_EQ(pointwise.groups(), 1U);
+  CHECK_EQ(pointwise.filter_size() * pointwise.filter_size_y(), 1U);
+  CHECK_EQ(pointwise.output_x(), depthwise.output_x());
+  CHECK_EQ(pointwise.output_y(), depthwise.output_y());
+
+  size_t filterPixels = depthwise.filter_size() * depthwise.filter_size_y();
+  depthwiseWeight_.reset(
+      new Weight(filterPixels, middleChannels, parameters_[0]));
+  pointwiseWeight_.reset(
+      new Weight(middleChannels, numFilters, parameters_[1]));
+
+  depthwiseShape_ = TensorShape({channels,
+                                 middleChannels / channels,
+                                 1,
+                                 (size_t)depthwise.filter_size_y(),
+                                 (size_t)depthwise.filter_size()});
+  pointwiseShape_ = TensorShape({1, numFilters, middleChannels, 1, 1});
+
+  std::vector<size_t> paddings = {(size_t)depthwise.padding_y(),
+                                  (size_t)depthwise.padding()};
+  std::vector<size_t> strides = {(size_t)depthwise.stride_y(),
+                                 (size_t)depthwise.stride()};
+  std::vector<size_t> noPaddings = {0, 0};
+  std::vector<size_t> noStrides = {1, 1};
+  FuncConfig depthwiseConfig = FuncConfig()
+                                   .set("paddings", paddings)
+                                   .set("strides", strides)
+                                   .set("groups", channels);
+  FuncConfig pointwiseConfig = FuncConfig()
+                                   .set("paddings", noPaddings)
+                                   .set("strides", noStrides)
+                                   .set("groups", (size_t)1);
+
+  createFunction(forward_, "DepthwiseConv", depthwiseConfig);
+  createFunction(forward_, "GemmConv", pointwiseConfig);
+  // Only the cpu has the fused function, which is used in testing.
+  if (!useGpu_) {
+    createFunction(forward_, "DepthwiseSeparableConv", depthwiseConfig);
+  }
+
+  createFunction(backward_, "GemmConvGradInput", pointwiseConfig);
+  createFunction(backward_, "GemmConvGradFilter", pointwiseConfig);
+  createFunction(backward_, "DepthwiseConvGradInput", depthwiseConfig);
+  createFunction(backward_, "DepthwiseConvGradFilter", depthwiseConfig);
+
+  return true;
+}
+
+void DepthwiseSeparableConvLayer::forward(PassType passType) {
+  Layer::forward(passType);
+
+  const ConvConfig& depthwise = config_.inputs(0).conv_conf();
+  const ConvConfig& pointwise = config_.inputs(1).conv_conf();
+  size_t batchSize = getInputValue(0)->getHeight();
+  size_t outputH = depthwise.output_y();
+  size_t outputW = depthwise.output_x();
+  inputShape_ = TensorShape({batchSize,
+                             (size_t)depthwise.channels(),
+                             (size_t)depthwise.img_size_y(),
+                             (size_t)depthwise.img_size()});
+  middleShape_ = TensorShape(
+      {batchSize, (size_t)pointwise.channels(), outputH, outputW});
+  outputShape_ = TensorShape(
+      {batchSize, (size_t)config_.num_filters(), outputH, outputW});
+  CHECK_EQ(getInputValue(0)->getWidth(), inputShape_.getElements() / batchSize);
+
+  resetOutput(batchSize, outputShape_.getElements() / batchSize);
+  getOutput().setFrameHeight(outputH);
+  getOutput().setFrameWidth(outputW);
+
+  MatrixPtr depthwiseW = depthwiseWeight_->getW();
+  MatrixPtr pointwiseW = pointwiseWeight_->getW();
+  if (passType == PASS_TEST && !useGpu_) {
+    REGISTER_TIMER_INFO("FwDepthwiseSeparableConvTimer", getName().c_str());
+    BufferArgs inputs;
+    BufferArgs outputs;
+    inputs.addArg(*getInputValue(0), inputShape_);
+    inputs.addArg(*depthwiseW, depthwiseShape_);
+    inputs.addArg(*pointwiseW,
+                  TensorShape({pointwiseShape_[1], pointwiseShape_[2], 1, 1}));
+    outputs.addArg(*getOutputValue(), outputShape_, ASSIGN_TO);
+    forward_[2]->calc(inputs, outputs);
+  } else {
+    REGISTER_TIMER_INFO("FwDepthwiseSeparableConvTimer", getName().c_str());
+    Matrix::resizeOrCreate(middle_,
+                           batchSize,
+                           middleShape_.getElements() / batchSize,
+                           false,
+                           useGpu_);
+    {
+      BufferArgs inputs;
+      BufferArgs outputs;
+      inputs.addArg(*getInputValue(0), inputShape_);
+      inputs.addArg(*depthwiseW, depthwiseShape_);
+      outputs.addArg(*middle_, middleShape_, ASSIGN_TO);
+      forward_[0]->calc(inputs, outputs);
+    }
+    {
+      BufferArgs inputs;
+      BufferArgs outputs;
+      inputs.addArg(*middle_, middleShape_);
+      inputs.addArg(*pointwiseW, pointwiseShape_);
+      outputs.addArg(*getOutputValue(), outputShape_, ASSIGN_TO);
+      forward_[1]->calc(inputs, outputs);
+    }
+  }
+
+  /* activation */ {
+    REGISTER_TIMER_INFO("FwAtvTimer", getName().c_str());
+    forwardActivation();
+  }
+}
+
+void DepthwiseSeparableConvLayer::backward(const UpdateCallback& callback) {
+  /* Do derivation */ {
+    REGISTER_TIMER_INFO("BpAvtTimer", getName().c_str());
+    backwardActivation();
+  }
+
+  REGISTER_TIMER_INFO("BpDepthwiseSeparableConvTimer", getName().c_str());
+  MatrixPtr outGrad = getOutputGrad();
+  Matrix::resizeOrCreate(middleGrad_,
+                         middle_->getHeight(),
+                         middle_->getWidth(),
+                         false,
+                         useGpu_);
+  middleGrad_->zeroMem();
+  {
+    BufferArgs inputs;
+    BufferArgs outputs;
+    inputs.addArg(*outGrad, outputShape_);
+    inputs.addArg(*pointwiseWeight_->getW(), pointwiseShape_);
+    outputs.addArg(*middleGrad_, middleShape_, ADD_TO);
+    backward_[0]->calc(inputs, outputs);
+  }
+  if (pointwiseWeight_->getWGrad()) {
+    BufferArgs inputs;
+    BufferArgs outputs;
+    inputs.addArg(*outGrad, outputShape_);
+    inputs.addArg(*middle_, middleShape_);
+    outputs.addArg(*pointwiseWeight_->getWGrad(), pointwiseShape_, ADD_TO);
+    backward_[1]->calc(inputs, outputs);
+    pointwiseWeight_->getParameterPtr()->incUpdate(callback);
+  }
+  if (getInputGrad(0)) {
+    BufferArgs inputs;
+    BufferArgs outputs;
+    inputs.addArg(*middleGrad_, middleShape_);
+    inputs.addArg(*depthwiseWeight_->getW(), depthwiseShape_);
+    outputs.addArg(*getInputGrad(0), inputShape_, ADD_TO);
+    backward_[2]->calc(inputs, outputs);
+  }
+  if (depthwiseWeight_->getWGrad()) {
+    BufferArgs inputs;
+    BufferArgs outputs;
+    inputs.addArg(*middleGrad_, middleShape_);
+    inputs.addArg(*getInputValue(0), inputShape_);
+    outputs.addArg(*depthwiseWeight_->getWGrad(), depthwiseShape_, ADD_TO);
+    backward_[3]->calc(inputs, outputs);
+    depthwiseWeight_->getParameterPtr()->incUpdate(callback);
+  }
+}
+
+}  // namespace paddle
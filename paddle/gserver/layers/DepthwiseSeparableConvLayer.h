@@ -0,0 +1,61 @@
+/* Copyright (c) 2016 PaddlePaddle Authors. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#pragma once
+
+#include "Layer.h"
+
+namespace paddle {
+
+/**
+ * \brief A depthwise convolution followed by a pointwise (1x1) convolution,
+ * the depthwise separable convolution block of MobileNet.
+ *
+ * The first input is the image, its conv_conf is the depthwise convolution
+ * and its parameter is the depthwise filter. The second input only carries
+ * the pointwise filter, its conv_conf is the 1x1 convolution over the
+ * depthwise output and its value is not used.
+ *
+ * In testing on cpu, the forward is the fused DepthwiseSeparableConv
+ * function, which never writes the depthwise output to memory. In training,
+ * the depthwise output is kept for the backward.
+ */
+class DepthwiseSeparableConvLayer : public Layer {
+public:
+  explicit DepthwiseSeparableConvLayer(const LayerConfig& config)
+      : Layer(config) {}
+
+  ~DepthwiseSeparableConvLayer() {}
+
+  bool init(const LayerMap& layerMap,
+            const ParameterMap& parameterMap) override;
+  void forward(PassType passType) override;
+  void backward(const UpdateCallback& callback = nullptr) override;
+
+protected:
+  std::unique_ptr<Weight> depthwiseWeight_;
+  std::unique_ptr<Weight> pointwiseWeight_;
+
+  // The depthwise output and its gradient.
+  MatrixPtr middle_;
+  MatrixPtr middleGrad_;
+
+  TensorShape inputShape_;
+  TensorShape depthwiseShape_;
+  TensorShape middleShape_;
+  TensorShape pointwiseShape_;
+  TensorShape outputShape_;
+};
+
+}  // namespace paddle
@@ -19,6 +19,14 @@ limitations under the License. */
 DEFINE_bool(use_nnpack,
             false,
             "Whether to use nnpack for convolution calculation.");
+DEFINE_bool(use_small_filter_conv,
+            false,
+            "Whether to use the Winograd and direct convolution kernels "
+            "for small filters on cpu.");
+DEFINE_bool(use_conv_autotune,
+            false,
+            "Whether to benchmark the cpu convolution implementations for "
+            "each shape on first use and use the fastest one.");
 
 namespace paddle {
 
@@ -47,7 +55,7 @@ bool ExpandConvLayer::init(const LayerMap &layerMap,
     std::vector<size_t> paddings = {(size_t)paddingY_[i], (size_t)padding_[i]};
     std::vector<size_t> strides = {(size_t)strideY_[i], (size_t)stride_[i]};
 
-    if (useGpu_ && (size_t)groups_[i] == (size_t)channels_[i] && !isDeconv_) {
+    if ((size_t)groups_[i] == (size_t)channels_[i] && !isDeconv_) {
       convType = "DepthwiseConv";
       convGradInputType = "DepthwiseConvGradInput";
       convGradFilterType = "DepthwiseConvGradFilter";
@@ -57,6 +65,38 @@ bool ExpandConvLayer::init(const LayerMap &layerMap,
       convGradFilterType = "GemmConvGradFilter";
     }
 
+    // Only the forward of convolution has the small filter kernels,
+    // the backward still uses GemmConvGradInput and GemmConvGradFilter.
+    std::string forwardType = convType;
+    FuncConfig forwardConfig;
+    forwardConfig.set("paddings", paddings)
+        .set("strides", strides)
+        .set("groups", (size_t)groups_[i]);
+    if (!useGpu_ && !isDeconv_ &&
+        (FLAGS_use_small_filter_conv || FLAGS_use_conv_autotune) &&
+        convType == "GemmConv") {
+      bool isWinograd = filterSize_[i] == 3 && filterSizeY_[i] == 3 &&
+                        stride_[i] == 1 && strideY_[i] == 1;
+      bool isPointwise = filterSize_[i] == 1 && filterSizeY_[i] == 1 &&
+                         stride_[i] == 1 && strideY_[i] == 1 &&
+                         padding_[i] == 0 && paddingY_[i] == 0;
+      if (FLAGS_use_conv_autotune) {
+        forwardType = "AutoTuneConv";
+      } else if (isWinograd) {
+        // F(4x4, 3x3) saves more multiplications than F(2x2, 3x3),
+        // but wastes more computation on the borders of small images.
+        forwardType = "WinogradConv";
+        forwardConfig.set("tile",
+                          outputH_[i] >= 8 && outputW_[i] >= 8 ? (size_t)4
+                                                               : (size_t)2);
+      } else if (!isPointwise && filterSize_[i] <= 5 &&
+                 filterSizeY_[i] <= 5 && filterChannels_[i] <= 32) {
+        // The pointwise convolution needs no im2col, and with many input
+        // channels per group the GEMM is efficient enough.
+        forwardType = "DirectConv";
+      }
+    }
+
     if (FLAGS_use_nnpack && !isDeconv_) {
       createFunction(forward_,
                      "NNPACKConv",
@@ -67,11 +107,8 @@ bool ExpandConvLayer::init(const LayerMap &layerMap,
                          .set("algo", std::string("auto")));
     } else {
       createFunction(forward_,
-                     !isDeconv_ ? convType : convGradInputType,
-                     FuncConfig()
-                         .set("paddings", paddings)
-                         .set("strides", strides)
-                         .set("groups", (size_t)groups_[i]));
+                     !isDeconv_ ? forwardType : convGradInputType,
+                     forwardConfig);
 
       createFunction(backward_,
                      !isDeconv_ ? convGradInputType : convType,
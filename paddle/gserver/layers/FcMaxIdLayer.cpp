@@ -0,0 +1,269 @@
+/* Copyright (c) 2016 PaddlePaddle Authors. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include "Layer.h"
+#include "paddle/math/CpuSparseMatrix.h"
+#include "paddle/math/MathFunctions.h"
+#include "paddle/utils/Stat.h"
+
+namespace paddle {
+
+/**
+ * A layer fusing fc_layer with softmax activation and maxid_layer, for
+ * generating with a large vocabulary. Like maxid_layer, it outputs the ids of
+ * the beam_size largest probabilities of each sample in output_.ids, and the
+ * probabilities in output_.in.
+ *
+ * The logits are computed block by block of the vocabulary. After each block,
+ * the max and the sum of exponentials of each sample are updated, and the
+ * best ids are kept in a min-heap of beam_size. So the batchSize x size output
+ * of fc_layer is neither stored nor normalized.
+ *
+ * The optional second input is a sparse binary matrix of batchSize x size,
+ * whose columns in a row are the candidate ids of the sample, as the select
+ * input of selective_fc_layer. Only the logits of the candidates are
+ * computed, and the softmax is over the candidates. If a sample has fewer
+ * candidates than beam_size, its remaining ids are -1.
+ *
+ * The weight is (size of the first input) x size as the weight of fc_layer,
+ * so a model trained with fc_layer can be used directly. The layer is only
+ * for inference on CPU, and has no backward.
+ *
+ * The config file api is fc_maxid_layer.
+ */
+class FcMaxIdLayer : public Layer {
+public:
+  explicit FcMaxIdLayer(const LayerConfig& config) : Layer(config) {}
+
+  bool init(const LayerMap& layerMap,
+            const ParameterMap& parameterMap) override;
+
+  void forward(PassType passType) override;
+
+  void backward(const UpdateCallback& callback) override {}
+
+protected:
+  /// number of the columns of the weight multiplied in one block
+  static const size_t kBlockSize = 1024;
+
+  typedef std::pair<real, int> Candidate;
+
+  /// the softmax normalizer and the best candidates of a sample
+  struct State {
+    real maxLogit;
+    real sumExp;
+    std::vector<Candidate> heap;
+  };
+
+  /**
+   * @brief Add the logits of a sample to its state. The id of logits[k] is
+   *        ids[k], or firstId + k if ids is nullptr.
+   */
+  void addLogits(State& state,
+                 const real* logits,
+                 size_t size,
+                 int firstId,
+                 const int* ids);
+
+  void forwardFull(const real* input, size_t batchSize);
+
+  void forwardCandidates(const real* input, size_t batchSize);
+
+  /// a predetermined number of best states at each level
+  size_t beamSize_;
+  std::unique_ptr<Weight> weight_;
+  std::unique_ptr<Weight> biases_;
+  std::vector<State> states_;
+  /// the logits of a block of the vocabulary, or of the candidates
+  std::vector<real> logits_;
+};
+
+const size_t FcMaxIdLayer::kBlockSize;
+
+REGISTER_LAYER(fc_maxid, FcMaxIdLayer);
+
+bool FcMaxIdLayer::init(const LayerMap& layerMap,
+                        const ParameterMap& parameterMap) {
+  if (!Layer::init(layerMap, parameterMap)) return false;
+  CHECK(!useGpu_) << "fc_maxid layer is only implemented on CPU";
+  CHECK(inputLayers_.size() == 1UL || inputLayers_.size() == 2UL);
+  CHECK(parameters_[0]) << "the first input of fc_maxid layer needs a weight";
+  CHECK(!parameters_[0]->isSparse());
+  size_t height = inputLayers_[0]->getSize();
+  CHECK_EQ(parameters_[0]->getSize(), height * getSize());
+  weight_.reset(new Weight(height, getSize(), parameters_[0]));
+  if (biasParameter_) {
+    biases_.reset(new Weight(1, getSize(), biasParameter_));
+  }
+  if (inputLayers_.size() == 2UL) {
+    CHECK(!parameters_[1]) << "the candidates input has no weight";
+  }
+
+  beamSize_ = config_.has_beam_size() ? config_.beam_size() : FLAGS_beam_size;
+  CHECK_GE(beamSize_, 1LU);
+  return true;
+}
+
+void FcMaxIdLayer::addLogits(State& state,
+                             const real* logits,
+                             size_t size,
+                             int firstId,
+                             const int* ids) {
+  if (size == 0) return;
+  real blockMax = *std::max_element(logits, logits + size);
+  if (blockMax > state.maxLogit) {
+    state.sumExp *= std::exp(state.maxLogit - blockMax);
+    state.maxLogit = blockMax;
+  }
+  real maxLogit = state.maxLogit;
+  real sumExp = 0;
+  for (size_t k = 0; k < size; ++k) {
+    sumExp += std::exp(logits[k] - maxLogit);
+  }
+  state.sumExp += sumExp;
+
+  auto& heap = state.heap;
+  std::greater<Candidate> comp;
+  for (size_t k = 0; k < size; ++k) {
+    if (heap.size() == beamSize_ && logits[k] <= heap.front().first) {
+      continue;
+    }
+    Candidate candidate(logits[k], ids ? ids[k] : firstId + (int)k);
+    if (heap.size() == beamSize_) {
+      std::pop_heap(heap.begin(), heap.end(), comp);
+      heap.back() = candidate;
+    } else {
+      heap.push_back(candidate);
+    }
+    std::push_heap(heap.begin(), heap.end(), comp);
+  }
+}
+
+void FcMaxIdLayer::forwardFull(const real* input, size_t batchSize) {
+  size_t inputSize = inputLayers_[0]->getSize();
+  size_t size = getSize();
+  const real* weight = weight_->getW()->getData();
+  const real* bias = biases_ ? biases_->getW()->getData() : nullptr;
+  logits_.resize(batchSize * kBlockSize);
+  for (size_t j = 0; j < size; j += kBlockSize) {
+    size_t blockSize = std::min(kBlockSize, size - j);
+    gemm<real>(CblasNoTrans,
+               CblasNoTrans,
+               batchSize,
+               blockSize,
+               inputSize,
+               1.0f,
+               input,
+               inputSize,
+               weight + j,
+               size,
+               0.0f,
+               logits_.data(),
+               kBlockSize);
+    for (size_t i = 0; i < batchSize; ++i) {
+      real* logits = logits_.data() + i * kBlockSize;
+      if (bias) {
+        for (size_t k = 0; k < blockSize; ++k) {
+          logits[k] += bias[j + k];
+        }
+      }
+      addLogits(states_[i], logits, blockSize, j, nullptr);
+    }
+  }
+}
+
+void FcMaxIdLayer::forwardCandidates(const real* input, size_t batchSize) {
+  auto candidates = dynamic_cast<CpuSparseMatrix*>(getInputValue(1).get());
+  CHECK(candidates) << "the candidates must be a sparse matrix";
+  CHECK_EQ(candidates->getFormat(), SPARSE_CSR);
+  CHECK_EQ(candidates->getHeight(), batchSize);
+  CHECK_EQ(candidates->getWidth(), getSize());
+
+  size_t inputSize = inputLayers_[0]->getSize();
+  size_t size = getSize();
+  const real* weight = weight_->getW()->getData();
+  const real* bias = biases_ ? biases_->getW()->getData() : nullptr;
+  const int* rows = candidates->getRows();
+  const int* cols = candidates->getCols();
+  for (size_t i = 0; i < batchSize; ++i) {
+    const int* ids = cols + rows[i];
+    size_t numIds = rows[i + 1] - rows[i];
+    logits_.resize(numIds);
+    real* logits = logits_.data();
+    for (size_t k = 0; k < numIds; ++k) {
+      logits[k] = bias ? bias[ids[k]] : 0;
+    }
+    const real* in = input + i * inputSize;
+    for (size_t d = 0; d < inputSize; ++d) {
+      const real* w = weight + d * size;
+      real x = in[d];
+      for (size_t k = 0; k < numIds; ++k) {
+        logits[k] += x * w[ids[k]];
+      }
+    }
+    addLogits(states_[i], logits, numIds, 0, ids);
+  }
+}
+
+void FcMaxIdLayer::forward(PassType passType) {
+  Layer::forward(passType);
+  const Argument& input = getInput(0);
+  size_t batchSize = input.getBatchSize();
+  IVector::resizeOrCreate(output_.ids, batchSize * beamSize_, useGpu_);
+  Matrix::resizeOrCreate(output_.in,
+                         batchSize,
+                         beamSize_,
+                         false,
+                         /* useGpu */ useGpu_);
+  output_.value = nullptr;
+
+  states_.resize(batchSize);
+  for (auto& state : states_) {
+    state.maxLogit = -std::numeric_limits<real>::infinity();
+    state.sumExp = 0;
+    state.heap.clear();
+  }
+  {
+    REGISTER_TIMER_INFO("FcMaxIdTimer", getName().c_str());
+    if (inputLayers_.size() == 2UL) {
+      forwardCandidates(input.value->getData(), batchSize);
+    } else {
+      forwardFull(input.value->getData(), batchSize);
+    }
+  }
+
+  int* ids = output_.ids->getData();
+  real* probs = output_.in->getData();
+  for (size_t i = 0; i < batchSize; ++i) {
+    State& state = states_[i];
+    std::sort_heap(
+        state.heap.begin(), state.heap.end(), std::greater<Candidate>());
+    for (size_t k = 0; k < beamSize_; ++k) {
+      if (k < state.heap.size()) {
+        ids[i * beamSize_ + k] = state.heap[k].second;
+        probs[i * beamSize_ + k] =
+            std::exp(state.heap[k].first - state.maxLogit) / state.sumExp;
+      } else {
+        ids[i * beamSize_ + k] = -1;
+        probs[i * beamSize_ + k] = 0;
+      }
+    }
+  }
+}
+
+}  // namespace paddle
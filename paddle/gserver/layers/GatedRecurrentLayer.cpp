@@ -39,6 +39,7 @@ bool GatedRecurrentLayer::init(const LayerMap& layerMap,
   activationGate_.reset(ActivationFunction::create(config_.active_gate_type()));
 
   GruCompute::init(config_);
+  GruCompute::initPackedWeight(parameters_[0], getSize(), useGpu_);
   useBatch_ = true;
 
   return true;
@@ -60,6 +61,11 @@ void GatedRecurrentLayer::resetState() {
 void GatedRecurrentLayer::setState(LayerStatePtr state) {
   CHECK(state->value.size() == 1)
       << "one matrix is expected for GatedRecurrentLayer state";
+  Matrix::resizeOrCreate(prevOutput_,
+                         state->value[0]->getHeight(),
+                         getSize(),
+                         /* trans= */ false,
+                         useGpu_);
   prevOutput_->copyFrom(*(state->value[0]));
 }
 
@@ -73,6 +79,7 @@ LayerStatePtr GatedRecurrentLayer::getState() {
 void GatedRecurrentLayer::forward(PassType passType) {
   REGISTER_TIMER_INFO("GruFwTimer", getName().c_str());
   Layer::forward(passType);
+  GruCompute::updatePackedWeight();
 
   const Argument& input = getInput(0);
   CHECK(input.sequenceStartPositions);
@@ -171,6 +178,13 @@ void GatedRecurrentLayer::forwardSequence(int batchSize,
     }
   };
 
+  // A state of one row is continued by all the sequences one after another.
+  // Otherwise every sequence continues its own row of the state.
+  bool statePerSequence = prevOutput_ && prevOutput_->getHeight() > 1;
+  if (statePerSequence) {
+    CHECK_EQ(prevOutput_->getHeight(), numSequences)
+        << "the number of sequences must be the same";
+  }
   if (!reversed_) {
     if (prevOutput_) {
       gruValue.prevOutValue = prevOutput_->getData();
@@ -184,6 +198,9 @@ void GatedRecurrentLayer::forwardSequence(int batchSize,
     } else {
       length = starts[numSequences - n] - starts[numSequences - n - 1];
     }
+    if (statePerSequence && !reversed_) {
+      gruValue.prevOutValue = prevOutput_->getData() + n * getSize();
+    }
     for (int l = 0; l < length; ++l) {
       if (useGpu_) {
         GruCompute::forward<1>(gruValue, getSize());
@@ -193,6 +210,10 @@ void GatedRecurrentLayer::forwardSequence(int batchSize,
 
       nextFrame(reversed_, getSize());
     }
+    if (statePerSequence && !reversed_ && length > 0) {
+      prevOutput_->subMatrix(n, 1)->assign(
+          *output_.value->subMatrix(starts[n + 1] - 1, 1));
+    }
     if (!reversed_) {
       if (!prevOutput_) gruValue.prevOutValue = nullptr;
     } else {
@@ -201,7 +222,7 @@ void GatedRecurrentLayer::forwardSequence(int batchSize,
   }
 
   if (!reversed_) {
-    if (prevOutput_) {
+    if (prevOutput_ && !statePerSequence) {
       prevOutput_->assign(*output_.value->subMatrix(batchSize - 1, 1));
     }
   }
@@ -13,6 +13,7 @@ See the License for the specific language governing permissions and
 limitations under the License. */
 
 #include "GruCompute.h"
+#include "PackedRecurrentWeight.h"
 #include "hl_recurrent_apply.cuh"
 #include "paddle/utils/Util.h"
 
@@ -23,8 +24,71 @@ void GruCompute::init(LayerConfig &config) {
   activeGate_ = hlActiveType(config.active_gate_type());
 }
 
+void GruCompute::initPackedWeight(const std::shared_ptr<Parameter> &parameter,
+                                  int frameSize,
+                                  bool useGpu) {
+  if (!PackedRecurrentWeight::isSupported(parameter, useGpu)) return;
+  packedGateWeight_ = PackedRecurrentWeight::get(parameter, 0, frameSize, 2);
+  packedStateWeight_ = PackedRecurrentWeight::get(
+      parameter, (size_t)frameSize * frameSize * 2, frameSize, 1);
+}
+
+void GruCompute::updatePackedWeight() {
+  if (packedGateWeight_) {
+    packedGateWeight_->update();
+    packedStateWeight_->update();
+  }
+}
+
+void GruCompute::forwardPacked(hl_gru_value value,
+                               int frameSize,
+                               int batchSize) {
+  const int kBlockSize = PackedRecurrentWeight::kBlockSize;
+  hppl::forward::gru_resetOutput opResetOutput;
+  hppl::forward::gru_finalOutput opFinalOutput;
+  hppl::Active<real>::forward actGate = hppl::cpu::forward[activeGate_];
+  hppl::Active<real>::forward actNode = hppl::cpu::forward[activeNode_];
+
+  // update gate, reset gate and reset output
+  packedGateWeight_->mul<2>(
+      value.prevOutValue,
+      batchSize,
+      [&](int n, int j, int size, const real *sum) {
+        real *updateGate = value.gateValue + n * frameSize * 3 + j;
+        real *resetGate = updateGate + frameSize;
+        real *prevOut = value.prevOutValue + n * frameSize + j;
+        real *resetOutput = value.resetOutputValue + n * frameSize + j;
+        for (int k = 0; k < size; ++k) {
+          updateGate[k] += sum[k];
+          resetGate[k] += sum[kBlockSize + k];
+          opResetOutput(
+              updateGate[k], resetGate[k], prevOut[k], resetOutput[k], actGate);
+        }
+      });
+
+  // frame state and output
+  packedStateWeight_->mul<1>(
+      value.resetOutputValue,
+      batchSize,
+      [&](int n, int j, int size, const real *sum) {
+        real *updateGate = value.gateValue + n * frameSize * 3 + j;
+        real *frameState = updateGate + frameSize * 2;
+        real *prevOut = value.prevOutValue + n * frameSize + j;
+        real *output = value.outputValue + n * frameSize + j;
+        for (int k = 0; k < size; ++k) {
+          frameState[k] += sum[k];
+          opFinalOutput(
+              updateGate[k], frameState[k], prevOut[k], output[k], actNode);
+        }
+      });
+}
+
 template <>
 void GruCompute::forward<0>(hl_gru_value value, int frameSize, int batchSize) {
+  if (packedGateWeight_ && value.prevOutValue) {
+    forwardPacked(value, frameSize, batchSize);
+    return;
+  }
   hl_cpu_gru_forward(hppl::forward::gru_resetOutput(),
                      hppl::forward::gru_finalOutput(),
                      value,
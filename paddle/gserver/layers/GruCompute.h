@@ -14,12 +14,16 @@ limitations under the License. */
 
 #pragma once
 
+#include <memory>
 #include "ModelConfig.pb.h"
 #include "hl_gpu.h"
 #include "paddle/utils/Common.h"
 
 namespace paddle {
 
+class Parameter;
+class PackedRecurrentWeight;
+
 class GruCompute {
 public:
   void init(LayerConfig &config);
@@ -33,9 +37,25 @@ public:
                 int frameSize,
                 int batchSize = 1);
 
+  /**
+   * Use the packed weights of the parameter in forward<0>, if the layer has
+   * no weight gradient and runs on CPU. Then the frames with previous output
+   * are computed by the fused kernel, see PackedRecurrentWeight.
+   */
+  void initPackedWeight(const std::shared_ptr<Parameter> &parameter,
+                        int frameSize,
+                        bool useGpu);
+  /// Called at the beginning of each forward of the layer.
+  void updatePackedWeight();
+
+protected:
+  void forwardPacked(hl_gru_value value, int frameSize, int batchSize);
+
 public:
   hl_activation_mode_t activeNode_;
   hl_activation_mode_t activeGate_;
+  std::shared_ptr<PackedRecurrentWeight> packedGateWeight_;
+  std::shared_ptr<PackedRecurrentWeight> packedStateWeight_;
 };
 
 }  // namespace paddle
@@ -78,12 +78,14 @@ bool GruStepLayer::init(const LayerMap& layerMap,
   }
 
   GruCompute::init(config_);
+  GruCompute::initPackedWeight(parameters_[0], getSize(), useGpu_);
   return true;
 }
 
 void GruStepLayer::forward(PassType passType) {
   REGISTER_TIMER_INFO("GruStepFwTime", getName().c_str());
   Layer::forward(passType);
+  GruCompute::updatePackedWeight();
 
   const Argument& input = getInput(0);
   const Argument& prevOutput = getInput(1);
@@ -13,6 +13,7 @@ See the License for the specific language governing permissions and
 limitations under the License. */
 
 #include "LstmCompute.h"
+#include "PackedRecurrentWeight.h"
 #include "hl_recurrent_apply.cuh"
 #include "paddle/utils/Util.h"
 
@@ -24,6 +25,61 @@ void LstmCompute::init(LayerConfig &config) {
   activeState_ = hlActiveType(config.active_state_type());
 }
 
+void LstmCompute::initPackedWeight(const std::shared_ptr<Parameter> &parameter,
+                                   int frameSize,
+                                   bool useGpu) {
+  if (!PackedRecurrentWeight::isSupported(parameter, useGpu)) return;
+  packedWeight_ = PackedRecurrentWeight::get(parameter, 0, frameSize, 4);
+}
+
+void LstmCompute::updatePackedWeight() {
+  if (packedWeight_) {
+    packedWeight_->update();
+  }
+}
+
+void LstmCompute::forwardBatchPacked(hl_lstm_value value,
+                                     const real *prevOutput,
+                                     int frameSize,
+                                     int batchSize) {
+  const int kBlockSize = PackedRecurrentWeight::kBlockSize;
+  hppl::forward::lstm op;
+  hppl::Active<real>::forward actNode = hppl::cpu::forward[activeNode_];
+  hppl::Active<real>::forward actGate = hppl::cpu::forward[activeGate_];
+  hppl::Active<real>::forward actState = hppl::cpu::forward[activeState_];
+
+  packedWeight_->mul<4>(
+      prevOutput, batchSize, [&](int n, int j, int size, const real *sum) {
+        real *valueIn = value.gateValue + n * frameSize * 4 + j;
+        real *valueIg = valueIn + frameSize;
+        real *valueFg = valueIn + frameSize * 2;
+        real *valueOg = valueIn + frameSize * 3;
+        size_t offset = (size_t)n * frameSize + j;
+        for (int k = 0; k < size; ++k) {
+          valueIn[k] += sum[k];
+          valueIg[k] += sum[kBlockSize + k];
+          valueFg[k] += sum[kBlockSize * 2 + k];
+          valueOg[k] += sum[kBlockSize * 3 + k];
+          real prevState =
+              value.prevStateValue ? value.prevStateValue[offset + k] : 0;
+          op(valueIn[k],
+             valueIg[k],
+             valueFg[k],
+             valueOg[k],
+             prevState,
+             value.stateValue[offset + k],
+             value.stateActiveValue[offset + k],
+             value.outputValue[offset + k],
+             value.checkIg[j + k],
+             value.checkFg[j + k],
+             value.checkOg[j + k],
+             actNode,
+             actGate,
+             actState);
+        }
+      });
+}
+
 template <>
 void LstmCompute::forwardOneSequence<0>(hl_lstm_value value, int frameSize) {
   hl_cpu_lstm_forward(hppl::forward::lstm(),
@@ -14,12 +14,16 @@ limitations under the License. */
 
 #pragma once
 
+#include <memory>
 #include "ModelConfig.pb.h"
 #include "hl_gpu.h"
 #include "paddle/utils/Common.h"
 
 namespace paddle {
 
+class Parameter;
+class PackedRecurrentWeight;
+
 class LstmCompute {
 public:
   void init(LayerConfig &config);
@@ -57,10 +61,32 @@ public:
                            hl_lstm_grad grad,
                            int frameSize);
 
+  /**
+   * Pack the recurrent weight of the parameter, if the layer has no weight
+   * gradient and runs on CPU. Then packedWeight_ is not null and the layer
+   * uses forwardBatchPacked for the frames with previous output.
+   */
+  void initPackedWeight(const std::shared_ptr<Parameter> &parameter,
+                        int frameSize,
+                        bool useGpu);
+  /// Called at the beginning of each forward of the layer.
+  void updatePackedWeight();
+
+  /**
+   * The CPU forwardBatch of the frames whose gates do not include the
+   * recurrent projection yet. The projection of prevOutput (batchSize x
+   * frameSize) is fused with the activations, see PackedRecurrentWeight.
+   */
+  void forwardBatchPacked(hl_lstm_value value,
+                          const real *prevOutput,
+                          int frameSize,
+                          int batchSize);
+
 public:
   hl_activation_mode_t activeNode_;
   hl_activation_mode_t activeGate_;
   hl_activation_mode_t activeState_;
+  std::shared_ptr<PackedRecurrentWeight> packedWeight_;
 };
 
 }  // namespace paddle
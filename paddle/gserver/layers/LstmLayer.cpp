@@ -13,11 +13,20 @@ See the License for the specific language governing permissions and
 limitations under the License. */
 
 #include "LstmLayer.h"
+#include <algorithm>
+#include <cstring>
+#include "PackedRecurrentWeight.h"
 #include "paddle/math/BaseMatrix.h"
 #include "paddle/math/Matrix.h"
 #include "paddle/utils/Stat.h"
 
 DECLARE_bool(prev_batch_state);
+DECLARE_bool(packed_recurrent_weight);
+DEFINE_int32(lstm_cpu_threads,
+             0,
+             "The number of threads which compute the sequences of a "
+             "lstmemory layer in parallel on CPU. If it is less than 2, "
+             "the frames of all the sequences are computed in batches.");
 
 namespace paddle {
 
@@ -96,6 +105,7 @@ bool LstmLayer::init(const LayerMap &layerMap,
   activation_.reset(ActivationFunction::create(""));
 
   LstmCompute::init(config_);
+  LstmCompute::initPackedWeight(parameters_[0], getSize(), useGpu_);
   useBatch_ = true;
   useSeqParallel_ = false;
   if (useGpu_ && (getSize() == 32 || getSize() == 64)) {
@@ -121,6 +131,11 @@ void LstmLayer::resetState() {
 
 void LstmLayer::setState(LayerStatePtr state) {
   CHECK(state->value.size() == 2) << "two matrices are expected for LSTM state";
+  // A state of several rows has one row for each sequence of the next batch,
+  // which is only supported by the batch computation.
+  if (state->value[0]->getHeight() > 1) {
+    useBatch_ = true;
+  }
   prevOutput_->resize(state->value[0]->getHeight(),
                       state->value[0]->getWidth());
   prevState_->resize(state->value[1]->getHeight(), state->value[1]->getWidth());
@@ -150,6 +165,7 @@ LayerStatePtr LstmLayer::getState() {
 void LstmLayer::forward(PassType passType) {
   REGISTER_TIMER_INFO("LstmFwTimer", getName().c_str());
   Layer::forward(passType);
+  LstmCompute::updatePackedWeight();
 
   const Argument &input = getInput(0);
   CHECK(input.sequenceStartPositions);
@@ -203,6 +219,8 @@ void LstmLayer::forward(PassType passType) {
 
   if (!useBatch_) {
     forwardSequence(batchSize, numSequences, starts, input.value);
+  } else if (useSeqParallelCpu(numSequences)) {
+    forwardSeqParallelCpu(numSequences, starts, input.value);
   } else {
     if (!useSeqParallel_) {
       forwardBatch(batchSize, numSequences, starts, input.value);
@@ -243,6 +261,8 @@ void LstmLayer::backward(const UpdateCallback &callback) {
   const int *starts = input.sequenceStartPositions->getData(false);
   if (!useBatch_) {
     backwardSequence(batchSize, numSequences, starts, input.grad);
+  } else if (useSeqParallelCpu(numSequences)) {
+    backwardSeqParallelCpu(batchSize, numSequences, starts, input.grad);
   } else {
     if (!useSeqParallel_) {
       backwardBatch(batchSize, numSequences, starts, input.grad);
@@ -310,13 +330,24 @@ void LstmLayer::forwardSequence(int batchSize,
                                          /* trans= */ false,
                                          useGpu_);
 
+  // With the packed weight, the projection of the previous output is left
+  // to the fused kernel of the next frame.
+  real *prevFrameOutput = nullptr;
+  auto projectFrame = [&](const MatrixPtr &prev) {
+    if (packedWeight_) {
+      prevFrameOutput = prev->getData();
+    } else {
+      frameGate->mul(*prev, *weight_->getW(), 1, 1);
+    }
+  };
+
   if (!reversed_) {
     if (prevState_) {
       lstmValue.prevStateValue = prevState_->getData();
     }
     if (prevOutput_) {
       frameGate->setData(lstmValue.gateValue);
-      frameGate->mul(*prevOutput_, *weight_->getW(), 1, 1);
+      projectFrame(prevOutput_);
     }
   }
   AsyncGpuBlock asyncGpuBlock;
@@ -330,6 +361,10 @@ void LstmLayer::forwardSequence(int batchSize,
     for (int l = 0; l < length; ++l) {
       if (useGpu_) {
         LstmCompute::forwardOneSequence<1>(lstmValue, getSize());
+      } else if (prevFrameOutput) {
+        LstmCompute::forwardBatchPacked(
+            lstmValue, prevFrameOutput, getSize(), /* batchSize */ 1);
+        prevFrameOutput = nullptr;
       } else {
         LstmCompute::forwardOneSequence<0>(lstmValue, getSize());
       }
@@ -338,7 +373,7 @@ void LstmLayer::forwardSequence(int batchSize,
         frameOutput->setData(lstmValue.outputValue);
         nextFrame(reversed_, getSize());
         frameGate->setData(lstmValue.gateValue);
-        frameGate->mul(*frameOutput, *weight_->getW(), 1, 1);
+        projectFrame(frameOutput);
       }
     }
     if (n != numSequences - 1) {
@@ -348,7 +383,7 @@ void LstmLayer::forwardSequence(int batchSize,
       if (!reversed_) {
         if (!prevState_) lstmValue.prevStateValue = nullptr;
         if (prevOutput_) {
-          frameGate->mul(*frameOutput, *weight_->getW(), 1, 1);
+          projectFrame(frameOutput);
         }
       } else {
         lstmValue.prevStateValue = nullptr;
@@ -539,9 +574,10 @@ void LstmLayer::forwardBatch(int batchSize,
       MatrixPtr gateValue = batchValue_->getBatchValue(*gate_.value, n);
       batchSize = outputValue->getHeight();
 
+      // the previous output, projected by the fused kernel if it is set
+      MatrixPtr prevBatchOutput;
       if (n != 0) {
-        MatrixPtr batch1 = batchValue_->getBatchValue(n - 1, batchSize);
-        gateValue->mul(*batch1, *weight_->getW(), 1, 1);
+        prevBatchOutput = batchValue_->getBatchValue(n - 1, batchSize);
       } else if (prevOutput_) {
         Matrix::resizeOrCreate(prevBatchOutput2_,
                                gateValue->getHeight(),
@@ -549,11 +585,14 @@ void LstmLayer::forwardBatch(int batchSize,
                                false,
                                useGpu_);
         batchValue_->prevOutput2Batch(*prevOutput_, *prevBatchOutput2_);
-        gateValue->mul(*prevBatchOutput2_, *weight_->getW(), 1, 1);
+        prevBatchOutput = prevBatchOutput2_;
 
         batchValue_->prevOutput2Batch(*prevState_,
                                       *totalState_->subMatrix(0, numSequences));
       }
+      if (prevBatchOutput && !packedWeight_) {
+        gateValue->mul(*prevBatchOutput, *weight_->getW(), 1, 1);
+      }
 
       lstmValue.gateValue = gateValue->getData();
       lstmValue.outputValue = outputValue->getData();
@@ -564,6 +603,9 @@ void LstmLayer::forwardBatch(int batchSize,
       {
         if (useGpu_) {
           LstmCompute::forwardBatch<1>(lstmValue, getSize(), batchSize);
+        } else if (prevBatchOutput && packedWeight_) {
+          LstmCompute::forwardBatchPacked(
+              lstmValue, prevBatchOutput->getData(), getSize(), batchSize);
         } else {
           LstmCompute::forwardBatch<0>(lstmValue, getSize(), batchSize);
         }
@@ -802,4 +844,264 @@ void LstmLayer::backwardSeqParallel(int batchSize,
   }
 }
 
+bool LstmLayer::useSeqParallelCpu(size_t numSequences) const {
+  return !useGpu_ && FLAGS_lstm_cpu_threads > 1 && !prevOutput_ &&
+         numSequences > 1;
+}
+
+void LstmLayer::partitionSequences(size_t numSequences, const int *starts) {
+  if (!seqParallelPool_) {
+    seqParallelPool_.reset(
+        new SyncThreadPool(FLAGS_lstm_cpu_threads, /* checkOwner */ false));
+  }
+  size_t numThreads = seqParallelPool_->getNumThreads();
+  std::vector<int> order(numSequences);
+  for (size_t i = 0; i < numSequences; ++i) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), [starts](int a, int b) {
+    return starts[a + 1] - starts[a] > starts[b + 1] - starts[b];
+  });
+
+  // Give the longest remaining sequence to the group with the fewest frames.
+  seqGroups_.assign(numThreads, std::vector<int>());
+  std::vector<int> frames(numThreads, 0);
+  for (int seq : order) {
+    size_t tid =
+        std::min_element(frames.begin(), frames.end()) - frames.begin();
+    seqGroups_[tid].push_back(seq);
+    frames[tid] += starts[seq + 1] - starts[seq];
+  }
+  seqParallelOutput_.resize(numThreads);
+  seqParallelGate_.resize(numThreads);
+}
+
+void LstmLayer::forwardSeqParallelCpu(size_t numSequences,
+                                      const int *starts,
+                                      MatrixPtr inputValue) {
+  REGISTER_TIMER_INFO("LstmFwSeqParallelCpuTime", getName().c_str());
+  gate_.value->assign(*inputValue);
+  if (bias_) {
+    gate_.value->addBias(*localBias_, /* scale */ 1);
+  }
+  partitionSequences(numSequences, starts);
+
+  int frameSize = getSize();
+  // The position of the l-th frame of a sequence.
+  auto framePos = [starts, this](int seq, int l) {
+    return reversed_ ? starts[seq + 1] - 1 - l : starts[seq] + l;
+  };
+
+  // The recurrent weight is packed once for all the steps of this batch.
+  // Without weight gradient, the shared packedWeight_ is already up to date.
+  // Otherwise the weight changes after each batch, and the layer repacks its
+  // own copy.
+  const PackedRecurrentWeight *packed = packedWeight_.get();
+  if (!packed && FLAGS_packed_recurrent_weight) {
+    if (!seqParallelWeight_) {
+      seqParallelWeight_ = std::make_shared<PackedRecurrentWeight>(
+          parameters_[0], 0, frameSize, 4);
+    }
+    seqParallelWeight_->repack();
+    packed = seqParallelWeight_.get();
+  }
+  const int kBlockSize = PackedRecurrentWeight::kBlockSize;
+
+  seqParallelPool_->exec([&](int tid, size_t) {
+    const std::vector<int> &group = seqGroups_[tid];
+    if (group.empty()) return;
+    int maxLength = starts[group[0] + 1] - starts[group[0]];
+    MatrixPtr &prevOutput = seqParallelOutput_[tid];
+    MatrixPtr &recurrGate = seqParallelGate_[tid];
+
+    hl_lstm_value lstmValue;
+    lstmValue.checkIg = checkIg_->getData();
+    lstmValue.checkFg = checkFg_->getData();
+    lstmValue.checkOg = checkOg_->getData();
+
+    size_t numActive = group.size();
+    for (int l = 0; l < maxLength; ++l) {
+      while (starts[group[numActive - 1] + 1] - starts[group[numActive - 1]] <=
+             l) {
+        --numActive;
+      }
+      if (l > 0) {
+        // gather the outputs of the previous frame and project them at once
+        Matrix::resizeOrCreate(prevOutput, numActive, frameSize, false, false);
+        for (size_t i = 0; i < numActive; ++i) {
+          memcpy(prevOutput->getRowBuf(i),
+                 output_.value->getRowBuf(framePos(group[i], l - 1)),
+                 sizeof(real) * frameSize);
+        }
+        if (packed) {
+          // add the projection of each block to the gates of its frame
+          packed->mul<4>(
+              prevOutput->getData(),
+              numActive,
+              [&](int n, int j, int size, const real *sum) {
+                real *gate = gate_.value->getRowBuf(framePos(group[n], l)) + j;
+                for (int g = 0; g < 4; ++g) {
+                  for (int k = 0; k < size; ++k) {
+                    gate[g * frameSize + k] += sum[g * kBlockSize + k];
+                  }
+                }
+              });
+        } else {
+          Matrix::resizeOrCreate(
+              recurrGate, numActive, frameSize * 4, false, false);
+          recurrGate->mul(*prevOutput, *weight_->getW(), 1, 0);
+        }
+      }
+      for (size_t i = 0; i < numActive; ++i) {
+        int pos = framePos(group[i], l);
+        real *gate = gate_.value->getRowBuf(pos);
+        if (l > 0 && !packed) {
+          const real *recurr = recurrGate->getRowBuf(i);
+          for (int j = 0; j < frameSize * 4; ++j) {
+            gate[j] += recurr[j];
+          }
+        }
+        lstmValue.gateValue = gate;
+        lstmValue.stateValue = state_.value->getRowBuf(pos);
+        lstmValue.stateActiveValue = preOutput_.value->getRowBuf(pos);
+        lstmValue.outputValue = output_.value->getRowBuf(pos);
+        lstmValue.prevStateValue =
+            l > 0 ? state_.value->getRowBuf(framePos(group[i], l - 1))
+                  : nullptr;
+        LstmCompute::forwardOneSequence<0>(lstmValue, frameSize);
+      }
+    }
+  });
+}
+
+void LstmLayer::backwardSeqParallelCpu(int batchSize,
+                                       size_t numSequences,
+                                       const int *starts,
+                                       MatrixPtr inputGrad) {
+  REGISTER_TIMER_INFO("LstmBwSeqParallelCpuTime", getName().c_str());
+  int frameSize = getSize();
+  size_t numThreads = seqParallelPool_->getNumThreads();
+  bool hasCheckGrad = bias_->getWGrad() != nullptr;
+  if (hasCheckGrad) {
+    Matrix::resizeOrCreate(
+        seqParallelCheckGrad_, numThreads, frameSize * 3, false, false);
+    seqParallelCheckGrad_->zeroMem();
+  }
+  if (weight_->getWGrad()) {
+    Matrix::resizeOrCreate(
+        seqParallelPrevOutput_, batchSize, frameSize, false, false);
+  }
+  auto framePos = [starts, this](int seq, int l) {
+    return reversed_ ? starts[seq + 1] - 1 - l : starts[seq] + l;
+  };
+  MatrixPtr weightT = weight_->getW()->getTranspose();
+
+  seqParallelPool_->exec([&](int tid, size_t) {
+    const std::vector<int> &group = seqGroups_[tid];
+    if (group.empty()) return;
+    int maxLength = starts[group[0] + 1] - starts[group[0]];
+    MatrixPtr &gateGrad = seqParallelGate_[tid];
+    MatrixPtr &recurrGrad = seqParallelOutput_[tid];
+
+    hl_lstm_value lstmValue;
+    hl_lstm_grad lstmGrad;
+    lstmValue.checkIg = checkIg_->getData();
+    lstmValue.checkFg = checkFg_->getData();
+    lstmValue.checkOg = checkOg_->getData();
+    lstmValue.outputValue = nullptr;
+    if (hasCheckGrad) {
+      lstmGrad.checkIgGrad = seqParallelCheckGrad_->getRowBuf(tid);
+      lstmGrad.checkFgGrad = lstmGrad.checkIgGrad + frameSize;
+      lstmGrad.checkOgGrad = lstmGrad.checkIgGrad + frameSize * 2;
+    } else {
+      lstmGrad.checkIgGrad = nullptr;
+      lstmGrad.checkFgGrad = nullptr;
+      lstmGrad.checkOgGrad = nullptr;
+    }
+    lstmGrad.stateActiveGrad = nullptr;
+
+    size_t numActive = 0;
+    for (int l = maxLength - 1; l >= 0; --l) {
+      while (numActive < group.size() &&
+             starts[group[numActive] + 1] - starts[group[numActive]] > l) {
+        ++numActive;
+      }
+      for (size_t i = 0; i < numActive; ++i) {
+        int pos = framePos(group[i], l);
+        int prevPos = l > 0 ? framePos(group[i], l - 1) : -1;
+        lstmValue.gateValue = gate_.value->getRowBuf(pos);
+        lstmValue.stateValue = state_.value->getRowBuf(pos);
+        lstmValue.stateActiveValue = preOutput_.value->getRowBuf(pos);
+        lstmGrad.gateGrad = gate_.grad->getRowBuf(pos);
+        lstmGrad.stateGrad = state_.grad->getRowBuf(pos);
+        lstmGrad.outputGrad = output_.grad->getRowBuf(pos);
+        if (l > 0) {
+          lstmValue.prevStateValue = state_.value->getRowBuf(prevPos);
+          lstmGrad.prevStateGrad = state_.grad->getRowBuf(prevPos);
+        } else {
+          lstmValue.prevStateValue = nullptr;
+          lstmGrad.prevStateGrad = nullptr;
+        }
+        LstmCompute::backwardOneSequence<0>(lstmValue, lstmGrad, frameSize);
+      }
+      if (l > 0) {
+        // propagate the gate gradients of the group to the previous frame
+        Matrix::resizeOrCreate(
+            gateGrad, numActive, frameSize * 4, false, false);
+        Matrix::resizeOrCreate(recurrGrad, numActive, frameSize, false, false);
+        for (size_t i = 0; i < numActive; ++i) {
+          memcpy(gateGrad->getRowBuf(i),
+                 gate_.grad->getRowBuf(framePos(group[i], l)),
+                 sizeof(real) * frameSize * 4);
+        }
+        recurrGrad->mul(*gateGrad, *weightT, 1, 0);
+        for (size_t i = 0; i < numActive; ++i) {
+          real *outputGrad =
+              output_.grad->getRowBuf(framePos(group[i], l - 1));
+          const real *recurr = recurrGrad->getRowBuf(i);
+          for (int j = 0; j < frameSize; ++j) {
+            outputGrad[j] += recurr[j];
+          }
+        }
+      }
+    }
+
+    if (weight_->getWGrad()) {
+      for (int seq : group) {
+        int start = starts[seq];
+        int length = starts[seq + 1] - start;
+        if (length == 0) continue;
+        int first = reversed_ ? start + length - 1 : start;
+        int shifted = reversed_ ? start : start + 1;
+        int origin = reversed_ ? start + 1 : start;
+        memset(seqParallelPrevOutput_->getRowBuf(first),
+               0,
+               sizeof(real) * frameSize);
+        if (length > 1) {
+          memcpy(seqParallelPrevOutput_->getRowBuf(shifted),
+                 output_.value->getRowBuf(origin),
+                 sizeof(real) * frameSize * (length - 1));
+        }
+      }
+    }
+  });
+
+  if (inputGrad) {
+    inputGrad->add(*gate_.grad);
+  }
+  if (bias_ && bias_->getWGrad()) {
+    localBiasGrad_->collectBias(*gate_.grad, 1);
+    MatrixPtr checkGrad = Matrix::create(checkIgGrad_->getData(),
+                                         /* height= */ 1,
+                                         frameSize * 3,
+                                         /* trans= */ false,
+                                         false);
+    checkGrad->collectBias(*seqParallelCheckGrad_, 1);
+  }
+  if (weight_->getWGrad()) {
+    weight_->getWGrad()->mul(
+        *seqParallelPrevOutput_->getTranspose(), *gate_.grad, 1, 1);
+  }
+}
+
 }  // namespace paddle
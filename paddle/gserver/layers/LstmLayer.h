@@ -19,6 +19,7 @@ limitations under the License. */
 #include "SequenceToBatch.h"
 #include "paddle/math/BaseMatrix.h"
 #include "paddle/math/Matrix.h"
+#include "paddle/utils/Thread.h"
 namespace paddle {
 
 /**
@@ -154,6 +155,39 @@ protected:
                            size_t numSequences,
                            const int *starts,
                            MatrixPtr inputGrad);
+  /**
+   * The CPU version of forwardSeqParallel. The sequences are divided into
+   * FLAGS_lstm_cpu_threads groups with about the same number of frames, and
+   * each group is computed by one thread. The sequences of a group advance
+   * one frame together, so the recurrent projection of a step is one matrix
+   * multiplication of the group. The recurrent weight is packed once per
+   * batch into blocks (see PackedRecurrentWeight), which each thread reads
+   * contiguously at every step. With --packed_recurrent_weight=false, the
+   * projection is a GEMM with the unpacked weight.
+   */
+  void forwardSeqParallelCpu(size_t numSequences,
+                             const int *starts,
+                             MatrixPtr inputValue);
+  /**
+   * Backward propagation corresponding to forwardSeqParallelCpu. The weight
+   * gradient is computed by one matrix multiplication of all the frames after
+   * the threads finish.
+   */
+  void backwardSeqParallelCpu(int batchSize,
+                              size_t numSequences,
+                              const int *starts,
+                              MatrixPtr inputGrad);
+  /**
+   * Whether forwardSeqParallelCpu is used. It does not support the states
+   * of sequence generation.
+   */
+  bool useSeqParallelCpu(size_t numSequences) const;
+  /**
+   * Divide the sequences into seqGroups_. Each group is sorted by length in
+   * descending order, so the sequences still running at a step are always a
+   * prefix of the group.
+   */
+  void partitionSequences(size_t numSequences, const int *starts);
   /**
    * This function is used for sequence generation and get output after
    * forwardBatch.
@@ -203,6 +237,22 @@ protected:
   bool useBatch_;
   /// Whether to use sequence parallell method to compute.
   bool useSeqParallel_;
+  /// The threads of forwardSeqParallelCpu, created on first use.
+  std::unique_ptr<SyncThreadPool> seqParallelPool_;
+  /// The indices of the sequences computed by each thread.
+  std::vector<std::vector<int>> seqGroups_;
+  /// The recurrent weight packed by forwardSeqParallelCpu, when the layer
+  /// has weight gradient and cannot use the shared packedWeight_.
+  std::shared_ptr<PackedRecurrentWeight> seqParallelWeight_;
+  /// The temporary matrices of each thread in forwardSeqParallelCpu and
+  /// backwardSeqParallelCpu, with one row for each sequence of the group.
+  std::vector<MatrixPtr> seqParallelOutput_;
+  std::vector<MatrixPtr> seqParallelGate_;
+  /// The peephole gradients of each thread, one row per thread.
+  MatrixPtr seqParallelCheckGrad_;
+  /// The output of the previous frame of each frame, zero for the first
+  /// frames of the sequences.
+  MatrixPtr seqParallelPrevOutput_;
   /// batchValue_ is used in method of batch calculation. It stores the
   /// batch value after reorganized input.
   std::unique_ptr<SequenceToBatch> batchValue_;
@@ -0,0 +1,111 @@
+/* Copyright (c) 2016 PaddlePaddle Authors. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "PackedRecurrentWeight.h"
+#include <map>
+#include "paddle/utils/Flags.h"
+
+DEFINE_bool(packed_recurrent_weight,
+            true,
+            "Whether the gated_recurrent, gru_step and lstmemory layers "
+            "without weight gradient use the packed recurrent weight and the "
+            "fused step kernels on CPU.");
+
+namespace paddle {
+
+const int PackedRecurrentWeight::kBlockSize;
+
+std::shared_ptr<PackedRecurrentWeight> PackedRecurrentWeight::get(
+    const ParameterPtr& parameter, size_t offset, int frameSize, int numGates) {
+  static std::mutex registryLock;
+  static std::map<std::pair<Parameter*, size_t>,
+                  std::weak_ptr<PackedRecurrentWeight>>
+      registry;
+
+  std::lock_guard<std::mutex> guard(registryLock);
+  auto& weak = registry[std::make_pair(parameter.get(), offset)];
+  std::shared_ptr<PackedRecurrentWeight> packed = weak.lock();
+  if (!packed) {
+    packed = std::make_shared<PackedRecurrentWeight>(
+        parameter, offset, frameSize, numGates);
+    weak = packed;
+  }
+  CHECK_EQ(packed->frameSize_, frameSize);
+  CHECK_EQ(packed->numGates_, numGates);
+  return packed;
+}
+
+bool PackedRecurrentWeight::isSupported(const ParameterPtr& parameter,
+                                        bool useGpu) {
+  return FLAGS_packed_recurrent_weight && !useGpu && !parameter->isSparse() &&
+         !parameter->getBuf(PARAMETER_GRADIENT);
+}
+
+PackedRecurrentWeight::PackedRecurrentWeight(const ParameterPtr& parameter,
+                                             size_t offset,
+                                             int frameSize,
+                                             int numGates)
+    : parameter_(parameter),
+      offset_(offset),
+      frameSize_(frameSize),
+      numGates_(numGates),
+      packedVersion_(0),
+      packedData_(nullptr) {
+  CHECK_LE(offset + (size_t)frameSize * frameSize * numGates,
+           parameter->getSize());
+  int numBlocks = (frameSize + kBlockSize - 1) / kBlockSize;
+  packed_.resize((size_t)numBlocks * frameSize * numGates * kBlockSize);
+}
+
+void PackedRecurrentWeight::update() {
+  std::lock_guard<std::mutex> guard(lock_);
+  const real* weight =
+      parameter_->getBuf(PARAMETER_VALUE)->getData() + offset_;
+  if (weight == packedData_ &&
+      packedVersion_ == parameter_->getValueVersion()) {
+    return;
+  }
+  pack(weight);
+  packedData_ = weight;
+  packedVersion_ = parameter_->getValueVersion();
+}
+
+void PackedRecurrentWeight::repack() {
+  std::lock_guard<std::mutex> guard(lock_);
+  const real* weight =
+      parameter_->getBuf(PARAMETER_VALUE)->getData() + offset_;
+  pack(weight);
+  packedData_ = weight;
+  packedVersion_ = parameter_->getValueVersion();
+}
+
+void PackedRecurrentWeight::pack(const real* weight) {
+  const int width = numGates_ * kBlockSize;
+  const int ld = numGates_ * frameSize_;
+  real* dst = packed_.data();
+  for (int j = 0; j < frameSize_; j += kBlockSize) {
+    int size = std::min(kBlockSize, frameSize_ - j);
+    for (int i = 0; i < frameSize_; ++i) {
+      for (int g = 0; g < numGates_; ++g) {
+        const real* src = weight + (size_t)i * ld + g * frameSize_ + j;
+        for (int k = 0; k < kBlockSize; ++k) {
+          dst[g * kBlockSize + k] = k < size ? src[k] : 0;
+        }
+      }
+      dst += width;
+    }
+  }
+}
+
+}  // namespace paddle
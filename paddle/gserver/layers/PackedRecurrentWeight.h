@@ -0,0 +1,132 @@
+/* Copyright (c) 2016 PaddlePaddle Authors. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "paddle/parameter/Parameter.h"
+
+namespace paddle {
+
+/**
+ * @brief The recurrent weight of a GRU or LSTM layer packed for the fused
+ *        step kernels of CPU inference.
+ *
+ * The weight is a frameSize x (numGates * frameSize) matrix stored at an
+ * offset of a parameter, and the gate g of the unit j is the column
+ * g * frameSize + j. The units are divided into blocks of kBlockSize, and
+ * the columns of all the gates of a block are stored together row by row.
+ * So mul() reads each block contiguously, and has all the gates of the
+ * units of a block ready when the block is finished. The epilogue applies
+ * the nonlinearities of the block right away, and the projected gates are
+ * never written back to memory before being activated.
+ *
+ * The packed weight of a parameter is shared by all the layers, including
+ * the frames of a recurrent layer group. It is only valid for the layers
+ * without weight gradient, whose parameter changes by loading or
+ * randomizing, which call Parameter::setValueUpdated(). A layer which
+ * trains the parameter owns its packed weight and calls repack() before
+ * using it.
+ */
+class PackedRecurrentWeight {
+public:
+  static const int kBlockSize = 8;
+
+  /**
+   * @brief The packed weight starting at the element offset of the
+   *        parameter, created on the first call.
+   */
+  static std::shared_ptr<PackedRecurrentWeight> get(
+      const ParameterPtr& parameter,
+      size_t offset,
+      int frameSize,
+      int numGates);
+
+  /**
+   * @brief Whether the packed weight can be used by a layer.
+   */
+  static bool isSupported(const ParameterPtr& parameter, bool useGpu);
+
+  PackedRecurrentWeight(const ParameterPtr& parameter,
+                        size_t offset,
+                        int frameSize,
+                        int numGates);
+
+  /**
+   * @brief Pack the weight again if the parameter value has been changed
+   *        since the last pack.
+   */
+  void update();
+
+  /**
+   * @brief Pack the weight again unconditionally. It is used by the layers
+   *        which train the parameter, whose value changes after each batch
+   *        without Parameter::setValueUpdated().
+   */
+  void repack();
+
+  /**
+   * @brief For each row n of input (batchSize x frameSize), compute
+   *        input[n] * weight block by block. After each block, call
+   *        epilogue(n, j, size, sum), where j is the first unit of the
+   *        block, size is the number of units in the block, and
+   *        sum[g * kBlockSize + k] is the gate g of the unit j + k.
+   */
+  template <int numGates, class Epilogue>
+  void mul(const real* input, int batchSize, Epilogue epilogue) const {
+    CHECK_EQ(numGates, numGates_);
+    const int width = numGates * kBlockSize;
+    real sum[numGates * kBlockSize];
+    for (int j = 0; j < frameSize_; j += kBlockSize) {
+      const real* block = packed_.data() + (size_t)j * frameSize_ * numGates;
+      for (int n = 0; n < batchSize; ++n) {
+        const real* in = input + (size_t)n * frameSize_;
+        const real* w = block;
+        for (int k = 0; k < width; ++k) {
+          sum[k] = 0;
+        }
+        for (int i = 0; i < frameSize_; ++i) {
+          real x = in[i];
+          for (int k = 0; k < width; ++k) {
+            sum[k] += x * w[k];
+          }
+          w += width;
+        }
+        epilogue(n, j, std::min(kBlockSize, frameSize_ - j), sum);
+      }
+    }
+  }
+
+  int getFrameSize() const { return frameSize_; }
+
+private:
+  void pack(const real* weight);
+
+  ParameterPtr parameter_;
+  size_t offset_;
+  int frameSize_;
+  int numGates_;
+  std::vector<real> packed_;
+  /// The value version and data of the parameter of the last pack.
+  uint64_t packedVersion_;
+  const real* packedData_;
+  std::mutex lock_;
+};
+
+typedef std::shared_ptr<PackedRecurrentWeight> PackedRecurrentWeightPtr;
+
+}  // namespace paddle
@@ -72,8 +72,10 @@ protected:
    * @param start The start position of this sequence (or sample).
    * @param length The length of this sequence (or sample), namely the words
    * number of this sequence.
+   * @param prevOutput The state continued by this sequence, it is updated to
+   * the last output of this sequence. nullptr if there is no state.
    */
-  void forwardOneSequence(int start, int length);
+  void forwardOneSequence(int start, int length, const MatrixPtr& prevOutput);
   /**
    * @brief Compute rnn backward one sequence by onesequence.
    * @param batchSize Total words number of all samples in this batch.
@@ -150,6 +152,11 @@ void RecurrentLayer::resetState() {
 
 void RecurrentLayer::setState(LayerStatePtr state) {
   CHECK(state->value.size() == 1) << "one matrix is expected for RNN state";
+  Matrix::resizeOrCreate(prevOutput_,
+                         state->value[0]->getHeight(),
+                         getSize(),
+                         /* trans= */ false,
+                         useGpu_);
   prevOutput_->copyFrom(*(state->value[0]));
 }
 
@@ -207,16 +214,28 @@ void RecurrentLayer::forwardSequence(int batchSize,
     frameOutput_[i].value->setData(output_.value->getData() + i * getSize());
   }
 
+  // A state of one row is continued by all the sequences one after another.
+  // Otherwise every sequence continues its own row of the state.
+  bool statePerSequence = prevOutput_ && prevOutput_->getHeight() > 1;
+  if (statePerSequence) {
+    CHECK_EQ(prevOutput_->getHeight(), numSequences)
+        << "the number of sequences must be the same";
+  }
   AsyncGpuBlock asyncGpuBlock;
   for (size_t i = 0; i < numSequences; ++i) {
-    forwardOneSequence(starts[i], starts[i + 1] - starts[i]);
+    forwardOneSequence(starts[i],
+                       starts[i + 1] - starts[i],
+                       statePerSequence ? prevOutput_->subMatrix(i, 1)
+                                        : prevOutput_);
   }
 }
 
-void RecurrentLayer::forwardOneSequence(int start, int length) {
+void RecurrentLayer::forwardOneSequence(int start,
+                                        int length,
+                                        const MatrixPtr& prevOutput) {
   if (!reversed_) {
-    if (prevOutput_) {
-      frameOutput_[start].value->mul(*prevOutput_, *weight_->getW(), 1, 1);
+    if (prevOutput) {
+      frameOutput_[start].value->mul(*prevOutput, *weight_->getW(), 1, 1);
     }
     activation_->forward(frameOutput_[start]).check();
 
@@ -225,8 +244,8 @@ void RecurrentLayer::forwardOneSequence(int start, int length) {
           *frameOutput_[start + i - 1].value, *weight_->getW(), 1, 1);
       activation_->forward(frameOutput_[start + i]).check();
     }
-    if (prevOutput_) {
-      prevOutput_->assign(*frameOutput_[start + length - 1].value);
+    if (prevOutput) {
+      prevOutput->assign(*frameOutput_[start + length - 1].value);
     }
   } else {
     activation_->forward(frameOutput_[start + length - 1]).check();
@@ -0,0 +1,178 @@
+/* Copyright (c) 2016 PaddlePaddle Authors. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include <gtest/gtest.h>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "paddle/gserver/dataproviders/CtrDataProvider.h"
+#include "paddle/math/SparseMatrix.h"
+#include "paddle/utils/StringUtil.h"
+#include "paddle/utils/Util.h"
+
+using namespace paddle;  // NOLINT
+using namespace std;     // NOLINT
+
+const char* kTestDir = "./test_CtrDataProvider";
+const char* kFileList = "./test_CtrDataProvider/files.txt";
+const uint32_t kUserDim = 100;
+const uint32_t kAdDim = 50;
+
+// one file of lines for each element
+const vector<vector<string>> kFiles = {
+    {"1 user:u1 ad:a1:0.5 user:u2 unknown:x", "", "0\tad:a:2:2"},
+    {"1", "0 user:a_long_feasign_of_many_bytes ad:a1:-1 ad:a2:3"},
+};
+
+struct Line {
+  int label;
+  vector<string> users;
+  vector<pair<string, real>> ads;
+};
+
+const vector<Line> kLines = {
+    {1, {"u1", "u2"}, {{"a1", 0.5}}},
+    {0, {}, {{"a:2", 2}}},
+    {1, {}, {}},
+    {0, {"a_long_feasign_of_many_bytes"}, {{"a1", -1}, {"a2", 3}}},
+};
+
+static void writeFiles() {
+  mkDir(kTestDir);
+  ofstream list(kFileList);
+  for (size_t i = 0; i < kFiles.size(); ++i) {
+    string fileName = string(kTestDir) + "/data" + str::to_string(i) + ".txt";
+    ofstream os(fileName);
+    for (auto& line : kFiles[i]) {
+      os << line << endl;
+    }
+    list << fileName << endl;
+  }
+}
+
+static DataConfig getConfig(int threadNum) {
+  DataConfig config;
+  config.set_type("ctr");
+  config.set_files(kFileList);
+  config.mutable_file_group_conf()->set_load_thread_num(threadNum);
+  auto user = config.add_ctr_slots();
+  user->set_name("user");
+  user->set_dim(kUserDim);
+  auto ad = config.add_ctr_slots();
+  ad->set_name("ad");
+  ad->set_dim(kAdDim);
+  ad->set_with_value(true);
+  return config;
+}
+
+static void testCtrDataProvider(int threadNum, int batchSize) {
+  unique_ptr<DataProvider> dataProvider(
+      DataProvider::create(getConfig(threadNum), false));
+  dataProvider->setSkipShuffle();
+  EXPECT_EQ(-1, dataProvider->getSize());
+
+  for (int pass = 0; pass < 2; ++pass) {
+    dataProvider->reset();
+    DataBatch batch;
+    size_t numLines = 0;
+    while (dataProvider->getNextBatch(batchSize, &batch) > 0) {
+      ASSERT_EQ(3, batch.getNumStreams());
+      auto users =
+          dynamic_cast<CpuSparseMatrix*>(batch.getStream(0).value.get());
+      auto ads =
+          dynamic_cast<CpuSparseMatrix*>(batch.getStream(1).value.get());
+      ASSERT_TRUE(users && ads);
+      EXPECT_EQ(NO_VALUE, users->getValueType());
+      EXPECT_EQ(FLOAT_VALUE, ads->getValueType());
+      EXPECT_EQ(kUserDim, users->getWidth());
+      EXPECT_EQ(kAdDim, ads->getWidth());
+      const IVectorPtr& labels = batch.getStream(2).ids;
+      for (int64_t i = 0; i < batch.getSize(); ++i, ++numLines) {
+        ASSERT_LT(numLines, kLines.size());
+        const Line& line = kLines[numLines];
+        EXPECT_EQ(line.label, labels->getElement(i));
+
+        ASSERT_EQ(line.users.size(), users->getColNum(i));
+        for (size_t j = 0; j < line.users.size(); ++j) {
+          const string& feasign = line.users[j];
+          EXPECT_EQ(CtrDataProvider::hash(feasign.data(), feasign.size()) %
+                        kUserDim,
+                    (uint64_t)users->getRowCols(i)[j]);
+        }
+
+        ASSERT_EQ(line.ads.size(), ads->getColNum(i));
+        for (size_t j = 0; j < line.ads.size(); ++j) {
+          const string& feasign = line.ads[j].first;
+          EXPECT_EQ(CtrDataProvider::hash(feasign.data(), feasign.size()) %
+                        kAdDim,
+                    (uint64_t)ads->getRowCols(i)[j]);
+          EXPECT_EQ(line.ads[j].second, ads->getRowValues(i)[j]);
+        }
+      }
+    }
+    EXPECT_EQ(kLines.size(), numLines);
+  }
+}
+
+TEST(CtrDataProvider, hash) {
+  string s = "feasign";
+  EXPECT_EQ(CtrDataProvider::hash(s.data(), s.size()),
+            CtrDataProvider::hash(string(s).data(), s.size()));
+  EXPECT_NE(CtrDataProvider::hash("a", 1), CtrDataProvider::hash("b", 1));
+  EXPECT_NE(CtrDataProvider::hash("abcdefgh1", 9),
+            CtrDataProvider::hash("abcdefgh2", 9));
+}
+
+TEST(CtrDataProvider, parse) {
+  writeFiles();
+  for (int threadNum : {1, 3}) {
+    for (int batchSize : {1, 3, 10}) {
+      testCtrDataProvider(threadNum, batchSize);
+    }
+  }
+  rmDir(kTestDir);
+}
+
+#ifndef PADDLE_ONLY_CPU
+TEST(CtrDataProvider, gpu) {
+  writeFiles();
+  unique_ptr<DataProvider> dataProvider(
+      DataProvider::create(getConfig(/* threadNum */ 2), true));
+  dataProvider->setSkipShuffle();
+  dataProvider->reset();
+  DataBatch batch;
+  size_t numLines = 0;
+  while (dataProvider->getNextBatch(3, &batch) > 0) {
+    ASSERT_EQ(3, batch.getNumStreams());
+    EXPECT_TRUE(batch.getStream(0).value->useGpu());
+    EXPECT_TRUE(batch.getStream(1).value->useGpu());
+    EXPECT_TRUE(batch.getStream(2).ids->useGpu());
+    EXPECT_EQ(batch.getSize(), (int64_t)batch.getStream(0).value->getHeight());
+    IVectorPtr labels = IVector::create(batch.getSize(), false);
+    labels->copyFrom(*batch.getStream(2).ids);
+    for (int64_t i = 0; i < batch.getSize(); ++i, ++numLines) {
+      ASSERT_LT(numLines, kLines.size());
+      EXPECT_EQ(kLines[numLines].label, labels->getElement(i));
+    }
+  }
+  EXPECT_EQ(kLines.size(), numLines);
+  rmDir(kTestDir);
+}
+#endif
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  initMain(argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,132 @@
+/* Copyright (c) 2016 PaddlePaddle Authors. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "LayerGradUtil.h"
+#include "paddle/math/CpuSparseMatrix.h"
+#include "paddle/testing/TestUtil.h"
+
+using namespace paddle;  // NOLINT
+using namespace std;     // NOLINT
+
+// Compare the output of fc_maxid layer with the softmax of fc and a sort.
+void testFcMaxId(size_t vocabSize, size_t beamSize, bool withSelect) {
+  const size_t batchSize = 7;
+  const size_t inputSize = 16;
+  TestConfig config;
+  config.layerConfig.set_type("fc_maxid");
+  config.layerConfig.set_size(vocabSize);
+  config.layerConfig.set_beam_size(beamSize);
+  config.biasSize = vocabSize;
+  config.layerConfig.add_inputs();
+  config.inputDefs.push_back(
+      {INPUT_DATA, "input", inputSize, inputSize * vocabSize});
+  if (withSelect) {
+    config.layerConfig.add_inputs();
+    config.inputDefs.push_back(
+        {INPUT_SPARSE_NON_VALUE_DATA, "select", vocabSize, 0});
+  }
+
+  std::vector<DataLayerPtr> dataLayers;
+  LayerMap layerMap;
+  vector<Argument> datas;
+  initDataLayer(config,
+                &dataLayers,
+                &datas,
+                &layerMap,
+                "fc_maxid",
+                batchSize,
+                false,
+                /* useGpu */ false);
+  std::vector<ParameterPtr> parameters;
+  LayerPtr layer;
+  initTestLayer(config, &layerMap, &parameters, &layer);
+  layer->forward(PASS_TEST);
+
+  MatrixPtr logits = Matrix::create(batchSize, vocabSize, false, false);
+  MatrixPtr weight =
+      Matrix::create(parameters[0]->getBuf(PARAMETER_VALUE)->getData(),
+                     inputSize,
+                     vocabSize,
+                     false,
+                     false);
+  MatrixPtr bias =
+      Matrix::create(parameters[1]->getBuf(PARAMETER_VALUE)->getData(),
+                     1,
+                     vocabSize,
+                     false,
+                     false);
+  logits->mul(*datas[0].value, *weight, 1, 0);
+  logits->addBias(*bias, 1);
+
+  const int* ids = layer->getOutput().ids->getData();
+  const real* probs = layer->getOutput().in->getData();
+  for (size_t i = 0; i < batchSize; ++i) {
+    std::vector<int> candidates;
+    if (withSelect) {
+      auto select = dynamic_cast<CpuSparseMatrix*>(datas[1].value.get());
+      const int* rows = select->getRows();
+      const int* cols = select->getCols();
+      candidates.assign(cols + rows[i], cols + rows[i + 1]);
+    } else {
+      for (size_t j = 0; j < vocabSize; ++j) {
+        candidates.push_back(j);
+      }
+    }
+    const real* row = logits->getData() + i * vocabSize;
+    real maxLogit = -1e30;
+    for (int id : candidates) {
+      maxLogit = std::max(maxLogit, row[id]);
+    }
+    double sumExp = 0;
+    for (int id : candidates) {
+      sumExp += std::exp(row[id] - maxLogit);
+    }
+    std::stable_sort(candidates.begin(),
+                     candidates.end(),
+                     [row](int a, int b) { return row[a] > row[b]; });
+    for (size_t k = 0; k < beamSize; ++k) {
+      if (k < candidates.size()) {
+        int id = candidates[k];
+        EXPECT_FLOAT_EQ(row[id], row[ids[i * beamSize + k]]);
+        EXPECT_NEAR(std::exp(row[id] - maxLogit) / sumExp,
+                    probs[i * beamSize + k],
+                    1e-5);
+      } else {
+        EXPECT_EQ(-1, ids[i * beamSize + k]);
+      }
+    }
+  }
+}
+
+TEST(Layer, FcMaxIdLayer) {
+  for (auto vocabSize : {10, 2500}) {
+    for (auto beamSize : {1, 5}) {
+      for (auto withSelect : {false, true}) {
+        testFcMaxId(vocabSize, beamSize, withSelect);
+      }
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  initMain(argc, argv);
+  return RUN_ALL_TESTS();
+}
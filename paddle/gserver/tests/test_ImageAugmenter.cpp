@@ -0,0 +1,159 @@
+/* Copyright (c) 2016 PaddlePaddle Authors. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <string>
+#include <vector>
+#include "paddle/gserver/dataproviders/ImageAugmenter.h"
+#include "paddle/utils/Util.h"
+
+using namespace paddle;  // NOLINT
+using namespace std;     // NOLINT
+
+const size_t kChannels = 3;
+const size_t kHeight = 7;
+const size_t kWidth = 6;
+const size_t kCropSize = 4;
+const size_t kNumImages = 9;
+const float kMean[] = {100, 120, 140};
+const float kStd[] = {50, 60, 70};
+
+static ImageAugmentConfig createConfig(int threadNum) {
+  ImageAugmentConfig config;
+  config.set_slot(0);
+  config.set_channels(kChannels);
+  config.set_height(kHeight);
+  config.set_width(kWidth);
+  config.set_crop_size(kCropSize);
+  config.set_mirror(true);
+  for (size_t c = 0; c < kChannels; ++c) {
+    config.add_mean(kMean[c]);
+    config.add_std(kStd[c]);
+  }
+  config.set_thread_num(threadNum);
+  return config;
+}
+
+// the normalized value of the pixel (y, x) of channel c of the image
+static real expectedValue(const string& image, size_t c, size_t y, size_t x) {
+  uint8_t pixel = image[(y * kWidth + x) * kChannels + c];
+  return (pixel - kMean[c]) / kStd[c];
+}
+
+// whether the output is the crop at (y0, x0) of the image
+static bool isCrop(const string& image,
+                   const real* output,
+                   size_t y0,
+                   size_t x0,
+                   bool mirror) {
+  for (size_t c = 0; c < kChannels; ++c) {
+    for (size_t y = 0; y < kCropSize; ++y) {
+      for (size_t x = 0; x < kCropSize; ++x) {
+        size_t srcX = x0 + (mirror ? kCropSize - 1 - x : x);
+        real value = output[(c * kCropSize + y) * kCropSize + x];
+        if (fabs(value - expectedValue(image, c, y0 + y, srcX)) > 1e-5) {
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+static void testAugment(bool isTest, int threadNum, bool denseInput) {
+  vector<string> images(kNumImages);
+  for (auto& image : images) {
+    for (size_t k = 0; k < kChannels * kHeight * kWidth; ++k) {
+      image.push_back(static_cast<char>(rand() % 256));  // NOLINT
+    }
+  }
+  DataBatch batch;
+  batch.setSize(kNumImages);
+  if (denseInput) {
+    MatrixPtr value =
+        Matrix::create(kNumImages, kChannels * kHeight * kWidth, false, false);
+    for (size_t i = 0; i < kNumImages; ++i) {
+      for (size_t k = 0; k < images[i].size(); ++k) {
+        value->getData()[i * value->getWidth() + k] = (uint8_t)images[i][k];
+      }
+    }
+    batch.appendData(value);
+  } else {
+    Argument arg;
+    arg.strs = make_shared<vector<string>>(images);
+    batch.getStreams().push_back(arg);
+  }
+
+  ImageAugmenter augmenter(createConfig(threadNum), isTest);
+  augmenter.apply(&batch);
+  const Argument& output = batch.getStream(0);
+  EXPECT_EQ(nullptr, output.strs);
+  EXPECT_EQ(kCropSize, output.frameHeight);
+  EXPECT_EQ(kCropSize, output.frameWidth);
+  ASSERT_EQ(kNumImages, output.value->getHeight());
+  ASSERT_EQ(kChannels * kCropSize * kCropSize, output.value->getWidth());
+
+  for (size_t i = 0; i < kNumImages; ++i) {
+    const real* values = output.value->getData() + i * output.value->getWidth();
+    if (isTest) {
+      // center crop without mirror
+      EXPECT_TRUE(isCrop(images[i],
+                         values,
+                         (kHeight - kCropSize) / 2,
+                         (kWidth - kCropSize) / 2,
+                         false));
+      continue;
+    }
+    bool found = false;
+    for (size_t y0 = 0; y0 <= kHeight - kCropSize; ++y0) {
+      for (size_t x0 = 0; x0 <= kWidth - kCropSize; ++x0) {
+        for (bool mirror : {false, true}) {
+          found = found || isCrop(images[i], values, y0, x0, mirror);
+        }
+      }
+    }
+    EXPECT_TRUE(found) << "image " << i << " is not a crop";
+  }
+}
+
+TEST(ImageAugmenter, augment) {
+  for (bool isTest : {false, true}) {
+    for (int threadNum : {1, 4}) {
+      for (bool denseInput : {false, true}) {
+        testAugment(isTest, threadNum, denseInput);
+      }
+    }
+  }
+}
+
+TEST(ImageAugmenter, gpu) {
+  // The augmented images are on CPU, so a batch for GPU has to be loaded
+  // by the async loader, whichever slot type the images are in.
+  DataBatch batch;
+  batch.setSize(kNumImages);
+  Argument arg;
+  arg.strs = make_shared<vector<string>>(
+      kNumImages, string(kChannels * kHeight * kWidth, 0));
+  batch.getStreams().push_back(arg);
+  ImageAugmenter augmenter(createConfig(/* threadNum= */ 1), false);
+  ASSERT_DEATH_IF_SUPPORTED(augmenter.apply(&batch, /* useGpu= */ true),
+                            "set async_load_data when using GPU");
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  initMain(argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -31,6 +31,7 @@ DECLARE_int32(gpu_id);
 DECLARE_double(checkgrad_eps);
 DECLARE_bool(thread_local_rand_use_global_seed);
 DECLARE_bool(prev_batch_state);
+DECLARE_int32(lstm_cpu_threads);
 
 TEST(Operator, dot_mul) {
   TestConfig config;
@@ -416,6 +417,93 @@ TEST(Layer, depthwiseConvLayer) {
 #endif
 }
 
+TestConfig getDepthwiseSeparableConvConfig() {
+  TestConfig config;
+  config.layerConfig.set_type("depthwise_separable_conv");
+  config.layerConfig.set_num_filters(16);
+
+  // channels = 4, depth multiplier = 2
+  config.inputDefs.push_back({INPUT_DATA, "layer_0", 4 * 8 * 16, 8 * 3 * 3});
+  ConvConfig* conv = config.layerConfig.add_inputs()->mutable_conv_conf();
+  conv->set_filter_size(3);
+  conv->set_filter_size_y(3);
+  conv->set_channels(4);
+  conv->set_padding(1);
+  conv->set_padding_y(1);
+  conv->set_stride(2);
+  conv->set_stride_y(1);
+  conv->set_groups(4);
+  conv->set_filter_channels(1);
+  conv->set_img_size(16);
+  conv->set_img_size_y(8);
+  conv->set_output_x(outputSize(conv->img_size(),
+                                conv->filter_size(),
+                                conv->padding(),
+                                conv->stride(),
+                                /* caffeMode */ true));
+  conv->set_output_y(outputSize(conv->img_size_y(),
+                                conv->filter_size_y(),
+                                conv->padding_y(),
+                                conv->stride_y(),
+                                /* caffeMode */ true));
+
+  // The second input only carries the pointwise filter.
+  config.inputDefs.push_back({INPUT_DATA, "layer_1", 1, 16 * 8});
+  ConvConfig* pointwise = config.layerConfig.add_inputs()->mutable_conv_conf();
+  pointwise->set_filter_size(1);
+  pointwise->set_filter_size_y(1);
+  pointwise->set_channels(8);
+  pointwise->set_padding(0);
+  pointwise->set_padding_y(0);
+  pointwise->set_stride(1);
+  pointwise->set_stride_y(1);
+  pointwise->set_groups(1);
+  pointwise->set_filter_channels(8);
+  pointwise->set_img_size(conv->output_x());
+  pointwise->set_img_size_y(conv->output_y());
+  pointwise->set_output_x(conv->output_x());
+  pointwise->set_output_y(conv->output_y());
+
+  config.layerConfig.set_size(conv->output_x() * conv->output_y() *
+                              config.layerConfig.num_filters());
+  return config;
+}
+
+TEST(Layer, depthwiseSeparableConvLayer) {
+  TestConfig config = getDepthwiseSeparableConvConfig();
+  for (auto useGpu : {false, true}) {
+    testLayerGrad(config, "depthwise_separable_conv", 10, false, useGpu);
+  }
+
+  // The fused forward in testing equals the forward in training.
+  FLAGS_use_gpu = false;
+  std::vector<DataLayerPtr> dataLayers;
+  LayerMap layerMap;
+  vector<Argument> datas;
+  initDataLayer(config,
+                &dataLayers,
+                &datas,
+                &layerMap,
+                "depthwise_separable_conv",
+                10,
+                false,
+                /* useGpu */ false);
+  std::vector<ParameterPtr> parameters;
+  LayerPtr layer;
+  initTestLayer(config, &layerMap, &parameters, &layer);
+  layer->forward(PASS_TRAIN);
+  MatrixPtr expect = Matrix::create(layer->getOutputValue()->getHeight(),
+                                    layer->getOutputValue()->getWidth(),
+                                    false,
+                                    false);
+  expect->copyFrom(*layer->getOutputValue());
+  layer->forward(PASS_TEST);
+  const real* output = layer->getOutputValue()->getData();
+  for (size_t i = 0; i < expect->getElementCnt(); i++) {
+    EXPECT_NEAR(expect->getData()[i], output[i], 1e-5);
+  }
+}
+
 void testConvLayer(const string& type, bool trans, bool useGpu) {
   TestConfig config;
   config.biasSize = 16;
@@ -1346,6 +1434,16 @@ TEST(Layer, LstmLayer) {
     config.layerConfig.set_reversed(false);
     testLayerGrad(config, "lstmemory", 10, /* trans= */ false, useGpu);
   }
+  config.testBatchState = false;
+  config.testState = false;
+  for (auto threads : {2, 3}) {
+    FLAGS_lstm_cpu_threads = threads;
+    for (auto reversed : {false, true}) {
+      config.layerConfig.set_reversed(reversed);
+      testLayerGrad(config, "lstmemory", 100, /* trans= */ false, false);
+    }
+  }
+  FLAGS_lstm_cpu_threads = 0;
 }
 
 TEST(Layer, MDLstmLayer) {
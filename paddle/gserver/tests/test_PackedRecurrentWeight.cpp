@@ -0,0 +1,217 @@
+/* Copyright (c) 2016 PaddlePaddle Authors. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include <gtest/gtest.h>
+#include "paddle/gserver/layers/GruCompute.h"
+#include "paddle/gserver/layers/LstmCompute.h"
+#include "paddle/gserver/layers/PackedRecurrentWeight.h"
+#include "paddle/math/Matrix.h"
+#include "paddle/utils/Util.h"
+
+using namespace paddle;  // NOLINT
+using namespace std;     // NOLINT
+
+static ParameterPtr createParameter(size_t size) {
+  ParameterConfig config;
+  config.set_name("weight");
+  config.set_size(size);
+  ParameterPtr parameter =
+      std::make_shared<Parameter>(config, /* useGpu */ false, false);
+  parameter->enableType(PARAMETER_VALUE);
+  parameter->randomize();
+  return parameter;
+}
+
+static MatrixPtr randomMatrix(size_t height, size_t width) {
+  MatrixPtr matrix = Matrix::create(height, width, false, false);
+  matrix->randomizeUniform();
+  return matrix;
+}
+
+static MatrixPtr cloneMatrix(const MatrixPtr& matrix) {
+  MatrixPtr copy = matrix->clone(0, 0, false);
+  copy->copyFrom(*matrix);
+  return copy;
+}
+
+static void checkEqual(const MatrixPtr& expected, const MatrixPtr& actual) {
+  const real* a = expected->getData();
+  const real* b = actual->getData();
+  size_t size = expected->getElementCnt();
+  ASSERT_EQ(size, actual->getElementCnt());
+  for (size_t i = 0; i < size; ++i) {
+    ASSERT_NEAR(a[i], b[i], 1e-5) << "at " << i;
+  }
+}
+
+static LayerConfig createConfig() {
+  LayerConfig config;
+  config.set_active_type("tanh");
+  config.set_active_gate_type("sigmoid");
+  config.set_active_state_type("tanh");
+  return config;
+}
+
+void testGru(int frameSize, int batchSize) {
+  LayerConfig config = createConfig();
+  ParameterPtr parameter = createParameter(frameSize * frameSize * 3);
+  GruCompute reference;
+  reference.init(config);
+  GruCompute fused;
+  fused.init(config);
+  fused.initPackedWeight(parameter, frameSize, /* useGpu */ false);
+  ASSERT_TRUE(fused.packedGateWeight_ != nullptr);
+
+  for (int pass = 0; pass < 2; ++pass) {
+    // the packed weight follows the new value of the parameter
+    if (pass > 0) parameter->randomize();
+    fused.updatePackedWeight();
+
+    MatrixPtr prevOutput = randomMatrix(batchSize, frameSize);
+    MatrixPtr gate[2], resetOutput[2], output[2];
+    gate[0] = randomMatrix(batchSize, frameSize * 3);
+    gate[1] = cloneMatrix(gate[0]);
+    for (int i = 0; i < 2; ++i) {
+      resetOutput[i] = Matrix::create(batchSize, frameSize, false, false);
+      output[i] = Matrix::create(batchSize, frameSize, false, false);
+    }
+    for (int i = 0; i < 2; ++i) {
+      hl_gru_value value;
+      value.gateWeight = parameter->getBuf(PARAMETER_VALUE)->getData();
+      value.stateWeight = value.gateWeight + frameSize * frameSize * 2;
+      value.gateValue = gate[i]->getData();
+      value.resetOutputValue = resetOutput[i]->getData();
+      value.outputValue = output[i]->getData();
+      value.prevOutValue = prevOutput->getData();
+      (i == 0 ? reference : fused).forward<0>(value, frameSize, batchSize);
+    }
+    checkEqual(gate[0], gate[1]);
+    checkEqual(resetOutput[0], resetOutput[1]);
+    checkEqual(output[0], output[1]);
+  }
+}
+
+void testLstm(int frameSize, int batchSize) {
+  LayerConfig config = createConfig();
+  ParameterPtr parameter = createParameter(frameSize * frameSize * 4);
+  LstmCompute reference;
+  reference.init(config);
+  LstmCompute fused;
+  fused.init(config);
+  fused.initPackedWeight(parameter, frameSize, /* useGpu */ false);
+  ASSERT_TRUE(fused.packedWeight_ != nullptr);
+  fused.updatePackedWeight();
+
+  MatrixPtr weight = Matrix::create(
+      parameter->getBuf(PARAMETER_VALUE)->getData(),
+      frameSize,
+      frameSize * 4,
+      false,
+      false);
+  MatrixPtr check = randomMatrix(3, frameSize);
+  MatrixPtr prevOutput = randomMatrix(batchSize, frameSize);
+  MatrixPtr prevState = randomMatrix(batchSize, frameSize);
+  MatrixPtr gate[2], state[2], stateActive[2], output[2];
+  gate[0] = randomMatrix(batchSize, frameSize * 4);
+  gate[1] = cloneMatrix(gate[0]);
+  gate[0]->mul(*prevOutput, *weight, 1, 1);
+  for (int i = 0; i < 2; ++i) {
+    state[i] = Matrix::create(batchSize, frameSize, false, false);
+    stateActive[i] = Matrix::create(batchSize, frameSize, false, false);
+    output[i] = Matrix::create(batchSize, frameSize, false, false);
+
+    hl_lstm_value value;
+    value.checkIg = check->getRowBuf(0);
+    value.checkFg = check->getRowBuf(1);
+    value.checkOg = check->getRowBuf(2);
+    value.gateValue = gate[i]->getData();
+    value.prevStateValue = prevState->getData();
+    value.stateValue = state[i]->getData();
+    value.stateActiveValue = stateActive[i]->getData();
+    value.outputValue = output[i]->getData();
+    if (i == 0) {
+      reference.forwardBatch<0>(value, frameSize, batchSize);
+    } else {
+      fused.forwardBatchPacked(
+          value, prevOutput->getData(), frameSize, batchSize);
+    }
+  }
+  checkEqual(gate[0], gate[1]);
+  checkEqual(state[0], state[1]);
+  checkEqual(output[0], output[1]);
+}
+
+TEST(PackedRecurrentWeight, Gru) {
+  for (auto frameSize : {1, 8, 13, 64}) {
+    for (auto batchSize : {1, 5}) {
+      VLOG(1) << " frameSize=" << frameSize << " batchSize=" << batchSize;
+      testGru(frameSize, batchSize);
+    }
+  }
+}
+
+TEST(PackedRecurrentWeight, Lstm) {
+  for (auto frameSize : {1, 8, 13, 64}) {
+    for (auto batchSize : {1, 5}) {
+      VLOG(1) << " frameSize=" << frameSize << " batchSize=" << batchSize;
+      testLstm(frameSize, batchSize);
+    }
+  }
+}
+
+TEST(PackedRecurrentWeight, Shared) {
+  ParameterPtr parameter = createParameter(16 * 16 * 3);
+  auto weight1 = PackedRecurrentWeight::get(parameter, 0, 16, 2);
+  auto weight2 = PackedRecurrentWeight::get(parameter, 0, 16, 2);
+  auto weight3 = PackedRecurrentWeight::get(parameter, 16 * 16 * 2, 16, 1);
+  EXPECT_EQ(weight1, weight2);
+  EXPECT_NE(weight1, weight3);
+}
+
+TEST(PackedRecurrentWeight, Repack) {
+  const int frameSize = 13;
+  const int batchSize = 3;
+  const int kBlockSize = PackedRecurrentWeight::kBlockSize;
+  ParameterPtr parameter = createParameter(frameSize * frameSize * 4);
+  PackedRecurrentWeight packed(parameter, 0, frameSize, 4);
+  MatrixPtr input = randomMatrix(batchSize, frameSize);
+  real* data = parameter->getBuf(PARAMETER_VALUE)->getData();
+  MatrixPtr weight =
+      Matrix::create(data, frameSize, frameSize * 4, false, false);
+  for (int pass = 0; pass < 2; ++pass) {
+    // a trained value changes without Parameter::setValueUpdated()
+    if (pass > 0) weight->randomizeUniform();
+    packed.repack();
+    MatrixPtr expected = Matrix::create(batchSize, frameSize * 4, false, false);
+    expected->mul(*input, *weight, 1, 0);
+    MatrixPtr actual = Matrix::create(batchSize, frameSize * 4, false, false);
+    packed.mul<4>(input->getData(),
+                  batchSize,
+                  [&](int n, int j, int size, const real* sum) {
+                    real* row = actual->getRowBuf(n) + j;
+                    for (int g = 0; g < 4; ++g) {
+                      for (int k = 0; k < size; ++k) {
+                        row[g * frameSize + k] = sum[g * kBlockSize + k];
+                      }
+                    }
+                  });
+    checkEqual(expected, actual);
+  }
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  initMain(argc, argv);
+  return RUN_ALL_TESTS();
+}
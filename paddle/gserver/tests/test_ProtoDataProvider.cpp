@@ -13,11 +13,14 @@ See the License for the specific language governing permissions and
 limitations under the License. */
 
 #include <memory>
+#include <sstream>
 #include <string>
 
 #include <gtest/gtest.h>
 
+#include "paddle/gserver/dataproviders/MultiDataProvider.h"
 #include "paddle/gserver/dataproviders/ProtoDataProvider.h"
+#include "paddle/gserver/dataproviders/RecordIO.h"
 #include "paddle/utils/Util.h"
 
 #include "paddle/testing/TestUtil.h"
@@ -36,6 +39,7 @@ const char* kTestDir = "./test_ProtoDataProvider";
 const char kProtoFileList[] = "gserver/tests/proto_files.txt";
 const char kProtoFileListCompressed[] =
     "gserver/tests/proto_files_compressed.txt";
+const char kRecordIOFileList[] = "./test_ProtoDataProvider/recordio_files.txt";
 const int kSpraseMatrixDim = 1024;
 
 using namespace paddle;  // NOLINT
@@ -312,6 +316,44 @@ void writeData(const DataBatch& batch, bool useGpu, bool dataCompression) {
   CHECK_EQ(arguments[0].getBatchSize(), numWritten);
 }
 
+// Convert the files written by writeData to RecordIO files of small chunks,
+// and write their file list. If splitChunks, the chunks of the first file
+// are listed as two ranges.
+void writeRecordIOData(bool splitChunks) {
+  ofstream list(kRecordIOFileList);
+  CHECK(list) << "Fail to open " << kRecordIOFileList;
+  for (size_t i = 0; i < protoFiles.size(); ++i) {
+    string fileName = protoFiles[i] + ".recordio";
+    {
+      ifstream is(protoFiles[i]);
+      CHECK(is) << "Fail to open " << protoFiles[i];
+      ofstream os(fileName, ios::binary);
+      CHECK(os) << "Fail to open " << fileName;
+      ProtoReader reader(&is);
+      RecordIOWriter writer(
+          &os, i % 2 ? RECORDIO_NO_COMPRESSION : RECORDIO_GZIP, 512);
+      DataHeader header;
+      CHECK(reader.read(&header));
+      writer.write(header.SerializeAsString());
+      DataSample sample;
+      while (reader.read(&sample)) {
+        writer.write(sample.SerializeAsString());
+      }
+    }
+
+    ifstream is(fileName, ios::binary);
+    vector<RecordIOChunkIndex> index;
+    loadRecordIOIndex(is, &index);
+    if (splitChunks && i == 0) {
+      size_t middle = index.size() / 2;
+      list << fileName << " 0 " << middle << endl;
+      list << fileName << " " << middle << " " << index.size() << endl;
+    } else {
+      list << fileName << endl;
+    }
+  }
+}
+
 // check that the sample at pos1 in args1 is same as the sample at pos2 in args2
 void checkSample(const vector<Argument>& args1,
                  int64_t pos1,
@@ -376,7 +418,9 @@ void testProtoDataProvider(int* numPerSlotType,
                            bool async,
                            bool useGpu,
                            bool dataCompression,
-                           int numConstantSlots = 0) {
+                           int numConstantSlots = 0,
+                           const string& type = "proto",
+                           int prefetchDepth = 1) {
   mkDir(kTestDir);
   DataBatch data;
 
@@ -384,9 +428,21 @@ void testProtoDataProvider(int* numPerSlotType,
   writeData(data, useGpu, dataCompression);
 
   DataConfig config;
-  config.set_type("proto");
+  config.set_type(type);
   config.set_files(dataCompression ? kProtoFileListCompressed : kProtoFileList);
   config.set_async_load_data(async);
+  config.set_prefetch_depth(prefetchDepth);
+  if (type == "proto_stream") {
+    // smaller than the data, so that the buffer is refilled
+    config.set_buffer_capacity(7);
+  }
+  if (type == "recordio") {
+    // The chunk ranges have to start at sequence boundaries.
+    writeRecordIOData(/* splitChunks= */ iid);
+    config.set_files(kRecordIOFileList);
+    // 0 load threads still parse with one thread.
+    config.mutable_file_group_conf()->set_load_thread_num(iid ? 3 : 0);
+  }
 
   for (int i = 0; i < numConstantSlots; ++i) {
     config.add_constant_slots(i + 11);
@@ -401,7 +457,11 @@ void testProtoDataProvider(int* numPerSlotType,
   unique_ptr<DataProvider> dataProvider(DataProvider::create(config, useGpu));
   dataProvider->setSkipShuffle();
 
-  EXPECT_EQ(data.getSize(), dataProvider->getSize());
+  if (type == "proto_stream") {
+    EXPECT_EQ(-1, dataProvider->getSize());
+  } else {
+    EXPECT_EQ(data.getSize(), dataProvider->getSize());
+  }
 
   int64_t batchSize = 10;
   DataBatch batch;
@@ -516,6 +576,210 @@ TEST(ProtoDataProvider, test) {
   }          // end for (while, traverse all slots)
 }
 
+TEST(ProtoDataProvider, prefetch) {
+  int numPerSlotType[SlotDef::SlotType_ARRAYSIZE] = {0};
+  numPerSlotType[SlotDef::VECTOR_DENSE] = 3;
+  numPerSlotType[SlotDef::VECTOR_SPARSE_NON_VALUE] = 3;
+  numPerSlotType[SlotDef::INDEX] = 3;
+  for (int iid : {0, 1}) {
+    testProtoDataProvider(numPerSlotType,
+                          iid,
+                          /* async= */ true,
+                          /* useGpu= */ false,
+                          /* dataCompression= */ false,
+                          /* numConstantSlots= */ 0,
+                          "proto",
+                          /* prefetchDepth= */ 4);
+  }
+}
+
+// Counts the samples of the batches from dataProvider until the end of the
+// pass, or only the first batch if onlyFirstBatch. The second stream of the
+// data is the index of each sample, since several prefetch threads may load
+// the batches out of order.
+void countSamples(DataProvider* dataProvider,
+                  const DataBatch& data,
+                  bool onlyFirstBatch,
+                  vector<int>* counts) {
+  const int64_t batchSize = 3;
+  counts->assign(data.getSize(), 0);
+  DataBatch batch;
+  while (dataProvider->getNextBatch(batchSize, &batch) > 0) {
+    const IVectorPtr& ids = batch.getStream(1).ids;
+    for (int64_t i = 0; i < batch.getSize(); ++i) {
+      int id = ids->getElement(i);
+      ASSERT_LT(id, data.getSize());
+      checkSample(data.getStreams(), id, batch.getStreams(), i, false);
+      ++(*counts)[id];
+    }
+    if (onlyFirstBatch) break;
+  }
+}
+
+TEST(ProtoDataProvider, prefetch_threads) {
+  mkDir(kTestDir);
+  int numPerSlotType[SlotDef::SlotType_ARRAYSIZE] = {0};
+  numPerSlotType[SlotDef::VECTOR_DENSE] = 1;
+  numPerSlotType[SlotDef::INDEX] = 1;
+  DataBatch data;
+  prepareData(&data, numPerSlotType, /* iid= */ true, /* useGpu= */ false);
+  IVectorPtr& sampleIds = data.getStreams()[1].ids;
+  for (int64_t i = 0; i < data.getSize(); ++i) {
+    sampleIds->setElement(i, i);
+  }
+  writeData(data, /* useGpu= */ false, /* dataCompression= */ false);
+
+  for (int numThreads : {2, 4}) {
+    LOG(INFO) << "prefetch_thread_num=" << numThreads;
+    DataConfig config;
+    config.set_type("proto");
+    config.set_files(kProtoFileList);
+    config.set_async_load_data(true);
+    config.set_prefetch_depth(4);
+    config.set_prefetch_thread_num(numThreads);
+    unique_ptr<DataProvider> dataProvider(DataProvider::create(config, false));
+
+    vector<int> counts;
+    for (int pass = 0; pass < 3; ++pass) {
+      // Resetting in the middle of a pass stops the loading threads, and
+      // the next pass starts from the beginning.
+      bool midPass = pass == 1;
+      dataProvider->reset();
+      countSamples(dataProvider.get(), data, midPass, &counts);
+      if (midPass) continue;
+      for (int64_t i = 0; i < data.getSize(); ++i) {
+        EXPECT_EQ(1, counts[i]) << "sample " << i << " in pass " << pass;
+      }
+    }
+  }
+  rmDir(kTestDir);
+}
+
+TEST(MultiDataProvider, interleave) {
+  mkDir(kTestDir);
+  int numPerSlotType[SlotDef::SlotType_ARRAYSIZE] = {0};
+  numPerSlotType[SlotDef::VECTOR_DENSE] = 2;
+  numPerSlotType[SlotDef::INDEX] = 1;
+  DataBatch data;
+  prepareData(&data, numPerSlotType, /* iid= */ true, /* useGpu= */ false);
+  writeData(data, /* useGpu= */ false, /* dataCompression= */ false);
+  size_t numStreams = data.getNumStreams();
+
+  for (bool forTest : {false, true}) {
+    // two sub data of the same files, the first of which is the main data
+    DataConfig config;
+    config.set_type("multi");
+    config.set_for_test(forTest);
+    config.set_interleave_sub_data(true);
+    for (int i = 0; i < 2; ++i) {
+      DataConfig* subConfig = config.add_sub_data_configs();
+      subConfig->set_type("proto");
+      subConfig->set_files(kProtoFileList);
+      subConfig->set_data_ratio(i + 1);
+      subConfig->set_is_main_data(i == 0);
+    }
+    unique_ptr<DataProvider> dataProvider(DataProvider::create(config, false));
+    auto multi = dynamic_cast<MultiDataProvider*>(dataProvider.get());
+    ASSERT_TRUE(multi);
+
+    for (int pass = 0; pass < 2; ++pass) {
+      dataProvider->reset();
+      int64_t numSamples[2] = {0, 0};
+      DataBatch batch;
+      while (int64_t batchSize = dataProvider->getNextBatch(10, &batch)) {
+        // the arguments of the sub data of the batch, and an empty argument
+        // for the other one
+        vector<Argument>& args = batch.getStreams();
+        ASSERT_EQ(numStreams + 1, args.size());
+        int id = args[0].dataId == -1 ? 1 : 0;
+        for (size_t i = 0; i < args.size(); ++i) {
+          bool inSubData = id == 0 ? i < numStreams : i > 0;
+          EXPECT_EQ(inSubData ? id : -1, args[i].dataId);
+        }
+        EXPECT_EQ(batchSize, args[id == 0 ? 0 : 1].getBatchSize());
+        numSamples[id] += batchSize;
+      }
+      // A pass ends with the main data in training, or with both in testing.
+      EXPECT_EQ(data.getSize(), numSamples[0]);
+      if (forTest) {
+        EXPECT_EQ(data.getSize(), numSamples[1]);
+      }
+      for (int i = 0; i < 2; ++i) {
+        EXPECT_EQ(numSamples[i], multi->getSubDataStats()[i].numSamples);
+      }
+    }
+  }
+  rmDir(kTestDir);
+}
+
+TEST(RecordIODataProvider, test) {
+  int numPerSlotType[SlotDef::SlotType_ARRAYSIZE] = {0};
+  numPerSlotType[SlotDef::VECTOR_DENSE] = 3;
+  numPerSlotType[SlotDef::VECTOR_SPARSE_VALUE] = 3;
+  numPerSlotType[SlotDef::INDEX] = 3;
+  numPerSlotType[SlotDef::STRING] = 3;
+  for (int iid : {0, 1}) {
+    testProtoDataProvider(numPerSlotType,
+                          iid,
+                          /* async= */ false,
+                          /* useGpu= */ false,
+                          /* dataCompression= */ false,
+                          /* numConstantSlots= */ 0,
+                          "recordio");
+  }
+}
+
+// The chunks of the records "paddle", "" and "recordio", without compression
+// and with gzip, written by the Writer of github.com/PaddlePaddle/recordio.
+const unsigned char kGoldenChunks[] = {
+    // no compression
+    0x04, 0x03, 0x02, 0x01, 0x03, 0x00, 0x00, 0x00, 0xc6, 0x4c, 0xbc, 0x5b,
+    0x00, 0x00, 0x00, 0x00, 0x1a, 0x00, 0x00, 0x00, 0x06, 0x00, 0x00, 0x00,
+    0x70, 0x61, 0x64, 0x64, 0x6c, 0x65, 0x00, 0x00, 0x00, 0x00, 0x08, 0x00,
+    0x00, 0x00, 0x72, 0x65, 0x63, 0x6f, 0x72, 0x64, 0x69, 0x6f,
+    // gzip
+    0x04, 0x03, 0x02, 0x01, 0x03, 0x00, 0x00, 0x00, 0xc9, 0xc9, 0xa5, 0xba,
+    0x02, 0x00, 0x00, 0x00, 0x32, 0x00, 0x00, 0x00, 0x1f, 0x8b, 0x08, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x62, 0x63, 0x60, 0x60, 0x28, 0x48,
+    0x4c, 0x49, 0xc9, 0x49, 0x65, 0x60, 0x60, 0x60, 0xe0, 0x60, 0x60, 0x60,
+    0x28, 0x4a, 0x4d, 0xce, 0x2f, 0x4a, 0xc9, 0xcc, 0x07, 0x04, 0x00, 0x00,
+    0xff, 0xff, 0xc6, 0x4c, 0xbc, 0x5b, 0x1a, 0x00, 0x00, 0x00,
+};
+const size_t kGoldenChunkSize = 46;  // the size of the uncompressed one
+
+TEST(RecordIO, golden_chunks) {
+  const vector<string> records = {"paddle", "", "recordio"};
+  const string golden(reinterpret_cast<const char*>(kGoldenChunks),
+                      sizeof(kGoldenChunks));
+
+  istringstream is(golden);
+  vector<RecordIOChunkIndex> index;
+  loadRecordIOIndex(is, &index);
+  ASSERT_EQ(2UL, index.size());
+  EXPECT_EQ(0, index[0].offset);
+  EXPECT_EQ((int64_t)kGoldenChunkSize, index[1].offset);
+  for (int i = 0; i < 2; ++i) {
+    EXPECT_EQ(records.size(), index[i].numRecords);
+    RecordIOChunk chunk;
+    readRecordIOChunk(is, index[i].offset, &chunk);
+    EXPECT_EQ(i == 0 ? RECORDIO_NO_COMPRESSION : RECORDIO_GZIP,
+              (RecordIOCompressor)chunk.compressor);
+    vector<string> parsed;
+    parseRecordIOChunk(chunk, &parsed);
+    EXPECT_EQ(records, parsed);
+  }
+
+  // Without compression, the chunk written is the same byte by byte.
+  ostringstream os;
+  {
+    RecordIOWriter writer(&os, RECORDIO_NO_COMPRESSION);
+    for (auto& record : records) {
+      writer.write(record);
+    }
+  }
+  EXPECT_EQ(golden.substr(0, kGoldenChunkSize), os.str());
+}
+
 TEST(ProtoDataProvider, constant_slots) {
   int numSlotsArray[] = {0, 3};
   int numTwoArray[] = {0, 1};
@@ -555,6 +819,27 @@ TEST(ProtoDataProvider, constant_slots) {
   }          // end for (int numDenseVecSlots : numSlotsArray)
 }
 
+TEST(ProtoStreamDataProvider, test) {
+  int numTwoArray[] = {0, 1};
+  for (int iid : numTwoArray) {
+    for (int dataCompression : numTwoArray) {
+      LOG(INFO) << " iid=" << iid << " dataCompression=" << dataCompression;
+      int numPerSlotType[SlotDef::SlotType_ARRAYSIZE] = {0};
+      numPerSlotType[SlotDef::VECTOR_DENSE] = 3;
+      numPerSlotType[SlotDef::VECTOR_SPARSE_NON_VALUE] = 1;
+      numPerSlotType[SlotDef::VECTOR_SPARSE_VALUE] = 1;
+      numPerSlotType[SlotDef::INDEX] = 1;
+      testProtoDataProvider(numPerSlotType,
+                            iid,
+                            /* async= */ false,
+                            /* useGpu= */ false,
+                            dataCompression,
+                            /* numConstantSlots= */ 0,
+                            "proto_stream");
+    }
+  }
+}
+
 void checkSampleSequence(const vector<Argument>& args1,
                          const vector<Argument>& args2,
                          int64_t offset,
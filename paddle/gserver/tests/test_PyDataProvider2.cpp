@@ -14,6 +14,8 @@ limitations under the License. */
 
 #ifndef PADDLE_NO_PYTHON
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <climits>
 #include <fstream>
 #include "paddle/gserver/dataproviders/DataProvider.h"
 #include "paddle/utils/PythonUtil.h"
@@ -300,6 +302,69 @@ TEST(PyDataProvider2, can_over_batch_size) {
   }
 }
 
+TEST(PyDataProvider2, bucket_window) {
+  paddle::DataConfig config;
+  config.set_type("py2");
+  config.set_files(FLAGS_train_list.c_str());
+  config.set_load_data_module("test_PyDataProvider2");
+  config.set_load_data_object("test_bucket_window");
+  config.set_load_data_args("");
+  paddle::DataBatch batch;
+  std::unique_ptr<paddle::DataProvider> provider(
+      paddle::DataProvider::create(config, false));
+  provider->reset();
+  constexpr size_t batchSize = 10;
+  constexpr size_t bucketWindow = 10;
+  // (min length, max length) of each batch
+  std::vector<std::pair<int, int>> lengths;
+  size_t numSamples = 0;
+  while (true) {
+    int64_t realBatchSize = provider->getNextBatchInternal(batchSize, &batch);
+    if (!realBatchSize) break;
+    ASSERT_LE(static_cast<size_t>(realBatchSize), batchSize);
+    numSamples += realBatchSize;
+    auto& starts = batch.getStreams()[0].sequenceStartPositions;
+    int minLength = INT_MAX;
+    int maxLength = 0;
+    for (int64_t i = 0; i < realBatchSize; ++i) {
+      int length = starts->getData(false)[i + 1] - starts->getData(false)[i];
+      minLength = std::min(minLength, length);
+      maxLength = std::max(maxLength, length);
+    }
+    lengths.emplace_back(minLength, maxLength);
+  }
+  ASSERT_EQ(numSamples, 1000UL);
+
+  // The batches of one window do not overlap in lengths.
+  for (size_t begin = 0; begin < lengths.size(); begin += bucketWindow) {
+    size_t end = std::min(begin + bucketWindow, lengths.size());
+    std::sort(lengths.begin() + begin, lengths.begin() + end);
+    for (size_t i = begin + 1; i < end; ++i) {
+      ASSERT_LE(lengths[i - 1].second, lengths[i].first);
+    }
+  }
+}
+
+TEST(PyDataProvider2, bucket_window_small_pool) {
+  // A window of 10 batches of 10 is larger than the pool of 50 samples.
+  paddle::DataConfig config;
+  config.set_type("py2");
+  config.set_files(FLAGS_train_list.c_str());
+  config.set_load_data_module("test_PyDataProvider2");
+  config.set_load_data_object("test_bucket_window_small_pool");
+  config.set_load_data_args("");
+  paddle::DataBatch batch;
+  std::unique_ptr<paddle::DataProvider> provider(
+      paddle::DataProvider::create(config, false));
+  provider->reset();
+  size_t numSamples = 0;
+  while (int64_t realBatchSize = provider->getNextBatchInternal(10, &batch)) {
+    ASSERT_LE(realBatchSize, 10);
+    numSamples += realBatchSize;
+  }
+  ASSERT_EQ(numSamples, 1000UL);
+}
+
 TEST(PyDataProvider2, input_order) {
   paddle::DataConfig config;
   config.set_type("py2");
@@ -393,6 +458,164 @@ TEST(PyDataProvider2, minPoolSizeWithCache) {
   }
 }
 
+TEST(PyDataProvider2, workers) {
+  const char *fileList = "test_PyDataProvider2_workers.list";
+  std::ofstream fout(fileList);
+  for (int i = 0; i < 4; ++i) {
+    fout << i << std::endl;  // the file id of test_workers.
+  }
+  fout.close();
+
+  paddle::DataConfig config;
+  config.set_type("py2");
+  config.set_files(fileList);
+  config.set_load_data_module("test_PyDataProvider2");
+  config.set_load_data_object("test_workers");
+  config.set_load_data_args("");
+  std::unique_ptr<paddle::DataProvider> provider(
+      paddle::DataProvider::create(config, false));
+
+  for (int pass = 0; pass < 2; ++pass) {
+    provider->reset();
+    std::vector<bool> seen(400, false);
+    paddle::DataBatch batch;
+    while (int64_t batchSize = provider->getNextBatchInternal(32, &batch)) {
+      auto &args = batch.getStreams();
+      ASSERT_EQ(4UL, args.size());
+      const paddle::real *dense = args[0].value->getData();
+      const int *ids = args[1].ids->getData();
+      const int *starts = args[1].sequenceStartPositions->getData(false);
+      auto sparse = dynamic_cast<paddle::CpuSparseMatrix *>(
+          args[2].value.get());
+      const int *subIds = args[3].ids->getData();
+      const int *seqStarts = args[3].sequenceStartPositions->getData(false);
+      const int *subStarts =
+          args[3].subSequenceStartPositions->getData(false);
+      size_t subSeq = 0;
+      for (int64_t n = 0; n < batchSize; ++n) {
+        int k = dense[n * 3];
+        ASSERT_GE(k, 0);
+        ASSERT_LT(k, 400);
+        ASSERT_FALSE(seen[k]);
+        seen[k] = true;
+        ASSERT_EQ(k + 1, dense[n * 3 + 1]);
+        ASSERT_EQ(k + 2, dense[n * 3 + 2]);
+
+        int i = k % 100;
+        ASSERT_EQ(i % 10 + 1, starts[n + 1] - starts[n]);
+        for (int t = starts[n]; t < starts[n + 1]; ++t) {
+          ASSERT_EQ(i, ids[t]);
+        }
+
+        int begin = sparse->getRows()[n];
+        ASSERT_EQ(1, sparse->getRows()[n + 1] - begin);
+        ASSERT_EQ(k % 30, sparse->getCols()[begin]);
+        ASSERT_EQ(k, sparse->getData()[begin]);
+
+        ASSERT_EQ(subStarts[subSeq], seqStarts[n]);
+        for (int j = 0; j < i % 3 + 1; ++j, ++subSeq) {
+          ASSERT_EQ(j + 1, subStarts[subSeq + 1] - subStarts[subSeq]);
+          for (int t = 0; t <= j; ++t) {
+            ASSERT_EQ(t, subIds[subStarts[subSeq] + t]);
+          }
+        }
+        ASSERT_EQ(subStarts[subSeq], seqStarts[n + 1]);
+      }
+    }
+    ASSERT_EQ(400L, std::count(seen.begin(), seen.end(), true));
+  }
+  std::remove(fileList);
+}
+
+TEST(PyDataProvider2, cacheOnDisk) {
+  paddle::DataConfig config;
+  config.set_type("py2");
+  config.set_files(FLAGS_train_list.c_str());
+  config.set_load_data_module("test_PyDataProvider2");
+  config.set_load_data_object("test_cache_on_disk");
+  config.set_load_data_args("");
+  std::unique_ptr<paddle::DataProvider> provider(
+      paddle::DataProvider::create(config, false));
+
+  // The first pass is read from python, and the rest from the cache.
+  for (int pass = 0; pass < 3; ++pass) {
+    provider->reset();
+    std::vector<bool> seen(1000, false);
+    paddle::DataBatch batch;
+    while (int64_t batchSize = provider->getNextBatchInternal(64, &batch)) {
+      auto &args = batch.getStreams();
+      ASSERT_EQ(2UL, args.size());
+      const int *ids = args[0].ids->getData();
+      const int *starts = args[0].sequenceStartPositions->getData(false);
+      const paddle::real *dense = args[1].value->getData();
+      for (int64_t n = 0; n < batchSize; ++n) {
+        int i = dense[n * 2];
+        ASSERT_GE(i, 0);
+        ASSERT_LT(i, 1000);
+        ASSERT_FALSE(seen[i]);
+        seen[i] = true;
+        ASSERT_EQ(-i, dense[n * 2 + 1]);
+        ASSERT_EQ(i % 7 + 1, starts[n + 1] - starts[n]);
+        for (int t = starts[n]; t < starts[n + 1]; ++t) {
+          ASSERT_EQ(i % 100, ids[t]);
+        }
+      }
+    }
+    ASSERT_EQ(1000L, std::count(seen.begin(), seen.end(), true));
+  }
+}
+
+TEST(PyDataProvider2, reuseBatchStorage) {
+  for (std::string funcName : {"test_dense_no_seq",
+                               "test_index_no_seq",
+                               "test_sparse_value_no_seq",
+                               "test_index_seq"}) {
+    paddle::DataConfig config;
+    config.set_type("py2");
+    config.set_files(FLAGS_train_list.c_str());
+    config.set_load_data_module("test_PyDataProvider2");
+    config.set_load_data_object(funcName);
+    std::unique_ptr<paddle::DataProvider> provider(
+        paddle::DataProvider::create(config, false));
+    provider->setSkipShuffle();
+
+    // The storage of the first pass is reused by the second one.
+    for (int pass = 0; pass < 2; ++pass) {
+      provider->reset();
+      paddle::DataBatch batch;
+      int64_t numAllocs = 0;
+      int64_t numSamples = 0;
+      while (int64_t batchSize = provider->getNextBatch(30, &batch)) {
+        numAllocs += batch.getNumAllocs();
+        // The reused storage is resized to this batch, not the previous one.
+        auto &arg = batch.getStreams()[0];
+        if (funcName == "test_index_no_seq") {
+          ASSERT_EQ((size_t)batchSize, arg.ids->getSize());
+        } else if (funcName != "test_index_seq") {
+          ASSERT_EQ((size_t)batchSize, arg.value->getHeight()) << funcName;
+        } else {
+          const int *ids = arg.ids->getData();
+          const int *starts = arg.sequenceStartPositions->getData(false);
+          ASSERT_EQ((size_t)starts[batchSize], arg.ids->getSize());
+          for (int64_t n = 0; n < batchSize; ++n) {
+            ASSERT_EQ(numSamples + n + 1, starts[n + 1] - starts[n]);
+            for (int t = starts[n]; t < starts[n + 1]; ++t) {
+              ASSERT_EQ(t - starts[n], ids[t]);
+            }
+          }
+        }
+        numSamples += batchSize;
+      }
+      ASSERT_EQ(200, numSamples);
+      if (pass == 0) {
+        ASSERT_GT(numAllocs, 0);
+      } else {
+        ASSERT_EQ(0, numAllocs) << funcName;
+      }
+    }
+  }
+}
+
 int main(int argc, char **argv) {
   testing::InitGoogleTest(&argc, argv);
   paddle::initMain(argc, argv);
@@ -121,3 +121,48 @@ def test_min_pool_size_with_cache(settings, filename):
     import random
     for _ in xrange(2**20):
         yield random.randint(0, 9)
+
+
+@provider(
+    input_types=[index_slot(
+        100, seq_type=SequenceType.SEQUENCE)],
+    should_shuffle=True,
+    bucket_window=10)
+def test_bucket_window(settings, filename):
+    for i in xrange(1000):
+        seq_len = random.randint(1, 100)
+        yield [i % 100] * seq_len
+
+
+@provider(
+    input_types=[index_slot(
+        100, seq_type=SequenceType.SEQUENCE)],
+    should_shuffle=True,
+    pool_size=50,
+    bucket_window=10)
+def test_bucket_window_small_pool(settings, filename):
+    for i in xrange(1000):
+        seq_len = random.randint(1, 100)
+        yield [i % 100] * seq_len
+
+
+@provider(
+    input_types=[
+        dense_vector(3), integer_value_sequence(100), sparse_vector(30),
+        integer_value_sub_sequence(100)
+    ],
+    num_workers=2)
+def test_workers(settings, filename):
+    file_id = int(filename)
+    for i in xrange(100):
+        k = file_id * 100 + i
+        yield [k, k + 1, k + 2], [i] * (i % 10 + 1), [(k % 30, float(k))], \
+            [range(j + 1) for j in xrange(i % 3 + 1)]
+
+
+@provider(
+    input_types=[integer_value_sequence(100), dense_vector(2)],
+    cache=CacheType.CACHE_PASS_ON_DISK)
+def test_cache_on_disk(settings, filename):
+    for i in xrange(1000):
+        yield [i % 100] * (i % 7 + 1), [i, -i]
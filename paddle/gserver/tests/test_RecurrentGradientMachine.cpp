@@ -22,6 +22,8 @@ limitations under the License. */
 #include <paddle/utils/Version.h>
 
 DECLARE_int32(seed);
+DECLARE_int32(rnn_checkpoint_interval);
+DECLARE_double(rnn_memory_budget_mb);
 
 using namespace paddle;  // NOLINT
 using namespace std;     // NOLINT
@@ -164,6 +166,50 @@ TEST(RecurrentGradientMachine, rnn_mixed_input) {
   }
 }
 
+// Train with the checkpoint interval, or the memory budget if interval is 0,
+// and compare the costs with training without checkpoints.
+void testCheckpoint(const string& conf,
+                    int interval,
+                    double budgetMb,
+                    bool useGpu) {
+  if (!paddle::version::isWithGpu() && useGpu) {
+    return;
+  }
+  FLAGS_use_gpu = useGpu;
+  int num_passes = 5;
+  std::vector<real> cost1(num_passes);
+  FLAGS_rnn_checkpoint_interval = 0;
+  FLAGS_rnn_memory_budget_mb = 0;
+  CalCost(conf, "gserver/tests/t1", cost1.data(), num_passes);
+
+  std::vector<real> cost2(num_passes);
+  FLAGS_rnn_checkpoint_interval = interval;
+  FLAGS_rnn_memory_budget_mb = budgetMb;
+  CalCost(conf, "gserver/tests/t2", cost2.data(), num_passes);
+  FLAGS_rnn_checkpoint_interval = 0;
+  FLAGS_rnn_memory_budget_mb = 0;
+
+  for (int i = 0; i < num_passes; i++) {
+    ASSERT_NEAR(cost1[i], cost2[i], 1e-6);
+  }
+}
+
+TEST(RecurrentGradientMachine, checkpoint) {
+  for (bool useGpu : {false, true}) {
+    for (int interval : {1, 2, 3}) {
+      testCheckpoint("gserver/tests/sequence_rnn.conf", interval, 0, useGpu);
+      testCheckpoint(
+          "gserver/tests/sequence_rnn_multi_input.conf", interval, 0, useGpu);
+    }
+    // The frames of every batch exceed a budget of 1 byte, so the interval
+    // is chosen from the budget and the frames are recomputed.
+    const double budgetMb = 1.0 / (1024 * 1024);
+    testCheckpoint("gserver/tests/sequence_rnn.conf", 0, budgetMb, useGpu);
+    testCheckpoint(
+        "gserver/tests/sequence_rnn_multi_input.conf", 0, budgetMb, useGpu);
+  }
+}
+
 int main(int argc, char** argv) {
   testing::InitGoogleTest(&argc, argv);
 
@@ -0,0 +1,105 @@
+/* Copyright (c) 2016 PaddlePaddle Authors. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "paddle/gserver/dataproviders/DataProvider.h"
+#include "paddle/utils/Util.h"
+
+using namespace paddle;  // NOLINT
+using namespace std;     // NOLINT
+
+const char* kTestDir = "./test_SimpleDataProvider";
+const char* kFileList = "./test_SimpleDataProvider/files.txt";
+const char* kDataFile = "./test_SimpleDataProvider/data.txt";
+const int kNumSamples = 11;
+const int kFeatDim = 3;
+// smaller than the data, so that the buffer is refilled within a pass
+const int kBufferCapacity = 5;
+
+// the label of sample i is i, and its features are i * kFeatDim + k
+static void writeFiles() {
+  mkDir(kTestDir);
+  ofstream list(kFileList);
+  list << kDataFile << endl;
+  ofstream os(kDataFile);
+  for (int i = 0; i < kNumSamples; ++i) {
+    os << i;
+    for (int k = 0; k < kFeatDim; ++k) {
+      os << ' ' << i * kFeatDim + k;
+    }
+    os << endl;
+  }
+}
+
+static void testSimpleDataProvider(bool skipShuffle, int batchSize) {
+  DataConfig config;
+  config.set_type("simple");
+  config.set_files(kFileList);
+  config.set_feat_dim(kFeatDim);
+  config.set_buffer_capacity(kBufferCapacity);
+
+  unique_ptr<DataProvider> dataProvider(DataProvider::create(config, false));
+  if (skipShuffle) {
+    dataProvider->setSkipShuffle();
+  }
+
+  for (int pass = 0; pass < 2; ++pass) {
+    dataProvider->reset();
+    DataBatch batch;
+    vector<int> labels;
+    while (dataProvider->getNextBatch(batchSize, &batch) > 0) {
+      ASSERT_EQ(2, batch.getNumStreams());
+      const MatrixPtr& data = batch.getStream(0).value;
+      const IVectorPtr& ids = batch.getStream(1).ids;
+      ASSERT_EQ((size_t)batch.getSize(), data->getHeight());
+      ASSERT_EQ((size_t)kFeatDim, data->getWidth());
+      for (int64_t i = 0; i < batch.getSize(); ++i) {
+        int label = ids->getElement(i);
+        for (int k = 0; k < kFeatDim; ++k) {
+          EXPECT_EQ(label * kFeatDim + k, data->getElement(i, k));
+        }
+        labels.push_back(label);
+      }
+    }
+
+    // every sample once, in the order of the file without shuffle
+    ASSERT_EQ((size_t)kNumSamples, labels.size());
+    if (!skipShuffle) {
+      sort(labels.begin(), labels.end());
+    }
+    for (int i = 0; i < kNumSamples; ++i) {
+      EXPECT_EQ(i, labels[i]);
+    }
+  }
+}
+
+TEST(SimpleDataProvider, shuffle) {
+  writeFiles();
+  for (bool skipShuffle : {false, true}) {
+    for (int batchSize : {1, 2, 4}) {
+      testSimpleDataProvider(skipShuffle, batchSize);
+    }
+  }
+  rmDir(kTestDir);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  initMain(argc, argv);
+  return RUN_ALL_TESTS();
+}
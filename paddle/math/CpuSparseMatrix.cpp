@@ -81,7 +81,7 @@ void CpuSparseMatrix::resize(size_t newHeight,
     newSize += newNnz * sizeof(real);
   }
 
-  if (NULL == memoryHandle_.get() || newSize > memoryHandle_->getSize()) {
+  if (NULL == memoryHandle_.get() || newSize > memoryHandle_->getAllocSize()) {
     memoryHandle_ = std::make_shared<CpuMemoryHandle>(newSize);
   }
 
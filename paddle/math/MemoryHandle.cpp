@@ -18,6 +18,10 @@ limitations under the License. */
 
 namespace paddle {
 
+static __thread int64_t g_numAllocs = 0;
+
+int64_t MemoryHandle::getNumAllocs() { return g_numAllocs; }
+
 /**
  * Calculate the actual allocation size according to the required size.
  */
@@ -41,6 +45,7 @@ GpuMemoryHandle::GpuMemoryHandle(size_t size) : MemoryHandle(size) {
   deviceId_ = hl_get_device();
   allocator_ = StorageEngine::singleton()->getGpuAllocator(deviceId_);
   buf_ = allocator_->alloc(allocSize_);
+  ++g_numAllocs;
 }
 
 GpuMemoryHandle::~GpuMemoryHandle() { allocator_->free(buf_, allocSize_); }
@@ -49,8 +54,18 @@ CpuMemoryHandle::CpuMemoryHandle(size_t size) : MemoryHandle(size) {
   CHECK(size != 0) << " allocate 0 bytes";
   allocator_ = StorageEngine::singleton()->getCpuAllocator();
   buf_ = allocator_->alloc(allocSize_);
+  ++g_numAllocs;
 }
 
-CpuMemoryHandle::~CpuMemoryHandle() { allocator_->free(buf_, allocSize_); }
+CpuMemoryHandle::CpuMemoryHandle(void* buf, size_t size) : MemoryHandle(size) {
+  allocSize_ = size;
+  deviceId_ = -1;
+  allocator_ = nullptr;
+  buf_ = buf;
+}
+
+CpuMemoryHandle::~CpuMemoryHandle() {
+  if (allocator_) allocator_->free(buf_, allocSize_);
+}
 
 }  // namespace paddle
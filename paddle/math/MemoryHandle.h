@@ -29,6 +29,13 @@ public:
   size_t getSize() const { return size_; }
   size_t getAllocSize() const { return allocSize_; }
 
+  /**
+   * The number of the memory buffers allocated by the calling thread so far.
+   * The difference before and after a piece of code tells how many
+   * allocations it does for matrices and vectors.
+   */
+  static int64_t getNumAllocs();
+
 protected:
   PoolAllocator* allocator_;
   size_t size_;       // the requested size
@@ -57,6 +64,26 @@ class CpuMemoryHandle : public MemoryHandle {
 public:
   explicit CpuMemoryHandle(size_t size);
   virtual ~CpuMemoryHandle();
+
+protected:
+  /// Wrap the memory buf owned by others, nothing is allocated.
+  CpuMemoryHandle(void* buf, size_t size);
+};
+
+/**
+ * Wrapper class for a piece of cpu memory owned by another object,
+ * such as a read-only file mapping.
+ *
+ * The memory is not released at destructor, but the owner is kept
+ * alive as long as the handle.
+ */
+class SharedCpuMemoryHandle : public CpuMemoryHandle {
+public:
+  SharedCpuMemoryHandle(void* buf, size_t size, std::shared_ptr<void> owner)
+      : CpuMemoryHandle(buf, size), owner_(owner) {}
+
+private:
+  std::shared_ptr<void> owner_;
 };
 
 typedef std::shared_ptr<MemoryHandle> MemoryHandlePtr;
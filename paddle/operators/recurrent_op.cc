@@ -26,48 +26,89 @@ namespace operators {
 using Scope = framework::Scope;
 using Variable = framework::Variable;
 using Tensor = framework::Tensor;
+using LODTensor = framework::LODTensor;
 
 void RecurrentAlgorithm::InferShape(const Scope& scope) const {
-  seq_len_ = scope.FindVar((arg_->inlinks[0]).external)
-                 ->GetMutable<Tensor>()
-                 ->dims()[0];
+  Variable* input_var = scope.FindVar((arg_->inlinks[0]).external);
+  PADDLE_ENFORCE(input_var != nullptr, "input link [%s] is not in scope.",
+                 arg_->inlinks[0].external);
+  is_ragged_ = input_var->IsType<LODTensor>();
+  if (is_ragged_) {
+    const LODTensor& lod_input = input_var->Get<LODTensor>();
+    PADDLE_ENFORCE(lod_input.HasLOD(), "input link [%s] has no LOD.",
+                   arg_->inlinks[0].external);
+    ragged_batch_.Init(lod_input.lod()->back());
+    seq_len_ = ragged_batch_.seq_len();
+  } else {
+    seq_len_ = input_var->GetMutable<Tensor>()->dims()[0];
+  }
   CreateScopes(scope);
-  auto step_scopes = GetStepScopes(scope);
-  rnn::SegmentInputs(step_scopes, arg_->inlinks, seq_len_,
-                     true /*infer_shape_mode*/);
+  auto& step_scopes = GetStepScopes(scope);
+  if (is_ragged_) {
+    rnn::SegmentRaggedInputs(step_scopes, arg_->inlinks, ragged_batch_,
+                             &ragged_inputs_, true /*infer_shape_mode*/);
+  } else {
+    rnn::SegmentInputs(step_scopes, arg_->inlinks, seq_len_,
+                       true /*infer_shape_mode*/);
+  }
   InitMemories(step_scopes[0], true /*infer_shape_mode*/);
   Variable* net = scope.FindVar(arg_->step_net);
   PADDLE_ENFORCE(net != nullptr, "failed to get step net");
 
   for (size_t i = 0; i < seq_len_; i++) {
-    if (i > 0) {
+    if (i > 0 && is_ragged_) {
+      rnn::LinkRaggedMemories(step_scopes, arg_->memories, i, ragged_batch_,
+                              true /*infer_shape_mode*/);
+    } else if (i > 0) {
       rnn::LinkMemories(step_scopes, arg_->memories, i, -1,
                         true /*infer_shape_mode*/);
     }
     net->GetMutable<NetOp>()->InferShape(*step_scopes[i]);
   }
-  rnn::ConcatOutputs(step_scopes, arg_->outlinks, seq_len_,
-                     true /*infer_shape_mode*/);
+  if (is_ragged_) {
+    rnn::ConcatRaggedOutputs(step_scopes, arg_->outlinks, ragged_batch_,
+                             input_var->Get<LODTensor>(),
+                             true /*infer_shape_mode*/);
+  } else {
+    rnn::ConcatOutputs(step_scopes, arg_->outlinks, seq_len_,
+                       true /*infer_shape_mode*/);
+  }
 }
 
 void RecurrentAlgorithm::Run(const Scope& scope,
                              const platform::DeviceContext& dev_ctx) const {
-  auto step_scopes = GetStepScopes(scope);
-  rnn::SegmentInputs(step_scopes, arg_->inlinks, seq_len_,
-                     false /*infer_shape_mode*/);
+  auto& step_scopes = GetStepScopes(scope);
+  if (is_ragged_) {
+    rnn::SegmentRaggedInputs(step_scopes, arg_->inlinks, ragged_batch_,
+                             &ragged_inputs_, false /*infer_shape_mode*/);
+  } else {
+    rnn::SegmentInputs(step_scopes, arg_->inlinks, seq_len_,
+                       false /*infer_shape_mode*/);
+    rnn::LinkOutputs(step_scopes, arg_->outlinks, seq_len_);
+  }
   InitMemories(step_scopes[0], false /*infer_shape_mode*/);
   Variable* net = scope.FindVar(arg_->step_net);
 
   for (size_t step_id = 0; step_id < seq_len_; step_id++) {
     // create output alias variables
-    if (step_id > 0) {
+    if (step_id > 0 && is_ragged_) {
+      rnn::LinkRaggedMemories(step_scopes, arg_->memories, step_id,
+                              ragged_batch_, false /*infer_shape_mode*/);
+    } else if (step_id > 0) {
       rnn::LinkMemories(step_scopes, arg_->memories, step_id, -1,
                         false /*infer_shape_mode*/);
     }
     net->GetMutable<NetOp>()->Run(*step_scopes[step_id], dev_ctx);
   }
-  rnn::ConcatOutputs(step_scopes, arg_->outlinks, seq_len_,
-                     false /*infer_shape_mode*/);
+  if (is_ragged_) {
+    rnn::ConcatRaggedOutputs(
+        step_scopes, arg_->outlinks, ragged_batch_,
+        scope.FindVar(arg_->inlinks[0].external)->Get<LODTensor>(),
+        false /*infer_shape_mode*/);
+  } else {
+    rnn::ConcatOutputs(step_scopes, arg_->outlinks, seq_len_,
+                       false /*infer_shape_mode*/);
+  }
 }
 
 void RecurrentAlgorithm::CreateScopes(const Scope& scope) const {
@@ -105,13 +146,34 @@ void RecurrentAlgorithm::CreateScopes(const Scope& scope) const {
 
 void RecurrentAlgorithm::InitMemories(Scope* step_scope,
                                       bool infer_shape_mode) const {
-  for (auto& attr : arg_->memories) {
+  ragged_boot_memories_.resize(arg_->memories.size());
+  for (size_t i = 0; i < arg_->memories.size(); ++i) {
+    auto& attr = arg_->memories[i];
     Tensor* pre_mem = step_scope->NewVar(attr.pre_var)->GetMutable<Tensor>();
     PADDLE_ENFORCE(step_scope->FindVar(attr.boot_var) != nullptr,
                    "memory [%s]'s boot variable [%s] not exists", attr.var,
                    attr.boot_var);
     Tensor* boot_mem = step_scope->FindVar(attr.boot_var)->GetMutable<Tensor>();
-    if (infer_shape_mode) {
+    if (is_ragged_) {
+      // the boot memory has a row for each sequence in the LOD order.
+      const auto& seq_order = ragged_batch_.seq_order;
+      PADDLE_ENFORCE_EQ(static_cast<size_t>(boot_mem->dims()[0]),
+                        seq_order.size(),
+                        "memory [%s] must have a row for each sequence",
+                        attr.var);
+      size_t batch_size = ragged_batch_.batch_size(0);
+      if (infer_shape_mode) {
+        framework::DDim dims = boot_mem->dims();
+        dims[0] = batch_size;
+        pre_mem->Resize(dims);
+        PADDLE_ENFORCE_EQ(pre_mem->dims().size(), 2);
+      } else {
+        Tensor& reordered = ragged_boot_memories_[i];
+        rnn::GatherRows(*boot_mem, seq_order.data(), seq_order.size(),
+                        &reordered);
+        *pre_mem = rnn::SliceRows(reordered, 0, batch_size);
+      }
+    } else if (infer_shape_mode) {
       pre_mem->Resize(boot_mem->dims());
       PADDLE_ENFORCE_EQ(pre_mem->dims().size(), 2);
     } else {
@@ -169,9 +231,10 @@ class RecurrentAlgorithmProtoAndCheckerMaker
 
 void RecurrentGradientAlgorithm::Run(
     const Scope& scope, const platform::DeviceContext& dev_ctx) const {
-  auto step_scopes = GetStepScopes(scope);
+  auto& step_scopes = GetStepScopes(scope);
   rnn::SegmentInputs(step_scopes, arg_->inlinks, seq_len_,
                      false /*infer_shape_mode*/);
+  rnn::LinkOutputs(step_scopes, arg_->outlinks, seq_len_);
   Variable* net = scope.FindVar(arg_->step_net);
   PADDLE_ENFORCE(net != nullptr, "failed to get step net");
   for (int step_id = seq_len_ - 1; step_id >= 0; --step_id) {
@@ -205,10 +268,13 @@ void RecurrentGradientAlgorithm::LinkBootMemoryGradients(
 }
 
 void RecurrentGradientAlgorithm::InferShape(const Scope& scope) const {
-  seq_len_ = scope.FindVar((arg_->inlinks[0]).external)
-                 ->GetMutable<Tensor>()
-                 ->dims()[0];
-  auto step_scopes = GetStepScopes(scope);
+  Variable* input_var = scope.FindVar((arg_->inlinks[0]).external);
+  PADDLE_ENFORCE(input_var != nullptr, "input link [%s] is not in scope.",
+                 arg_->inlinks[0].external);
+  PADDLE_ENFORCE(!input_var->IsType<LODTensor>(),
+                 "LODTensor is not supported by RecurrentGradientOp yet.");
+  seq_len_ = input_var->GetMutable<Tensor>()->dims()[0];
+  auto& step_scopes = GetStepScopes(scope);
   rnn::SegmentInputs(step_scopes, arg_->inlinks, seq_len_,
                      true /*infer_shape_mode*/);
   Variable* net = scope.FindVar(arg_->step_net);
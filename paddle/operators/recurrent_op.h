@@ -20,9 +20,11 @@
 namespace paddle {
 namespace operators {
 
-// The sequence format in RecurrentOp is Tensor<seq_len, batch_size, dim> now.
+// The sequence format in RecurrentOp is Tensor<seq_len, batch_size, dim>, or
+// a LODTensor<num_rows, dim> whose sequences are the elements of the last LOD
+// level, which is computed without padding by a RaggedBatch.
 // TODO(Yan Chunwei):
-// 1. No-padding computing for sequences with indifinite length in one batch.
+// 1. No-padding computing in RecurrentGradientOp.
 // 2. Hierarchical RNN for sequence with sub-sequence.
 // 3. Internal Memory.
 // 4. More Complex RNN architecture, such as Gated Feedback RNN.
@@ -60,6 +62,12 @@ class RecurrentAlgorithm {
  private:
   std::unique_ptr<rnn::Argument> arg_;
   mutable size_t seq_len_;
+  // the inlinks are LODTensor, and the steps run on ragged_batch_.
+  mutable bool is_ragged_ = false;
+  mutable rnn::RaggedBatch ragged_batch_;
+  // the inlinks and boot memories reordered by ragged_batch_.
+  mutable std::vector<framework::Tensor> ragged_inputs_;
+  mutable std::vector<framework::Tensor> ragged_boot_memories_;
 };
 
 class RecurrentGradientAlgorithm {
@@ -393,6 +393,149 @@ TEST(RecurrentOp, LinkMemories) {
   }
 }
 
+TEST(RecurrentOp, LinkOutputs) {
+  using namespace paddle::framework;
+  using namespace paddle::platform;
+  using namespace paddle::operators;
+
+  size_t len = 10;
+  Scope scope;
+  scope.NewVar("h")->GetMutable<Tensor>()->Resize({10, 15, 20});
+  std::vector<Scope*> step_scopes;
+  for (size_t i = 0; i < len; ++i) {
+    auto& step_scope = scope.NewScope();
+    step_scope.NewVar("h@alias")->GetMutable<Tensor>()->Resize({15, 20});
+    step_scopes.push_back(&step_scope);
+  }
+  rnn::Link outlink;
+  outlink.external = "h";
+  outlink.internal = "h@alias";
+  std::vector<rnn::Link> outlinks{outlink};
+
+  rnn::LinkOutputs(step_scopes, outlinks, len);
+  // the step nets write into the slices of the outlink
+  const float* h = scope.FindVar("h")->GetMutable<Tensor>()->data<float>();
+  for (size_t i = 0; i < len; ++i) {
+    Tensor* step_output =
+        step_scopes[i]->FindVar("h@alias")->GetMutable<Tensor>();
+    ASSERT_EQ(step_output->dims(), make_ddim({15, 20}));
+    float* data = step_output->mutable_data<float>(CPUPlace());
+    ASSERT_EQ(data, h + i * 15 * 20);
+    for (size_t j = 0; j < 15 * 20; ++j) {
+      data[j] = i * 15 * 20 + j;
+    }
+  }
+  rnn::ConcatOutputs(step_scopes, outlinks, len, false /*infer_shape_mode*/);
+
+  for (size_t j = 0; j < len * 15 * 20; ++j) {
+    ASSERT_FLOAT_EQ(h[j], j);
+  }
+}
+
+TEST(RecurrentOp, RaggedBatch) {
+  using namespace paddle::operators;
+
+  // the sequences have lengths 2, 4, 0, 1, 4
+  paddle::framework::LODTensor::Level starts{0, 2, 6, 6, 7, 11};
+  rnn::RaggedBatch batch;
+  batch.Init(starts);
+
+  EXPECT_EQ(batch.seq_order, (std::vector<size_t>{1, 4, 0, 3, 2}));
+  EXPECT_EQ(batch.step_begin, (std::vector<size_t>{0, 4, 7, 9, 11}));
+  EXPECT_EQ(batch.rows,
+            (std::vector<size_t>{2, 7, 0, 6, 3, 8, 1, 4, 9, 5, 10}));
+  EXPECT_EQ(batch.seq_len(), 4UL);
+  EXPECT_EQ(batch.batch_size(1), 3UL);
+}
+
+TEST(RecurrentOp, RunRaggedBatch) {
+  using namespace paddle::framework;
+  using namespace paddle::platform;
+  using namespace paddle::operators;
+
+  // h[t] = h[t - 1] * w + x[t] for each sequence of x.
+  const int dim = 3;
+  std::vector<size_t> lengths{2, 4, 1, 3};
+  auto lod = std::make_shared<LODTensor::LOD>();
+  lod->push_back(LODTensor::Level{0});
+  for (auto length : lengths) {
+    lod->back().push_back(lod->back().back() + length);
+  }
+  int num_rows = lod->back().back();
+  int num_seqs = lengths.size();
+
+  Scope scope;
+  auto x = std::make_shared<Tensor>();
+  float* x_data = x->mutable_data<float>({num_rows, dim}, CPUPlace());
+  for (int i = 0; i < num_rows * dim; ++i) {
+    x_data[i] = rand() * (1. / (double)RAND_MAX);
+  }
+  scope.NewVar("x")->GetMutable<LODTensor>()->Reset(x, lod);
+  float* boot_data =
+      scope.NewVar("h_boot")->GetMutable<Tensor>()->mutable_data<float>(
+          {num_seqs, dim}, CPUPlace());
+  for (int i = 0; i < num_seqs * dim; ++i) {
+    boot_data[i] = rand() * (1. / (double)RAND_MAX);
+  }
+  float* w_data =
+      scope.NewVar("rnn/w")->GetMutable<Tensor>()->mutable_data<float>(
+          {dim, dim}, CPUPlace());
+  for (int i = 0; i < dim * dim; ++i) {
+    w_data[i] = rand() * (1. / (double)RAND_MAX);
+  }
+  scope.NewVar("h");
+  scope.NewVar("step_scopes");
+  auto net = scope.NewVar("step_net")->GetMutable<NetOp>();
+  net->AddOp(
+      OpRegistry::CreateOp("mul", {"rnn/h@pre", "rnn/w"}, {"rnn/s"}, {}));
+  net->AddOp(
+      OpRegistry::CreateOp("add_two", {"x@alias", "rnn/s"}, {"rnn/h"}, {}));
+  net->CompleteAddOp();
+
+  std::unique_ptr<rnn::Argument> arg(new rnn::Argument());
+  arg->step_net = "step_net";
+  arg->step_scopes = "step_scopes";
+  rnn::Link inlink;
+  inlink.external = "x";
+  inlink.internal = "x@alias";
+  arg->inlinks = std::vector<rnn::Link>{inlink};
+  rnn::Link outlink;
+  outlink.external = "h";
+  outlink.internal = "rnn/h";
+  arg->outlinks = std::vector<rnn::Link>{outlink};
+  rnn::MemoryAttr mem_attr;
+  mem_attr.pre_var = "rnn/h@pre";
+  mem_attr.var = "rnn/h";
+  mem_attr.boot_var = "h_boot";
+  arg->memories = std::vector<rnn::MemoryAttr>{mem_attr};
+
+  RecurrentAlgorithm rnn_algo;
+  rnn_algo.Init(std::move(arg));
+  CPUDeviceContext ctx;
+  rnn_algo.InferShape(scope);
+  rnn_algo.Run(scope, ctx);
+
+  LODTensor* h = scope.FindVar("h")->GetMutable<LODTensor>();
+  ASSERT_EQ(h->lod(), lod.get());
+  ASSERT_EQ(h->raw_tensor()->dims(), make_ddim({num_rows, dim}));
+  const float* h_data = h->raw_tensor()->data<float>();
+  for (int s = 0; s < num_seqs; ++s) {
+    std::vector<float> state(boot_data + s * dim, boot_data + (s + 1) * dim);
+    for (size_t row = (*lod)[0][s]; row < (*lod)[0][s + 1]; ++row) {
+      std::vector<float> next(x_data + row * dim, x_data + (row + 1) * dim);
+      for (int i = 0; i < dim; ++i) {
+        for (int j = 0; j < dim; ++j) {
+          next[j] += state[i] * w_data[i * dim + j];
+        }
+      }
+      state = next;
+      for (int j = 0; j < dim; ++j) {
+        ASSERT_NEAR(h_data[row * dim + j], state[j], 1e-5);
+      }
+    }
+  }
+}
+
 USE_OP(add_two);
 USE_OP(mul);
 USE_OP_WITHOUT_KERNEL(recurrent_op);
@@ -14,6 +14,10 @@
 
 #include "paddle/operators/rnn/recurrent_op_utils.h"
 
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
 namespace paddle {
 namespace operators {
 namespace rnn {
@@ -21,6 +25,73 @@ namespace rnn {
 namespace f = paddle::framework;
 
 using Tensor = framework::Tensor;
+using LODTensor = framework::LODTensor;
+
+void RaggedBatch::Init(const LODTensor::Level& starts) {
+  // copy the offsets to host once, the level may be on device.
+  std::vector<size_t> offsets(starts.begin(), starts.end());
+  PADDLE_ENFORCE_GE(offsets.size(), 2UL, "no sequence in the LOD level");
+  auto length = [&offsets](size_t i) { return offsets[i + 1] - offsets[i]; };
+
+  seq_order.resize(offsets.size() - 1);
+  std::iota(seq_order.begin(), seq_order.end(), 0UL);
+  std::stable_sort(
+      seq_order.begin(), seq_order.end(),
+      [&length](size_t a, size_t b) { return length(a) > length(b); });
+
+  size_t max_len = length(seq_order[0]);
+  PADDLE_ENFORCE_GT(max_len, 0UL, "all the sequences are empty");
+  step_begin.assign(1, 0UL);
+  rows.clear();
+  rows.reserve(offsets.back() - offsets.front());
+  for (size_t step_id = 0; step_id < max_len; ++step_id) {
+    for (size_t i : seq_order) {
+      if (length(i) <= step_id) break;
+      rows.push_back(offsets[i] + step_id);
+    }
+    step_begin.push_back(rows.size());
+  }
+}
+
+// TODO: GatherRows and ScatterRows only handle float tensors on CPU.
+void GatherRows(const Tensor& src, const size_t* rows, size_t num_rows,
+                Tensor* dst) {
+  f::DDim dims = src.dims();
+  size_t src_rows = dims[0];
+  size_t width = product(dims) / dims[0];
+  dims[0] = num_rows;
+  dst->Resize(dims);
+  const float* src_data = src.data<float>();
+  float* dst_data = dst->mutable_data<float>(platform::CPUPlace());
+  for (size_t i = 0; i < num_rows; ++i) {
+    PADDLE_ENFORCE_LT(rows[i], src_rows, "row [%d] is out of range", rows[i]);
+    std::memcpy(dst_data + i * width, src_data + rows[i] * width,
+                width * sizeof(float));
+  }
+}
+
+void ScatterRows(const Tensor& src, const size_t* rows, Tensor* dst) {
+  size_t num_rows = src.dims()[0];
+  size_t dst_rows = dst->dims()[0];
+  size_t width = product(src.dims()) / num_rows;
+  PADDLE_ENFORCE_EQ(product(dst->dims()) / dst_rows, width,
+                    "the width of src and dst don't match");
+  const float* src_data = src.data<float>();
+  float* dst_data = dst->mutable_data<float>(platform::CPUPlace());
+  for (size_t i = 0; i < num_rows; ++i) {
+    PADDLE_ENFORCE_LT(rows[i], dst_rows, "row [%d] is out of range", rows[i]);
+    std::memcpy(dst_data + rows[i] * width, src_data + i * width,
+                width * sizeof(float));
+  }
+}
+
+Tensor SliceRows(const Tensor& src, size_t begin, size_t end) {
+  // Tensor::Slice can not take all the rows of a tensor with one row.
+  if (begin == 0 && end == static_cast<size_t>(src.dims()[0])) {
+    return src;
+  }
+  return src.Slice<float>(begin, end);
+}
 
 void SegmentInputs(const std::vector<Scope*>& step_scopes,
                    const std::vector<Link>& inlinks, const size_t seq_len,
@@ -65,10 +136,14 @@ void ConcatOutputs(const std::vector<Scope*>& step_scopes,
       dims_vec.insert(dims_vec.begin(), seq_len);
       output->Resize(f::make_ddim(dims_vec));
     } else {
-      output->mutable_data<float>(platform::CPUPlace());
+      float* output_data = output->mutable_data<float>(platform::CPUPlace());
+      size_t step_size = product(output->dims()) / seq_len;
       for (size_t j = 0; j < seq_len; j++) {
         Tensor* step_output =
             step_scopes[j]->FindVar(outlinks[i].internal)->GetMutable<Tensor>();
+        if (step_output->data<float>() == output_data + j * step_size) {
+          continue;
+        }
         // TODO(luotao02) data type and platform::DeviceContext() should set
         // correctly
         (output->Slice<float>(j, j + 1))
@@ -78,6 +153,29 @@ void ConcatOutputs(const std::vector<Scope*>& step_scopes,
   }
 }
 
+void LinkOutputs(const std::vector<Scope*>& step_scopes,
+                 const std::vector<Link>& outlinks, const size_t seq_len) {
+  for (size_t i = 0; i < outlinks.size(); i++) {
+    auto output_var = step_scopes[0]->FindVar(outlinks[i].external);
+    PADDLE_ENFORCE(output_var != nullptr, "output link [%s] is not in scope.",
+                   outlinks[i].external);
+    Tensor* output = output_var->GetMutable<Tensor>();
+    output->mutable_data<float>(platform::CPUPlace());
+    for (size_t j = 0; j < seq_len; j++) {
+      auto step_output_var = step_scopes[j]->FindVar(outlinks[i].internal);
+      PADDLE_ENFORCE(step_output_var != nullptr, "%s not in scope",
+                     outlinks[i].internal);
+      if (step_scopes[j]->FindScope(step_output_var) != step_scopes[j]) {
+        continue;
+      }
+      Tensor* step_output = step_output_var->GetMutable<Tensor>();
+      f::DDim step_dims = step_output->dims();
+      *step_output = SliceRows(*output, j, j + 1);
+      step_output->Resize(step_dims);
+    }
+  }
+}
+
 void LinkMemories(const std::vector<Scope*>& scopes,
                   const std::vector<rnn::MemoryAttr>& memories,
                   const size_t step_id, const int offset,
@@ -104,6 +202,106 @@ void LinkMemories(const std::vector<Scope*>& scopes,
   }
 }
 
+void SegmentRaggedInputs(const std::vector<Scope*>& step_scopes,
+                         const std::vector<Link>& inlinks,
+                         const RaggedBatch& batch,
+                         std::vector<Tensor>* step_inputs,
+                         bool infer_shape_mode) {
+  PADDLE_ENFORCE(!inlinks.empty(), "no in links are provided.");
+  step_inputs->resize(inlinks.size());
+  for (size_t i = 0; i < inlinks.size(); ++i) {
+    auto input_var = step_scopes[0]->FindVar(inlinks[i].external);
+    PADDLE_ENFORCE(input_var != nullptr, "input link [%s] is not in scope.",
+                   inlinks[i].external);
+    PADDLE_ENFORCE(input_var->IsType<LODTensor>(),
+                   "all the inlinks must be LODTensor");
+    Tensor* input = input_var->GetMutable<LODTensor>()->raw_tensor();
+    PADDLE_ENFORCE(input != nullptr, "input link [%s] has no tensor.",
+                   inlinks[i].external);
+    f::DDim dims = input->dims();
+    PADDLE_ENFORCE(static_cast<size_t>(dims[0]) >= batch.rows.size(),
+                   "all the inlinks must have same LOD");
+
+    Tensor& reordered = (*step_inputs)[i];
+    if (infer_shape_mode) {
+      dims[0] = batch.rows.size();
+      reordered.Resize(dims);
+    } else {
+      GatherRows(*input, batch.rows.data(), batch.rows.size(), &reordered);
+    }
+    for (size_t j = 0; j < batch.seq_len(); j++) {
+      Tensor* step_input =
+          step_scopes[j]->NewVar(inlinks[i].internal)->GetMutable<Tensor>();
+      if (infer_shape_mode) {
+        dims[0] = batch.batch_size(j);
+        step_input->Resize(dims);
+      } else {
+        *step_input = SliceRows(reordered, batch.step_begin[j],
+                                batch.step_begin[j + 1]);
+      }
+    }
+  }
+}
+
+void ConcatRaggedOutputs(const std::vector<Scope*>& step_scopes,
+                         const std::vector<Link>& outlinks,
+                         const RaggedBatch& batch, const LODTensor& lod_input,
+                         bool infer_shape_mode) {
+  for (size_t i = 0; i < outlinks.size(); i++) {
+    auto output_var = step_scopes[0]->FindVar(outlinks[i].external);
+    PADDLE_ENFORCE(output_var != nullptr, "output link [%s] is not in scope.",
+                   outlinks[i].external);
+    LODTensor* output = output_var->GetMutable<LODTensor>();
+
+    if (infer_shape_mode) {
+      auto step_scope_var = step_scopes[0]->FindVar(outlinks[i].internal);
+      PADDLE_ENFORCE(step_scope_var != nullptr, "%s not in scope",
+                     outlinks[i].internal);
+      f::DDim dims = step_scope_var->GetMutable<Tensor>()->dims();
+      dims[0] = batch.rows.size();
+      if (output->tensor() == nullptr) {
+        output->tensor() = std::make_shared<Tensor>();
+      }
+      output->raw_tensor()->Resize(dims);
+      output->ShareLOD(lod_input);
+    } else {
+      Tensor* output_tensor = output->raw_tensor();
+      output_tensor->mutable_data<float>(platform::CPUPlace());
+      for (size_t j = 0; j < batch.seq_len(); j++) {
+        Tensor* step_output =
+            step_scopes[j]->FindVar(outlinks[i].internal)->GetMutable<Tensor>();
+        ScatterRows(*step_output, batch.rows.data() + batch.step_begin[j],
+                    output_tensor);
+      }
+    }
+  }
+}
+
+void LinkRaggedMemories(const std::vector<Scope*>& scopes,
+                        const std::vector<rnn::MemoryAttr>& memories,
+                        const size_t step_id, const RaggedBatch& batch,
+                        bool infer_shape_mode) {
+  PADDLE_ENFORCE_LT(step_id, batch.seq_len(),
+                    "step [%d] is out of range of sequence length [%d]",
+                    step_id, batch.seq_len());
+  PADDLE_ENFORCE_GT(step_id, 0UL, "the first step has no previous memory");
+  auto scope = scopes[step_id];
+  auto linked_scope = scopes[step_id - 1];
+  size_t batch_size = batch.batch_size(step_id);
+  for (auto& attr : memories) {
+    auto mem = scope->FindVar(attr.pre_var)->GetMutable<Tensor>();
+    auto linked_mem = linked_scope->FindVar(attr.var)->GetMutable<Tensor>();
+    if (infer_shape_mode) {
+      f::DDim dims = linked_mem->dims();
+      dims[0] = batch_size;
+      mem->Resize(dims);
+    } else {
+      // the finished sequences are at the end of the previous memory.
+      *mem = SliceRows(*linked_mem, 0, batch_size);
+    }
+  }
+}
+
 void InitArgument(const ArgumentName& name, Argument* arg,
                   const framework::OperatorBase& op) {
   arg->step_net = op.Input(name.step_net);
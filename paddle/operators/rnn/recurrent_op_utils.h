@@ -16,6 +16,7 @@
 
 #include <string>
 
+#include "paddle/framework/lod_tensor.h"
 #include "paddle/framework/operator.h"
 
 namespace paddle {
@@ -68,6 +69,55 @@ struct ArgumentName {
   std::string boot_memories;  // the boot memory name
 };
 
+/**
+ * Schedule of the sequences of a LODTensor for a RNN without padding.
+ *
+ * The sequences are sorted by length in descending order, so the sequences
+ * still running at a step are always the first ones of the batch. The rows of
+ * all the sequences are reordered step by step into one tensor, where the
+ * input of a step and the previous memory of a step are offset views, and no
+ * step computes on the padding of the shorter sequences.
+ */
+struct RaggedBatch {
+  // the index in the LOD level of each sequence of the batch.
+  std::vector<size_t> seq_order;
+  // the rows of step t are [step_begin[t], step_begin[t + 1]) in step order.
+  std::vector<size_t> step_begin;
+  // the row in the LODTensor of each row in step order.
+  std::vector<size_t> rows;
+
+  /**
+   * Build the schedule from the start offsets of a LOD level.
+   */
+  void Init(const framework::LODTensor::Level& starts);
+
+  size_t seq_len() const { return step_begin.size() - 1; }
+
+  size_t batch_size(size_t step_id) const {
+    return step_begin[step_id + 1] - step_begin[step_id];
+  }
+};
+
+/**
+ * Copy the rows of src to dst, dst[i] = src[rows[i]], dst is resized to
+ * num_rows rows.
+ */
+void GatherRows(const framework::Tensor& src, const size_t* rows,
+                size_t num_rows, framework::Tensor* dst);
+
+/**
+ * Copy the rows of src to the rows of dst, dst[rows[i]] = src[i], i < the
+ * number of rows of src.
+ */
+void ScatterRows(const framework::Tensor& src, const size_t* rows,
+                 framework::Tensor* dst);
+
+/**
+ * Rows [begin, end) of a tensor, sharing its memory.
+ */
+framework::Tensor SliceRows(const framework::Tensor& src, size_t begin,
+                            size_t end);
+
 /**
  * Prepare inputs for each step net.
  */
@@ -76,7 +126,16 @@ void SegmentInputs(const std::vector<Scope*>& step_scopes,
                    bool infer_shape_mode);
 
 /**
- * Process outputs of step nets and merge to variables.
+ * Make the outputs of step nets views of the slices of the outlinks, so the
+ * step nets write their outputs in place and ConcatOutputs copies nothing.
+ * The outputs not created in the step scopes are left unchanged.
+ */
+void LinkOutputs(const std::vector<Scope*>& step_scopes,
+                 const std::vector<Link>& outlinks, const size_t seq_len);
+
+/**
+ * Process outputs of step nets and merge to variables. The outputs linked by
+ * LinkOutputs are not copied again.
  */
 void ConcatOutputs(const std::vector<Scope*>& step_scopes,
                    const std::vector<Link>& outlinks, const size_t seq_len,
@@ -86,6 +145,36 @@ void LinkMemories(const std::vector<Scope*>& step_scopes,
                   const std::vector<MemoryAttr>& memories, const size_t step_id,
                   const int offset, bool infer_shape_mode);
 
+/**
+ * Prepare the inputs of each step net from the LODTensor inlinks. The inlinks
+ * are reordered once into step_inputs, and the input of a step is a view of
+ * its rows.
+ */
+void SegmentRaggedInputs(const std::vector<Scope*>& step_scopes,
+                         const std::vector<Link>& inlinks,
+                         const RaggedBatch& batch,
+                         std::vector<framework::Tensor>* step_inputs,
+                         bool infer_shape_mode);
+
+/**
+ * Copy the outputs of step nets back to the rows of the sequences in the
+ * LODTensor outlinks, which share the LOD of lod_input.
+ */
+void ConcatRaggedOutputs(const std::vector<Scope*>& step_scopes,
+                         const std::vector<Link>& outlinks,
+                         const RaggedBatch& batch,
+                         const framework::LODTensor& lod_input,
+                         bool infer_shape_mode);
+
+/**
+ * Link the memories of the previous step for a RaggedBatch. The previous
+ * memory is the rows of the sequences that are still running.
+ */
+void LinkRaggedMemories(const std::vector<Scope*>& step_scopes,
+                        const std::vector<MemoryAttr>& memories,
+                        const size_t step_id, const RaggedBatch& batch,
+                        bool infer_shape_mode);
+
 void InitArgument(const ArgumentName& name, Argument* arg,
                   const framework::OperatorBase& op);
 
@@ -0,0 +1,145 @@
+/* Copyright (c) 2016 PaddlePaddle Authors. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "PackedModel.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstring>
+#include <fstream>
+#include "paddle/math/MemoryHandle.h"
+#include "paddle/utils/Logging.h"
+
+namespace paddle {
+
+const char PackedModel::kMagic[8] = {'P', 'D', 'P', 'A', 'C', 'K', 'E', 'D'};
+
+static uint64_t alignOffset(uint64_t offset) {
+  return (offset + PackedModel::kAlignment - 1) / PackedModel::kAlignment *
+         PackedModel::kAlignment;
+}
+
+bool PackedModel::save(const std::string& filename,
+                       const std::string& config,
+                       const std::vector<ParameterPtr>& parameters) {
+  Header header;
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kFormatVersion;
+  header.valueSize = sizeof(real);
+  header.configOffset = sizeof(Header) + parameters.size() * sizeof(Entry);
+  header.configSize = config.size();
+  header.numParameters = parameters.size();
+
+  std::vector<Entry> entries(parameters.size());
+  uint64_t offset = alignOffset(header.configOffset + header.configSize);
+  for (size_t i = 0; i < parameters.size(); ++i) {
+    CHECK(!parameters[i]->isSparse())
+        << "Sparse parameter " << parameters[i]->getName()
+        << " is not supported by PackedModel";
+    entries[i].offset = offset;
+    entries[i].size = parameters[i]->getSize();
+    offset = alignOffset(offset + entries[i].size * sizeof(real));
+  }
+
+  std::ofstream fs(filename, std::ios_base::binary);
+  if (!fs) {
+    LOG(ERROR) << "Fail to open " << filename;
+    return false;
+  }
+  fs.write(reinterpret_cast<char*>(&header), sizeof(header));
+  fs.write(reinterpret_cast<char*>(entries.data()),
+           entries.size() * sizeof(Entry));
+  fs.write(config.data(), config.size());
+  for (size_t i = 0; i < parameters.size(); ++i) {
+    // zero padding up to the aligned offset
+    fs.seekp(entries[i].offset);
+    CpuVector vec(*parameters[i]->getBuf(PARAMETER_VALUE).get());
+    fs.write(reinterpret_cast<char*>(vec.getData()),
+             entries[i].size * sizeof(real));
+  }
+  if (!fs) {
+    LOG(ERROR) << "Fail to write " << filename;
+    return false;
+  }
+  return true;
+}
+
+std::shared_ptr<PackedModel> PackedModel::open(const std::string& filename) {
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    LOG(ERROR) << "Fail to open " << filename;
+    return nullptr;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Header)) {
+    LOG(ERROR) << "Invalid packed model " << filename;
+    close(fd);
+    return nullptr;
+  }
+  size_t size = st.st_size;
+  // A private writable mapping, so that writing the parameters, such as
+  // randomizing or loading them, copies the written pages instead of
+  // faulting, and never changes the file.
+  void* data =
+      mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  // The mapping is still valid after the file is closed.
+  close(fd);
+  if (data == MAP_FAILED) {
+    LOG(ERROR) << "Fail to mmap " << filename;
+    return nullptr;
+  }
+  // Start reading the file in the background.
+  madvise(data, size, MADV_WILLNEED);
+
+  std::shared_ptr<PackedModel> model(
+      new PackedModel(reinterpret_cast<char*>(data), size));
+  if (!model->isValid()) {
+    LOG(ERROR) << "Invalid packed model " << filename;
+    return nullptr;
+  }
+  return model;
+}
+
+PackedModel::~PackedModel() { munmap(data_, size_); }
+
+bool PackedModel::isValid() const {
+  const Header* h = header();
+  if (memcmp(h->magic, kMagic, sizeof(kMagic)) != 0 ||
+      h->version != kFormatVersion || h->valueSize != sizeof(real)) {
+    return false;
+  }
+  if (h->numParameters > (size_ - sizeof(Header)) / sizeof(Entry) ||
+      h->configOffset > size_ || h->configSize > size_ - h->configOffset) {
+    return false;
+  }
+  const Entry* e = entries();
+  for (size_t i = 0; i < h->numParameters; ++i) {
+    if (e[i].offset % kAlignment != 0 || e[i].offset > size_ ||
+        e[i].size > (size_ - e[i].offset) / sizeof(real)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+VectorPtr PackedModel::getValue(size_t paramId) {
+  CHECK_LT(paramId, getNumParameters());
+  const Entry& entry = entries()[paramId];
+  auto handle = std::make_shared<SharedCpuMemoryHandle>(
+      data_ + entry.offset, entry.size * sizeof(real), shared_from_this());
+  return std::make_shared<CpuVector>(entry.size, handle, 0);
+}
+
+}  // namespace paddle
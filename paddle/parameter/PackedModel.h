@@ -0,0 +1,103 @@
+/* Copyright (c) 2016 PaddlePaddle Authors. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "Parameter.h"
+#include "paddle/math/Vector.h"
+
+namespace paddle {
+
+/**
+ * @brief A single file with a serialized model config and the values of all
+ *        the parameters of the model.
+ *
+ * The file layout is:
+ *   Header | Entry * numParameters | model config | value 0 | value 1 | ...
+ * The values are in the order of the parameters in the model config, and
+ * each of them starts at a multiple of kAlignment bytes.
+ *
+ * The file is mapped copy-on-write by open(), and the values returned by
+ * getValue() point into the mapping. So loading a model reads nothing
+ * until the values are used, and the processes on one host which open the
+ * same file share one physical copy of the parameters. A process which
+ * modifies a value gets a private copy of the modified pages, and the file
+ * is never changed.
+ */
+class PackedModel : public std::enable_shared_from_this<PackedModel> {
+public:
+  static const int32_t kFormatVersion = 0;
+  static const size_t kAlignment = 64;
+
+  /**
+   * @brief Write the serialized model config and the PARAMETER_VALUE of
+   *        the parameters into a packed model file. The sparse parameters
+   *        are not supported.
+   */
+  static bool save(const std::string& filename,
+                   const std::string& config,
+                   const std::vector<ParameterPtr>& parameters);
+
+  /**
+   * @brief Map a packed model file. Return nullptr if the file can not be
+   *        mapped or is not a valid packed model.
+   */
+  static std::shared_ptr<PackedModel> open(const std::string& filename);
+
+  ~PackedModel();
+
+  const void* getConfig() const { return data_ + header()->configOffset; }
+  size_t getConfigSize() const { return header()->configSize; }
+
+  size_t getNumParameters() const { return header()->numParameters; }
+
+  /**
+   * @brief The value of the paramId-th parameter. The vector shares the
+   *        mapping, which stays valid as long as any of the vectors.
+   */
+  VectorPtr getValue(size_t paramId);
+
+private:
+  struct Header {
+    char magic[8];           // = kMagic
+    int32_t version;         // = kFormatVersion
+    uint32_t valueSize;      // = sizeof(real)
+    uint64_t configOffset;   // offset of the model config in bytes
+    uint64_t configSize;     // size of the model config in bytes
+    uint64_t numParameters;  // number of Entry following the header
+  };
+
+  struct Entry {
+    uint64_t offset;  // offset of the value in bytes
+    uint64_t size;    // number of elements of the value
+  };
+
+  static const char kMagic[8];
+
+  PackedModel(char* data, size_t size) : data_(data), size_(size) {}
+
+  const Header* header() const { return reinterpret_cast<Header*>(data_); }
+  const Entry* entries() const {
+    return reinterpret_cast<Entry*>(data_ + sizeof(Header));
+  }
+  bool isValid() const;
+
+  char* data_;
+  size_t size_;
+};
+
+}  // namespace paddle
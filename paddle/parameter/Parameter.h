@@ -185,12 +185,21 @@ public:
 
   const MatrixPtr& getMat(ParameterType pType) const { return mats_[pType]; }
 
-  void setValueUpdated() { updated_ = true; }
+  void setValueUpdated() {
+    updated_ = true;
+    ++valueVersion_;
+  }
 
   void clearValueUpdated() { updated_ = false; }
 
   bool isValueUpdated() const { return updated_; }
 
+  /**
+   * @brief The number of setValueUpdated() calls. The data derived from the
+   *        value, such as a packed copy, is stale if the version changes.
+   */
+  uint64_t getValueVersion() const { return valueVersion_; }
+
   /**
    * Save parameter value to a file
    */
@@ -319,6 +328,7 @@ protected:
   int updateCounter_;
 
   bool updated_;
+  uint64_t valueVersion_;
   SparseFormat format_;
 
   std::vector<std::shared_ptr<IParameterUpdaterHook>> updaterHooks_;
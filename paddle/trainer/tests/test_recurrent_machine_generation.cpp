@@ -12,8 +12,11 @@ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 See the License for the specific language governing permissions and
 limitations under the License. */
 
+#include <cstdio>
 #include <fstream>
+#include <unistd.h>
 
+#include <paddle/gserver/gradientmachines/RecurrentGradientMachine.h>
 #include <paddle/trainer/Trainer.h>
 #include <paddle/utils/PythonUtil.h>
 
@@ -25,6 +28,8 @@ using namespace std;     // NOLINT
 static const string& CONFIG_FILE = "trainer/tests/sample_trainer_rnn_gen.conf";
 static const string& NEST_CONFIG_FILE =
     "trainer/tests/sample_trainer_nest_rnn_gen.conf";
+static const string& FC_MAXID_CONFIG_FILE =
+    "trainer/tests/sample_trainer_rnn_gen_fc_maxid.conf";
 static const string& OUTPUT_DIR = "trainer/tests/dump_text.test";
 static string modelDir = "trainer/tests/rnn_gen_test_model_dir/t1";  // NOLINT
 static string expectFile =                                           // NOLINT
@@ -89,10 +94,7 @@ void prepareInArgs(vector<Argument>& inArgs,
   inArgs.emplace_back(dummyInput);
 }
 
-void testGeneration(const string& configFile,
-                    bool useGpu,
-                    bool hasSubseq,
-                    const string& expRetFile) {
+void generate(const string& configFile, bool useGpu, bool hasSubseq) {
   FLAGS_use_gpu = useGpu;
   auto config = std::make_shared<TrainerConfigHelper>(configFile);
   unique_ptr<GradientMachine> gradientMachine(GradientMachine::create(*config));
@@ -107,6 +109,13 @@ void testGeneration(const string& configFile,
   gradientMachine->forward(inArgs, &outArgs, PASS_TEST);
   gradientMachine->eval(testEvaluator.get());
   testEvaluator->finish();
+}
+
+void testGeneration(const string& configFile,
+                    bool useGpu,
+                    bool hasSubseq,
+                    const string& expRetFile) {
+  generate(configFile, useGpu, hasSubseq);
   checkOutput(expRetFile);
 }
 
@@ -140,6 +149,149 @@ TEST(RecurrentGradientMachine, test_generation) {
           false);  // no beam search
   testGen(NEST_CONFIG_FILE, true, expectFile + ".nest", true);  // beam search
 }
+
+TEST(RecurrentGradientMachine, test_generation_fc_maxid) {
+  // fc_maxid_layer only runs on CPU. It must generate the same sequences
+  // as fc_layer with softmax followed by the maxid_layer of beam_search.
+  const string softmaxRetFile = string(OUTPUT_DIR) + ".softmax";
+  for (bool beamSearch : {false, true}) {
+    LOG(INFO) << FC_MAXID_CONFIG_FILE << " beam_search=" << beamSearch;
+    string beamArg = beamSearch ? "beam_search=1" : "beam_search=0";
+    FLAGS_config_args = beamArg + ",fc_maxid=0";
+    generate(FC_MAXID_CONFIG_FILE, false, false);
+    ASSERT_EQ(0, rename(OUTPUT_DIR.c_str(), softmaxRetFile.c_str()));
+    FLAGS_config_args = beamArg + ",fc_maxid=1";
+    generate(FC_MAXID_CONFIG_FILE, false, false);
+
+    vector<float> rets = readRetFile(OUTPUT_DIR);
+    vector<float> expRets = readRetFile(softmaxRetFile);
+    EXPECT_FALSE(rets.empty());
+    ASSERT_EQ(expRets.size(), rets.size());
+    for (size_t i = 0; i < rets.size(); i++) {
+      EXPECT_NEAR(expRets[i], rets[i], 1e-5);
+    }
+    unlink(softmaxRetFile.c_str());
+  }
+}
+
+RecurrentGradientMachine* findGenerator(GradientMachine* gradientMachine) {
+  RecurrentGradientMachine* generator = nullptr;
+  auto network = dynamic_cast<NeuralNetwork*>(gradientMachine);
+  CHECK(network);
+  network->forEachLayer([&](const LayerPtr& layer) {
+    layer->accessSubNetwork([&](NeuralNetwork& subNetwork) {
+      generator = dynamic_cast<RecurrentGradientMachine*>(&subNetwork);
+    });
+    return generator != nullptr;
+  });
+  CHECK(generator);
+  return generator;
+}
+
+void testFinishedSequenceCallback(bool beamSearch) {
+  FLAGS_use_gpu = false;
+  FLAGS_config_args = beamSearch ? "beam_search=1" : "beam_search=0";
+  auto config = std::make_shared<TrainerConfigHelper>(CONFIG_FILE);
+  unique_ptr<GradientMachine> gradientMachine(GradientMachine::create(*config));
+  gradientMachine->loadParameters(modelDir);
+  RecurrentGradientMachine* generator = findGenerator(gradientMachine.get());
+
+  vector<int> finishedSeqIds;
+  vector<vector<vector<int>>> finishedIds;
+  vector<vector<real>> finishedLogProbs;
+  generator->registerFinishedSequenceCallback(
+      [&](int seqId,
+          const vector<vector<int>>& ids,
+          const vector<real>& logProbs) {
+        finishedSeqIds.push_back(seqId);
+        finishedIds.push_back(ids);
+        finishedLogProbs.push_back(logProbs);
+      });
+
+  const size_t batchSize = 15;
+  vector<Argument> inArgs;
+  vector<Argument> outArgs;
+  prepareInArgs(inArgs, batchSize, false, false);
+  gradientMachine->forward(inArgs, &outArgs, PASS_TEST);
+  generator->removeFinishedSequenceCallback();
+
+  // Each sequence is streamed out once, with the same results as the
+  // final paths of the whole batch. Without beam search, the final paths
+  // of the batch are all in the first element, one for each sequence.
+  ASSERT_EQ(batchSize, finishedSeqIds.size());
+  auto& finalPaths = generator->getFinalPaths();
+  vector<bool> finished(batchSize, false);
+  vector<int> ids;
+  for (size_t i = 0; i < finishedSeqIds.size(); ++i) {
+    int seqId = finishedSeqIds[i];
+    EXPECT_FALSE(finished[seqId]);
+    finished[seqId] = true;
+    typedef RecurrentGradientMachine::Path Path;
+    vector<Path> paths = beamSearch ? finalPaths[seqId]
+                                    : vector<Path>{finalPaths[0][seqId]};
+    ASSERT_EQ(paths.size(), finishedIds[i].size());
+    for (size_t j = 0; j < paths.size(); ++j) {
+      paths[j].getIds(generator->getPathTree(), &ids);
+      EXPECT_EQ(ids, finishedIds[i][j]);
+      EXPECT_EQ(paths[j].logProb, finishedLogProbs[i][j]);
+    }
+  }
+}
+
+TEST(RecurrentGradientMachine, test_finished_sequence_callback) {
+  testFinishedSequenceCallback(/* beamSearch */ true);
+  testFinishedSequenceCallback(/* beamSearch */ false);
+}
+
+// Generate with beam search and return the ids and log probabilities of the
+// results of each sequence. Beam search control callbacks, even if they do
+// nothing, disable the pruning of the unfinished paths.
+vector<vector<pair<vector<int>, real>>> beamSearchResults(bool pruning) {
+  FLAGS_use_gpu = false;
+  FLAGS_config_args = "beam_search=1";
+  auto config = std::make_shared<TrainerConfigHelper>(CONFIG_FILE);
+  unique_ptr<GradientMachine> gradientMachine(GradientMachine::create(*config));
+  gradientMachine->loadParameters(modelDir);
+  RecurrentGradientMachine* generator = findGenerator(gradientMachine.get());
+  if (!pruning) {
+    generator->registerBeamSearchControlCallbacks(
+        [](const vector<vector<int>*>&, NeuralNetwork*, const int) {},
+        [](int, const vector<int>&, vector<real>&, real*) {},
+        [](int, const vector<int>&, const vector<real>&) { return false; });
+  }
+
+  const size_t batchSize = 15;
+  vector<Argument> inArgs;
+  vector<Argument> outArgs;
+  prepareInArgs(inArgs, batchSize, false, false);
+  gradientMachine->forward(inArgs, &outArgs, PASS_TEST);
+  generator->removeBeamSearchControlCallbacks();
+
+  auto& finalPaths = generator->getFinalPaths();
+  vector<vector<pair<vector<int>, real>>> results(finalPaths.size());
+  for (size_t i = 0; i < finalPaths.size(); ++i) {
+    for (auto& path : finalPaths[i]) {
+      vector<int> ids;
+      path.getIds(generator->getPathTree(), &ids);
+      results[i].emplace_back(ids, path.logProb);
+    }
+  }
+  return results;
+}
+
+TEST(RecurrentGradientMachine, test_beam_search_pruning) {
+  // Pruning the unfinished paths must not change the results.
+  auto expect = beamSearchResults(/* pruning */ false);
+  auto results = beamSearchResults(/* pruning */ true);
+  ASSERT_EQ(expect.size(), results.size());
+  for (size_t i = 0; i < expect.size(); ++i) {
+    ASSERT_EQ(expect[i].size(), results[i].size());
+    for (size_t j = 0; j < expect[i].size(); ++j) {
+      EXPECT_EQ(expect[i][j].first, results[i][j].first);
+      EXPECT_FLOAT_EQ(expect[i][j].second, results[i][j].second);
+    }
+  }
+}
 #endif
 
 int main(int argc, char** argv) {
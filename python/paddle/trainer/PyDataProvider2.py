@@ -43,6 +43,10 @@ class CacheType(object):
     # memory during rest passes.
     CACHE_PASS_IN_MEM = 1
 
+    # First pass, read data from python. And serialize them into a temporary
+    # file. Read from the file without python during rest passes.
+    CACHE_PASS_ON_DISK = 2
+
 
 class InputType(object):
     """
@@ -332,6 +336,8 @@ def provider(input_types=None,
              min_pool_size=-1,
              can_over_batch_size=True,
              calc_batch_size=None,
+             bucket_window=0,
+             num_workers=0,
              cache=CacheType.NO_CACHE,
              check=False,
              check_fail_continue=False,
@@ -390,6 +396,29 @@ def provider(input_types=None,
                             can customize each sample's batch size.
     :type calc_batch_size: callable
 
+    :param bucket_window: Group the samples of similar lengths into a
+                          mini-batch. If it is larger than 1, PaddlePaddle
+                          takes bucket_window mini-batches of samples from the
+                          data pool, sorts them by the length of their longest
+                          sequence, and splits them into mini-batches, which
+                          are returned in random order when shuffling. So the
+                          randomness is bounded by the window. The padding
+                          efficiency is logged at the end of each pass. It can
+                          not be used with calc_batch_size.
+    :type bucket_window: int
+
+    :param num_workers: The number of the processes running the generator. If
+                        it is larger than 0, PaddlePaddle forks num_workers
+                        processes at the beginning of each pass, and each of
+                        them runs the generator on the files whose index
+                        modulo num_workers is its id. The samples are passed
+                        to the trainer in shared memory, and the mini-batches
+                        are assembled without the python lock. The changes
+                        made in the processes, to settings for example, are
+                        not seen by the trainer. bucket_window and
+                        CACHE_PASS_IN_MEM are ignored if it is set.
+    :type num_workers: int
+
     :param cache: Cache strategy of Data Provider. Default is CacheType.NO_CACHE
     :type cache: int
 
@@ -449,6 +478,8 @@ def provider(input_types=None,
                 self.pool_size = pool_size
                 self.can_over_batch_size = can_over_batch_size
                 self.calc_batch_size = calc_batch_size
+                self.bucket_window = bucket_window
+                self.num_workers = num_workers
                 self.file_list = file_list
                 self.generator = generator
                 self.cache = cache
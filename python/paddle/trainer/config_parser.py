@@ -83,6 +83,7 @@ import shutil
 
 try:
     from paddle.proto.DataConfig_pb2 import DataConfig
+    from paddle.proto.DataConfig_pb2 import ImageAugmentConfig
     from paddle.proto.ModelConfig_pb2 import ModelConfig
     from paddle.proto.ModelConfig_pb2 import LayerConfig
     from paddle.proto.ModelConfig_pb2 import LayerInputConfig
@@ -962,7 +963,10 @@ def create_data_config_proto(async_load_data=False,
                              constant_slots=None,
                              data_ratio=1,
                              is_main_data=True,
-                             usage_ratio=None):
+                             usage_ratio=None,
+                             prefetch_depth=None,
+                             prefetch_thread_num=None,
+                             image_augment_config=None):
     # default: all sub dataproviders are treat as "main data".
     # see proto/DataConfig.proto for is_main_data
     data_config = DataConfig()
@@ -979,9 +983,55 @@ def create_data_config_proto(async_load_data=False,
                   "The range of usage_ratio is [0, 1]")
     data_config.usage_ratio = usage_ratio
 
+    if prefetch_depth is not None:
+        config_assert(prefetch_depth >= 1, "prefetch_depth must be positive")
+        data_config.prefetch_depth = prefetch_depth
+    if prefetch_thread_num is not None:
+        config_assert(prefetch_thread_num >= 1,
+                      "prefetch_thread_num must be positive")
+        data_config.prefetch_thread_num = prefetch_thread_num
+
+    if image_augment_config is not None:
+        data_config.image_augment_config.CopyFrom(image_augment_config)
+
     return data_config
 
 
+# The augmentation of the images of a slot done by the data provider in C++,
+# passed to a data config as image_augment_config. See ImageAugmentConfig in
+# proto/DataConfig.proto for the arguments.
+@config_func
+def ImageAugment(slot,
+                 channels,
+                 height,
+                 width,
+                 crop_size=0,
+                 mirror=False,
+                 scale=1.0,
+                 mean=None,
+                 std=None,
+                 thread_num=1):
+    config = ImageAugmentConfig()
+    config.slot = slot
+    config.channels = channels
+    config.height = height
+    config.width = width
+    config.crop_size = crop_size
+    config.mirror = mirror
+    config.scale = scale
+    for name, values in (('mean', mean), ('std', std)):
+        if values is None:
+            continue
+        if not isinstance(values, (list, tuple)):
+            values = [values]
+        config_assert(
+            len(values) in (1, channels),
+            "%s needs one value or one value for each channel" % name)
+        getattr(config, name).extend(values)
+    config.thread_num = thread_num
+    return config
+
+
 @config_func
 def SimpleData(files=None,
                feat_dim=None,
@@ -1060,6 +1110,7 @@ def ProtoData(files=None,
               load_file_count=None,
               constant_slots=None,
               load_thread_num=None,
+              buffer_capacity=None,
               **xargs):
     data_config = create_data_config_proto(**xargs)
     if type is None:
@@ -1071,23 +1122,54 @@ def ProtoData(files=None,
     # When type="proto_group", one data provider contains at most
     # load_file_count files, and there are at most
     # (queue_capacity + load_thread_num + 1) data providers in memory
+    # When type="proto_stream", load_thread_num threads read the files, and
+    # the samples are shuffled in a buffer of buffer_capacity samples
+    # When type="recordio", the files are RecordIO files, each line of files
+    # may give the range of the chunks to load, and load_thread_num threads
+    # decompress the chunks
     if file_group_queue_capacity is not None:
         data_config.file_group_conf.queue_capacity = file_group_queue_capacity
     if load_file_count is not None:
         data_config.file_group_conf.load_file_count = load_file_count
     if load_thread_num is not None:
         data_config.file_group_conf.load_thread_num = load_thread_num
+    if buffer_capacity:
+        data_config.buffer_capacity = buffer_capacity
     if constant_slots:
         data_config.constant_slots.extend(constant_slots)
     return data_config
 
 
+# CTR data of text lines "label slot:feasign[:value] ...". slots is a list of
+# (name, dim) or (name, dim, with_value), each of which gives a sparse input
+# of dim, followed by the label. load_thread_num threads parse the lines.
+@config_func
+def CtrData(files=None, slots=None, load_thread_num=None, **xargs):
+    data_config = create_data_config_proto(**xargs)
+    data_config.type = 'ctr'
+    data_config.files = files
+    config_assert(slots, "CtrData needs slots")
+    for slot in slots:
+        config_assert(
+            len(slot) in (2, 3), "A slot should be (name, dim[, with_value])")
+        slot_config = data_config.ctr_slots.add()
+        slot_config.name = slot[0]
+        slot_config.dim = slot[1]
+        if len(slot) == 3:
+            slot_config.with_value = slot[2]
+    if load_thread_num is not None:
+        data_config.file_group_conf.load_thread_num = load_thread_num
+    return data_config
+
+
 #real data for training is actually provided by "sub_data" data providers.
 @config_func
-def MultiData(sub_data=[]):
+def MultiData(sub_data=[], interleave_sub_data=False):
     data_config = DataConfig()
     data_config.type = 'multi'
     data_config.sub_data_configs.extend(sub_data)
+    # each batch is from one sub data sampled by the weights of data_ratio
+    data_config.interleave_sub_data = interleave_sub_data
     return data_config
 
 
@@ -1966,6 +2048,62 @@ class ConvTransLayer(ConvTransLayerBase):
     layer_type = 'cudnn_convt'
 
 
+@config_layer('depthwise_separable_conv')
+class DepthwiseSeparableConvLayer(LayerBase):
+    """
+    The first input is the image with the depthwise convolution, the second
+    input is the same image and only carries the pointwise filter.
+    """
+
+    def __init__(self,
+                 name,
+                 inputs=[],
+                 num_filters=None,
+                 depth_multiplier=1,
+                 **xargs):
+        super(DepthwiseSeparableConvLayer, self).__init__(
+            name, 'depthwise_separable_conv', 0, inputs=inputs, **xargs)
+        config_assert(
+            len(self.inputs) == 2,
+            'depthwise_separable_conv layer must have two inputs')
+        config_assert(
+            self.inputs[0].input_layer_name == self.inputs[1].input_layer_name,
+            'the two inputs of depthwise_separable_conv must be the same layer')
+        conv = self.inputs[0].conv
+        config_assert(conv.groups == conv.channels,
+                      'the groups of depthwise convolution must be channels')
+        self.config.num_filters = num_filters
+        middle_channels = conv.channels * depth_multiplier
+
+        depthwise_conf = self.config.inputs[0].conv_conf
+        parse_conv(conv,
+                   self.get_input_layer(0).name, depthwise_conf,
+                   middle_channels)
+        self.create_input_parameter(
+            0, middle_channels * depthwise_conf.filter_size *
+            depthwise_conf.filter_size_y)
+
+        pointwise_conf = self.config.inputs[1].conv_conf
+        pointwise_conf.filter_size = 1
+        pointwise_conf.filter_size_y = 1
+        pointwise_conf.channels = middle_channels
+        pointwise_conf.padding = 0
+        pointwise_conf.padding_y = 0
+        pointwise_conf.stride = 1
+        pointwise_conf.stride_y = 1
+        pointwise_conf.groups = 1
+        pointwise_conf.caffe_mode = depthwise_conf.caffe_mode
+        pointwise_conf.filter_channels = middle_channels
+        pointwise_conf.img_size = depthwise_conf.output_x
+        pointwise_conf.img_size_y = depthwise_conf.output_y
+        pointwise_conf.output_x = depthwise_conf.output_x
+        pointwise_conf.output_y = depthwise_conf.output_y
+        self.create_input_parameter(1, num_filters * middle_channels)
+
+        self.set_cnn_layer(name, depthwise_conf.output_y,
+                           depthwise_conf.output_x, num_filters)
+
+
 @config_layer('norm')
 class NormLayer(LayerBase):
     def __init__(self, name, inputs, **xargs):
@@ -2571,6 +2709,38 @@ class MaxIdLayer(LayerBase):
             self.config.beam_size = beam_size
 
 
+@config_layer('fc_maxid')
+class FcMaxIdLayer(LayerBase):
+    def __init__(self,
+                 name,
+                 size,
+                 inputs,
+                 bias=True,
+                 beam_size=None,
+                 device=None):
+        super(FcMaxIdLayer, self).__init__(
+            name, 'fc_maxid', size, inputs=inputs, device=device)
+        config_assert(
+            len(self.inputs) in [1, 2],
+            'FcMaxIdLayer must have 1 input and an optional candidates input')
+        input_layer = self.get_input_layer(0)
+        dims = [input_layer.size, self.config.size]
+        self.create_input_parameter(0, input_layer.size * self.config.size,
+                                    dims)
+        if len(self.inputs) == 2:
+            config_assert(self.get_input_layer(1).size == self.config.size,
+                          'the size of the candidates input must be %d' %
+                          self.config.size)
+        self.create_bias_parameter(bias, self.config.size)
+
+        if beam_size is None:
+            global g_current_submodel
+            if g_current_submodel.HasField("generator"):
+                self.config.beam_size = g_current_submodel.generator.beam_size
+        else:
+            self.config.beam_size = beam_size
+
+
 @config_layer('eos_id')
 class EosIdLayer(LayerBase):
     def __init__(self, name, inputs, eos_id, device=None):
@@ -82,6 +82,7 @@ __all__ = [
     'context_projection',
     'beam_search',
     'maxid_layer',
+    'fc_maxid_layer',
     'GeneratedInput',
     'SubsequenceInput',
     'gru_step_layer',
@@ -187,6 +188,7 @@ class LayerType(object):
 
     MEMORY = 'memory'
     MAXID_LAYER = 'maxid'
+    FC_MAXID_LAYER = 'fc_maxid'
     EOSID_LAYER = 'eos_id'
     RECURRENT_LAYER = 'recurrent'
 
@@ -3754,24 +3756,31 @@ class GeneratedInput(BaseGeneratedInput):
                      "PLEASE garantee the first output is probability of "
                      "the predicted next word."))
 
+        if input[0].layer_type == LayerType.FC_MAXID_LAYER:
+            # fc_maxid_layer already outputs the predicted ids and their
+            # probabilities, as maxid_layer does.
+            self.predict_id.set_input(input[0])
+            return input
+
         return [maxid_layer(
             input=input[0], name='__beam_search_predict__')] + (
                 input[1:] if len(input) > 1 else [])
 
     def before_real_step(self):
-        predict_id = memory(
+        self.predict_id = memory(
             name='__beam_search_predict__',
             size=self.size,
             boot_with_const_id=self.bos_id)
 
         trg_emb = embedding_layer(
-            input=predict_id,
+            input=self.predict_id,
             size=self.embedding_size,
             param_attr=ParamAttr(name=self.embedding_name))
         return trg_emb
 
     def __init__(self, size, embedding_name, embedding_size):
         super(GeneratedInput, self).__init__()
+        self.predict_id = None
         self.size = size
         self.embedding_name = embedding_name
         self.embedding_size = embedding_size
@@ -3812,6 +3821,75 @@ def maxid_layer(input, name=None, layer_attr=None):
         size=l.config.size)
 
 
+@wrap_name_default()
+@wrap_param_attr_default()
+@wrap_bias_attr_default()
+def fc_maxid_layer(input,
+                   size,
+                   select=None,
+                   name=None,
+                   param_attr=None,
+                   bias_attr=None,
+                   layer_attr=None):
+    """
+    A layer computing fc_layer with softmax activation and maxid_layer in one
+    pass, for generating with a large vocabulary. Like maxid_layer, the ids of
+    the beam_size largest probabilities of each sample are stored in
+    output.ids, but the full softmax output is never stored. Its parameters
+    are the same as the ones of fc_layer, so a model trained with fc_layer
+    and softmax can generate with this layer. It only runs on CPU, and can
+    not be trained.
+
+    The example usage is:
+
+    .. code-block:: python
+
+       maxid = fc_maxid_layer(input=decoder, size=target_dict_dim,
+                              param_attr=ParamAttr(name='_output.w'),
+                              bias_attr=ParamAttr(name='_output.wbias'))
+
+    :param input: Input layer.
+    :type input: LayerOutput
+    :param size: The vocabulary size.
+    :type size: int
+    :param select: The candidate ids of each sample, a sparse binary layer of
+                   the vocabulary size. If given, the softmax is only over the
+                   candidates of a sample.
+    :type select: LayerOutput|None
+    :param name: Layer name.
+    :type name: basestring
+    :param param_attr: The Parameter Attribute.
+    :type param_attr: ParameterAttribute
+    :param bias_attr: The Bias Attribute. If no bias, then pass False or
+                      something not type of ParameterAttribute. None will get a
+                      default Bias.
+    :type bias_attr: ParameterAttribute|None|Any
+    :param layer_attr: extra layer attributes.
+    :type layer_attr: ExtraLayerAttribute.
+    :return: LayerOutput object.
+    :rtype: LayerOutput
+    """
+    assert isinstance(input, LayerOutput)
+    inputs = [Input(input.name, **param_attr.attr)]
+    parents = [input]
+    if select is not None:
+        assert isinstance(select, LayerOutput)
+        inputs.append(select.name)
+        parents.append(select)
+    l = Layer(
+        name=name,
+        type=LayerType.FC_MAXID_LAYER,
+        size=size,
+        inputs=inputs,
+        bias=ParamAttr.to_bias(bias_attr),
+        **ExtraLayerAttribute.to_kwargs(layer_attr))
+    return LayerOutput(
+        name=name,
+        layer_type=LayerType.FC_MAXID_LAYER,
+        parents=parents,
+        size=l.config.size)
+
+
 @wrap_name_default()
 def out_prod_layer(input1, input2, name=None, layer_attr=None):
     """
@@ -3939,7 +4017,9 @@ def beam_search(step,
                  sharing a same set of weights.
 
                  You can refer to the first parameter of recurrent_group, or
-                 demo/seqToseq/seqToseq_net.py for more details.
+                 demo/seqToseq/seqToseq_net.py for more details. Its first
+                 output is the probability of the next word, or the output of
+                 a fc_maxid_layer.
     :type step: callable
     :param input: Input data for the recurrent unit, which should include the
                   previously generated words as a GeneratedInput object.
@@ -0,0 +1,34 @@
+from paddle.trainer_config_helpers import *
+
+settings(batch_size=10, learning_rate=0)
+
+dict_dim = 100
+word_dim = 32
+hidden_dim = 64
+
+encoded = data_layer(name='encoded', size=hidden_dim)
+
+
+def step(encoded, word):
+    decoder = fc_layer(
+        input=[encoded, word], size=hidden_dim, act=TanhActivation())
+    return fc_maxid_layer(
+        input=decoder,
+        size=dict_dim,
+        param_attr=ParamAttr(name='_output.w'),
+        bias_attr=ParamAttr(name='_output.wbias'))
+
+
+gen = beam_search(
+    name='decoder',
+    step=step,
+    input=[
+        StaticInput(input=encoded), GeneratedInput(
+            size=dict_dim, embedding_name='_word_emb', embedding_size=word_dim)
+    ],
+    bos_id=0,
+    eos_id=1,
+    beam_size=5,
+    max_length=10)
+
+outputs(gen)